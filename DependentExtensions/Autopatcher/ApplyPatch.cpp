@@ -30,6 +30,8 @@ __FBSDID("$FreeBSD: src/usr.bin/bsdiff/bspatch/bspatch.c,v 1.1 2005/08/06 01:59:
 #endif
 
 #include "MemoryCompressor.h"
+#include "ApplyPatch.h"
+#include "SuperFastHash.h"
 
 #include <bzlib.h>
 #include <stdlib.h>
@@ -39,8 +41,11 @@ __FBSDID("$FreeBSD: src/usr.bin/bsdiff/bspatch/bspatch.c,v 1.1 2005/08/06 01:59:
 // KevinJ - Windows compatibility
 #include <err.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #else
 typedef int ssize_t;
+#include "WindowsIncludes.h"
 #include <wchar.h>
 #include <io.h>
 #define fseeko fseek
@@ -267,6 +272,328 @@ bool ApplyPatch(char *old, unsigned int oldsize, char **_new, unsigned int *news
 }
 
 
+// Patched output is hashed and written in multiples of this, the block size SuperFastHash() uses, so the hash matches SuperFastHash() of the whole file
+static const int HASH_BLOCK_SIZE=65536;
+static const int NEW_FILE_BUFFER_SIZE=HASH_BLOCK_SIZE*16;
+// Used only if the old file cannot be mapped, such as a file larger than the address space
+static const int OLD_FILE_WINDOW_SIZE=HASH_BLOCK_SIZE*16;
+
+// One of the three bzip2 blocks of a patch, decompressed as it is read
+struct PatchBlockReader
+{
+	bz_stream stream;
+	bool inited;
+};
+
+static bool PatchBlockOpen(PatchBlockReader *reader, char *data, unsigned int length)
+{
+	memset(&reader->stream, 0, sizeof(bz_stream));
+	reader->inited = BZ2_bzDecompressInit(&reader->stream, 0, 0)==BZ_OK;
+	reader->stream.next_in=data;
+	reader->stream.avail_in=length;
+	return reader->inited;
+}
+
+static bool PatchBlockRead(PatchBlockReader *reader, char *dest, unsigned int length)
+{
+	reader->stream.next_out=dest;
+	reader->stream.avail_out=length;
+	while (reader->stream.avail_out>0)
+	{
+		unsigned int availOut=reader->stream.avail_out;
+		int ret = BZ2_bzDecompress(&reader->stream);
+		if (ret==BZ_STREAM_END)
+			return reader->stream.avail_out==0;
+		if (ret!=BZ_OK)
+			return false;
+		// Out of input before the end of the stream
+		if (reader->stream.avail_in==0 && reader->stream.avail_out==availOut)
+			return false;
+	}
+	return true;
+}
+
+static void PatchBlockClose(PatchBlockReader *reader)
+{
+	if (reader->inited)
+		BZ2_bzDecompressEnd(&reader->stream);
+	reader->inited=false;
+}
+
+// The file being patched. Memory mapped where possible, otherwise read through a window
+struct OldFileView
+{
+	const unsigned char *data;
+	off_t size;
+	FILE *fp;
+	unsigned char *window;
+	off_t windowStart, windowLength;
+#if defined(_WIN32)
+	HANDLE file, mapping;
+#endif
+};
+
+static bool OldFileOpen(OldFileView *view, const char *path)
+{
+	memset(view, 0, sizeof(OldFileView));
+#if defined(_WIN32)
+	view->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (view->file==INVALID_HANDLE_VALUE)
+	{
+		view->file=0;
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(view->file, &fileSize)==0)
+		return false;
+	view->size=(off_t) fileSize.QuadPart;
+	if (view->size>0)
+	{
+		view->mapping = CreateFileMappingA(view->file, 0, PAGE_READONLY, 0, 0, 0);
+		if (view->mapping)
+			view->data = (const unsigned char*) MapViewOfFile(view->mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd<0)
+		return false;
+	struct stat fileStat;
+	if (fstat(fd, &fileStat)!=0)
+	{
+		close(fd);
+		return false;
+	}
+	view->size=fileStat.st_size;
+	if (view->size>0)
+	{
+		void *mapped = mmap(0, (size_t) view->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped!=MAP_FAILED)
+		{
+			view->data=(const unsigned char*) mapped;
+			madvise(mapped, (size_t) view->size, MADV_SEQUENTIAL);
+		}
+	}
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+#endif
+	if (view->data==0 && view->size>0)
+	{
+		view->fp=fopen(path, "rb");
+		view->window=(unsigned char*) malloc(OLD_FILE_WINDOW_SIZE);
+		if (view->fp==0 || view->window==0)
+			return false;
+	}
+	return true;
+}
+
+static void OldFileClose(OldFileView *view)
+{
+#if defined(_WIN32)
+	if (view->data)
+		UnmapViewOfFile(view->data);
+	if (view->mapping)
+		CloseHandle(view->mapping);
+	if (view->file)
+		CloseHandle(view->file);
+#else
+	if (view->data)
+		munmap((void*) view->data, (size_t) view->size);
+#endif
+	if (view->fp)
+		fclose(view->fp);
+	free(view->window);
+	memset(view, 0, sizeof(OldFileView));
+}
+
+// dest[i]+=old[oldpos+i], for the part of the range that lies inside the old file
+static bool OldFileAdd(OldFileView *view, unsigned char *dest, off_t oldpos, off_t length)
+{
+	if (oldpos<0)
+	{
+		dest-=oldpos;
+		length+=oldpos;
+		oldpos=0;
+	}
+	if (oldpos+length>view->size)
+		length=view->size-oldpos;
+	if (length<=0)
+		return true;
+
+	off_t i;
+	if (view->data)
+	{
+		const unsigned char *old=view->data+oldpos;
+		for (i=0; i<length; i++)
+			dest[i]+=old[i];
+		return true;
+	}
+
+	while (length>0)
+	{
+		if (oldpos<view->windowStart || oldpos>=view->windowStart+view->windowLength)
+		{
+			view->windowStart=oldpos;
+			view->windowLength=view->size-oldpos;
+			if (view->windowLength>OLD_FILE_WINDOW_SIZE)
+				view->windowLength=OLD_FILE_WINDOW_SIZE;
+			if (fseeko(view->fp, oldpos, SEEK_SET)!=0 ||
+				fread(view->window, 1, (size_t) view->windowLength, view->fp)!=(size_t) view->windowLength)
+			{
+				view->windowLength=0;
+				return false;
+			}
+		}
+		const unsigned char *old=view->window+(oldpos-view->windowStart);
+		off_t count=view->windowStart+view->windowLength-oldpos;
+		if (count>length)
+			count=length;
+		for (i=0; i<count; i++)
+			dest[i]+=old[i];
+		dest+=count;
+		oldpos+=count;
+		length-=count;
+	}
+	return true;
+}
+
+static bool WriteNewFileBuffer(FILE *fp, char *buffer, int length, unsigned int *hash)
+{
+	for (int offset=0; offset<length; offset+=HASH_BLOCK_SIZE)
+		*hash=SuperFastHashIncremental(buffer+offset, length-offset < HASH_BLOCK_SIZE ? length-offset : HASH_BLOCK_SIZE, *hash);
+	return length==0 || fwrite(buffer, length, 1, fp)==1;
+}
+
+static bool ApplyPatchBlocks(OldFileView *old, PatchBlockReader *ctrlReader, PatchBlockReader *diffReader, PatchBlockReader *extraReader, off_t newsize, FILE *newFile, char *buffer, unsigned int *newFileHash)
+{
+	unsigned char buf[8];
+	off_t oldpos,newpos;
+	off_t ctrl[3];
+	off_t count;
+	int bufferUsed=0;
+	int i;
+
+	*newFileHash=(unsigned int) newsize;
+	oldpos=0;newpos=0;
+	while(newpos<newsize) {
+		/* Read control data */
+		for(i=0;i<=2;i++) {
+			if (PatchBlockRead(ctrlReader, (char*) buf, 8)==false)
+				return false;
+			ctrl[i]=offtin(buf);
+		};
+
+		/* Sanity-check */
+		if(ctrl[0]<0 || ctrl[1]<0 || newpos+ctrl[0]>newsize)
+			return false;
+
+		/* Read diff string and add old data to it, a buffer at a time */
+		while (ctrl[0]>0)
+		{
+			count=NEW_FILE_BUFFER_SIZE-bufferUsed;
+			if (count>ctrl[0])
+				count=ctrl[0];
+			if (PatchBlockRead(diffReader, buffer+bufferUsed, (unsigned int) count)==false ||
+				OldFileAdd(old, (unsigned char*) buffer+bufferUsed, oldpos, count)==false)
+				return false;
+			bufferUsed+=(int) count;
+			newpos+=count;
+			oldpos+=count;
+			ctrl[0]-=count;
+			if (bufferUsed==NEW_FILE_BUFFER_SIZE)
+			{
+				if (WriteNewFileBuffer(newFile, buffer, bufferUsed, newFileHash)==false)
+					return false;
+				bufferUsed=0;
+			}
+		}
+
+		/* Sanity-check */
+		if(newpos+ctrl[1]>newsize)
+			return false;
+
+		/* Read extra string */
+		while (ctrl[1]>0)
+		{
+			count=NEW_FILE_BUFFER_SIZE-bufferUsed;
+			if (count>ctrl[1])
+				count=ctrl[1];
+			if (PatchBlockRead(extraReader, buffer+bufferUsed, (unsigned int) count)==false)
+				return false;
+			bufferUsed+=(int) count;
+			newpos+=count;
+			ctrl[1]-=count;
+			if (bufferUsed==NEW_FILE_BUFFER_SIZE)
+			{
+				if (WriteNewFileBuffer(newFile, buffer, bufferUsed, newFileHash)==false)
+					return false;
+				bufferUsed=0;
+			}
+		}
+
+		/* Adjust pointers */
+		oldpos+=ctrl[2];
+	};
+
+	return WriteNewFileBuffer(newFile, buffer, bufferUsed, newFileHash);
+}
+
+bool ApplyPatchToFile(const char *oldFilePath, const char *newFilePath, char *patch, unsigned int patchsize, unsigned int *newFileHash)
+{
+	ssize_t bzctrllen,bzdatalen;
+	off_t newsize;
+	unsigned int hash;
+
+	/* Check for appropriate magic */
+	if (patchsize < 32 || memcmp(patch, "BSDIFF40", 8) != 0)
+		return false;
+
+	/* Read lengths from header */
+	bzctrllen=offtin((unsigned char*)patch+8);
+	bzdatalen=offtin((unsigned char*)patch+16);
+	newsize=offtin((unsigned char*)patch+24);
+	if((bzctrllen<0) || (bzdatalen<0) || (newsize<0) || (off_t) 32+bzctrllen+bzdatalen>(off_t) patchsize)
+		return false;
+
+	OldFileView old;
+	if (OldFileOpen(&old, oldFilePath)==false)
+	{
+		OldFileClose(&old);
+		return false;
+	}
+
+	PatchBlockReader ctrlReader, diffReader, extraReader;
+	// Not short circuited, so each reader is initialized before PatchBlockClose()
+	bool succeeded =
+		PatchBlockOpen(&ctrlReader, patch+32, (unsigned int) bzctrllen) &
+		PatchBlockOpen(&diffReader, patch+32+bzctrllen, (unsigned int) bzdatalen) &
+		PatchBlockOpen(&extraReader, patch+32+bzctrllen+bzdatalen, patchsize-(unsigned int)(32+bzctrllen+bzdatalen));
+
+	FILE *newFile=0;
+	char *buffer=0;
+	if (succeeded)
+	{
+		newFile=fopen(newFilePath, "wb");
+		buffer=(char*) malloc(NEW_FILE_BUFFER_SIZE);
+		succeeded = newFile!=0 && buffer!=0 &&
+			ApplyPatchBlocks(&old, &ctrlReader, &diffReader, &extraReader, newsize, newFile, buffer, &hash);
+	}
+
+	free(buffer);
+	if (newFile && fclose(newFile)!=0)
+		succeeded=false;
+	if (newFile && succeeded==false)
+		remove(newFilePath);
+	PatchBlockClose(&ctrlReader);
+	PatchBlockClose(&diffReader);
+	PatchBlockClose(&extraReader);
+	OldFileClose(&old);
+
+	if (succeeded && newFileHash)
+		*newFileHash=hash;
+	return succeeded;
+}
+
+
 int TestPatchInMemory(int argc,char *argv[])
 {
 	FILE *patchFile, *newFile, *oldFile;
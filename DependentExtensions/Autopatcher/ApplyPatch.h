@@ -1,3 +1,8 @@
 /// Apply \a patch to \a old.  Will return the new file in \a _new which is allocated for you.
 bool ApplyPatch( char *old, unsigned int oldsize, char **_new, unsigned int *newsize, char *patch, unsigned int patchsize );
 
+/// Apply \a patch to the file at \a oldFilePath, writing the result to \a newFilePath.
+/// Unlike ApplyPatch(), neither file is loaded into memory. The old file is memory mapped, the patch is decompressed as it is read, and the new file is written through a fixed size buffer, so memory use does not depend on the size of the files.
+/// \a newFilePath must not be \a oldFilePath. It is deleted if the patch cannot be applied.
+/// \param[out] newFileHash If not 0, set to SuperFastHash() of the new file
+bool ApplyPatchToFile(const char *oldFilePath, const char *newFilePath, char *patch, unsigned int patchsize, unsigned int *newFileHash);
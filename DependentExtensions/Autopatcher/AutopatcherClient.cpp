@@ -36,6 +36,8 @@ using namespace RakNet;
 static const unsigned HASH_LENGTH=4;
 
 #define COPY_ON_RESTART_EXTENSION ".patched.tmp"
+// Patched files are written here first when patching on disk, then renamed over the original
+#define PATCHING_EXTENSION ".patching.tmp"
 
 // -----------------------------------------------------------------
 
@@ -67,6 +69,40 @@ PatchContext AutopatcherClientCBInterface::ApplyPatchBSDiff(const char *oldFileP
 	return PC_WRITE_FILE;
 }
 
+PatchContext AutopatcherClientCBInterface::ApplyPatchBaseToFile(const char *oldFilePath, const char *newFilePath, char *patchContents, unsigned int patchSize, uint32_t patchAlgorithm, unsigned int *newFileHash)
+{
+	if (patchAlgorithm==0)
+		return ApplyPatchBSDiffToFile(oldFilePath, newFilePath, patchContents, patchSize, newFileHash);
+
+	// Another algorithm, which ApplyPatchBase() may have been overridden to handle. Patch in memory and write the result
+	char *newFileContents=0;
+	unsigned int newFileSize=0;
+	PatchContext result = ApplyPatchBase(oldFilePath, &newFileContents, &newFileSize, patchContents, patchSize, patchAlgorithm);
+	if (result==PC_WRITE_FILE)
+	{
+		*newFileHash=SuperFastHash(newFileContents, newFileSize);
+		if (WriteFileWithDirectories(newFilePath, newFileContents, newFileSize)==false)
+			result=PC_ERROR_FILE_WRITE_FAILURE;
+	}
+	if (newFileContents)
+		rakFree_Ex(newFileContents, _FILE_AND_LINE_ );
+	return result;
+}
+
+PatchContext AutopatcherClientCBInterface::ApplyPatchBSDiffToFile(const char *oldFilePath, const char *newFilePath, char *patchContents, unsigned int patchSize, unsigned int *newFileHash)
+{
+	FILE *fp;
+	fp=fopen(oldFilePath, "rb");
+	if (fp==0)
+		return PC_ERROR_PATCH_TARGET_MISSING;
+	fclose(fp);
+
+	if (ApplyPatchToFile(oldFilePath, newFilePath, patchContents, patchSize, newFileHash)==false)
+		return PC_ERROR_PATCH_APPLICATION_FAILURE;
+
+	return PC_WRITE_FILE;
+}
+
 // -----------------------------------------------------------------
 
 struct AutopatcherClientThreadInfo
@@ -80,9 +116,49 @@ struct AutopatcherClientThreadInfo
 	// postPatchFile is passed in PC_NOTICE_WILL_COPY_ON_RESTART
 	char *postPatchFile;
 	unsigned postPatchLength;
+	unsigned int streamingPatchThreshold;
 	AutopatcherClientCBInterface *cbInterface;
 };
 // -----------------------------------------------------------------
+// Patch without holding either version of the file in memory. The patched file is written next to the original, checked, then renamed over it
+static PatchContext ApplyPatchOnDisk(AutopatcherClientThreadInfo* input, const char *fullPathToDir, char *patchContents, unsigned int patchSize, int hashMultiplier)
+{
+	char patchedPath[1024];
+	strcpy(patchedPath, fullPathToDir);
+	strcat(patchedPath, PATCHING_EXTENSION);
+
+	unsigned int hash;
+	PatchContext result = input->cbInterface->ApplyPatchBaseToFile(fullPathToDir, patchedPath, patchContents, patchSize, input->onFileStruct.context.flnc_extraData2, &hash);
+	if (result!=PC_WRITE_FILE)
+	{
+		remove(patchedPath);
+		return result;
+	}
+
+	if (RakNet::BitStream::DoEndianSwap())
+		RakNet::BitStream::ReverseBytesInPlace((unsigned char*) &hash, sizeof(hash));
+	if (memcmp(&hash, input->onFileStruct.fileData+HASH_LENGTH*(hashMultiplier-1), HASH_LENGTH)!=0)
+	{
+		remove(patchedPath);
+		return PC_ERROR_PATCH_RESULT_CHECKSUM_FAILURE;
+	}
+
+	// rename() does not replace an existing file on Windows
+	if (rename(patchedPath, fullPathToDir)==0 ||
+		(remove(fullPathToDir)==0 && rename(patchedPath, fullPathToDir)==0))
+		return (PatchContext) input->onFileStruct.context.op;
+
+	// Original is in use
+	char newDir[1024];
+	strcpy(newDir, fullPathToDir);
+	strcat(newDir, COPY_ON_RESTART_EXTENSION);
+	remove(newDir);
+	if (rename(patchedPath, newDir)==0)
+		return PC_NOTICE_WILL_COPY_ON_RESTART;
+	remove(patchedPath);
+	return PC_ERROR_FILE_WRITE_FAILURE;
+}
+// -----------------------------------------------------------------
 AutopatcherClientThreadInfo* AutopatcherClientWorkerThread(AutopatcherClientThreadInfo* input, bool *returnOutput, void* perThreadData)
 {
 	char fullPathToDir[1024];
@@ -128,6 +204,12 @@ AutopatcherClientThreadInfo* AutopatcherClientWorkerThread(AutopatcherClientThre
 		else
 			hashMultiplier=2; // else op==PC_HASH_2_WITH_PATCH
 
+		if (GetFileLength64(fullPathToDir) >= input->streamingPatchThreshold)
+		{
+			input->result=ApplyPatchOnDisk(input, fullPathToDir, (char*)input->onFileStruct.fileData+HASH_LENGTH*hashMultiplier, input->onFileStruct.byteLengthOfThisFile-HASH_LENGTH*hashMultiplier, hashMultiplier);
+			return input;
+		}
+
 		PatchContext result = input->cbInterface->ApplyPatchBase(fullPathToDir, &input->postPatchFile, &input->postPatchLength, (char*)input->onFileStruct.fileData+HASH_LENGTH*hashMultiplier, input->onFileStruct.byteLengthOfThisFile-HASH_LENGTH*hashMultiplier, input->onFileStruct.context.flnc_extraData2);
 		if (result == PC_ERROR_PATCH_APPLICATION_FAILURE || input->result==PC_ERROR_PATCH_TARGET_MISSING)
 		{
@@ -181,12 +263,14 @@ public:
 	char applicationDirectory[512];
 	AutopatcherClientCBInterface *onFileCallback;
 	AutopatcherClient *client;
+	unsigned int streamingPatchThreshold;
 	bool downloadComplete;
 	bool canDeleteUser;
 
 	AutopatcherClientCallback(void)
 	{
 		threadPool.StartThreads(1,0);
+		streamingPatchThreshold=(unsigned int) -1;
 		canDeleteUser=false;
 		downloadComplete=false;
 	}
@@ -354,6 +438,7 @@ public:
 		inStruct->cbInterface=onFileCallback;
 		memcpy(&(inStruct->onFileStruct), onFileStruct, sizeof(OnFileStruct));
 		strcpy(inStruct->applicationDirectory,applicationDirectory);
+		inStruct->streamingPatchThreshold=streamingPatchThreshold;
 		if (onFileStruct->context.op==PC_HASH_1_WITH_PATCH || onFileStruct->context.op==PC_HASH_2_WITH_PATCH)
 			onFileStruct->context.op=PC_NOTICE_FILE_DOWNLOADED_PATCH;
 		else
@@ -387,6 +472,7 @@ AutopatcherClient::AutopatcherClient()
 	orderingChannel=0;
 	serverDate=0;
 	userCB=0;
+	streamingPatchThreshold=16*1024*1024;
 	processThreadCompletion=false;
 }
 AutopatcherClient::~AutopatcherClient()
@@ -411,6 +497,10 @@ void AutopatcherClient::SetFileListTransferPlugin(FileListTransfer *flt)
 {
 	fileListTransfer=flt;
 }
+void AutopatcherClient::SetStreamingPatchThreshold(unsigned int bytes)
+{
+	streamingPatchThreshold=bytes;
+}
 double AutopatcherClient::GetServerDate(void) const
 {
 	return serverDate;
@@ -481,6 +571,7 @@ void AutopatcherClient::Update(void)
 			AutopatcherClientCallback *transferCallback;
 			transferCallback = RakNet::OP_NEW<AutopatcherClientCallback>( _FILE_AND_LINE_ );
 			strcpy(transferCallback->applicationDirectory, applicationDirectory);
+			transferCallback->streamingPatchThreshold=streamingPatchThreshold;
 			transferCallback->onFileCallback=userCB;
 			transferCallback->client=this;
 			setId = fileListTransfer->SetupReceive(transferCallback, true, serverId);
@@ -613,6 +704,7 @@ PluginReceiveResult AutopatcherClient::OnCreationList(Packet *packet)
 	AutopatcherClientCallback *transferCallback;
 	transferCallback = RakNet::OP_NEW<AutopatcherClientCallback>( _FILE_AND_LINE_ );
 	strcpy(transferCallback->applicationDirectory, applicationDirectory);
+	transferCallback->streamingPatchThreshold=streamingPatchThreshold;
 	transferCallback->onFileCallback=userCB;
 	transferCallback->client=this;
 	setId = fileListTransfer->SetupReceive(transferCallback, true, packet->systemAddress);
@@ -36,6 +36,12 @@ class RAK_DLL_EXPORT AutopatcherClientCBInterface : public FileListTransferCBInt
 public:
 	virtual PatchContext ApplyPatchBSDiff(const char *oldFilePath, char **newFileContents, unsigned int *newFileSize, char *patchContents, unsigned int patchSize);
 	virtual PatchContext ApplyPatchBase(const char *oldFilePath, char **newFileContents, unsigned int *newFileSize, char *patchContents, unsigned int patchSize, uint32_t patchAlgorithm);
+
+	/// Same as ApplyPatchBSDiff(), but writes the new file to \a newFilePath with ApplyPatchToFile() rather than returning its contents
+	/// \param[out] newFileHash SuperFastHash() of the new file
+	virtual PatchContext ApplyPatchBSDiffToFile(const char *oldFilePath, const char *newFilePath, char *patchContents, unsigned int patchSize, unsigned int *newFileHash);
+	/// Used instead of ApplyPatchBase() for files at least AutopatcherClient::SetStreamingPatchThreshold() bytes long. By default, patches with a \a patchAlgorithm other than 0 are applied in memory with ApplyPatchBase() and the result written to \a newFilePath
+	virtual PatchContext ApplyPatchBaseToFile(const char *oldFilePath, const char *newFilePath, char *patchContents, unsigned int patchSize, uint32_t patchAlgorithm, unsigned int *newFileHash);
 };
 
 /// \ingroup Autopatcher
@@ -62,6 +68,11 @@ public:
 	/// \param[in] flt A pointer to a registered instance of FileListTransfer
 	void SetFileListTransferPlugin(FileListTransfer *flt);
 
+	/// Existing files at least this large are patched from disk to disk, without loading the old or new version into memory. See ApplyPatchToFile()
+	/// \note For these files, AutopatcherClientCBInterface::OnFile() is called with fileData set to 0
+	/// \param[in] bytes Size of the existing file. Defaults to 16 megabytes. Pass 0xFFFFFFFF to patch in memory all files that can be, which are those under 4 gigabytes
+	void SetStreamingPatchThreshold(unsigned int bytes);
+
 	/// Patches a certain directory associated with a named application to match the same named application on the patch server
 	/// \param[in] _applicationName The name of the application
 	/// \param[in] _applicationDirectory The directory to write the output to.
@@ -113,6 +124,7 @@ protected:
 	SystemIndex serverIdIndex;
 	char orderingChannel;
 	unsigned short setId;
+	unsigned int streamingPatchThreshold;
 	AutopatcherClientCBInterface *userCB;
 	bool patchComplete;
 	FileList redownloadList, copyAndRestartList;
@@ -52,9 +52,22 @@ struct FileInfo
 #define PQEXECPARAM_FORMAT_TEXT		0
 #define PQEXECPARAM_FORMAT_BINARY	1
 
+// Frees the old versions and patches UpdateApplicationFiles() holds for one file
+static void FreePatchJobs(DataStructures::List<MYSQL_RES*> &contentResults, DataStructures::List<CreatePatchJob> &patchJobs)
+{
+	unsigned int i;
+	for (i=0; i < patchJobs.Size(); i++)
+		delete [] patchJobs[i].out;
+	for (i=0; i < contentResults.Size(); i++)
+		mysql_free_result(contentResults[i]);
+	patchJobs.Clear(false, _FILE_AND_LINE_);
+	contentResults.Clear(false, _FILE_AND_LINE_);
+}
+
 AutopatcherMySQLRepository::AutopatcherMySQLRepository()
 {
 	filePartConnection=0;
+	patchThreads=4;
 }
 
 AutopatcherMySQLRepository::~AutopatcherMySQLRepository()
@@ -609,9 +622,11 @@ bool AutopatcherMySQLRepository::UpdateApplicationFiles(const char *applicationN
 		}
 		//sqlCommandMutex.Unlock();
 		
-		// Create new patches for every create version
+		// Fetch every create version first, so their patches are created together
 		MYSQL_ROW row;
-
+		DataStructures::List<const char*> fileIDs;
+		DataStructures::List<MYSQL_RES*> contentResults;
+		DataStructures::List<CreatePatchJob> patchJobs;
 		while ((row = mysql_fetch_row (res)) != 0)
 		{
 			const char * fileID = row [0];
@@ -625,6 +640,7 @@ bool AutopatcherMySQLRepository::UpdateApplicationFiles(const char *applicationN
 				Rollback();
 				//sqlCommandMutex.Unlock();
 				newFiles.Clear();
+				FreePatchJobs(contentResults, patchJobs);
 				mysql_free_result(res);
 				return false;
 			}
@@ -632,30 +648,44 @@ bool AutopatcherMySQLRepository::UpdateApplicationFiles(const char *applicationN
 		
 			MYSQL_ROW queryRow = mysql_fetch_row (queryResult);
 
-			const unsigned contentLength=mysql_fetch_lengths (queryResult) [0];
-			const char * content=queryRow [0];
+			CreatePatchJob patchJob;
+			patchJob.old=queryRow [0];
+			patchJob.oldsize=mysql_fetch_lengths (queryResult) [0];
+			patchJob._new=(char *) hardDriveData;
+			patchJob.newsize=hardDriveDataLength;
+			patchJob.out=0;
+			fileIDs.Push(fileID, _FILE_AND_LINE_);
+			contentResults.Push(queryResult, _FILE_AND_LINE_);
+			patchJobs.Push(patchJob, _FILE_AND_LINE_);
+		}
 
-			char *patch;
-			unsigned patchLength;	
-			if (!CreatePatch(content, contentLength, (char *) hardDriveData, hardDriveDataLength, &patch, &patchLength))
-			{
-				strcpy(lastError,"CreatePatch failed.\n");
-				Rollback();
+		if (patchJobs.Size() > 0 && CreatePatches(&patchJobs[0], patchJobs.Size(), patchThreads, &patchCache)==false)
+		{
+			strcpy(lastError,"CreatePatch failed.\n");
+			Rollback();
+
+			newFiles.Clear();
+			FreePatchJobs(contentResults, patchJobs);
+			mysql_free_result(res);
+			return false;
+		}
+
+		// Create new patches for every create version
+		for (unsigned int jobIndex=0; jobIndex < patchJobs.Size(); jobIndex++)
+		{
+			char *patch=patchJobs[jobIndex].out;
+			unsigned patchLength=patchJobs[jobIndex].outSize;
 
-				newFiles.Clear();
-				mysql_free_result(res);
-				mysql_free_result(queryResult);
-				return false;
-			}
-			
 			char buf[512];
 			stmt = mysql_stmt_init(mySqlConnection);
-			sprintf (buf, "UPDATE FileVersionHistory SET patch=? where fileID=%s;", fileID);
+			sprintf (buf, "UPDATE FileVersionHistory SET patch=? where fileID=%s;", fileIDs[jobIndex]);
 			if ((prepareResult=mysql_stmt_prepare(stmt, buf, (unsigned long) strlen(buf)))!=0)
 			{
 				strcpy (lastError, mysql_stmt_error (stmt));
 				mysql_stmt_close(stmt);
 				Rollback();
+				FreePatchJobs(contentResults, patchJobs);
+				mysql_free_result(res);
 				return false;
 			}
 			memset(bind, 0, sizeof(bind));
@@ -673,6 +703,8 @@ bool AutopatcherMySQLRepository::UpdateApplicationFiles(const char *applicationN
 				strcpy (lastError, mysql_stmt_error (stmt));
 				mysql_stmt_close(stmt);
 				Rollback();
+				FreePatchJobs(contentResults, patchJobs);
+				mysql_free_result(res);
 				return false;
 			}
 
@@ -684,18 +716,15 @@ bool AutopatcherMySQLRepository::UpdateApplicationFiles(const char *applicationN
 				Rollback();
 				//sqlCommandMutex.Unlock();
 				newFiles.Clear();
+				FreePatchJobs(contentResults, patchJobs);
 				mysql_free_result(res);
-				mysql_free_result(queryResult);
-				delete [] patch;
 				return false;
 			}
 			//sqlCommandMutex.Unlock();
 
 			mysql_stmt_close(stmt);
-			delete [] patch;
-
-			mysql_free_result(queryResult);
 		}
+		FreePatchJobs(contentResults, patchJobs);
          mysql_free_result(res);
 
 		 stmt = mysql_stmt_init(mySqlConnection);
@@ -768,6 +797,14 @@ bool AutopatcherMySQLRepository::UpdateApplicationFiles(const char *applicationN
 	return true;
 }
 
+PatchCache* AutopatcherMySQLRepository::GetPatchCache(void)
+{
+	return &patchCache;
+}
+void AutopatcherMySQLRepository::SetPatchThreads(int numThreads)
+{
+	patchThreads=numThreads;
+}
 const char *AutopatcherMySQLRepository::GetLastError(void) const
 {
 	return MySQLInterface::GetLastError();
@@ -19,6 +19,7 @@
 
 #include "AutopatcherRepositoryInterface.h"
 #include "MySQLInterface.h"
+#include "PatchCache.h"
 #include "Export.h"
 
 namespace RakNet
@@ -81,6 +82,14 @@ public:
 	// Not yet implemented
 	virtual bool GetMostRecentChangelistWithPatches(RakNet::RakString &applicationName, FileList *patchedFiles, FileList *addedFiles, FileList *addedOrModifiedFileHashes, FileList *deletedFiles, double *priorRowPatchTime, double *mostRecentRowPatchTime);
 
+	/// UpdateApplicationFiles() takes patches from and adds patches to this cache, so each pair of file versions is only diffed once
+	/// \details Call PatchCache::SetDirectory() on it to also keep patches between runs
+	PatchCache* GetPatchCache(void);
+
+	/// Sets how many threads UpdateApplicationFiles() uses to create the patches for each file. Defaults to 4. 0 or less uses one thread per core
+	/// \note Each thread uses memory of about 13 times the size of the old version it is diffing
+	void SetPatchThreads(int numThreads);
+
 	/// If any of the above functions fail, the error string is stored internally.  Call this to get it.
 	virtual const char *GetLastError(void) const;
 
@@ -98,6 +107,10 @@ public:
 
 	st_mysql *filePartConnection;
 	SimpleMutex filePartConnectionMutex;
+
+protected:
+	PatchCache patchCache;
+	int patchThreads;
 };
 
 } // namespace RakNet
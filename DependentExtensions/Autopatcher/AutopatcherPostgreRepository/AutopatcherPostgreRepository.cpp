@@ -47,9 +47,22 @@ static const unsigned HASH_LENGTH=sizeof(unsigned int);
 
 using namespace RakNet;
 
+// Frees the old versions and patches UpdateApplicationFiles() holds for one file
+static void FreePatchJobs(DataStructures::List<PGresult*> &contentResults, DataStructures::List<CreatePatchJob> &patchJobs)
+{
+	unsigned int i;
+	for (i=0; i < patchJobs.Size(); i++)
+		delete [] patchJobs[i].out;
+	for (i=0; i < contentResults.Size(); i++)
+		PQclear(contentResults[i]);
+	patchJobs.Clear(false, _FILE_AND_LINE_);
+	contentResults.Clear(false, _FILE_AND_LINE_);
+}
+
 AutopatcherPostgreRepository::AutopatcherPostgreRepository()
 {
 	filePartConnection=0;
+	patchThreads=4;
 }
 AutopatcherPostgreRepository::~AutopatcherPostgreRepository()
 {
@@ -1282,15 +1295,11 @@ bool AutopatcherPostgreRepository::UpdateApplicationFiles(const char *applicatio
 
 	PGresult *uploadResult;
 	PGresult *fileRows;
-	char *content;
 	char *fileID;
-	int contentLength;
 	int fileIDLength;
 	int fileIDColumnIndex;
 	char *hardDriveData;
 	unsigned hardDriveDataLength;
-	char *patch;
-	unsigned patchLength;	
 
 	// For each file in the create list
 	for (fileListIndex=0; fileListIndex < newFiles.fileList.Size(); fileListIndex++)
@@ -1341,7 +1350,9 @@ bool AutopatcherPostgreRepository::UpdateApplicationFiles(const char *applicatio
 		outTemp[0]=hardDriveFilename;
 		outLengths[0]=(int)strlen(hardDriveFilename);
 
-		// Create new patches for every create version
+		// Fetch every create version first, so their patches are created together
+		DataStructures::List<PGresult*> contentResults;
+		DataStructures::List<CreatePatchJob> patchJobs;
 		for (rowIndex=0; rowIndex < numRows; rowIndex++ )
 		{
 			fileIDLength=PQgetlength(fileRows, rowIndex, fileIDColumnIndex);			
@@ -1359,6 +1370,7 @@ bool AutopatcherPostgreRepository::UpdateApplicationFiles(const char *applicatio
 			if (IsResultSuccessful(result, true)==false)
 			{
 				rakFree_Ex(hardDriveData, _FILE_AND_LINE_);
+				FreePatchJobs(contentResults, patchJobs);
 				Rollback();
 				newFiles.Clear();
 				PQclear(result);
@@ -1368,6 +1380,7 @@ bool AutopatcherPostgreRepository::UpdateApplicationFiles(const char *applicatio
 			if( numContent > 1 || numContent == 0 )
 			{
 				rakFree_Ex(hardDriveData, _FILE_AND_LINE_);
+				FreePatchJobs(contentResults, patchJobs);
 				Rollback();
 				newFiles.Clear();
 				PQclear(result);
@@ -1378,30 +1391,36 @@ bool AutopatcherPostgreRepository::UpdateApplicationFiles(const char *applicatio
 			formats[0] = PQEXECPARAM_FORMAT_TEXT;
 
 			contentColumnIndex = PQfnumber(result, "content");
-			contentLength=PQgetlength(result, 0, contentColumnIndex);
-			content=PQgetvalue(result, 0, contentColumnIndex);
+			CreatePatchJob patchJob;
+			patchJob.old=PQgetvalue(result, 0, contentColumnIndex);
+			patchJob.oldsize=PQgetlength(result, 0, contentColumnIndex);
+			patchJob._new=hardDriveData;
+			patchJob.newsize=hardDriveDataLength;
+			patchJob.out=0;
+			contentResults.Push(result, _FILE_AND_LINE_);
+			patchJobs.Push(patchJob, _FILE_AND_LINE_);
+		}
 
+		if (patchJobs.Size() > 0 && CreatePatches(&patchJobs[0], patchJobs.Size(), patchThreads, &patchCache)==false)
+		{
+			rakFree_Ex(hardDriveData, _FILE_AND_LINE_);
+			FreePatchJobs(contentResults, patchJobs);
 
-			if (CreatePatch(content, contentLength, hardDriveData, hardDriveDataLength, &patch, &patchLength)==false)
-			{
-				rakFree_Ex(hardDriveData, _FILE_AND_LINE_);
+			strcpy(lastError,"CreatePatch failed.\n");
+			Rollback();
 
-				strcpy(lastError,"CreatePatch failed.\n");
-				Rollback();
+			newFiles.Clear();
+			PQclear(fileRows);
+			return false;
+		}
 
-				newFiles.Clear();
-				PQclear(result);
-				PQclear(fileRows);
-				return false;
-			}
-			
-// 			outTemp[0]=fileID;
-// 			outLengths[0]=fileIDLength;
-// 			outTemp[1]=patch;
-// 			outLengths[1]=patchLength;
+		// Create new patches for every create version
+		for (rowIndex=0; rowIndex < numRows; rowIndex++ )
+		{
+			fileID=PQgetvalue(fileRows, rowIndex, fileIDColumnIndex);
 
-			outTemp[0]=patch;
-			outLengths[0]=patchLength;
+			outTemp[0]=patchJobs[rowIndex].out;
+			outLengths[0]=patchJobs[rowIndex].outSize;
 			formats[0]=PQEXECPARAM_FORMAT_BINARY;
 			
 			//sqlCommandMutex.Lock();
@@ -1410,23 +1429,23 @@ bool AutopatcherPostgreRepository::UpdateApplicationFiles(const char *applicatio
 			uploadResult = PQexecParams(pgConn, buff, 1,0,outTemp,outLengths,formats,PQEXECPARAM_FORMAT_BINARY);
 			
 			// Done with this patch data
-			delete [] patch;
+			delete [] patchJobs[rowIndex].out;
+			patchJobs[rowIndex].out=0;
 
 			//sqlCommandMutex.Unlock();
 			if (IsResultSuccessful(uploadResult, true)==false)
 			{
 				rakFree_Ex(hardDriveData, _FILE_AND_LINE_);
+				FreePatchJobs(contentResults, patchJobs);
 				Rollback();
 				newFiles.Clear();
-				PQclear(result);
+				PQclear(uploadResult);
 				return false;
 			}
 
-			
-
-			PQclear(result);
 			PQclear(uploadResult);
 		}
+		FreePatchJobs(contentResults, patchJobs);
 		PQclear(fileRows);
 
 		// Add totally new files
@@ -2009,7 +2028,7 @@ bool AutopatcherPostgreRepository2::MakePatchBSDiff(FILE *fpOld, int contentLeng
 	fseek(fpNew, 0, SEEK_SET);
 	fread(newContent, contentLengthNew, 1, fpNew);
 
-	bool b = CreatePatch(oldContent, contentLengthOld, newContent, contentLengthNew, patch, patchLength);
+	bool b = patchCache.CreatePatch(oldContent, contentLengthOld, newContent, contentLengthNew, patch, patchLength);
 
 	if (b==false)
 	{
@@ -2025,6 +2044,14 @@ bool AutopatcherPostgreRepository2::MakePatchBSDiff(FILE *fpOld, int contentLeng
 	rakFree_Ex(newContent, _FILE_AND_LINE_);
 	return b;
 }
+PatchCache* AutopatcherPostgreRepository::GetPatchCache(void)
+{
+	return &patchCache;
+}
+void AutopatcherPostgreRepository::SetPatchThreads(int numThreads)
+{
+	patchThreads=numThreads;
+}
 const char *AutopatcherPostgreRepository::GetLastError(void) const
 {
 	return PostgreSQLInterface::GetLastError();
@@ -25,6 +25,11 @@
  */
  
 #include "MemoryCompressor.h"
+#include "CreatePatch.h"
+#include "PatchCache.h"
+#include "ThreadPool.h"
+#include "RakSleep.h"
+#include <thread>
 
 #if 0
 __FBSDID("$FreeBSD: src/usr.bin/bsdiff/bsdiff/bsdiff.c,v 1.1 2005/08/06 01:59:05 cperciva Exp $");
@@ -170,6 +175,208 @@ static void qsufsort(off_t *I,off_t *V,u_char *old,off_t oldsize)
 	for(i=0;i<oldsize+1;i++) I[V[i]]=i;
 }
 
+// Suffix array by induced sorting (SA-IS, Nong, Zhang and Chan 2009). Linear time, where qsufsort is O(n log n)
+// Writes the start of each suffix of s[0..n-1] to sa in sorted order. The empty suffix is not included
+// \param[in] upper The largest value in s
+// \return false if out of memory
+template <class CharType>
+static bool SuffixSort(const CharType *s, int n, int upper, int *sa)
+{
+	int i;
+	if (n==0)
+		return true;
+	if (n==1)
+	{
+		sa[0]=0;
+		return true;
+	}
+	if (n < 10)
+	{
+		// Insertion sort, comparing whole suffixes
+		for (i=0; i < n; i++)
+		{
+			int j=i;
+			while (j > 0)
+			{
+				int a=sa[j-1], b=i, k=0;
+				while (a+k < n && b+k < n && s[a+k]==s[b+k])
+					k++;
+				bool aIsGreater = b+k==n || (a+k < n && s[a+k] > s[b+k]);
+				if (aIsGreater==false)
+					break;
+				sa[j]=sa[j-1];
+				j--;
+			}
+			sa[j]=i;
+		}
+		return true;
+	}
+
+	// isS[i] is 1 if suffix i is smaller than suffix i+1 (S-type), else 0 (L-type)
+	unsigned char *isS = (unsigned char*) malloc(n);
+	int *bucketStartS = (int*) malloc((upper+2)*sizeof(int));
+	int *bucketStartL = (int*) malloc((upper+2)*sizeof(int));
+	int *bucket = (int*) malloc((upper+2)*sizeof(int));
+	int *lmsMap = (int*) malloc((n+1)*sizeof(int));
+	if (isS==0 || bucketStartS==0 || bucketStartL==0 || bucket==0 || lmsMap==0)
+	{
+		free(isS); free(bucketStartS); free(bucketStartL); free(bucket); free(lmsMap);
+		return false;
+	}
+
+	isS[n-1]=0;
+	for (i=n-2; i >= 0; i--)
+		isS[i] = (s[i]==s[i+1]) ? isS[i+1] : (s[i] < s[i+1]);
+
+	memset(bucketStartS, 0, (upper+2)*sizeof(int));
+	memset(bucketStartL, 0, (upper+2)*sizeof(int));
+	for (i=0; i < n; i++)
+	{
+		if (isS[i]==0)
+			bucketStartS[s[i]]++;
+		else
+			bucketStartL[s[i]+1]++;
+	}
+	for (i=0; i <= upper; i++)
+	{
+		bucketStartS[i]+=bucketStartL[i];
+		if (i < upper)
+			bucketStartL[i+1]+=bucketStartS[i];
+	}
+
+	int numLms=0;
+	for (i=0; i <= n; i++)
+		lmsMap[i]=-1;
+	for (i=1; i < n; i++)
+	{
+		if (isS[i-1]==0 && isS[i])
+			lmsMap[i]=numLms++;
+	}
+	int *lms = (int*) malloc((numLms+1)*sizeof(int));
+	int *sortedLms = (int*) malloc((numLms+1)*sizeof(int));
+	if (lms==0 || sortedLms==0)
+	{
+		free(isS); free(bucketStartS); free(bucketStartL); free(bucket); free(lmsMap); free(lms); free(sortedLms);
+		return false;
+	}
+	numLms=0;
+	for (i=1; i < n; i++)
+	{
+		if (isS[i-1]==0 && isS[i])
+			lms[numLms++]=i;
+	}
+
+	bool success=true;
+	for (int pass=0; pass < 2; pass++)
+	{
+		// Place the LMS suffixes at the ends of their buckets, then induce the L-type and S-type suffixes from them
+		// First pass with the LMS suffixes in text order sorts the LMS substrings. Second pass with them fully sorted sorts everything
+		const int *seeds = pass==0 ? lms : sortedLms;
+		for (i=0; i < n; i++)
+			sa[i]=-1;
+		memcpy(bucket, bucketStartS, (upper+1)*sizeof(int));
+		for (i=0; i < numLms; i++)
+			sa[bucket[s[seeds[i]]]++]=seeds[i];
+		memcpy(bucket, bucketStartL, (upper+1)*sizeof(int));
+		sa[bucket[s[n-1]]++]=n-1;
+		for (i=0; i < n; i++)
+		{
+			int v=sa[i];
+			if (v >= 1 && isS[v-1]==0)
+				sa[bucket[s[v-1]]++]=v-1;
+		}
+		memcpy(bucket, bucketStartL, (upper+1)*sizeof(int));
+		for (i=n-1; i >= 0; i--)
+		{
+			int v=sa[i];
+			if (v >= 1 && isS[v-1])
+				sa[--bucket[s[v-1]+1]]=v-1;
+		}
+
+		if (pass==1 || numLms==0)
+			break;
+
+		// Name each LMS substring by its rank, then sort the LMS suffixes by recursing on the names
+		int numSorted=0;
+		for (i=0; i < n; i++)
+		{
+			if (lmsMap[sa[i]]!=-1)
+				sortedLms[numSorted++]=sa[i];
+		}
+		int *reducedText = (int*) malloc(numLms*sizeof(int));
+		int *reducedSa = (int*) malloc(numLms*sizeof(int));
+		if (reducedText==0 || reducedSa==0)
+		{
+			free(reducedText);
+			free(reducedSa);
+			success=false;
+			break;
+		}
+		int reducedUpper=0;
+		reducedText[lmsMap[sortedLms[0]]]=0;
+		for (i=1; i < numLms; i++)
+		{
+			int l=sortedLms[i-1], r=sortedLms[i];
+			int endL = (lmsMap[l]+1 < numLms) ? lms[lmsMap[l]+1] : n;
+			int endR = (lmsMap[r]+1 < numLms) ? lms[lmsMap[r]+1] : n;
+			bool same=true;
+			if (endL-l != endR-r)
+				same=false;
+			else
+			{
+				while (l < endL && s[l]==s[r])
+				{
+					l++;
+					r++;
+				}
+				if (l==n || r==n || s[l]!=s[r])
+					same=false;
+			}
+			if (same==false)
+				reducedUpper++;
+			reducedText[lmsMap[sortedLms[i]]]=reducedUpper;
+		}
+
+		success=SuffixSort<int>(reducedText, numLms, reducedUpper, reducedSa);
+		if (success)
+		{
+			for (i=0; i < numLms; i++)
+				sortedLms[i]=lms[reducedSa[i]];
+		}
+		free(reducedText);
+		free(reducedSa);
+		if (success==false)
+			break;
+	}
+
+	free(isS); free(bucketStartS); free(bucketStartL); free(bucket); free(lmsMap); free(lms); free(sortedLms);
+	return success;
+}
+
+// Returns the same I as qsufsort(), allocated with malloc, or 0 if out of memory
+// I is allocated after sorting, so it does not add to the sort's peak memory use
+static off_t *SuffixSortBSDiff(const u_char *old, off_t oldsize)
+{
+	int *sa = (int*) malloc((oldsize+1)*sizeof(int));
+	if (sa==0)
+		return 0;
+	// qsufsort puts the empty suffix first
+	sa[0]=(int) oldsize;
+	if (SuffixSort<u_char>(old, (int) oldsize, 255, sa+1)==false)
+	{
+		free(sa);
+		return 0;
+	}
+	off_t *I = (off_t*) malloc((oldsize+1)*sizeof(off_t));
+	if (I)
+	{
+		for (off_t i=0; i < oldsize+1; i++)
+			I[i]=sa[i];
+	}
+	free(sa);
+	return I;
+}
+
 static off_t matchlen(u_char *old,off_t oldsize,u_char *_new,off_t newsize)
 {
 	off_t i;
@@ -275,14 +482,25 @@ bool CreatePatch(const char *old, unsigned oldsize, char *_new, unsigned int new
 		(close(fd)==-1)) err(1,"%s",argv[1]);
 		*/
 
-	if(((I=(off_t*)malloc((oldsize+1)*sizeof(off_t)))==NULL) ||
-		((V=(off_t*)malloc((oldsize+1)*sizeof(off_t)))==NULL))
-		// err(1,NULL);
+	if ((off_t) oldsize < 0x7FFFFFFF)
+	{
+		if ((I=SuffixSortBSDiff((const u_char*)old,oldsize))==NULL)
 			return false;
+	}
+	else
+	{
+		// Too large for int indices
+		if(((I=(off_t*)malloc((oldsize+1)*sizeof(off_t)))==NULL) ||
+			((V=(off_t*)malloc((oldsize+1)*sizeof(off_t)))==NULL))
+		{
+			free(I);
+			return false;
+		}
 
-	qsufsort(I,V,(u_char*)old,oldsize);
+		qsufsort(I,V,(u_char*)old,oldsize);
 
-	free(V);
+		free(V);
+	}
 
 	/* Allocate newsize+1 bytes instead of newsize bytes to ensure
 		that we never try to malloc(0) and get a NULL pointer */
@@ -542,6 +760,99 @@ bool CreatePatch(const char *old, unsigned oldsize, char *_new, unsigned int new
 }
 
 
+struct CreatePatchTask
+{
+	CreatePatchJob *job;
+	PatchCache *patchCache;
+};
+
+static CreatePatchTask* CreatePatchWorker(CreatePatchTask* task, bool *returnOutput, void* perThreadData)
+{
+	(void) perThreadData;
+	CreatePatchJob *job=task->job;
+	if (task->patchCache)
+		job->succeeded=task->patchCache->CreatePatch(job->old, job->oldsize, job->_new, job->newsize, &job->out, &job->outSize);
+	else
+		job->succeeded=CreatePatch(job->old, job->oldsize, job->_new, job->newsize, &job->out, &job->outSize);
+	if (job->succeeded==false)
+	{
+		job->out=0;
+		job->outSize=0;
+	}
+	*returnOutput=true;
+	return task;
+}
+
+static int CreatePatchTaskComp(const void *a, const void *b)
+{
+	// Largest first. The pool takes input in order, so the longest diffs start soonest and do not finish last on their own
+	const CreatePatchJob *jobA=((const CreatePatchTask*)a)->job;
+	const CreatePatchJob *jobB=((const CreatePatchTask*)b)->job;
+	double sizeA=(double)jobA->oldsize+jobA->newsize;
+	double sizeB=(double)jobB->oldsize+jobB->newsize;
+	if (sizeA > sizeB)
+		return -1;
+	if (sizeA < sizeB)
+		return 1;
+	return 0;
+}
+
+bool CreatePatches(CreatePatchJob *jobs, unsigned int numJobs, int numThreads, PatchCache *patchCache)
+{
+	if (numJobs==0)
+		return true;
+
+	unsigned int i;
+	CreatePatchTask *tasks = new CreatePatchTask[numJobs];
+	for (i=0; i < numJobs; i++)
+	{
+		tasks[i].job=&jobs[i];
+		tasks[i].patchCache=patchCache;
+	}
+	qsort(tasks, numJobs, sizeof(CreatePatchTask), CreatePatchTaskComp);
+
+	if (numThreads<=0)
+	{
+		// hardware_concurrency() returns 0 if it can't tell
+		numThreads=(int) std::thread::hardware_concurrency();
+		if (numThreads<=0)
+			numThreads=1;
+	}
+	if ((unsigned int) numThreads > numJobs)
+		numThreads=(int) numJobs;
+	ThreadPool<CreatePatchTask*, CreatePatchTask*> threadPool;
+	if (numThreads > 1 && threadPool.StartThreads(numThreads, 0))
+	{
+		for (i=0; i < numJobs; i++)
+			threadPool.AddInput(CreatePatchWorker, &tasks[i]);
+		unsigned int numFinished=0;
+		while (numFinished < numJobs)
+		{
+			if (threadPool.HasOutputFast() && threadPool.HasOutput())
+			{
+				threadPool.GetOutput();
+				numFinished++;
+			}
+			else
+				RakSleep(10);
+		}
+		threadPool.StopThreads();
+	}
+	else
+	{
+		bool returnOutput;
+		for (i=0; i < numJobs; i++)
+			CreatePatchWorker(&tasks[i], &returnOutput, 0);
+	}
+
+	delete [] tasks;
+
+	bool allSucceeded=true;
+	for (i=0; i < numJobs; i++)
+		allSucceeded&=jobs[i].succeeded;
+	return allSucceeded;
+}
+
 int TestDiffInMemory(int argc,char *argv[])
 {
 	char *old;
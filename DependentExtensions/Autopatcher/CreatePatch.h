@@ -1,3 +1,24 @@
 /// Given \a old and \a new , return \a out which will contain a patch to get from \a old to \a new .  \a out is allocated for you.
 bool CreatePatch(const char *old, unsigned oldsize, char *_new, unsigned int newsize, char **out, unsigned *outSize);
 
+class PatchCache;
+
+/// One call to CreatePatch(), for CreatePatches()
+struct CreatePatchJob
+{
+	const char *old;
+	unsigned int oldsize;
+	char *_new;
+	unsigned int newsize;
+
+	/// Written by CreatePatches(). Delete [] out when done with it
+	char *out;
+	unsigned int outSize;
+	bool succeeded;
+};
+
+/// Calls CreatePatch() for each job, on up to \a numThreads threads at once. The largest files are started first. If \a numThreads is 0 or less, uses one thread per core
+/// \note Each thread uses memory of about 13 times the size of the old file it is diffing, so limit \a numThreads for large files
+/// \param[in] patchCache If not 0, patches are taken from and added to this cache
+/// \return true if every job succeeded
+bool CreatePatches(CreatePatchJob *jobs, unsigned int numJobs, int numThreads, PatchCache *patchCache=0);
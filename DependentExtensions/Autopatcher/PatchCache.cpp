@@ -0,0 +1,226 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "PatchCache.h"
+#include "CreatePatch.h"
+#include "DR_SHA1.h"
+#include "FileOperations.h"
+#include "RakSleep.h"
+#include "RakMemoryOverride.h"
+#include <stdio.h>
+#include <string.h>
+
+PatchCache::PatchCache()
+{
+	maxMemory=256*1024*1024;
+	usedMemory=0;
+	useCounter=0;
+}
+PatchCache::~PatchCache()
+{
+	Clear();
+}
+void PatchCache::SetDirectory(const char *_directory)
+{
+	patchMutex.Lock();
+	if (_directory && _directory[0])
+	{
+		directory=_directory;
+		if (directory.IsEmpty()==false && directory.C_String()[directory.GetLength()-1]!='/' && directory.C_String()[directory.GetLength()-1]!='\\')
+			directory+="/";
+	}
+	else
+		directory.Clear();
+	patchMutex.Unlock();
+}
+void PatchCache::SetMaxMemory(unsigned int _maxMemory)
+{
+	patchMutex.Lock();
+	maxMemory=_maxMemory;
+	AddPatch(0,0,0);
+	patchMutex.Unlock();
+}
+bool PatchCache::CreatePatch(const char *old, unsigned oldsize, char *_new, unsigned int newsize, char **out, unsigned *outSize)
+{
+	unsigned char key[KEY_LENGTH];
+	CSHA1 sha1;
+	sha1.Update((const unsigned char*) old, oldsize);
+	sha1.Final();
+	sha1.GetHash(key);
+	sha1.Reset();
+	sha1.Update((const unsigned char*) _new, newsize);
+	sha1.Final();
+	sha1.GetHash(key+20);
+
+	RakNet::RakString path;
+
+	// Wait for any other thread creating the same patch, then claim the key
+	for (;;)
+	{
+		patchMutex.Lock();
+		if (CopyPatch(key, out, outSize))
+		{
+			patchMutex.Unlock();
+			return true;
+		}
+		if (IsPending(key)==false)
+		{
+			PendingKey pendingKey;
+			memcpy(pendingKey.key, key, KEY_LENGTH);
+			pendingKeys.Push(pendingKey, _FILE_AND_LINE_);
+			if (directory.IsEmpty()==false)
+				GetPatchPath(key, path);
+			patchMutex.Unlock();
+			break;
+		}
+		patchMutex.Unlock();
+		RakSleep(10);
+	}
+
+	bool succeeded=path.IsEmpty()==false && ReadPatchFile(path, out, outSize);
+	if (succeeded==false)
+	{
+		succeeded=::CreatePatch(old, oldsize, _new, newsize, out, outSize);
+		if (succeeded && path.IsEmpty()==false)
+			WritePatchFile(path, *out, *outSize);
+	}
+
+	patchMutex.Lock();
+	if (succeeded)
+		AddPatch(key, *out, *outSize);
+	RemovePending(key);
+	patchMutex.Unlock();
+	return succeeded;
+}
+void PatchCache::Clear(void)
+{
+	patchMutex.Lock();
+	for (unsigned int i=0; i < patches.Size(); i++)
+	{
+		rakFree_Ex(patches[i]->patch, _FILE_AND_LINE_);
+		RakNet::OP_DELETE(patches[i], _FILE_AND_LINE_);
+	}
+	patches.Clear(false, _FILE_AND_LINE_);
+	usedMemory=0;
+	patchMutex.Unlock();
+}
+void PatchCache::GetPatchPath(const unsigned char *key, RakNet::RakString &path) const
+{
+	char hex[KEY_LENGTH*2+1];
+	for (int i=0; i < KEY_LENGTH; i++)
+		sprintf(hex+i*2, "%02x", key[i]);
+	path=directory;
+	path+=hex;
+	path+=".patch";
+}
+bool PatchCache::ReadPatchFile(const RakNet::RakString &path, char **out, unsigned *outSize)
+{
+	FILE *fp = fopen(path.C_String(), "rb");
+	if (fp==0)
+		return false;
+	fseek(fp, 0, SEEK_END);
+	long length = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	// Shortest valid patch is the 32 byte header
+	if (length < 32)
+	{
+		fclose(fp);
+		return false;
+	}
+	*out = new char [length];
+	if (fread(*out, 1, length, fp)!=(size_t) length || memcmp(*out, "BSDIFF40", 8)!=0)
+	{
+		delete [] *out;
+		*out=0;
+		fclose(fp);
+		return false;
+	}
+	fclose(fp);
+	*outSize=(unsigned) length;
+	return true;
+}
+void PatchCache::WritePatchFile(const RakNet::RakString &path, const char *patch, unsigned int patchLength)
+{
+	// Write under a temporary name so another process never reads a partial patch
+	RakNet::RakString tempPath=path;
+	tempPath+=".tmp";
+	if (WriteFileWithDirectories(tempPath.C_String(), (char*) patch, patchLength)==false)
+		return;
+	remove(path.C_String());
+	if (rename(tempPath.C_String(), path.C_String())!=0)
+		remove(tempPath.C_String());
+}
+bool PatchCache::CopyPatch(const unsigned char *key, char **out, unsigned *outSize)
+{
+	for (unsigned int i=0; i < patches.Size(); i++)
+	{
+		if (memcmp(patches[i]->key, key, KEY_LENGTH)==0)
+		{
+			patches[i]->lastUse=++useCounter;
+			*outSize=patches[i]->patchLength;
+			*out = new char [*outSize];
+			memcpy(*out, patches[i]->patch, *outSize);
+			return true;
+		}
+	}
+	return false;
+}
+void PatchCache::AddPatch(const unsigned char *key, const char *patch, unsigned int patchLength)
+{
+	// Also called with key==0 to evict down to maxMemory
+	if (key && patchLength > maxMemory)
+		return;
+
+	while (patches.Size() > 0 && usedMemory + patchLength > maxMemory)
+	{
+		unsigned int oldest=0;
+		for (unsigned int i=1; i < patches.Size(); i++)
+		{
+			if (patches[i]->lastUse < patches[oldest]->lastUse)
+				oldest=i;
+		}
+		usedMemory-=patches[oldest]->patchLength;
+		rakFree_Ex(patches[oldest]->patch, _FILE_AND_LINE_);
+		RakNet::OP_DELETE(patches[oldest], _FILE_AND_LINE_);
+		patches.RemoveAtIndexFast(oldest);
+	}
+
+	if (key==0)
+		return;
+
+	CachedPatch *cachedPatch = RakNet::OP_NEW<CachedPatch>(_FILE_AND_LINE_);
+	memcpy(cachedPatch->key, key, KEY_LENGTH);
+	cachedPatch->patch=(char*) rakMalloc_Ex(patchLength, _FILE_AND_LINE_);
+	memcpy(cachedPatch->patch, patch, patchLength);
+	cachedPatch->patchLength=patchLength;
+	cachedPatch->lastUse=++useCounter;
+	patches.Push(cachedPatch, _FILE_AND_LINE_);
+	usedMemory+=patchLength;
+}
+bool PatchCache::IsPending(const unsigned char *key) const
+{
+	for (unsigned int i=0; i < pendingKeys.Size(); i++)
+	{
+		if (memcmp(pendingKeys[i].key, key, KEY_LENGTH)==0)
+			return true;
+	}
+	return false;
+}
+void PatchCache::RemovePending(const unsigned char *key)
+{
+	for (unsigned int i=0; i < pendingKeys.Size(); i++)
+	{
+		if (memcmp(pendingKeys[i].key, key, KEY_LENGTH)==0)
+		{
+			pendingKeys.RemoveAtIndexFast(i);
+			return;
+		}
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#ifndef __PATCH_CACHE_H
+#define __PATCH_CACHE_H
+
+#include "RakString.h"
+#include "SimpleMutex.h"
+#include "DS_List.h"
+
+/// Remembers patches from CreatePatch() by the contents they were made from
+/// \details The key is the SHA1 of the old contents followed by the SHA1 of the new contents, so a pair of files is only diffed once no matter which application or filename it belongs to.
+/// Patches are held in memory up to SetMaxMemory(), dropping the least recently used first. After SetDirectory() they are also written to disk and survive restarts.
+/// Threadsafe. If two threads ask for the same patch at once, one creates it and the other waits for the result.
+class PatchCache
+{
+public:
+	PatchCache();
+	~PatchCache();
+
+	/// \param[in] _directory Where to store patches on disk, one file per patch. Pass 0 to keep patches in memory only, which is the default
+	void SetDirectory(const char *_directory);
+
+	/// \param[in] _maxMemory Total size of patches to hold in memory. Defaults to 256 megabytes
+	void SetMaxMemory(unsigned int _maxMemory);
+
+	/// Same as ::CreatePatch(), but returns a copy of the earlier patch if one was created from the same contents
+	/// \note Delete [] out when done with it
+	bool CreatePatch(const char *old, unsigned oldsize, char *_new, unsigned int newsize, char **out, unsigned *outSize);
+
+	/// Drop all patches held in memory. Patches on disk are not deleted
+	void Clear(void);
+
+protected:
+	static const int KEY_LENGTH=40;
+
+	struct CachedPatch
+	{
+		unsigned char key[KEY_LENGTH];
+		char *patch;
+		unsigned int patchLength;
+		unsigned int lastUse;
+	};
+
+	struct PendingKey
+	{
+		unsigned char key[KEY_LENGTH];
+	};
+
+	void GetPatchPath(const unsigned char *key, RakNet::RakString &path) const;
+	static bool ReadPatchFile(const RakNet::RakString &path, char **out, unsigned *outSize);
+	static void WritePatchFile(const RakNet::RakString &path, const char *patch, unsigned int patchLength);
+	// Call with patchMutex locked
+	bool CopyPatch(const unsigned char *key, char **out, unsigned *outSize);
+	void AddPatch(const unsigned char *key, const char *patch, unsigned int patchLength);
+	bool IsPending(const unsigned char *key) const;
+	void RemovePending(const unsigned char *key);
+
+	RakNet::SimpleMutex patchMutex;
+	DataStructures::List<CachedPatch*> patches;
+	// Keys being created by some thread
+	DataStructures::List<PendingKey> pendingKeys;
+	RakNet::RakString directory;
+	unsigned int maxMemory;
+	unsigned int usedMemory;
+	unsigned int useCounter;
+};
+
+#endif
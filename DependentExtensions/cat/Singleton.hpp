@@ -46,8 +46,8 @@ namespace cat {
 template<class T> class Singleton
 {
 protected:
-    Singleton<T>() {}
-    Singleton<T>(Singleton<T> &) {}
+    Singleton() {}
+    Singleton(Singleton<T> &) {}
     Singleton<T> &operator=(Singleton<T> &) {}
 
 public:
@@ -105,6 +105,21 @@ namespace cat {
     sure not to accept the new IV until the message authentication code has
 	been verified if your protocol uses a message authentication code (MAC).
         Otherwise: An attacker could desynchronize the IVs.
+
+    Several messages under the same key can be encrypted in one call,
+    which keeps the SIMD kernels busy when each message is only a few blocks:
+
+        ChaChaMessage messages[2];
+        messages[0].in = messages[0].out = message0;
+        messages[0].bytes = sizeof(message0);
+        messages[0].iv = message0_iv;
+        messages[1].in = messages[1].out = message1;
+        messages[1].bytes = sizeof(message1);
+        messages[1].iv = message1_iv;
+
+        ChaChaOutput::CryptBatch(cck, messages, 2);
+
+    The output is the same as one ChaChaOutput per message.
 */
 
 
@@ -123,20 +138,52 @@ public:
 };
 
 
+//// ChaChaMessage
+
+// One message for ChaChaOutput::CryptBatch()
+struct ChaChaMessage
+{
+	const void *in;
+	void *out;
+	int bytes;
+	u64 iv;
+};
+
+
+//// ChaChaKernel
+
+// Keystream generators, slowest to fastest.  The SIMD kernels generate several blocks at once
+enum ChaChaKernel
+{
+	CHACHA_KERNEL_SCALAR,	// One block at a time, any CPU
+	CHACHA_KERNEL_SSE2,		// Four blocks at a time, x86 with SSE2
+	CHACHA_KERNEL_AVX2,		// Eight blocks at a time, x86 with AVX2
+
+	CHACHA_KERNEL_COUNT
+};
+
+
 //// ChaChaOutput
 
 class CAT_EXPORT ChaChaOutput
 {
 	u32 state[16];
 
-	void GenerateKeyStream(u32 *out);
-
 public:
 	ChaChaOutput(const ChaChaKey &key, u64 iv);
 	~ChaChaOutput();
 
 	// Message with any number of bytes
 	void Crypt(const void *in, void *out, int bytes);
+
+	// Same as Crypt() with a new ChaChaOutput(key, messages[ii].iv) for each message
+	static void CryptBatch(const ChaChaKey &key, const ChaChaMessage *messages, int count);
+
+	// The fastest kernel this CPU supports is used by default.  Changing it is for benchmarks and tests
+	static bool IsKernelSupported(ChaChaKernel kernel);
+	static bool SetKernel(ChaChaKernel kernel); // Returns false if not supported
+	static ChaChaKernel GetKernel();
+	static const char *GetKernelName(ChaChaKernel kernel);
 };
 
 
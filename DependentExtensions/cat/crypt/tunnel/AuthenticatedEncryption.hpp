@@ -139,6 +139,11 @@ public:
     // msg_bytes: Number of bytes in the message, excluding the overhead
 	// If Encrypt() returns true, msg_bytes is set to the size of the encrypted message
     bool Encrypt(u8 *buffer, u32 buffer_bytes, u32 &msg_bytes);
+
+	// Same as calling Encrypt() on each message in order, producing the same output
+	// The keystream for all messages is generated together, so the SIMD ChaCha kernels fill their lanes even when messages are short
+	// Returns false without encrypting anything if any buffer is too small
+	bool EncryptBatch(u8 *const *buffers, const u32 *buffer_bytes, u32 *msg_bytes, int count);
 };
 
 
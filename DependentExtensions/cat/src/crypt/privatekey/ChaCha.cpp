@@ -29,6 +29,22 @@
 #include <cat/crypt/symmetric/ChaCha.hpp>
 #include <cat/port/EndianNeutral.hpp>
 #include <string.h>
+
+// SIMD kernels for x86 compilers that take intrinsics for instruction sets the build does not target
+#if (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)) && \
+	(defined(CAT_COMPILER_MSVC) || defined(__GNUC__))
+# define CAT_CHACHA_X86_SIMD
+# include <immintrin.h>
+# if defined(CAT_COMPILER_MSVC)
+#  include <intrin.h>
+#  define CAT_CHACHA_TARGET_SSE2
+#  define CAT_CHACHA_TARGET_AVX2
+# else
+#  define CAT_CHACHA_TARGET_SSE2 __attribute__((target("sse2")))
+#  define CAT_CHACHA_TARGET_AVX2 __attribute__((target("avx2")))
+# endif
+#endif
+
 using namespace cat;
 
 
@@ -73,12 +89,25 @@ void ChaChaKey::Set(const void *key, int bytes)
 	x[a] += x[b]; x[d] = CAT_ROL32(x[d] ^ x[a], 8); \
 	x[c] += x[d]; x[b] = CAT_ROL32(x[b] ^ x[c], 7);
 
-void ChaChaOutput::GenerateKeyStream(u32 *out_words)
+/*
+	Each kernel generates the keystream for a fixed number of blocks (lanes) at once.
+
+	key_state: First 12 words of the state, from ChaChaKey
+	lanes: For each block, 4 words: block counter low, block counter high, IV low, IV high
+	keystream: 16 words per block, in the byte order they are XORed with the message
+*/
+typedef void (*ChaChaKernelFunction)(const u32 *key_state, const u32 *lanes, u32 *keystream);
+
+static const int CHACHA_MAX_LANES = 8;
+
+static void ChaChaScalarKernel(const u32 *key_state, const u32 *lanes, u32 *keystream)
 {
-	// Update block counter
-	if (!++state[12]) state[13]++;
+	u32 state[16], x[16];
 
-	register u32 x[16];
+	for (int ii = 0; ii < 12; ++ii)
+		state[ii] = key_state[ii];
+	for (int ii = 0; ii < 4; ++ii)
+		state[12 + ii] = lanes[ii];
 
 	// Copy state into work registers
 	for (int ii = 0; ii < 16; ++ii)
@@ -99,7 +128,297 @@ void ChaChaOutput::GenerateKeyStream(u32 *out_words)
 
 	// Add state to mixed state, little-endian
 	for (int jj = 0; jj < 16; ++jj)
-		out_words[jj] = getLE(x[jj] + state[jj]);
+		keystream[jj] = getLE(x[jj] + state[jj]);
+}
+
+#undef QUARTERROUND
+
+#if defined(CAT_CHACHA_X86_SIMD)
+
+#define QUARTERROUND(a,b,c,d) \
+	x[a] = _mm_add_epi32(x[a], x[b]); x[d] = ROL128(_mm_xor_si128(x[d], x[a]), 16); \
+	x[c] = _mm_add_epi32(x[c], x[d]); x[b] = ROL128(_mm_xor_si128(x[b], x[c]), 12); \
+	x[a] = _mm_add_epi32(x[a], x[b]); x[d] = ROL128(_mm_xor_si128(x[d], x[a]), 8); \
+	x[c] = _mm_add_epi32(x[c], x[d]); x[b] = ROL128(_mm_xor_si128(x[b], x[c]), 7);
+
+#define ROL128(v, r) _mm_or_si128(_mm_slli_epi32(v, r), _mm_srli_epi32(v, 32 - (r)))
+
+// Four blocks, one in each 32-bit lane of each register
+CAT_CHACHA_TARGET_SSE2 static void ChaChaSSE2Kernel(const u32 *key_state, const u32 *lanes, u32 *keystream)
+{
+	__m128i state[16], x[16];
+
+	for (int ii = 0; ii < 12; ++ii)
+		state[ii] = _mm_set1_epi32((int)key_state[ii]);
+	for (int ii = 0; ii < 4; ++ii)
+		state[12 + ii] = _mm_setr_epi32((int)lanes[ii], (int)lanes[4 + ii], (int)lanes[8 + ii], (int)lanes[12 + ii]);
+
+	for (int ii = 0; ii < 16; ++ii)
+		x[ii] = state[ii];
+
+	for (int round = 12; round > 0; round -= 2)
+	{
+		QUARTERROUND(0, 4, 8,  12)
+		QUARTERROUND(1, 5, 9,  13)
+		QUARTERROUND(2, 6, 10, 14)
+		QUARTERROUND(3, 7, 11, 15)
+		QUARTERROUND(0, 5, 10, 15)
+		QUARTERROUND(1, 6, 11, 12)
+		QUARTERROUND(2, 7, 8,  13)
+		QUARTERROUND(3, 4, 9,  14)
+	}
+
+	// Add state, then transpose each group of 4 words so each block's words are contiguous
+	for (int group = 0; group < 4; ++group)
+	{
+		__m128i a = _mm_add_epi32(x[group*4 + 0], state[group*4 + 0]);
+		__m128i b = _mm_add_epi32(x[group*4 + 1], state[group*4 + 1]);
+		__m128i c = _mm_add_epi32(x[group*4 + 2], state[group*4 + 2]);
+		__m128i d = _mm_add_epi32(x[group*4 + 3], state[group*4 + 3]);
+
+		__m128i ab_lo = _mm_unpacklo_epi32(a, b), cd_lo = _mm_unpacklo_epi32(c, d);
+		__m128i ab_hi = _mm_unpackhi_epi32(a, b), cd_hi = _mm_unpackhi_epi32(c, d);
+
+		_mm_storeu_si128((__m128i*)(keystream + 0*16 + group*4), _mm_unpacklo_epi64(ab_lo, cd_lo));
+		_mm_storeu_si128((__m128i*)(keystream + 1*16 + group*4), _mm_unpackhi_epi64(ab_lo, cd_lo));
+		_mm_storeu_si128((__m128i*)(keystream + 2*16 + group*4), _mm_unpacklo_epi64(ab_hi, cd_hi));
+		_mm_storeu_si128((__m128i*)(keystream + 3*16 + group*4), _mm_unpackhi_epi64(ab_hi, cd_hi));
+	}
+}
+
+#undef ROL128
+#undef QUARTERROUND
+
+#define QUARTERROUND(a,b,c,d) \
+	x[a] = _mm256_add_epi32(x[a], x[b]); x[d] = _mm256_shuffle_epi8(_mm256_xor_si256(x[d], x[a]), rol16); \
+	x[c] = _mm256_add_epi32(x[c], x[d]); x[b] = ROL256(_mm256_xor_si256(x[b], x[c]), 12); \
+	x[a] = _mm256_add_epi32(x[a], x[b]); x[d] = _mm256_shuffle_epi8(_mm256_xor_si256(x[d], x[a]), rol8); \
+	x[c] = _mm256_add_epi32(x[c], x[d]); x[b] = ROL256(_mm256_xor_si256(x[b], x[c]), 7);
+
+#define ROL256(v, r) _mm256_or_si256(_mm256_slli_epi32(v, r), _mm256_srli_epi32(v, 32 - (r)))
+
+// Eight blocks, one in each 32-bit lane of each register
+CAT_CHACHA_TARGET_AVX2 static void ChaChaAVX2Kernel(const u32 *key_state, const u32 *lanes, u32 *keystream)
+{
+	// Rotations by whole bytes are a byte shuffle
+	const __m256i rol16 = _mm256_setr_epi8(2,3,0,1, 6,7,4,5, 10,11,8,9, 14,15,12,13, 2,3,0,1, 6,7,4,5, 10,11,8,9, 14,15,12,13);
+	const __m256i rol8 = _mm256_setr_epi8(3,0,1,2, 7,4,5,6, 11,8,9,10, 15,12,13,14, 3,0,1,2, 7,4,5,6, 11,8,9,10, 15,12,13,14);
+
+	__m256i state[16], x[16];
+
+	for (int ii = 0; ii < 12; ++ii)
+		state[ii] = _mm256_set1_epi32((int)key_state[ii]);
+	for (int ii = 0; ii < 4; ++ii)
+		state[12 + ii] = _mm256_setr_epi32((int)lanes[ii], (int)lanes[4 + ii], (int)lanes[8 + ii], (int)lanes[12 + ii],
+			(int)lanes[16 + ii], (int)lanes[20 + ii], (int)lanes[24 + ii], (int)lanes[28 + ii]);
+
+	for (int ii = 0; ii < 16; ++ii)
+		x[ii] = state[ii];
+
+	for (int round = 12; round > 0; round -= 2)
+	{
+		QUARTERROUND(0, 4, 8,  12)
+		QUARTERROUND(1, 5, 9,  13)
+		QUARTERROUND(2, 6, 10, 14)
+		QUARTERROUND(3, 7, 11, 15)
+		QUARTERROUND(0, 5, 10, 15)
+		QUARTERROUND(1, 6, 11, 12)
+		QUARTERROUND(2, 7, 8,  13)
+		QUARTERROUND(3, 4, 9,  14)
+	}
+
+	// Add state, then transpose within each 128-bit half, leaving block n in the low half and block n+4 in the high half
+	__m256i t[4][4];
+	for (int group = 0; group < 4; ++group)
+	{
+		__m256i a = _mm256_add_epi32(x[group*4 + 0], state[group*4 + 0]);
+		__m256i b = _mm256_add_epi32(x[group*4 + 1], state[group*4 + 1]);
+		__m256i c = _mm256_add_epi32(x[group*4 + 2], state[group*4 + 2]);
+		__m256i d = _mm256_add_epi32(x[group*4 + 3], state[group*4 + 3]);
+
+		__m256i ab_lo = _mm256_unpacklo_epi32(a, b), cd_lo = _mm256_unpacklo_epi32(c, d);
+		__m256i ab_hi = _mm256_unpackhi_epi32(a, b), cd_hi = _mm256_unpackhi_epi32(c, d);
+
+		t[group][0] = _mm256_unpacklo_epi64(ab_lo, cd_lo);
+		t[group][1] = _mm256_unpackhi_epi64(ab_lo, cd_lo);
+		t[group][2] = _mm256_unpacklo_epi64(ab_hi, cd_hi);
+		t[group][3] = _mm256_unpackhi_epi64(ab_hi, cd_hi);
+	}
+
+	// Join the halves of two groups into 32 contiguous bytes of one block
+	for (int block = 0; block < 4; ++block)
+	{
+		_mm256_storeu_si256((__m256i*)(keystream + block*16), _mm256_permute2x128_si256(t[0][block], t[1][block], 0x20));
+		_mm256_storeu_si256((__m256i*)(keystream + block*16 + 8), _mm256_permute2x128_si256(t[2][block], t[3][block], 0x20));
+		_mm256_storeu_si256((__m256i*)(keystream + (block + 4)*16), _mm256_permute2x128_si256(t[0][block], t[1][block], 0x31));
+		_mm256_storeu_si256((__m256i*)(keystream + (block + 4)*16 + 8), _mm256_permute2x128_si256(t[2][block], t[3][block], 0x31));
+	}
+}
+
+#undef ROL256
+#undef QUARTERROUND
+
+#endif // CAT_CHACHA_X86_SIMD
+
+struct ChaChaKernelInfo
+{
+	ChaChaKernelFunction function;
+	int lanes;
+	const char *name;
+};
+
+static const ChaChaKernelInfo ChaChaKernels[CHACHA_KERNEL_COUNT] = {
+	{ ChaChaScalarKernel, 1, "Scalar" },
+#if defined(CAT_CHACHA_X86_SIMD)
+	{ ChaChaSSE2Kernel, 4, "SSE2" },
+	{ ChaChaAVX2Kernel, 8, "AVX2" },
+#else
+	{ 0, 4, "SSE2" },
+	{ 0, 8, "AVX2" },
+#endif
+};
+
+static bool CpuSupportsKernel(ChaChaKernel kernel)
+{
+	if (kernel == CHACHA_KERNEL_SCALAR) return true;
+
+#if defined(CAT_CHACHA_X86_SIMD)
+# if defined(CAT_COMPILER_MSVC)
+	int info[4];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	// AVX2 also needs the OS to save the YMM registers
+	bool avx2 = false;
+	if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+# else
+	__builtin_cpu_init();
+	bool sse2 = __builtin_cpu_supports("sse2") != 0;
+	bool avx2 = __builtin_cpu_supports("avx2") != 0;
+# endif
+
+	if (kernel == CHACHA_KERNEL_SSE2) return sse2;
+	if (kernel == CHACHA_KERNEL_AVX2) return avx2;
+#endif
+
+	return false;
+}
+
+// Which kernels this CPU supports, and which one to use for full batches
+struct ChaChaKernelSelection
+{
+	bool supported[CHACHA_KERNEL_COUNT];
+	ChaChaKernel kernel;
+
+	ChaChaKernelSelection()
+	{
+		kernel = CHACHA_KERNEL_SCALAR;
+		for (int ii = 0; ii < CHACHA_KERNEL_COUNT; ++ii)
+		{
+			supported[ii] = CpuSupportsKernel((ChaChaKernel)ii);
+			if (supported[ii]) kernel = (ChaChaKernel)ii;
+		}
+	}
+};
+
+static ChaChaKernelSelection &GetKernelSelection()
+{
+	static ChaChaKernelSelection selection;
+	return selection;
+}
+
+// XOR the keystream for each used lane into its part of a message
+static void XorKeyStream(const u32 *keystream, const u8 * const *in, u8 * const *out, const int *bytes, int used)
+{
+	for (int lane = 0; lane < used; ++lane)
+	{
+		const u8 *key8 = (const u8 *)(keystream + lane * 16);
+
+		if (bytes[lane] == 64)
+		{
+			for (int ii = 0; ii < 64; ii += 8)
+			{
+				u64 m, k;
+				memcpy(&m, in[lane] + ii, 8);
+				memcpy(&k, key8 + ii, 8);
+				m ^= k;
+				memcpy(out[lane] + ii, &m, 8);
+			}
+		}
+		else
+		{
+			for (int ii = 0; ii < bytes[lane]; ++ii)
+				out[lane][ii] = in[lane][ii] ^ key8[ii];
+		}
+	}
+}
+
+// Crypt each message with block counters starting at first_block, spreading the blocks of all messages across the kernel's lanes
+static void CryptBlocks(const u32 *key_state, u64 first_block, const ChaChaMessage *messages, int count)
+{
+	const ChaChaKernelSelection &selection = GetKernelSelection();
+	const int max_lanes = ChaChaKernels[selection.kernel].lanes;
+
+	u32 lanes[CHACHA_MAX_LANES * 4];
+	CAT_ALIGNED(32) u32 keystream[CHACHA_MAX_LANES * 16];
+	const u8 *lane_in[CHACHA_MAX_LANES];
+	u8 *lane_out[CHACHA_MAX_LANES];
+	int lane_bytes[CHACHA_MAX_LANES];
+	int used = 0;
+
+	for (int ii = 0; ii <= count; ++ii)
+	{
+		const u8 *in8 = 0;
+		u8 *out8 = 0;
+		int bytes = 0;
+		u64 block = first_block, iv = 0;
+
+		if (ii < count)
+		{
+			in8 = (const u8 *)messages[ii].in;
+			out8 = (u8 *)messages[ii].out;
+			bytes = messages[ii].bytes;
+			iv = messages[ii].iv;
+		}
+
+		for (;;)
+		{
+			// Run the kernel when the lanes are full, or on what is left after the last message
+			if (used == max_lanes || (ii == count && used > 0))
+			{
+				// Use the narrowest kernel that fits, so a short last batch does not pay for unused lanes
+				int kernel = CHACHA_KERNEL_SCALAR;
+				while (ChaChaKernels[kernel].lanes < used || !selection.supported[kernel])
+					++kernel;
+
+				for (int lane = 0; lane < used; lane += ChaChaKernels[kernel].lanes)
+					ChaChaKernels[kernel].function(key_state, lanes + lane * 4, keystream + lane * 16);
+
+				XorKeyStream(keystream, lane_in, lane_out, lane_bytes, used);
+				used = 0;
+			}
+
+			if (bytes <= 0) break;
+
+			u32 *lane = lanes + used * 4;
+			lane[0] = (u32)block;
+			lane[1] = (u32)(block >> 32);
+			lane[2] = (u32)iv;
+			lane[3] = (u32)(iv >> 32);
+			lane_in[used] = in8;
+			lane_out[used] = out8;
+			lane_bytes[used] = bytes < 64 ? bytes : 64;
+			++used;
+
+			++block;
+			in8 += 64;
+			out8 += 64;
+			bytes -= 64;
+		}
+	}
 }
 
 ChaChaOutput::ChaChaOutput(const ChaChaKey &key, u64 iv)
@@ -123,9 +442,6 @@ ChaChaOutput::~ChaChaOutput()
 // Message with any number of bytes
 void ChaChaOutput::Crypt(const void *in_bytes, void *out_bytes, int bytes)
 {
-	const u32 *in32 = (const u32 *)in_bytes;
-	u32 *out32 = (u32 *)out_bytes;
-
 #ifdef CAT_AUDIT
 	int initial_bytes = bytes;
 	printf("AUDIT: ChaCha input ");
@@ -136,38 +452,21 @@ void ChaChaOutput::Crypt(const void *in_bytes, void *out_bytes, int bytes)
 	printf("\n");
 #endif
 
-	while (bytes >= 64)
-	{
-		u32 key32[16];
-		GenerateKeyStream(key32);
+	ChaChaMessage message;
+	message.in = in_bytes;
+	message.out = out_bytes;
+	message.bytes = bytes;
+	message.iv = ((u64)state[15] << 32) | state[14];
 
-		for (int ii = 0; ii < 16; ++ii)
-			out32[ii] = in32[ii] ^ key32[ii];
+	// The block counter is incremented before each block, so the first block of a new ChaChaOutput is block 1
+	u64 block = ((u64)state[13] << 32) | state[12];
+	CryptBlocks(state, block + 1, &message, 1);
 
-		out32 += 16;
-		in32 += 16;
-		bytes -= 64;
-	}
-
-	if (bytes)
+	if (bytes > 0)
 	{
-		u32 key32[16];
-		GenerateKeyStream(key32);
-
-		int words = bytes / 4;
-		for (int ii = 0; ii < words; ++ii)
-			out32[ii] = in32[ii] ^ key32[ii];
-
-		const u8 *in8 = (const u8 *)(in32 + words);
-		u8 *out8 = (u8 *)(out32 + words);
-		const u8 *key8 = (const u8 *)(key32 + words);
-
-		switch (bytes % 4)
-		{
-		case 3: out8[2] = in8[2] ^ key8[2];
-		case 2: out8[1] = in8[1] ^ key8[1];
-		case 1: out8[0] = in8[0] ^ key8[0];
-		}
+		block += (u64)((bytes + 63) / 64);
+		state[12] = (u32)block;
+		state[13] = (u32)(block >> 32);
 	}
 
 #ifdef CAT_AUDIT
@@ -180,4 +479,34 @@ void ChaChaOutput::Crypt(const void *in_bytes, void *out_bytes, int bytes)
 #endif
 }
 
-#undef QUARTERROUND
+void ChaChaOutput::CryptBatch(const ChaChaKey &key, const ChaChaMessage *messages, int count)
+{
+	CryptBlocks(key.state, 1, messages, count);
+}
+
+bool ChaChaOutput::IsKernelSupported(ChaChaKernel kernel)
+{
+	if ((int)kernel < 0 || kernel >= CHACHA_KERNEL_COUNT) return false;
+
+	return ChaChaKernels[kernel].function != 0 && GetKernelSelection().supported[kernel];
+}
+
+bool ChaChaOutput::SetKernel(ChaChaKernel kernel)
+{
+	if (!IsKernelSupported(kernel)) return false;
+
+	GetKernelSelection().kernel = kernel;
+	return true;
+}
+
+ChaChaKernel ChaChaOutput::GetKernel()
+{
+	return GetKernelSelection().kernel;
+}
+
+const char *ChaChaOutput::GetKernelName(ChaChaKernel kernel)
+{
+	if ((int)kernel < 0 || kernel >= CHACHA_KERNEL_COUNT) return "Unknown";
+
+	return ChaChaKernels[kernel].name;
+}
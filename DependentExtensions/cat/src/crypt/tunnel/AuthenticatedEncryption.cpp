@@ -407,3 +407,59 @@ bool AuthenticatedEncryption::Encrypt(u8 *buffer, u32 buffer_bytes, u32 &msg_byt
 	msg_bytes = out_bytes;
 	return true;
 }
+
+bool AuthenticatedEncryption::EncryptBatch(u8 *const *buffers, const u32 *buffer_bytes, u32 *msg_bytes, int count)
+{
+	for (int ii = 0; ii < count; ++ii)
+		if (msg_bytes[ii] + OVERHEAD_BYTES > buffer_bytes[ii]) return false;
+
+	// Messages per call to ChaChaOutput::CryptBatch()
+	static const int CHUNK = 16;
+	ChaChaMessage messages[CHUNK];
+
+	for (int first = 0; first < count; first += CHUNK)
+	{
+		int chunk = count - first;
+		if (chunk > CHUNK) chunk = CHUNK;
+
+		// Generate a MAC for each message and full IV, as in Encrypt()
+		for (int ii = 0; ii < chunk; ++ii)
+		{
+			u8 *buffer = buffers[first + ii];
+			u32 bytes = msg_bytes[first + ii];
+			u64 iv = ++local_iv;
+
+			HMAC_MD5 local_mac;
+			local_mac.RekeyFromMD5(&local_mac_key);
+			local_mac.BeginMAC();
+			u64 iv_neutral = getLE(iv);
+			local_mac.Crunch(&iv_neutral, sizeof(iv_neutral));
+			local_mac.Crunch(buffer, bytes);
+			local_mac.End();
+			local_mac.Generate(buffer + bytes, MAC_BYTES);
+
+			messages[ii].in = buffer;
+			messages[ii].out = buffer;
+			messages[ii].bytes = bytes + MAC_BYTES;
+			messages[ii].iv = iv;
+		}
+
+		// Encrypt all messages and MACs
+		ChaChaOutput::CryptBatch(local_cipher_key, messages, chunk);
+
+		// Obfuscate the truncated IVs
+		for (int ii = 0; ii < chunk; ++ii)
+		{
+			u8 *overhead = buffers[first + ii] + msg_bytes[first + ii];
+			u32 trunc_iv = IV_MASK & ((u32)messages[ii].iv ^ getLE(*(u32*)overhead) ^ IV_FUZZ);
+
+			overhead[MAC_BYTES] = (u8)trunc_iv;
+			overhead[MAC_BYTES+1] = (u8)(trunc_iv >> 8);
+			overhead[MAC_BYTES+2] = (u8)(trunc_iv >> 16);
+
+			msg_bytes[first + ii] += OVERHEAD_BYTES;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,218 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Times BitStream writes and reads of the kinds used by serialization code: byte aligned, unaligned after a single bit,
+// long unaligned runs, compressed integers, Float16 and quaternions.
+// Each case writes the same values every pass into a reused BitStream, so only the packing is measured.
+
+#include "BitStream.h"
+#include "GetTime.h"
+#include "Rand.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace RakNet;
+
+static const int VALUES_PER_PASS=1024;
+static unsigned int intValues[VALUES_PER_PASS];
+static float floatValues[VALUES_PER_PASS];
+static unsigned char block[VALUES_PER_PASS];
+static volatile unsigned int sink;
+
+static void WriteAligned(BitStream &bs)
+{
+	for (int i=0; i < VALUES_PER_PASS; i++)
+		bs.Write(intValues[i]);
+}
+static void ReadAligned(BitStream &bs)
+{
+	unsigned int value=0, sum=0;
+	for (int i=0; i < VALUES_PER_PASS; i++)
+	{
+		bs.Read(value);
+		sum+=value;
+	}
+	sink=sum;
+}
+
+// One bit before each value, as a flag or a bool member would leave it
+static void WriteUnaligned(BitStream &bs)
+{
+	for (int i=0; i < VALUES_PER_PASS; i++)
+	{
+		bs.Write((intValues[i] & 1)!=0);
+		bs.Write(intValues[i]);
+	}
+}
+static void ReadUnaligned(BitStream &bs)
+{
+	unsigned int value=0, sum=0;
+	bool flag=false;
+	for (int i=0; i < VALUES_PER_PASS; i++)
+	{
+		bs.Read(flag);
+		bs.Read(value);
+		sum+=value+flag;
+	}
+	sink=sum;
+}
+
+// One bit, then a 1 KB block, as a split message payload following a header is copied
+static void WriteUnalignedBlock(BitStream &bs)
+{
+	bs.Write1();
+	bs.WriteBits(block, VALUES_PER_PASS*8);
+}
+static void ReadUnalignedBlock(BitStream &bs)
+{
+	unsigned char output[VALUES_PER_PASS];
+	bs.ReadBit();
+	bs.ReadBits(output, VALUES_PER_PASS*8);
+	sink=output[VALUES_PER_PASS-1];
+}
+
+static void WriteCompressed(BitStream &bs)
+{
+	for (int i=0; i < VALUES_PER_PASS; i++)
+		bs.WriteCompressed(intValues[i] >> (i & 31));
+}
+static void ReadCompressed(BitStream &bs)
+{
+	unsigned int value=0, sum=0;
+	for (int i=0; i < VALUES_PER_PASS; i++)
+	{
+		bs.ReadCompressed(value);
+		sum+=value;
+	}
+	sink=sum;
+}
+
+static void WriteIntegerRange(BitStream &bs)
+{
+	for (int i=0; i < VALUES_PER_PASS; i++)
+		bs.WriteBitsFromIntegerRange(intValues[i] % 1000, 0u, 999u);
+}
+static void ReadIntegerRange(BitStream &bs)
+{
+	unsigned int value=0, sum=0;
+	for (int i=0; i < VALUES_PER_PASS; i++)
+	{
+		bs.ReadBitsFromIntegerRange(value, 0u, 999u);
+		sum+=value;
+	}
+	sink=sum;
+}
+
+static void WriteFloat16(BitStream &bs)
+{
+	for (int i=0; i < VALUES_PER_PASS; i++)
+		bs.WriteFloat16(floatValues[i], -1.0f, 1.0f);
+}
+static void ReadFloat16(BitStream &bs)
+{
+	float value=0.0f, sum=0.0f;
+	for (int i=0; i < VALUES_PER_PASS; i++)
+	{
+		bs.ReadFloat16(value, -1.0f, 1.0f);
+		sum+=value;
+	}
+	sink=(unsigned int) sum;
+}
+
+static void WriteNormQuat(BitStream &bs)
+{
+	for (int i=0; i < VALUES_PER_PASS; i+=4)
+		bs.WriteNormQuat(0.5f, floatValues[i+1]*0.5f, floatValues[i+2]*0.5f, floatValues[i+3]*0.5f);
+}
+static void ReadNormQuat(BitStream &bs)
+{
+	float w=0.0f, x=0.0f, y=0.0f, z=0.0f, sum=0.0f;
+	for (int i=0; i < VALUES_PER_PASS; i+=4)
+	{
+		bs.ReadNormQuat(w, x, y, z);
+		sum+=w+x+y+z;
+	}
+	sink=(unsigned int) sum;
+}
+
+struct BenchmarkCase
+{
+	const char *name;
+	// Values per pass
+	int operations;
+	void (*write)(BitStream &bs);
+	void (*read)(BitStream &bs);
+};
+
+static const BenchmarkCase benchmarkCases[]=
+{
+	{"Aligned uint32", VALUES_PER_PASS, WriteAligned, ReadAligned},
+	{"Bool + uint32", VALUES_PER_PASS, WriteUnaligned, ReadUnaligned},
+	{"Unaligned 1KB", 1, WriteUnalignedBlock, ReadUnalignedBlock},
+	{"Compressed", VALUES_PER_PASS, WriteCompressed, ReadCompressed},
+	{"IntegerRange", VALUES_PER_PASS, WriteIntegerRange, ReadIntegerRange},
+	{"Float16", VALUES_PER_PASS, WriteFloat16, ReadFloat16},
+	{"NormQuat", VALUES_PER_PASS/4, WriteNormQuat, ReadNormQuat},
+};
+
+int main(int argc, char **argv)
+{
+	unsigned int passes=20000;
+	if (argc>1)
+		passes=(unsigned int) atoi(argv[1]);
+	if (passes==0)
+		passes=1;
+
+	seedMT(1);
+	for (int i=0; i < VALUES_PER_PASS; i++)
+	{
+		intValues[i]=randomMT();
+		floatValues[i]=frandomMT()*2.0f-1.0f;
+		block[i]=(unsigned char) randomMT();
+	}
+
+	printf("Usage: BitStreamBenchmark [passes]\n");
+	printf("Each case is written and then read %u times.\n\n", passes);
+	printf("%-16s %8s %12s %12s %12s\n", "Case", "Bits/op", "Write ns/op", "Read ns/op", "Write MB/s");
+
+	BitStream bs;
+	for (unsigned int c=0; c < sizeof(benchmarkCases)/sizeof(benchmarkCases[0]); c++)
+	{
+		const BenchmarkCase &benchmarkCase=benchmarkCases[c];
+		unsigned int pass;
+
+		// Warm up, and grow the BitStream to its final size
+		bs.Reset();
+		benchmarkCase.write(bs);
+		BitSize_t bitsPerPass=bs.GetNumberOfBitsUsed();
+
+		TimeUS startTime=GetTimeUS();
+		for (pass=0; pass < passes; pass++)
+		{
+			bs.ResetWritePointer();
+			benchmarkCase.write(bs);
+		}
+		TimeUS writeUS=GetTimeUS()-startTime;
+
+		startTime=GetTimeUS();
+		for (pass=0; pass < passes; pass++)
+		{
+			bs.ResetReadPointer();
+			benchmarkCase.read(bs);
+		}
+		TimeUS readUS=GetTimeUS()-startTime;
+
+		double operations=(double) passes*benchmarkCase.operations;
+		printf("%-16s %8.1f %12.2f %12.2f %12.1f\n", benchmarkCase.name, (double) bitsPerPass/benchmarkCase.operations,
+			writeUS*1000.0/operations, readUS*1000.0/operations, writeUS > 0 ? (double) passes*bitsPerPass/8.0/writeUS : 0.0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Measures ChaCha encryption throughput for each kernel this CPU supports, one datagram at a time and in batches
+// as ReliabilityLayer encrypts them with AuthenticatedEncryption::EncryptBatch(). Also checks every kernel against the scalar one
+
+#include "NativeFeatureIncludes.h"
+#include "GetTime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if LIBCAT_SECURITY==1
+#include <cat/crypt/symmetric/ChaCha.hpp>
+
+using namespace cat;
+
+static const int MAX_DATAGRAM_BYTES=1500;
+static const int MAX_BATCH=64;
+
+static unsigned char input[MAX_BATCH][MAX_DATAGRAM_BYTES];
+static unsigned char output[MAX_BATCH][MAX_DATAGRAM_BYTES];
+static unsigned char expected[MAX_BATCH][MAX_DATAGRAM_BYTES];
+
+// Encrypts the same datagrams with the scalar kernel and with \a kernel, and compares
+static bool CheckKernel(const ChaChaKey &key, ChaChaKernel kernel)
+{
+	for (int bytes=1; bytes <= MAX_DATAGRAM_BYTES; bytes+=(bytes < 130 ? 1 : 61))
+	{
+		ChaChaMessage messages[MAX_BATCH];
+		int count=1 + bytes % MAX_BATCH;
+		for (int i=0; i < count; i++)
+		{
+			messages[i].in=input[i];
+			messages[i].out=expected[i];
+			messages[i].bytes=bytes - i % bytes;
+			messages[i].iv=(u64) bytes << 32 | (u64) i;
+		}
+
+		ChaChaOutput::SetKernel(CHACHA_KERNEL_SCALAR);
+		ChaChaOutput::CryptBatch(key, messages, count);
+
+		ChaChaOutput::SetKernel(kernel);
+		for (int i=0; i < count; i++)
+			messages[i].out=output[i];
+		ChaChaOutput::CryptBatch(key, messages, count);
+		for (int i=0; i < count; i++)
+		{
+			if (memcmp(output[i], expected[i], messages[i].bytes)!=0)
+				return false;
+		}
+
+		// One message at a time, in two calls to Crypt() so the block counter carries over
+		ChaChaOutput cipher(key, messages[0].iv);
+		int half=messages[0].bytes/2 & ~63;
+		cipher.Crypt(input[0], output[0], half);
+		cipher.Crypt(input[0]+half, output[0]+half, messages[0].bytes-half);
+		if (memcmp(output[0], expected[0], messages[0].bytes)!=0)
+			return false;
+	}
+	return true;
+}
+
+// Returns megabytes per second encrypting \a batch datagrams of \a bytes each per call
+static double Measure(const ChaChaKey &key, int bytes, int batch)
+{
+	ChaChaMessage messages[MAX_BATCH];
+	for (int i=0; i < batch; i++)
+	{
+		messages[i].in=input[i];
+		messages[i].out=output[i];
+		messages[i].bytes=bytes;
+	}
+
+	const int totalBytes=64*1024*1024;
+	int calls=totalBytes/(bytes*batch);
+	if (calls < 1)
+		calls=1;
+	u64 iv=0;
+	RakNet::TimeUS startTime=RakNet::GetTimeUS();
+	for (int call=0; call < calls; call++)
+	{
+		if (batch==1)
+		{
+			ChaChaOutput cipher(key, ++iv);
+			cipher.Crypt(input[0], output[0], bytes);
+		}
+		else
+		{
+			for (int i=0; i < batch; i++)
+				messages[i].iv=++iv;
+			ChaChaOutput::CryptBatch(key, messages, batch);
+		}
+	}
+	RakNet::TimeUS elapsed=RakNet::GetTimeUS()-startTime;
+	if (elapsed==0)
+		elapsed=1;
+	return (double) calls * bytes * batch / (double) elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	int batch=8;
+	if (argc>1)
+		batch=atoi(argv[1]);
+	if (batch < 2)
+		batch=2;
+	if (batch > MAX_BATCH)
+		batch=MAX_BATCH;
+
+	for (int i=0; i < MAX_BATCH; i++)
+	{
+		for (int j=0; j < MAX_DATAGRAM_BYTES; j++)
+			input[i][j]=(unsigned char) rand();
+	}
+	unsigned char keyBytes[32];
+	for (int i=0; i < 32; i++)
+		keyBytes[i]=(unsigned char) rand();
+	ChaChaKey key;
+	key.Set(keyBytes, sizeof(keyBytes));
+
+	printf("Usage: ChaChaBenchmark [batch]\n");
+	printf("Encrypts datagrams one per call with ChaChaOutput::Crypt(), and %i per call with ChaChaOutput::CryptBatch().\n", batch);
+	printf("ReliabilityLayer encrypts up to RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE datagrams per call. Results in MB/s.\n\n");
+
+	const int sizes[]={32, 128, 512, 1200, 1460};
+	const ChaChaKernel bestKernel=ChaChaOutput::GetKernel();
+	printf("%8s %6s %7s", "Kernel", "Check", "Calls");
+	for (unsigned int s=0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+		printf(" %8iB", sizes[s]);
+	printf("\n");
+
+	for (int kernel=0; kernel < CHACHA_KERNEL_COUNT; kernel++)
+	{
+		const char *name=ChaChaOutput::GetKernelName((ChaChaKernel) kernel);
+		if (ChaChaOutput::IsKernelSupported((ChaChaKernel) kernel)==false)
+		{
+			printf("%8s not supported on this CPU or compiler\n", name);
+			continue;
+		}
+
+		bool passed=CheckKernel(key, (ChaChaKernel) kernel);
+		ChaChaOutput::SetKernel((ChaChaKernel) kernel);
+
+		printf("%8s %6s %7s", name, passed ? "ok" : "FAILED", "single");
+		for (unsigned int s=0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+			printf(" %9.0f", Measure(key, sizes[s], 1));
+		printf("\n%8s %6s %7s", "", "", "batch");
+		for (unsigned int s=0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+			printf(" %9.0f", Measure(key, sizes[s], batch));
+		printf("\n");
+	}
+
+	ChaChaOutput::SetKernel(bestKernel);
+	printf("\nDefault kernel: %s\n", ChaChaOutput::GetKernelName(bestKernel));
+	return 0;
+}
+
+#else // LIBCAT_SECURITY
+
+int main(void)
+{
+	printf("Define LIBCAT_SECURITY 1 in NativeFeatureIncludesOverrides.h to run this benchmark\n");
+	return 1;
+}
+
+#endif // LIBCAT_SECURITY
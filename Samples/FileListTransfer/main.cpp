@@ -18,7 +18,7 @@
 #include "SuperFastHash.h"
 #include "RakAssert.h"
 #include "BitStream.h"
-#include "IncrementalReadInterface.h"
+#include "CachedIncrementalReadInterface.h"
 #include "PacketizedTCP.h"
 #include "SocketLayer.h"
 #include <stdio.h>
@@ -162,7 +162,7 @@ int main()
 	// Run incremental reads in a thread so the read does not block the main thread
 	flt1.StartIncrementalReadThreads(1);
 	RakNet::FileList fileList;
-	RakNet::IncrementalReadInterface incrementalReadInterface;
+	RakNet::CachedIncrementalReadInterface incrementalReadInterface;
 	printf("Enter complete filename with path to test:\n");
 	char str[256];
 	Gets(str, sizeof(str));
@@ -0,0 +1,210 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Turns the files written by PacketBinaryLogger into the text PacketFileLogger writes
+// Usage: PacketLogDecoder [-o output.csv] file.rpl [file.rpl ...]
+
+#include "PacketBinaryLogger.h"
+#include "DS_List.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+using namespace RakNet;
+
+// Formats lines with PacketLogger, taking the Clock column from the record being decoded
+class DecodingLogger : public PacketLogger
+{
+public:
+	DecodingLogger() {outputFile=stdout; clockUS=0;}
+	virtual void WriteLog(const char *str) {fprintf(outputFile, "%s\n", str);}
+
+	void DecodeRecord(const PacketLogRecord &record)
+	{
+		static const char *sendTypes[] =
+		{
+			"Rcv",
+			"Snd",
+			"Err1",
+			"Err2",
+			"Err3",
+			"Err4",
+			"Err5",
+			"Err6",
+		};
+
+		char str[1024];
+		char text[sizeof(record.text)+1];
+		SystemAddress local=record.local.Get();
+		SystemAddress remote=record.remote.Get();
+		clockUS=record.clockUS;
+
+		switch (record.type)
+		{
+		case PLRT_DIRECT_SEND:
+		case PLRT_DIRECT_RECEIVE:
+			FormatLine(str, record.type==PLRT_DIRECT_SEND ? "Snd" : "Rcv", "Raw", 0, 0, record.messageId, record.bitLength, record.time, local, remote, (unsigned int)-1,(unsigned int)-1,(unsigned int)-1,(unsigned int)-1);
+			break;
+		case PLRT_RELIABILITY_ERROR:
+		case PLRT_RELIABILITY_WARNING:
+			memcpy(text, record.text, sizeof(record.text));
+			text[sizeof(record.text)]=0;
+			FormatLine(str, record.type==PLRT_RELIABILITY_ERROR ? "RcvErr" : "RcvWrn", text, 0, 0, "", record.bitLength, record.time, local, remote, (unsigned int)-1,(unsigned int)-1,(unsigned int)-1,(unsigned int)-1);
+			break;
+		case PLRT_INTERNAL_PACKET:
+		case PLRT_INTERNAL_PACKET_TIMESTAMP:
+			FormatLine(str, sendTypes[record.direction & 7], record.type==PLRT_INTERNAL_PACKET_TIMESTAMP ? "Tms" : "Nrm", record.reliableMessageNumber, record.frame, record.messageId, record.bitLength, record.time, local, remote,
+				record.packet.splitPacketId, record.packet.splitPacketIndex, record.packet.splitPacketCount, record.packet.orderingIndex);
+			break;
+		case PLRT_ACK:
+			FormatAckLine(str, sizeof(str), record.reliableMessageNumber, record.time, local, remote);
+			break;
+		case PLRT_PUSH_BACK_PACKET:
+			FormatPushBackPacketLine(str, sizeof(str), record.messageId, record.bitLength, record.time, local, remote);
+			break;
+		case PLRT_MISCELLANEOUS:
+			// Type and message, each null terminated
+			memcpy(text, record.text, sizeof(record.text));
+			text[sizeof(record.text)]=0;
+			FormatMiscellaneousLine(str, sizeof(str), text, text+strlen(text)+1, record.time, local);
+			break;
+		case PLRT_DROPPED:
+			sprintf(text, "%u records lost", record.bitLength);
+			FormatMiscellaneousLine(str, sizeof(str), "Dropped", text, record.time, local);
+			break;
+		default:
+			sprintf(str, "Unknown record type %i", record.type);
+			break;
+		}
+		AddToLog(str);
+	}
+
+	FILE *outputFile;
+
+protected:
+	virtual void GetLocalTime(char buffer[128])
+	{
+		time_t rawtime=(time_t) (clockUS/1000000);
+		struct tm *timeinfo=localtime(&rawtime);
+		if (timeinfo==0)
+		{
+			buffer[0]=0;
+			return;
+		}
+		strftime(buffer, 128, "%x %X", timeinfo);
+		char buff[32];
+		sprintf(buff, ".%i", (int) (clockUS%1000000));
+		strcat(buffer, buff);
+	}
+
+	unsigned long long clockUS;
+};
+
+struct LogFile
+{
+	const char *filename;
+	FILE *fp;
+	PacketLogFileHeader header;
+};
+
+static bool ReadHeader(LogFile &logFile)
+{
+	logFile.fp=fopen(logFile.filename, "rb");
+	if (logFile.fp==0)
+	{
+		printf("Cannot open %s\n", logFile.filename);
+		return false;
+	}
+	if (fread(&logFile.header, sizeof(logFile.header), 1, logFile.fp)!=1 || memcmp(logFile.header.magic, PACKET_LOG_FILE_MAGIC, sizeof(PACKET_LOG_FILE_MAGIC))!=0)
+	{
+		printf("%s is not a packet log\n", logFile.filename);
+		return false;
+	}
+	if (logFile.header.version!=PACKET_LOG_FILE_VERSION || logFile.header.recordLength!=sizeof(PacketLogRecord))
+	{
+		printf("%s was written by a different version of PacketBinaryLogger, or on a machine of different endianness\n", logFile.filename);
+		return false;
+	}
+	logFile.header.prefix[sizeof(logFile.header.prefix)-1]=0;
+	logFile.header.suffix[sizeof(logFile.header.suffix)-1]=0;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	DataStructures::List<LogFile> logFiles;
+	const char *outputFilename=0;
+	for (int i=1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-o")==0 && i+1 < argc)
+		{
+			outputFilename=argv[++i];
+			continue;
+		}
+
+		LogFile logFile;
+		logFile.filename=argv[i];
+		if (ReadHeader(logFile)==false)
+		{
+			if (logFile.fp)
+				fclose(logFile.fp);
+			continue;
+		}
+
+		// Decode in the order the files were written
+		unsigned int index=0;
+		while (index < logFiles.Size() && logFiles[index].header.fileIndex <= logFile.header.fileIndex)
+			index++;
+		logFiles.Insert(logFile, index, _FILE_AND_LINE_);
+	}
+
+	if (logFiles.Size()==0)
+	{
+		printf("Usage: PacketLogDecoder [-o output.csv] file.rpl [file.rpl ...]\n");
+		return 1;
+	}
+
+	DecodingLogger decoder;
+	if (outputFilename)
+	{
+		decoder.outputFile=fopen(outputFilename, "wt");
+		if (decoder.outputFile==0)
+		{
+			printf("Cannot open %s\n", outputFilename);
+			return 1;
+		}
+	}
+
+	decoder.LogHeader();
+	unsigned int recordCount=0;
+	for (unsigned int i=0; i < logFiles.Size(); i++)
+	{
+		decoder.SetPrintID(logFiles[i].header.printId!=0);
+		decoder.SetPrefix(logFiles[i].header.prefix);
+		decoder.SetSuffix(logFiles[i].header.suffix);
+
+		PacketLogRecord records[256];
+		size_t count;
+		while ((count=fread(records, sizeof(PacketLogRecord), 256, logFiles[i].fp)) > 0)
+		{
+			for (size_t j=0; j < count; j++)
+				decoder.DecodeRecord(records[j]);
+			recordCount+=(unsigned int) count;
+		}
+		fclose(logFiles[i].fp);
+	}
+
+	if (outputFilename)
+	{
+		fclose(decoder.outputFile);
+		printf("Decoded %u records from %u files to %s\n", recordCount, logFiles.Size(), outputFilename);
+	}
+	return 0;
+}
@@ -0,0 +1,188 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Compares RPC4 sending each identifier as a string with sending a number in its place (RPC4::SetInternIdentifiers()).
+// A client on the loopback address calls a slot and a function on a server many times with a small payload, as a game sends position updates.
+// Reports the bytes the client sends per call and how long the server spends in Receive() per call, which includes finding the function.
+
+#include "RakPeerInterface.h"
+#include "RPC4Plugin.h"
+#include "MessageIdentifiers.h"
+#include "BitStream.h"
+#include "RakSleep.h"
+#include "GetTime.h"
+#include "RakNetStatistics.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace RakNet;
+
+static unsigned int slotCalls, functionCalls, badPayloads;
+
+static void PlayerMovedSlot(RakNet::BitStream *userData, Packet *packet)
+{
+	(void) packet;
+	float x=0, y=0, z=0;
+	userData->Read(x);
+	userData->Read(y);
+	userData->Read(z);
+	if (x!=1.0f || y!=2.0f || z!=(float) (slotCalls % 1000))
+		badPayloads++;
+	slotCalls++;
+}
+static void SetPlayerHealthFunction(RakNet::BitStream *userData, Packet *packet)
+{
+	(void) packet;
+	unsigned short health=0;
+	userData->Read(health);
+	if (health!=100)
+		badPayloads++;
+	functionCalls++;
+}
+
+struct RunResult
+{
+	double bytesPerCall;
+	double serverNsPerCall;
+	bool allReceived;
+};
+
+static RunResult Run(bool internIdentifiers, unsigned int callsPerRun)
+{
+	RunResult result={0,0,false};
+	RakPeerInterface *server=RakPeerInterface::GetInstance();
+	RakPeerInterface *client=RakPeerInterface::GetInstance();
+	RPC4 serverRpc, clientRpc;
+	server->AttachPlugin(&serverRpc);
+	client->AttachPlugin(&clientRpc);
+	clientRpc.SetInternIdentifiers(internIdentifiers);
+	serverRpc.RegisterSlot("OnPlayerMovedWithinTheCurrentLevel", PlayerMovedSlot, 0);
+	serverRpc.RegisterFunction("SetPlayerHealth", SetPlayerHealthFunction);
+
+	SocketDescriptor serverSocket(0,"127.0.0.1"), clientSocket(0,"127.0.0.1");
+	server->Startup(1,&serverSocket,1);
+	server->SetMaximumIncomingConnections(1);
+	client->Startup(1,&clientSocket,1);
+	client->Connect("127.0.0.1",server->GetMyBoundAddress().GetPort(),0,0);
+
+	Packet *packet;
+	bool connected=false;
+	TimeMS endTime=GetTimeMS()+5000;
+	while (connected==false && GetTimeMS() < endTime)
+	{
+		for (packet=client->Receive(); packet; client->DeallocatePacket(packet), packet=client->Receive())
+		{
+			if (packet->data[0]==ID_CONNECTION_REQUEST_ACCEPTED)
+				connected=true;
+		}
+		for (packet=server->Receive(); packet; server->DeallocatePacket(packet), packet=server->Receive())
+			;
+		RakSleep(1);
+	}
+	if (connected==false)
+	{
+		printf("Failed to connect\n");
+		RakPeerInterface::DestroyInstance(client);
+		RakPeerInterface::DestroyInstance(server);
+		return result;
+	}
+
+	// The server's RPC4 announces that it reads numbers once it gets a message from the client. Let that arrive before measuring
+	RakNet::BitStream firstPosition;
+	firstPosition.Write(0.0f);
+	firstPosition.Write(0.0f);
+	firstPosition.Write(0.0f);
+	clientRpc.Signal("OnPlayerMovedWithinTheCurrentLevel", &firstPosition, HIGH_PRIORITY, RELIABLE_ORDERED, 0, server->GetMyGUID(), false, false);
+	endTime=GetTimeMS()+100;
+	while (GetTimeMS() < endTime)
+	{
+		for (packet=server->Receive(); packet; server->DeallocatePacket(packet), packet=server->Receive())
+			;
+		for (packet=client->Receive(); packet; client->DeallocatePacket(packet), packet=client->Receive())
+			;
+		RakSleep(1);
+	}
+
+	slotCalls=0;
+	functionCalls=0;
+	badPayloads=0;
+	RakNetStatistics statistics;
+	client->GetStatistics(0, &statistics);
+	uint64_t bytesBefore=statistics.runningTotal[USER_MESSAGE_BYTES_PUSHED];
+
+	// Send in bursts, letting both sides run between them, so the client picks up acknowledgements as a real game would
+	TimeUS serverReceiveUS=0;
+	unsigned int sent=0;
+	const unsigned int callsPerBurst=200;
+	endTime=GetTimeMS()+60000;
+	while ((slotCalls < callsPerRun || functionCalls < callsPerRun/4) && GetTimeMS() < endTime)
+	{
+		for (unsigned int i=0; i < callsPerBurst && sent < callsPerRun; i++, sent++)
+		{
+			RakNet::BitStream position;
+			position.Write(1.0f);
+			position.Write(2.0f);
+			position.Write((float) (sent % 1000));
+			clientRpc.Signal("OnPlayerMovedWithinTheCurrentLevel", &position, HIGH_PRIORITY, RELIABLE_ORDERED, 0, server->GetMyGUID(), false, false);
+			if ((sent % 4)==0)
+			{
+				RakNet::BitStream health;
+				health.Write((unsigned short) 100);
+				clientRpc.Call("SetPlayerHealth", &health, HIGH_PRIORITY, RELIABLE_ORDERED, 0, server->GetMyGUID(), false);
+			}
+		}
+
+		RakSleep(0);
+		TimeUS startTime=GetTimeUS();
+		for (packet=server->Receive(); packet; server->DeallocatePacket(packet), packet=server->Receive())
+			;
+		serverReceiveUS+=GetTimeUS()-startTime;
+		for (packet=client->Receive(); packet; client->DeallocatePacket(packet), packet=client->Receive())
+			;
+	}
+
+	client->GetStatistics(0, &statistics);
+	unsigned int totalCalls=callsPerRun+callsPerRun/4;
+	result.bytesPerCall=(double) (statistics.runningTotal[USER_MESSAGE_BYTES_PUSHED]-bytesBefore)/totalCalls;
+	result.serverNsPerCall=serverReceiveUS*1000.0/totalCalls;
+	result.allReceived=slotCalls==callsPerRun && functionCalls==callsPerRun/4 && badPayloads==0;
+
+	client->Shutdown(100);
+	server->Shutdown(100);
+	server->DetachPlugin(&serverRpc);
+	client->DetachPlugin(&clientRpc);
+	RakPeerInterface::DestroyInstance(client);
+	RakPeerInterface::DestroyInstance(server);
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int callsPerRun=100000;
+	if (argc>1)
+		callsPerRun=(unsigned int) atoi(argv[1]);
+	if (callsPerRun < 4)
+		callsPerRun=4;
+
+	printf("Usage: RPC4Benchmark [signals]\n");
+	printf("Each run sends %u signals and %u calls from a client to a server on this computer.\n\n", callsPerRun, callsPerRun/4);
+	printf("%-12s %14s %18s %10s\n", "Identifiers", "Bytes/call", "Server ns/call", "Received");
+
+	bool allReceived=true;
+	for (int run=0; run < 2; run++)
+	{
+		bool internIdentifiers=run==1;
+		RunResult result=Run(internIdentifiers, callsPerRun);
+		printf("%-12s %14.1f %18.1f %10s\n", internIdentifiers ? "Numbers" : "Strings", result.bytesPerCall, result.serverNsPerCall, result.allReceived ? "All" : "MISSING");
+		allReceived=allReceived && result.allReceived;
+	}
+
+	return allReceived ? 0 : 1;
+}
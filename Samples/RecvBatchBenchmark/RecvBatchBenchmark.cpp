@@ -0,0 +1,200 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Measures how many datagrams per second one core of the RNS2_Berkley recv thread can process,
+// reading one datagram per recvfrom() versus several per recvmmsg() (RNS2_BerkleyBindParameters::recvBatchSize)
+
+#include "RakNetSocket2.h"
+#include "RakThread.h"
+#include "RakSleep.h"
+#include "GetTime.h"
+#include "DS_Queue.h"
+#include "LocklessTypes.h"
+#include "RakMemoryOverride.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace RakNet;
+
+#if RAKNET_SUPPORT_RECVMMSG==1
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static const int DATAGRAM_SIZE=64;
+static const int NUM_SENDER_THREADS=2;
+
+// All callbacks come from the single recv thread, so no locking is needed
+class CountingEventHandler : public RNS2EventHandler
+{
+public:
+	CountingEventHandler() {recvThreadClockKnown=false;}
+	virtual ~CountingEventHandler()
+	{
+		while (freePool.Size())
+			RakNet::OP_DELETE(freePool.Pop(), _FILE_AND_LINE_);
+	}
+	virtual void OnRNS2Recv(RNS2RecvStruct *recvStruct)
+	{
+		if (recvThreadClockKnown==false)
+		{
+			pthread_getcpuclockid(pthread_self(), &recvThreadClock);
+			recvThreadClockKnown=true;
+		}
+		datagramsReceived.Increment();
+		DeallocRNS2RecvStruct(recvStruct, _FILE_AND_LINE_);
+	}
+	virtual void DeallocRNS2RecvStruct(RNS2RecvStruct *s, const char *file, unsigned int line)
+	{
+		freePool.Push(s, file, line);
+	}
+	virtual RNS2RecvStruct *AllocRNS2RecvStruct(const char *file, unsigned int line)
+	{
+		if (freePool.Size())
+			return freePool.Pop();
+		return RakNet::OP_NEW<RNS2RecvStruct>(file,line);
+	}
+
+	// Recv thread CPU time in microseconds, or 0 if no datagram has arrived yet
+	RakNet::TimeUS GetRecvThreadCPUTime(void) const
+	{
+		if (recvThreadClockKnown==false)
+			return 0;
+		timespec ts;
+		clock_gettime(recvThreadClock, &ts);
+		return (RakNet::TimeUS) ts.tv_sec*1000000+(RakNet::TimeUS) ts.tv_nsec/1000;
+	}
+
+	RakNet::LocklessUint32_t datagramsReceived;
+	volatile bool recvThreadClockKnown;
+	clockid_t recvThreadClock;
+	DataStructures::Queue<RNS2RecvStruct*> freePool;
+};
+
+struct SenderContext
+{
+	unsigned short port;
+	volatile bool endThreads;
+	RakNet::LocklessUint32_t activeThreads;
+};
+
+RAK_THREAD_DECLARATION(SenderThread)
+{
+	SenderContext *context = (SenderContext *) arguments;
+	context->activeThreads.Increment();
+
+	int s = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in sa;
+	memset(&sa,0,sizeof(sa));
+	sa.sin_family=AF_INET;
+	sa.sin_port=htons(context->port);
+	sa.sin_addr.s_addr=inet_addr("127.0.0.1");
+	char data[DATAGRAM_SIZE];
+	memset(data,0,sizeof(data));
+	while (context->endThreads==false)
+		sendto(s, data, sizeof(data), 0, (const sockaddr*) &sa, sizeof(sa));
+	close(s);
+
+	context->activeThreads.Decrement();
+	return 0;
+}
+
+static void RunTrial(unsigned int recvBatchSize, RakNet::TimeMS durationMS)
+{
+	CountingEventHandler eventHandler;
+	RNS2_Berkley *rns2 = (RNS2_Berkley *) RakNetSocket2Allocator::AllocRNS2();
+
+	RNS2_BerkleyBindParameters bbp;
+	bbp.port=0;
+	bbp.hostAddress=(char*) "127.0.0.1";
+	bbp.addressFamily=AF_INET;
+	bbp.type=SOCK_DGRAM;
+	bbp.protocol=0;
+	bbp.nonBlockingSocket=false;
+	bbp.setBroadcast=false;
+	bbp.setIPHdrIncl=false;
+	bbp.doNotFragment=false;
+	bbp.pollingThreadPriority=0;
+	bbp.eventHandler=&eventHandler;
+	bbp.remotePortRakNetWasStartedOn_PS3_PS4_PSP2=0;
+	bbp.recvBatchSize=recvBatchSize;
+	bbp.reusePort=false;
+	bbp.recvThreadCpu=-1;
+	if (rns2->Bind(&bbp, _FILE_AND_LINE_)!=BR_SUCCESS)
+	{
+		printf("Bind failed\n");
+		RakNetSocket2Allocator::DeallocRNS2(rns2);
+		return;
+	}
+	rns2->CreateRecvPollingThread(0);
+
+	SenderContext context;
+	context.port=rns2->GetBoundAddress().GetPort();
+	context.endThreads=false;
+	for (int i=0; i < NUM_SENDER_THREADS; i++)
+		RakThread::Create(SenderThread, &context);
+
+	// Warm up, then measure over the given window
+	RakSleep(500);
+	uint32_t countStart = eventHandler.datagramsReceived.GetValue();
+	RakNet::TimeUS cpuStart = eventHandler.GetRecvThreadCPUTime();
+	RakNet::TimeUS wallStart = RakNet::GetTimeUS();
+	RakSleep(durationMS);
+	uint32_t countEnd = eventHandler.datagramsReceived.GetValue();
+	RakNet::TimeUS cpuEnd = eventHandler.GetRecvThreadCPUTime();
+	RakNet::TimeUS wallEnd = RakNet::GetTimeUS();
+
+	context.endThreads=true;
+	while (context.activeThreads.GetValue()>0)
+		RakSleep(10);
+	rns2->BlockOnStopRecvPollingThread();
+	RakNetSocket2Allocator::DeallocRNS2(rns2);
+
+	double datagrams = (double) (countEnd-countStart);
+	double wallSeconds = (double) (wallEnd-wallStart) / 1000000.0;
+	double cpuSeconds = (double) (cpuEnd-cpuStart) / 1000000.0;
+	printf("%10u %14.0f %12.1f%% %20.0f\n",
+		recvBatchSize,
+		datagrams / wallSeconds,
+		100.0 * cpuSeconds / wallSeconds,
+		cpuSeconds > 0.0 ? datagrams / cpuSeconds : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+	RakNet::TimeMS durationMS=3000;
+	if (argc>1)
+		durationMS=(RakNet::TimeMS) atoi(argv[1]);
+
+	printf("Receives %i byte datagrams on 127.0.0.1 from %i sender threads for %u ms per trial.\n", DATAGRAM_SIZE, NUM_SENDER_THREADS, (unsigned int) durationMS);
+	printf("Batch size 1 is the recvfrom() path. Larger sizes use recvmmsg().\n\n");
+	printf("%10s %14s %13s %20s\n", "BatchSize", "Datagrams/s", "RecvThreadCPU", "Datagrams/s/core");
+
+	const unsigned int batchSizes[] = {1, 8, 32, 64};
+	for (unsigned int i=0; i < sizeof(batchSizes)/sizeof(batchSizes[0]); i++)
+		RunTrial(batchSizes[i], durationMS);
+
+	return 0;
+}
+
+#else
+
+int main(void)
+{
+	printf("recvmmsg is not supported on this platform (RAKNET_SUPPORT_RECVMMSG is 0).\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Checks ReplicaManager3::SetAreaOfInterest() over loopback.
+// The server has replicas along a line and a view radius on its connection to the client. As the view moves, the client should get exactly the
+// replicas within the radius, lose those past the radius plus the hysteresis, and get everything again after DisableAreaOfInterest().
+// The client also creates a replica out of view, which the server downloads from it and must not construct back to it.
+
+#include "ReplicaManager3.h"
+#include "RakPeerInterface.h"
+#include "NetworkIDManager.h"
+#include "MessageIdentifiers.h"
+#include "RakSleep.h"
+#include "GetTime.h"
+#include <stdio.h>
+
+using namespace RakNet;
+
+static const unsigned short SERVER_PORT=61235;
+static const float VIEW_RADIUS=10.0f;
+static const float HYSTERESIS=5.0f;
+
+// Where the server's connection to the client views the world from
+static float viewX=0.0f;
+static ReplicaManager3 *serverReplicaManager=0;
+
+class PositionedReplica : public Replica3
+{
+public:
+	PositionedReplica() {x=0; y=0;}
+	virtual void WriteAllocationID(RakNet::Connection_RM3 *destinationConnection, RakNet::BitStream *allocationIdBitstream) const {
+		(void) destinationConnection;
+		allocationIdBitstream->Write(RakString("PositionedReplica"));
+	}
+	virtual RM3ConstructionState QueryConstruction(RakNet::Connection_RM3 *destinationConnection, ReplicaManager3 *replicaManager3) {
+		return QueryConstruction_ClientConstruction(destinationConnection, replicaManager3==serverReplicaManager);
+	}
+	virtual bool QueryRemoteConstruction(RakNet::Connection_RM3 *sourceConnection) {
+		return QueryRemoteConstruction_ClientConstruction(sourceConnection, replicaManager==serverReplicaManager);
+	}
+	virtual void SerializeConstruction(RakNet::BitStream *constructionBitstream, RakNet::Connection_RM3 *destinationConnection) {
+		(void) destinationConnection;
+		constructionBitstream->Write(x);
+		constructionBitstream->Write(y);
+	}
+	virtual bool DeserializeConstruction(RakNet::BitStream *constructionBitstream, RakNet::Connection_RM3 *sourceConnection) {
+		(void) sourceConnection;
+		return constructionBitstream->Read(x) && constructionBitstream->Read(y);
+	}
+	virtual void SerializeDestruction(RakNet::BitStream *destructionBitstream, RakNet::Connection_RM3 *destinationConnection) {(void) destructionBitstream; (void) destinationConnection;}
+	virtual bool DeserializeDestruction(RakNet::BitStream *destructionBitstream, RakNet::Connection_RM3 *sourceConnection) {(void) destructionBitstream; (void) sourceConnection; return true;}
+	virtual RakNet::RM3ActionOnPopConnection QueryActionOnPopConnection(RakNet::Connection_RM3 *droppedConnection) const {
+		if (replicaManager==serverReplicaManager)
+			return QueryActionOnPopConnection_Server(droppedConnection);
+		return QueryActionOnPopConnection_Client(droppedConnection);
+	}
+	virtual void DeallocReplica(RakNet::Connection_RM3 *sourceConnection) {(void) sourceConnection; delete this;}
+	virtual RakNet::RM3QuerySerializationResult QuerySerialization(RakNet::Connection_RM3 *destinationConnection) {(void) destinationConnection; return RM3QSR_NEVER_CALL_SERIALIZE;}
+	virtual RM3SerializationResult Serialize(RakNet::SerializeParameters *serializeParameters) {(void) serializeParameters; return RM3SR_DO_NOT_SERIALIZE;}
+	virtual void Deserialize(RakNet::DeserializeParameters *deserializeParameters) {(void) deserializeParameters;}
+	virtual bool QueryAreaOfInterestPosition(float *_x, float *_y) {*_x=x; *_y=y; return true;}
+
+	float x, y;
+};
+
+class ViewConnection : public Connection_RM3
+{
+public:
+	ViewConnection(const SystemAddress &_systemAddress, RakNetGUID _guid) : Connection_RM3(_systemAddress, _guid) {}
+	virtual Replica3 *AllocReplica(RakNet::BitStream *allocationId, ReplicaManager3 *replicaManager3) {
+		(void) replicaManager3;
+		RakString typeName;
+		allocationId->Read(typeName);
+		if (typeName=="PositionedReplica")
+			return new PositionedReplica;
+		return 0;
+	}
+	virtual bool QueryViewPosition(float *x, float *y) {*x=viewX; *y=0.0f; return true;}
+};
+
+class AreaOfInterestReplicaManager : public ReplicaManager3
+{
+public:
+	AreaOfInterestReplicaManager(bool _isServer) : isServer(_isServer) {}
+	virtual Connection_RM3* AllocConnection(const SystemAddress &systemAddress, RakNetGUID rakNetGUID) const {
+		ViewConnection *connection = new ViewConnection(systemAddress, rakNetGUID);
+		if (isServer)
+			connection->SetViewRadius(VIEW_RADIUS);
+		return connection;
+	}
+	virtual void DeallocConnection(Connection_RM3 *connection) const {delete connection;}
+	bool isServer;
+};
+
+static void RunFor(RakPeerInterface *server, RakPeerInterface *client, RakNet::TimeMS duration)
+{
+	RakNet::TimeMS end = RakNet::GetTimeMS()+duration;
+	while (RakNet::GetTimeMS() < end)
+	{
+		Packet *packet;
+		for (packet=server->Receive(); packet; server->DeallocatePacket(packet), packet=server->Receive())
+			;
+		for (packet=client->Receive(); packet; client->DeallocatePacket(packet), packet=client->Receive())
+			;
+		RakSleep(10);
+	}
+}
+
+static int Check(const char *step, unsigned int got, unsigned int expected)
+{
+	printf("%-60s %u (expected %u)\n", step, got, expected);
+	return got==expected ? 0 : 1;
+}
+
+int main(void)
+{
+	int failures=0;
+
+	RakPeerInterface *server=RakPeerInterface::GetInstance();
+	RakPeerInterface *client=RakPeerInterface::GetInstance();
+	NetworkIDManager serverNetworkIdManager, clientNetworkIdManager;
+	AreaOfInterestReplicaManager serverRM3(true), clientRM3(false);
+	serverReplicaManager=&serverRM3;
+	server->AttachPlugin(&serverRM3);
+	client->AttachPlugin(&clientRM3);
+	serverRM3.SetNetworkIDManager(&serverNetworkIdManager);
+	clientRM3.SetNetworkIDManager(&clientNetworkIdManager);
+
+	SocketDescriptor serverSocket(SERVER_PORT, 0), clientSocket;
+	serverSocket.socketFamily=AF_INET;
+	clientSocket.socketFamily=AF_INET;
+	if (server->Startup(1, &serverSocket, 1)!=RAKNET_STARTED || client->Startup(1, &clientSocket, 1)!=RAKNET_STARTED)
+	{
+		printf("Startup failed\n");
+		return 1;
+	}
+	server->SetMaximumIncomingConnections(1);
+
+	// Cells the size of the view radius, over a world wider than every position used
+	serverRM3.SetAreaOfInterest(VIEW_RADIUS, -200.0f, -200.0f, 200.0f, 200.0f, HYSTERESIS);
+	const float positions[]={0.0f, 5.0f, 20.0f, 40.0f};
+	for (unsigned int i=0; i < sizeof(positions)/sizeof(positions[0]); i++)
+	{
+		PositionedReplica *replica = new PositionedReplica;
+		replica->x=positions[i];
+		serverRM3.Reference(replica);
+	}
+
+	viewX=0.0f;
+	client->Connect("127.0.0.1", SERVER_PORT, 0, 0);
+	RunFor(server, client, 1500);
+	failures+=Check("View at 0: replicas at 0 and 5", clientRM3.GetReplicaCount(), 2);
+
+	viewX=40.0f;
+	RunFor(server, client, 500);
+	failures+=Check("View at 40: only the replica at 40", clientRM3.GetReplicaCount(), 1);
+
+	// The replica at 40 is now past the radius plus the hysteresis
+	viewX=2.0f;
+	RunFor(server, client, 500);
+	failures+=Check("View at 2: replicas at 0 and 5 again", clientRM3.GetReplicaCount(), 2);
+
+	// The replica at 0 is past the radius but within the hysteresis, so is kept
+	viewX=13.0f;
+	RunFor(server, client, 500);
+	failures+=Check("View at 13: replica at 0 kept, 5 and 20", clientRM3.GetReplicaCount(), 3);
+
+	viewX=16.0f;
+	RunFor(server, client, 500);
+	failures+=Check("View at 16: replicas at 5 and 20", clientRM3.GetReplicaCount(), 2);
+
+	// A replica the client creates out of view is downloaded by the server, which must not send it back
+	PositionedReplica *clientReplica = new PositionedReplica;
+	clientReplica->x=100.0f;
+	clientRM3.Reference(clientReplica);
+	RunFor(server, client, 500);
+	failures+=Check("Client replica at 100: server has it", serverRM3.GetReplicaCount(), 5);
+	viewX=100.0f;
+	RunFor(server, client, 500);
+	failures+=Check("View at 100: only the client's own replica", clientRM3.GetReplicaCount(), 1);
+	viewX=0.0f;
+	RunFor(server, client, 500);
+	failures+=Check("View at 0: client's replica and replicas at 0 and 5", clientRM3.GetReplicaCount(), 3);
+
+	serverRM3.DisableAreaOfInterest();
+	RunFor(server, client, 500);
+	failures+=Check("Area of interest disabled: everything", clientRM3.GetReplicaCount(), 5);
+
+	// Each system owns the replicas it created. Downloaded copies go away with the connection
+	ReplicaManager3 *replicaManagers[2]={&clientRM3, &serverRM3};
+	for (unsigned int i=0; i < 2; i++)
+	{
+		DataStructures::List<Replica3*> replicaListOut;
+		replicaManagers[i]->GetReplicasCreatedByMe(replicaListOut);
+		for (unsigned int j=0; j < replicaListOut.Size(); j++)
+			delete replicaListOut[j];
+	}
+
+	client->Shutdown(100);
+	server->Shutdown(100);
+	clientRM3.Clear(true);
+	serverRM3.Clear(true);
+	RakPeerInterface::DestroyInstance(client);
+	RakPeerInterface::DestroyInstance(server);
+
+	if (failures==0)
+		printf("Test passed\n");
+	else
+		printf("Test FAILED\n");
+	return failures==0 ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Measures how many secure connections per second one RakPeer accepts when many clients connect at once,
+// with the key agreement on the update thread or on handshake threads (RakPeer::SetNumberOfHandshakeThreads())
+// Also measures the worst delay the storm adds to messages from a client that was already connected
+
+#include "RakPeerInterface.h"
+#include "MessageIdentifiers.h"
+#include "NativeFeatureIncludes.h"
+#include "RakSleep.h"
+#include "GetTime.h"
+#include "BitStream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#if LIBCAT_SECURITY==1
+#include "SecureHandshake.h"
+
+using namespace RakNet;
+
+static const unsigned short SERVER_PORT=60124;
+
+static char publicKey[cat::EasyHandshake::PUBLIC_KEY_BYTES];
+static char privateKey[cat::EasyHandshake::PRIVATE_KEY_BYTES];
+
+// Sends a timestamped message from the client that connected before the storm
+static void SendProbe(RakPeerInterface *probe)
+{
+	RakNet::BitStream bs;
+	bs.Write((MessageID) ID_USER_PACKET_ENUM);
+	bs.Write(RakNet::GetTimeUS());
+	probe->Send(&bs, HIGH_PRIORITY, RELIABLE_ORDERED, 0, UNASSIGNED_SYSTEM_ADDRESS, true);
+}
+
+static void RunTrial(unsigned int numberOfHandshakeThreads, unsigned int numberOfClients, unsigned int maxPendingHandshakes)
+{
+	RakPeerInterface *server=RakPeerInterface::GetInstance();
+	server->InitializeSecurity(publicKey, privateKey, false);
+	server->SetNumberOfHandshakeThreads(numberOfHandshakeThreads, maxPendingHandshakes);
+	SocketDescriptor sd(SERVER_PORT, "127.0.0.1");
+	if (server->Startup(numberOfClients+1, &sd, 1)!=RAKNET_STARTED)
+	{
+		printf("Server startup failed\n");
+		RakPeerInterface::DestroyInstance(server);
+		return;
+	}
+	server->SetMaximumIncomingConnections((unsigned short) (numberOfClients+1));
+
+	PublicKey pk;
+	pk.remoteServerPublicKey=publicKey;
+	pk.publicKeyMode=PKM_USE_KNOWN_PUBLIC_KEY;
+
+	// Connect the probe before the storm
+	RakPeerInterface *probe=RakPeerInterface::GetInstance();
+	SocketDescriptor probeSd(0, "127.0.0.1");
+	probe->Startup(1, &probeSd, 1);
+	probe->Connect("127.0.0.1", SERVER_PORT, 0, 0, &pk);
+	bool probeConnected=false;
+	RakNet::TimeMS giveUp=RakNet::GetTimeMS()+5000;
+	while (probeConnected==false && RakNet::GetTimeMS() < giveUp)
+	{
+		for (Packet *p=server->Receive(); p; server->DeallocatePacket(p), p=server->Receive())
+		{
+			if (p->data[0]==ID_NEW_INCOMING_CONNECTION)
+				probeConnected=true;
+		}
+		RakSleep(1);
+	}
+	if (probeConnected==false)
+	{
+		printf("%16u: probe client did not connect\n", numberOfHandshakeThreads);
+		RakPeerInterface::DestroyInstance(probe);
+		RakPeerInterface::DestroyInstance(server);
+		return;
+	}
+
+	RakPeerInterface **clients = new RakPeerInterface*[numberOfClients];
+	unsigned int i;
+	for (i=0; i < numberOfClients; i++)
+	{
+		clients[i]=RakPeerInterface::GetInstance();
+		SocketDescriptor clientSd(0, "127.0.0.1");
+		clients[i]->Startup(1, &clientSd, 1);
+	}
+
+	RakNet::TimeUS startTime=RakNet::GetTimeUS();
+	for (i=0; i < numberOfClients; i++)
+		clients[i]->Connect("127.0.0.1", SERVER_PORT, 0, 0, &pk);
+
+	unsigned int connected=0;
+	unsigned int maxPending=0;
+	RakNet::TimeUS maxProbeDelay=0;
+	RakNet::TimeUS lastConnectTime=startTime;
+	giveUp=RakNet::GetTimeMS()+30000;
+	while (connected < numberOfClients && RakNet::GetTimeMS() < giveUp)
+	{
+		SendProbe(probe);
+		for (Packet *p=server->Receive(); p; server->DeallocatePacket(p), p=server->Receive())
+		{
+			if (p->data[0]==ID_NEW_INCOMING_CONNECTION)
+			{
+				connected++;
+				lastConnectTime=RakNet::GetTimeUS();
+			}
+			else if (p->data[0]==ID_USER_PACKET_ENUM)
+			{
+				RakNet::BitStream bs(p->data, p->length, false);
+				bs.IgnoreBytes(sizeof(MessageID));
+				RakNet::TimeUS sendTime;
+				bs.Read(sendTime);
+				RakNet::TimeUS delay=RakNet::GetTimeUS()-sendTime;
+				if (delay > maxProbeDelay)
+					maxProbeDelay=delay;
+			}
+		}
+		if (server->GetNumberOfPendingHandshakes() > maxPending)
+			maxPending=server->GetNumberOfPendingHandshakes();
+		RakSleep(1);
+	}
+	RakNet::TimeUS elapsed=lastConnectTime-startTime;
+
+	printf("%16u %8u %10u %14.0f %11u %8u %14.2f\n",
+		numberOfHandshakeThreads,
+		numberOfClients,
+		connected,
+		elapsed > 0 ? (double) connected * 1000000.0 / (double) elapsed : 0.0,
+		maxPending,
+		(unsigned int) server->GetNumberOfDroppedHandshakes(),
+		(double) maxProbeDelay / 1000.0);
+
+	for (i=0; i < numberOfClients; i++)
+		RakPeerInterface::DestroyInstance(clients[i]);
+	delete [] clients;
+	RakPeerInterface::DestroyInstance(probe);
+	RakPeerInterface::DestroyInstance(server);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int maxHandshakeThreads=std::thread::hardware_concurrency();
+	unsigned int numberOfClients=200;
+	unsigned int maxPendingHandshakes=256;
+	if (argc>1)
+		maxHandshakeThreads=(unsigned int) atoi(argv[1]);
+	if (argc>2)
+		numberOfClients=(unsigned int) atoi(argv[2]);
+	if (argc>3)
+		maxPendingHandshakes=(unsigned int) atoi(argv[3]);
+
+	cat::EasyHandshake handshake;
+	if (!handshake.GenerateServerKey(publicKey, privateKey))
+	{
+		printf("Unable to generate server keys\n");
+		return 1;
+	}
+
+	printf("Usage: SecureHandshakeBenchmark [maxHandshakeThreads] [clients] [maxPendingHandshakes]\n");
+	printf("%u clients connect at once to one server on 127.0.0.1 with security enabled.\n", numberOfClients);
+	printf("A client connected beforehand sends a timestamped message every millisecond; ProbeDelay(ms) is the worst time one took to arrive.\n");
+	printf("The clients run in this process too and do their half of the key agreement, so leave cores free for them.\n\n");
+	printf("%16s %8s %10s %14s %11s %8s %14s\n", "HandshakeThreads", "Clients", "Connected", "Connections/s", "MaxPending", "Dropped", "ProbeDelay(ms)");
+
+	RunTrial(0, numberOfClients, maxPendingHandshakes);
+	for (unsigned int threads=1; threads <= maxHandshakeThreads; threads*=2)
+	{
+		RunTrial(threads, numberOfClients, maxPendingHandshakes);
+		if (threads < maxHandshakeThreads && threads*2 > maxHandshakeThreads)
+			RunTrial(maxHandshakeThreads, numberOfClients, maxPendingHandshakes);
+	}
+
+	return 0;
+}
+
+#else // LIBCAT_SECURITY
+
+int main(void)
+{
+	printf("Define LIBCAT_SECURITY 1 in NativeFeatureIncludesOverrides.h to run this benchmark\n");
+	return 1;
+}
+
+#endif // LIBCAT_SECURITY
@@ -0,0 +1,172 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Compares heap traffic when broadcasting with RakPeer::Send(const char*, ...), which copies the message for every destination,
+// against RakPeer::Send(SendBuffer*, ...), which shares one reference counted copy among every destination and split fragment
+
+#include "RakPeerInterface.h"
+#include "MessageIdentifiers.h"
+#include "RakSleep.h"
+#include "GetTime.h"
+#include "SendBuffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+using namespace RakNet;
+
+static const unsigned short SERVER_PORT=60124;
+
+// Every allocation made through rakMalloc_Ex, by every peer in this process
+static std::atomic<unsigned long long> bytesAllocated(0);
+static void *(*defaultMalloc_Ex)(size_t size, const char *file, unsigned int line);
+static void *CountingMalloc_Ex(size_t size, const char *file, unsigned int line)
+{
+	bytesAllocated.fetch_add(size, std::memory_order_relaxed);
+	return defaultMalloc_Ex(size, file, line);
+}
+
+static void RunTrial(bool useSendBuffer, unsigned int messageSize, unsigned int numberOfClients, unsigned int numberOfBroadcasts)
+{
+	RakPeerInterface *server=RakPeerInterface::GetInstance();
+	SocketDescriptor sd(SERVER_PORT, "127.0.0.1");
+	if (server->Startup(numberOfClients, &sd, 1)!=RAKNET_STARTED)
+	{
+		printf("Server startup failed\n");
+		RakPeerInterface::DestroyInstance(server);
+		return;
+	}
+	server->SetMaximumIncomingConnections((unsigned short) numberOfClients);
+
+	RakPeerInterface **clients = new RakPeerInterface*[numberOfClients];
+	unsigned int i;
+	for (i=0; i < numberOfClients; i++)
+	{
+		clients[i]=RakPeerInterface::GetInstance();
+		SocketDescriptor clientSd(0, "127.0.0.1");
+		clients[i]->Startup(1, &clientSd, 1);
+		clients[i]->Connect("127.0.0.1", SERVER_PORT, 0, 0);
+	}
+
+	// Wait for every client to connect
+	unsigned int connected=0;
+	RakNet::TimeMS giveUp=RakNet::GetTimeMS()+10000;
+	while (connected < numberOfClients && RakNet::GetTimeMS() < giveUp)
+	{
+		for (Packet *p=server->Receive(); p; server->DeallocatePacket(p), p=server->Receive())
+		{
+			if (p->data[0]==ID_NEW_INCOMING_CONNECTION)
+				connected++;
+		}
+		for (i=0; i < numberOfClients; i++)
+		{
+			for (Packet *p=clients[i]->Receive(); p; clients[i]->DeallocatePacket(p), p=clients[i]->Receive())
+				;
+		}
+		RakSleep(1);
+	}
+
+	if (connected==numberOfClients)
+	{
+		char *message = new char[messageSize];
+		memset(message, 0, messageSize);
+		message[0]=ID_USER_PACKET_ENUM;
+
+		unsigned long long bytesBefore=bytesAllocated.load();
+		RakNet::TimeUS startTime=RakNet::GetTimeUS();
+		for (unsigned int j=0; j < numberOfBroadcasts; j++)
+		{
+			if (useSendBuffer)
+			{
+				SendBuffer *sendBuffer=SendBuffer::Create(message, messageSize, _FILE_AND_LINE_);
+				server->Send(sendBuffer, HIGH_PRIORITY, RELIABLE_ORDERED, 0, UNASSIGNED_SYSTEM_ADDRESS, true);
+				sendBuffer->Release();
+			}
+			else
+			{
+				server->Send(message, (int) messageSize, HIGH_PRIORITY, RELIABLE_ORDERED, 0, UNASSIGNED_SYSTEM_ADDRESS, true);
+			}
+		}
+
+		unsigned int expected=numberOfClients*numberOfBroadcasts;
+		unsigned int received=0;
+		giveUp=RakNet::GetTimeMS()+60000;
+		while (received < expected && RakNet::GetTimeMS() < giveUp)
+		{
+			bool gotAny=false;
+			for (i=0; i < numberOfClients; i++)
+			{
+				for (Packet *p=clients[i]->Receive(); p; clients[i]->DeallocatePacket(p), p=clients[i]->Receive())
+				{
+					if (p->data[0]==ID_USER_PACKET_ENUM)
+						received++;
+					gotAny=true;
+				}
+			}
+			if (gotAny==false)
+				RakSleep(0);
+		}
+		RakNet::TimeUS elapsed=RakNet::GetTimeUS()-startTime;
+		unsigned long long bytesPerBroadcast=(bytesAllocated.load()-bytesBefore)/numberOfBroadcasts;
+
+		printf("%-12s %8u %8u %20llu %12.1f%s\n",
+			useSendBuffer ? "SendBuffer" : "copy",
+			messageSize,
+			numberOfClients,
+			bytesPerBroadcast,
+			(double) elapsed / 1000.0,
+			received < expected ? " (timed out)" : "");
+
+		delete [] message;
+	}
+	else
+	{
+		printf("Only %u of %u clients connected\n", connected, numberOfClients);
+	}
+
+	for (i=0; i < numberOfClients; i++)
+		RakPeerInterface::DestroyInstance(clients[i]);
+	delete [] clients;
+	RakPeerInterface::DestroyInstance(server);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int numberOfClients=32;
+	unsigned int numberOfBroadcasts=50;
+	if (argc>1)
+		numberOfClients=(unsigned int) atoi(argv[1]);
+	if (argc>2)
+		numberOfBroadcasts=(unsigned int) atoi(argv[2]);
+	if (numberOfClients==0)
+		numberOfClients=1;
+	if (numberOfBroadcasts==0)
+		numberOfBroadcasts=1;
+
+	defaultMalloc_Ex=GetMalloc_Ex();
+	SetMalloc_Ex(CountingMalloc_Ex);
+
+	printf("Usage: SendBufferBenchmark [clients] [broadcasts]\n");
+	printf("One server broadcasts %u RELIABLE_ORDERED messages to %u clients on 127.0.0.1.\n", numberOfBroadcasts, numberOfClients);
+	printf("Heap bytes counts every rakMalloc_Ex in the process, receivers included, from the first send until every client has every message.\n");
+	printf("The receive side is the same in both modes, so the difference between rows is the copying done by the sender.\n\n");
+	printf("%-12s %8s %8s %20s %12s\n", "Mode", "Bytes", "Clients", "Heap bytes/broadcast", "Total ms");
+
+	// 1000 bytes fits in one datagram, 4000 bytes is split into fragments
+	const unsigned int messageSizes[2]={1000, 4000};
+	for (int s=0; s < 2; s++)
+	{
+		RunTrial(false, messageSizes[s], numberOfClients, numberOfBroadcasts);
+		RunTrial(true, messageSizes[s], numberOfClients, numberOfBroadcasts);
+	}
+
+	return 0;
+}
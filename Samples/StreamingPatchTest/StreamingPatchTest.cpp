@@ -0,0 +1,172 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Round trip of the autopatcher's two ways of applying a patch.
+// A patch is made with CreatePatch(), then applied both in memory, as AutopatcherClient does below its streaming patch threshold,
+// and from disk to disk with ApplyPatchToFile(), as it does at or above it. Both results must match the new file.
+
+#include "AutopatcherClient.h"
+#include "ApplyPatch.h"
+#include "CreatePatch.h"
+#include "FileOperations.h"
+#include "SuperFastHash.h"
+#include "RakMemoryOverride.h"
+#include "Rand.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace RakNet;
+
+static const char *OLD_FILE_PATH="StreamingPatchTest_old.bin";
+static const char *NEW_FILE_PATH="StreamingPatchTest_new.bin";
+static const unsigned int OLD_FILE_SIZE=1024*1024;
+
+// Thresholds to pass to AutopatcherClient::SetStreamingPatchThreshold(). 0 always streams, 0xFFFFFFFF streams nothing under 4 gigabytes
+static const unsigned int thresholds[]={0, OLD_FILE_SIZE, OLD_FILE_SIZE+1, 0xFFFFFFFF};
+
+// Only the patching functions are used, not the file transfer callbacks
+class PatchOnlyCB : public AutopatcherClientCBInterface
+{
+public:
+	virtual bool OnFile(OnFileStruct *onFileStruct) {(void) onFileStruct; return true;}
+	virtual void OnFileProgress(FileProgressStruct *fps) {(void) fps;}
+};
+
+// Allocated with new [], as ApplyPatch() does
+static char *ReadWholeFile(const char *path, unsigned int *length)
+{
+	*length=GetFileLength(path);
+	FILE *fp = fopen(path, "rb");
+	if (fp==0)
+		return 0;
+	char *data = new char[*length+1];
+	size_t bytesRead = fread(data, 1, *length, fp);
+	fclose(fp);
+	if (bytesRead!=*length)
+	{
+		delete [] data;
+		return 0;
+	}
+	return data;
+}
+
+static bool Matches(const char *data, unsigned int length, const char *expected, unsigned int expectedLength)
+{
+	return data!=0 && length==expectedLength && memcmp(data, expected, length)==0;
+}
+
+int main(void)
+{
+	int failures=0;
+
+	// The old file is compressible but not uniform, like most game data. The new file changes some bytes, inserts a block and drops another
+	seedMT(12345);
+	char *oldFile = (char*) rakMalloc_Ex(OLD_FILE_SIZE, _FILE_AND_LINE_);
+	unsigned int i;
+	for (i=0; i < OLD_FILE_SIZE; i++)
+		oldFile[i] = (char) (i%251 + (randomMT()%4==0 ? randomMT()%16 : 0));
+	unsigned int newFileSize = OLD_FILE_SIZE + 4096 - 8192;
+	char *newFile = (char*) rakMalloc_Ex(newFileSize, _FILE_AND_LINE_);
+	memcpy(newFile, oldFile, 300000);
+	for (i=0; i < 4096; i++)
+		newFile[300000+i] = (char) randomMT();
+	memcpy(newFile+300000+4096, oldFile+300000, 400000);
+	memcpy(newFile+700000+4096, oldFile+700000+8192, OLD_FILE_SIZE-700000-8192);
+	for (i=0; i < 1000; i++)
+		newFile[randomMT()%newFileSize] ^= 0x55;
+
+	if (WriteFileWithDirectories(OLD_FILE_PATH, oldFile, OLD_FILE_SIZE)==false)
+	{
+		printf("Could not write %s\n", OLD_FILE_PATH);
+		return 1;
+	}
+	if (GetFileLength64(OLD_FILE_PATH)!=OLD_FILE_SIZE)
+	{
+		printf("FAILED: GetFileLength64() returned the wrong size\n");
+		failures++;
+	}
+
+	char *patch;
+	unsigned int patchSize;
+	if (CreatePatch(oldFile, OLD_FILE_SIZE, newFile, newFileSize, &patch, &patchSize)==false)
+	{
+		printf("FAILED: CreatePatch()\n");
+		return 1;
+	}
+	printf("Old file %u bytes, new file %u bytes, patch %u bytes\n", OLD_FILE_SIZE, newFileSize, patchSize);
+	unsigned int expectedHash = SuperFastHash(newFile, newFileSize);
+
+	AutopatcherClient autopatcherClient;
+	PatchOnlyCB cbInterface;
+	for (unsigned int thresholdIndex=0; thresholdIndex < sizeof(thresholds)/sizeof(thresholds[0]); thresholdIndex++)
+	{
+		autopatcherClient.SetStreamingPatchThreshold(thresholds[thresholdIndex]);
+
+		// The same test AutopatcherClient makes for an existing file
+		bool streamed = GetFileLength64(OLD_FILE_PATH) >= thresholds[thresholdIndex];
+		bool expectStreamed = OLD_FILE_SIZE >= thresholds[thresholdIndex];
+		if (streamed!=expectStreamed)
+		{
+			printf("FAILED: threshold %u chose the wrong path\n", thresholds[thresholdIndex]);
+			failures++;
+		}
+
+		char *result=0;
+		unsigned int resultLength=0;
+		unsigned int hash=0;
+		PatchContext patchContext;
+		if (streamed)
+		{
+			patchContext = cbInterface.ApplyPatchBaseToFile(OLD_FILE_PATH, NEW_FILE_PATH, patch, patchSize, 0, &hash);
+			if (patchContext==PC_WRITE_FILE)
+				result = ReadWholeFile(NEW_FILE_PATH, &resultLength);
+		}
+		else
+		{
+			patchContext = cbInterface.ApplyPatchBase(OLD_FILE_PATH, &result, &resultLength, patch, patchSize, 0);
+			if (patchContext==PC_WRITE_FILE)
+				hash = SuperFastHash(result, resultLength);
+		}
+
+		if (patchContext!=PC_WRITE_FILE || Matches(result, resultLength, newFile, newFileSize)==false || hash!=expectedHash)
+		{
+			printf("FAILED: threshold %u, %s\n", thresholds[thresholdIndex], streamed ? "patched on disk" : "patched in memory");
+			failures++;
+		}
+		else
+		{
+			printf("Threshold %u, %s: OK\n", thresholds[thresholdIndex], streamed ? "patched on disk" : "patched in memory");
+		}
+		delete [] result;
+	}
+
+	// A damaged patch fails without leaving a partial new file
+	remove(NEW_FILE_PATH);
+	patch[patchSize/2] ^= 0xFF;
+	patch[patchSize/2+1] ^= 0xFF;
+	if (ApplyPatchToFile(OLD_FILE_PATH, NEW_FILE_PATH, patch, patchSize, 0) || GetFileLength64(NEW_FILE_PATH)!=0)
+	{
+		printf("FAILED: damaged patch was applied\n");
+		failures++;
+	}
+
+	delete [] patch;
+	rakFree_Ex(oldFile, _FILE_AND_LINE_);
+	rakFree_Ex(newFile, _FILE_AND_LINE_);
+	remove(OLD_FILE_PATH);
+	remove(NEW_FILE_PATH);
+
+	if (failures==0)
+		printf("Test passed\n");
+	else
+		printf("Test FAILED\n");
+	return failures==0 ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Times StringCompressor::EncodeString() and DecodeString() on strings like those sent by RPC4 (function names),
+// chat, and longer text such as Lobby2 messages and CloudKey values.
+// Every decoded string is compared with the original, so the sample also checks the round trip.
+
+#include "StringCompressor.h"
+#include "BitStream.h"
+#include "GetTime.h"
+#include "Rand.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace RakNet;
+
+static const int STRINGS_PER_PASS=256;
+static const int MAX_STRING_LENGTH=1024;
+
+static const char *words[]=
+{
+	"the", "player", "joined", "team", "red", "blue", "match", "ready", "server", "lobby", "room", "score", "level",
+	"map", "and", "is", "to", "of", "in", "you", "with", "for", "game", "over", "win", "lost", "connect", "friend",
+};
+
+// Words joined by spaces, capitalized and punctuated like chat, up to length characters
+static void MakeSentence(char *output, int length)
+{
+	int used=0;
+	while (used < length)
+	{
+		const char *word=words[randomMT() % (sizeof(words)/sizeof(words[0]))];
+		int wordLength=(int) strlen(word);
+		if (used+wordLength+1 >= length)
+			break;
+		if (used > 0)
+			output[used++]=' ';
+		memcpy(output+used, word, wordLength);
+		if (used==0)
+			output[0]=(char) (output[0]-'a'+'A');
+		used+=wordLength;
+	}
+	if (used > 0 && used < length)
+		output[used++]='.';
+	output[used]=0;
+}
+
+// Identifiers such as RPC4 function names, CamelCase with an occasional digit
+static void MakeIdentifier(char *output, int length)
+{
+	MakeSentence(output, length);
+	int used=0;
+	bool capitalizeNext=true;
+	for (int i=0; output[i]; i++)
+	{
+		if (output[i]==' ' || output[i]=='.')
+		{
+			capitalizeNext=true;
+			continue;
+		}
+		char c=output[i];
+		if (capitalizeNext && c >= 'a' && c <= 'z')
+			c=(char) (c-'a'+'A');
+		capitalizeNext=false;
+		output[used++]=c;
+	}
+	if (used > 0 && randomMT() % 4==0)
+		output[used-1]=(char) ('0'+randomMT() % 10);
+	output[used]=0;
+}
+
+struct BenchmarkCase
+{
+	const char *name;
+	int length;
+	void (*make)(char *output, int length);
+};
+static const BenchmarkCase benchmarkCases[]=
+{
+	{"Identifier", 24, MakeIdentifier},
+	{"Chat", 80, MakeSentence},
+	{"Long text", MAX_STRING_LENGTH-1, MakeSentence},
+};
+
+int main(int argc, char **argv)
+{
+	unsigned int passes=2000;
+	if (argc>1)
+		passes=(unsigned int) atoi(argv[1]);
+	if (passes==0)
+		passes=1;
+	seedMT(1);
+
+	StringCompressor::AddReference();
+	StringCompressor *stringCompressor=StringCompressor::Instance();
+
+	printf("Usage: StringCompressorBenchmark [passes]\n");
+	printf("Each case encodes and then decodes %i strings %u times.\n\n", STRINGS_PER_PASS, passes);
+	printf("%-12s %8s %8s %14s %14s\n", "Case", "Chars", "Bits", "Encodes/sec", "Decodes/sec");
+
+	static char strings[STRINGS_PER_PASS][MAX_STRING_LENGTH];
+	char output[MAX_STRING_LENGTH];
+	BitStream bs;
+	bool allMatched=true;
+	for (unsigned int c=0; c < sizeof(benchmarkCases)/sizeof(benchmarkCases[0]); c++)
+	{
+		const BenchmarkCase &benchmarkCase=benchmarkCases[c];
+		size_t totalChars=0;
+		int i;
+		unsigned int pass;
+		for (i=0; i < STRINGS_PER_PASS; i++)
+		{
+			benchmarkCase.make(strings[i], benchmarkCase.length);
+			totalChars+=strlen(strings[i]);
+		}
+
+		// Warm up, grow the BitStream to its final size, and check every string survives the round trip
+		bs.Reset();
+		for (i=0; i < STRINGS_PER_PASS; i++)
+			stringCompressor->EncodeString(strings[i], MAX_STRING_LENGTH, &bs);
+		BitSize_t bitsPerPass=bs.GetNumberOfBitsUsed();
+		for (i=0; i < STRINGS_PER_PASS; i++)
+		{
+			if (stringCompressor->DecodeString(output, MAX_STRING_LENGTH, &bs)==false || strcmp(output, strings[i])!=0)
+			{
+				printf("%s: string %i did not decode to the original\n", benchmarkCase.name, i);
+				allMatched=false;
+				break;
+			}
+		}
+
+		TimeUS startTime=GetTimeUS();
+		for (pass=0; pass < passes; pass++)
+		{
+			bs.ResetWritePointer();
+			for (i=0; i < STRINGS_PER_PASS; i++)
+				stringCompressor->EncodeString(strings[i], MAX_STRING_LENGTH, &bs);
+		}
+		TimeUS encodeUS=GetTimeUS()-startTime;
+
+		startTime=GetTimeUS();
+		for (pass=0; pass < passes; pass++)
+		{
+			bs.ResetReadPointer();
+			for (i=0; i < STRINGS_PER_PASS; i++)
+				stringCompressor->DecodeString(output, MAX_STRING_LENGTH, &bs);
+		}
+		TimeUS decodeUS=GetTimeUS()-startTime;
+
+		double numStrings=(double) passes*STRINGS_PER_PASS;
+		printf("%-12s %8.1f %8.1f %14.0f %14.0f\n", benchmarkCase.name, (double) totalChars/STRINGS_PER_PASS, (double) bitsPerPass/STRINGS_PER_PASS,
+			encodeUS > 0 ? numStrings*1000000.0/encodeUS : 0.0, decodeUS > 0 ? numStrings*1000000.0/decodeUS : 0.0);
+	}
+
+	StringCompressor::RemoveReference();
+	return allMatched ? 0 : 1;
+}
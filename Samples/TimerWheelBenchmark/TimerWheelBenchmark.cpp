@@ -0,0 +1,215 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Measures the cost of one resend pass against the number of messages awaiting an ack, and how late the resends go out.
+// ReliabilityLayer keeps those messages in a DataStructures::TimerWheel keyed on InternalPacket::nextActionTime.
+// It is compared with scanning every message each pass, and with the list ReliabilityLayer used before, where only the head was checked.
+
+#include "DS_TimerWheel.h"
+#include "GetTime.h"
+#include "Rand.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace RakNet;
+
+// Same units as ReliabilityLayer: microseconds, one pass per millisecond
+static const uint64_t TICK_US=1000;
+static const unsigned int NUMBER_OF_TICKS=1000;
+// Each message is acked about this long after it is sent
+static const uint64_t ROUND_TRIP_US=200000;
+
+enum Mode
+{
+	TIMER_WHEEL,
+	SCAN,
+	HEAD_ONLY_LIST,
+};
+
+static const char *modeNames[3]={"TimerWheel", "Scan", "HeadOnlyList"};
+
+struct Message
+{
+	DataStructures::TimerWheelLinks<Message> resendLinks;
+	uint64_t nextActionTime;
+	// For HEAD_ONLY_LIST
+	Message *prev, *next;
+};
+
+typedef DataStructures::TimerWheel<Message, &Message::resendLinks, &Message::nextActionTime> ResendTimers;
+
+// Circular list, new sends and resends go on the tail
+struct ResendList
+{
+	Message *head;
+	void AddToTail(Message *message)
+	{
+		if (head==0)
+		{
+			message->next=message;
+			message->prev=message;
+			head=message;
+			return;
+		}
+		message->next=head;
+		message->prev=head->prev;
+		message->prev->next=message;
+		head->prev=message;
+	}
+	void Remove(Message *message)
+	{
+		message->prev->next=message->next;
+		message->next->prev=message->prev;
+		if (head==message)
+			head=message->next==message ? 0 : message->next;
+	}
+};
+
+static uint64_t RandomRTO(void)
+{
+	// 100 to 300 milliseconds
+	return 100000 + (uint64_t) (randomMT() % 200000);
+}
+
+struct Result
+{
+	uint64_t elapsedUS;
+	unsigned int resends;
+	uint64_t totalLatenessUS;
+};
+
+static Result RunTrial(Mode mode, unsigned int numberOfMessages)
+{
+	std::vector<Message> messages(numberOfMessages);
+	ResendTimers resendTimers;
+	resendTimers.SetTickLength(TICK_US);
+	ResendList resendList;
+	resendList.head=0;
+	uint64_t now=TICK_US;
+	unsigned int i;
+
+	seedMT(1);
+	for (i=0; i < numberOfMessages; i++)
+	{
+		messages[i].nextActionTime=now+RandomRTO();
+		if (mode==TIMER_WHEEL)
+			resendTimers.Insert(&messages[i]);
+		else if (mode==HEAD_ONLY_LIST)
+			resendList.AddToTail(&messages[i]);
+	}
+
+	unsigned int acksPerTick=(unsigned int) (numberOfMessages*TICK_US/ROUND_TRIP_US);
+	if (acksPerTick==0)
+		acksPerTick=1;
+	unsigned int naksPerTick=(acksPerTick+49)/50;
+
+	Result result;
+	result.resends=0;
+	result.totalLatenessUS=0;
+	TimeUS startTime=GetTimeUS();
+	for (unsigned int tick=0; tick < NUMBER_OF_TICKS; tick++)
+	{
+		now+=TICK_US;
+
+		// An ack removes a message and a new send takes its place
+		for (i=0; i < acksPerTick; i++)
+		{
+			Message *message=&messages[randomMT() % numberOfMessages];
+			if (mode==TIMER_WHEEL)
+				resendTimers.Remove(message);
+			else if (mode==HEAD_ONLY_LIST)
+				resendList.Remove(message);
+			message->nextActionTime=now+RandomRTO();
+			if (mode==TIMER_WHEEL)
+				resendTimers.Insert(message);
+			else if (mode==HEAD_ONLY_LIST)
+				resendList.AddToTail(message);
+		}
+
+		// A NAK makes a message due right away. The old list only changed the time, leaving the message where it was
+		for (i=0; i < naksPerTick; i++)
+		{
+			Message *message=&messages[randomMT() % numberOfMessages];
+			if (mode==TIMER_WHEEL)
+				resendTimers.Reschedule(message, now);
+			else
+				message->nextActionTime=now;
+		}
+
+		Message *message;
+		switch (mode)
+		{
+		case TIMER_WHEEL:
+			resendTimers.Advance(now);
+			while ((message=resendTimers.GetDue())!=0)
+			{
+				result.totalLatenessUS+=now-message->nextActionTime;
+				resendTimers.Remove(message);
+				message->nextActionTime=now+RandomRTO();
+				resendTimers.Insert(message);
+				result.resends++;
+			}
+			break;
+		case SCAN:
+			for (i=0; i < numberOfMessages; i++)
+			{
+				if (messages[i].nextActionTime <= now)
+				{
+					result.totalLatenessUS+=now-messages[i].nextActionTime;
+					messages[i].nextActionTime=now+RandomRTO();
+					result.resends++;
+				}
+			}
+			break;
+		case HEAD_ONLY_LIST:
+			while (resendList.head && resendList.head->nextActionTime <= now)
+			{
+				message=resendList.head;
+				result.totalLatenessUS+=now-message->nextActionTime;
+				resendList.Remove(message);
+				message->nextActionTime=now+RandomRTO();
+				resendList.AddToTail(message);
+				result.resends++;
+			}
+			break;
+		}
+	}
+	result.elapsedUS=GetTimeUS()-startTime;
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int maxMessages=262144;
+	if (argc>1)
+		maxMessages=(unsigned int) atoi(argv[1]);
+	if (maxMessages<64)
+		maxMessages=64;
+
+	printf("Usage: TimerWheelBenchmark [max in flight]\n");
+	printf("Runs %u passes %u microseconds apart. Each pass acks in flight messages at random so each lives about %u ms, NAKs 1 in 50 of that number, then resends whatever is due with a new RTO of 100 to 300 ms.\n",
+		NUMBER_OF_TICKS, (unsigned int) TICK_US, (unsigned int) (ROUND_TRIP_US/1000));
+	printf("One connection has at most RESEND_BUFFER_ARRAY_LENGTH (%i) messages in flight. Larger counts show how each mode scales if that is raised.\n", RESEND_BUFFER_ARRAY_LENGTH);
+	printf("Late is the mean time between a message coming due and being resent. Passes are 1 ms apart, so up to 1 ms is expected.\n\n");
+	printf("%-14s %10s %12s %10s %10s\n", "Mode", "In flight", "ns/pass", "Resends", "Late ms");
+
+	for (unsigned int numberOfMessages=64; numberOfMessages <= maxMessages; numberOfMessages*=8)
+	{
+		for (int mode=0; mode < 3; mode++)
+		{
+			Result result=RunTrial((Mode) mode, numberOfMessages);
+			printf("%-14s %10u %12.0f %10u %10.2f\n", modeNames[mode], numberOfMessages, result.elapsedUS*1000.0/NUMBER_OF_TICKS, result.resends,
+				result.resends ? result.totalLatenessUS/1000.0/result.resends : 0.0);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Measures how many reliable messages per second one RakPeer can take in from many connections,
+// as the per-connection work is spread across more update threads (RakPeer::SetNumberOfUpdateThreads())
+
+#include "RakPeerInterface.h"
+#include "MessageIdentifiers.h"
+#include "RakSleep.h"
+#include "GetTime.h"
+#include "BitStream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+using namespace RakNet;
+
+static const int MESSAGE_SIZE=100;
+static const unsigned short SERVER_PORT=60123;
+
+static void RunTrial(unsigned int numberOfUpdateThreads, unsigned int numberOfClients, unsigned int messagesPerClient)
+{
+	RakPeerInterface *server=RakPeerInterface::GetInstance();
+	server->SetNumberOfUpdateThreads(numberOfUpdateThreads);
+	SocketDescriptor sd(SERVER_PORT, "127.0.0.1");
+	if (server->Startup(numberOfClients, &sd, 1)!=RAKNET_STARTED)
+	{
+		printf("Server startup failed\n");
+		RakPeerInterface::DestroyInstance(server);
+		return;
+	}
+	server->SetMaximumIncomingConnections((unsigned short) numberOfClients);
+
+	RakPeerInterface **clients = new RakPeerInterface*[numberOfClients];
+	unsigned int i;
+	for (i=0; i < numberOfClients; i++)
+	{
+		clients[i]=RakPeerInterface::GetInstance();
+		SocketDescriptor clientSd(0, "127.0.0.1");
+		clients[i]->Startup(1, &clientSd, 1);
+		clients[i]->Connect("127.0.0.1", SERVER_PORT, 0, 0);
+	}
+
+	// Wait for every client to connect
+	unsigned int connected=0;
+	RakNet::TimeMS giveUp=RakNet::GetTimeMS()+10000;
+	while (connected < numberOfClients && RakNet::GetTimeMS() < giveUp)
+	{
+		for (Packet *p=server->Receive(); p; server->DeallocatePacket(p), p=server->Receive())
+		{
+			if (p->data[0]==ID_NEW_INCOMING_CONNECTION)
+				connected++;
+		}
+		RakSleep(1);
+	}
+	for (i=0; i < numberOfClients; i++)
+	{
+		for (Packet *p=clients[i]->Receive(); p; clients[i]->DeallocatePacket(p), p=clients[i]->Receive())
+			;
+	}
+
+	if (connected==numberOfClients)
+	{
+		char message[MESSAGE_SIZE];
+		memset(message, 0, sizeof(message));
+		message[0]=ID_USER_PACKET_ENUM;
+
+		RakNet::TimeUS startTime=RakNet::GetTimeUS();
+		for (unsigned int j=0; j < messagesPerClient; j++)
+		{
+			for (i=0; i < numberOfClients; i++)
+				clients[i]->Send(message, MESSAGE_SIZE, HIGH_PRIORITY, RELIABLE_ORDERED, 0, UNASSIGNED_SYSTEM_ADDRESS, true);
+		}
+
+		unsigned int expected=numberOfClients*messagesPerClient;
+		unsigned int received=0;
+		giveUp=RakNet::GetTimeMS()+60000;
+		while (received < expected && RakNet::GetTimeMS() < giveUp)
+		{
+			Packet *p=server->Receive();
+			if (p==0)
+			{
+				RakSleep(0);
+				continue;
+			}
+			if (p->data[0]==ID_USER_PACKET_ENUM)
+				received++;
+			server->DeallocatePacket(p);
+		}
+		RakNet::TimeUS elapsed=RakNet::GetTimeUS()-startTime;
+
+		printf("%14u %8u %12u %14.0f%s\n",
+			numberOfUpdateThreads,
+			numberOfClients,
+			received,
+			(double) received * 1000000.0 / (double) elapsed,
+			received < expected ? " (timed out)" : "");
+	}
+	else
+	{
+		printf("%14u: only %u of %u clients connected\n", numberOfUpdateThreads, connected, numberOfClients);
+	}
+
+	for (i=0; i < numberOfClients; i++)
+		RakPeerInterface::DestroyInstance(clients[i]);
+	delete [] clients;
+	RakPeerInterface::DestroyInstance(server);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int maxUpdateThreads=std::thread::hardware_concurrency();
+	unsigned int numberOfClients=64;
+	unsigned int messagesPerClient=2000;
+	if (argc>1)
+		maxUpdateThreads=(unsigned int) atoi(argv[1]);
+	if (argc>2)
+		numberOfClients=(unsigned int) atoi(argv[2]);
+	if (argc>3)
+		messagesPerClient=(unsigned int) atoi(argv[3]);
+	if (maxUpdateThreads==0)
+		maxUpdateThreads=1;
+
+	printf("Usage: UpdateThreadsBenchmark [maxUpdateThreads] [clients] [messagesPerClient]\n");
+	printf("%u clients each send %u %i byte RELIABLE_ORDERED messages to one server on 127.0.0.1.\n", numberOfClients, messagesPerClient, MESSAGE_SIZE);
+	printf("The clients run in this process too, so leave cores free for them.\n\n");
+	printf("%14s %8s %12s %14s\n", "UpdateThreads", "Clients", "Messages", "Messages/s");
+
+	for (unsigned int threads=1; threads <= maxUpdateThreads; threads*=2)
+	{
+		RunTrial(threads, numberOfClients, messagesPerClient);
+		if (threads < maxUpdateThreads && threads*2 > maxUpdateThreads)
+			RunTrial(maxUpdateThreads, numberOfClients, messagesPerClient);
+	}
+
+	return 0;
+}
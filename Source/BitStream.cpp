@@ -40,6 +40,25 @@ using namespace RakNet;
 #pragma warning( push )
 #endif
 
+// The stream holds bits most significant first, so 8 bytes of it read as a big endian integer put the first bit at bit 63.
+// Built from bytes so the result is the same on any host. Compilers turn these into a load or store and a byte swap
+static inline uint64_t ReadBigEndian64(const unsigned char *input)
+{
+	return ((uint64_t) input[0] << 56) | ((uint64_t) input[1] << 48) | ((uint64_t) input[2] << 40) | ((uint64_t) input[3] << 32) |
+		((uint64_t) input[4] << 24) | ((uint64_t) input[5] << 16) | ((uint64_t) input[6] << 8) | (uint64_t) input[7];
+}
+static inline void WriteBigEndian64(unsigned char *output, const uint64_t bits)
+{
+	output[0]=static_cast<unsigned char>(bits >> 56);
+	output[1]=static_cast<unsigned char>(bits >> 48);
+	output[2]=static_cast<unsigned char>(bits >> 40);
+	output[3]=static_cast<unsigned char>(bits >> 32);
+	output[4]=static_cast<unsigned char>(bits >> 24);
+	output[5]=static_cast<unsigned char>(bits >> 16);
+	output[6]=static_cast<unsigned char>(bits >> 8);
+	output[7]=static_cast<unsigned char>(bits);
+}
+
 STATIC_FACTORY_DEFINITIONS(BitStream,BitStream)
 
 BitStream::BitStream()
@@ -425,44 +444,57 @@ void BitStream::WriteBits( const unsigned char* inByteArray, BitSize_t numberOfB
 		return;
 	}
 
-  const unsigned char* inputPtr=inByteArray;
+	const unsigned char* inputPtr=inByteArray;
+	unsigned char* outputPtr=data + ( numberOfBitsUsed >> 3 );
 
-	// Faster to put the while at the top surprisingly enough
-	while ( numberOfBitsToWrite > 0 )
-		//do
+	// 64 bits per step. The first output byte already holds numberOfBitsUsedMod8 bits, so it is ORed into
+	while ( numberOfBitsToWrite >= 64 )
 	{
-		unsigned char dataByte = *(inputPtr++);
-
-		if ( numberOfBitsToWrite < 8 && rightAlignedBits )   // rightAlignedBits means in the case of a partial byte, the bits are aligned from the right (bit 0) rather than the left (as in the normal internal representation)
-			dataByte <<= 8 - numberOfBitsToWrite;  // shift left to get the bits on the left, as in our internal representation
-
-		// Writing to a new byte each time
+		const uint64_t bits = ReadBigEndian64( inputPtr );
 		if ( numberOfBitsUsedMod8 == 0 )
-			* ( data + ( numberOfBitsUsed >> 3 ) ) = dataByte;
+			WriteBigEndian64( outputPtr, bits );
 		else
 		{
-			// Copy over the new data.
-			*( data + ( numberOfBitsUsed >> 3 ) ) |= dataByte >> ( numberOfBitsUsedMod8 ); // First half
-
-			if ( 8 - ( numberOfBitsUsedMod8 ) < 8 && 8 - ( numberOfBitsUsedMod8 ) < numberOfBitsToWrite )   // If we didn't write it all out in the first half (8 - (numberOfBitsUsed%8) is the number we wrote in the first half)
-			{
-				*( data + ( numberOfBitsUsed >> 3 ) + 1 ) = static_cast<unsigned char>(
-            dataByte << (8 - (numberOfBitsUsedMod8))); // Second half (overlaps byte boundary)
-			}
+			*outputPtr |= static_cast<unsigned char>( bits >> ( 56 + numberOfBitsUsedMod8 ) );
+			WriteBigEndian64( outputPtr + 1, bits << ( 8 - numberOfBitsUsedMod8 ) );
 		}
+		inputPtr += 8;
+		outputPtr += 8;
+		numberOfBitsUsed += 64;
+		numberOfBitsToWrite -= 64;
+	}
 
-		if ( numberOfBitsToWrite >= 8 )
-		{
-			numberOfBitsUsed += 8;
-			numberOfBitsToWrite -= 8;
-		}
-		else
-		{
-			numberOfBitsUsed += numberOfBitsToWrite;
-			numberOfBitsToWrite=0;
-		}
+	if ( numberOfBitsToWrite == 0 )
+		return;
+
+	// The last 1 to 63 bits
+	const BitSize_t numberOfBytesToRead = BITS_TO_BYTES( numberOfBitsToWrite );
+	uint64_t bits = 0;
+	for ( BitSize_t i = 0; i < numberOfBytesToRead; i++ )
+	{
+		unsigned char dataByte = inputPtr[ i ];
+
+		if ( i == numberOfBytesToRead - 1 && ( numberOfBitsToWrite & 7 ) != 0 && rightAlignedBits )   // rightAlignedBits means in the case of a partial byte, the bits are aligned from the right (bit 0) rather than the left (as in the normal internal representation)
+			dataByte <<= 8 - ( numberOfBitsToWrite & 7 );  // shift left to get the bits on the left, as in our internal representation
+
+		bits |= static_cast<uint64_t>( dataByte ) << ( 56 - 8 * i );
 	}
-	// } while(numberOfBitsToWrite>0);
+
+	// Writes the same bytes as writing a byte at a time did, so the output is unchanged.
+	// That includes any unused low bits of the last input byte, and no byte past the last one holding new bits
+	if ( numberOfBitsUsedMod8 == 0 )
+		*outputPtr = static_cast<unsigned char>( bits >> 56 );
+	else
+		*outputPtr |= static_cast<unsigned char>( bits >> ( 56 + numberOfBitsUsedMod8 ) );
+	bits <<= 8 - numberOfBitsUsedMod8;
+	const BitSize_t lastByte = ( numberOfBitsUsedMod8 + numberOfBitsToWrite - 1 ) >> 3;
+	for ( BitSize_t i = 1; i <= lastByte; i++ )
+	{
+		outputPtr[ i ] = static_cast<unsigned char>( bits >> 56 );
+		bits <<= 8;
+	}
+
+	numberOfBitsUsed += numberOfBitsToWrite;
 }
 
 // Set the stream to some initial data.  For internal use
@@ -557,43 +589,46 @@ bool BitStream::ReadBits( unsigned char *inOutByteArray, BitSize_t numberOfBitsT
 		return true;
 	}
 
-	BitSize_t offset = 0;
-
-	memset( inOutByteArray, 0, (size_t) BITS_TO_BYTES( numberOfBitsToRead ) );
+	const unsigned char* inputPtr = data + ( readOffset >> 3 );
+	unsigned char* outputPtr = inOutByteArray;
 
-	while ( numberOfBitsToRead > 0 )
+	// 64 bits per step. Unaligned, that takes 9 bytes of input, all of which are before numberOfBitsUsed
+	while ( numberOfBitsToRead >= 64 )
 	{
-		*( inOutByteArray + offset ) |= *( data + ( readOffset >> 3 ) ) << ( readOffsetMod8 ); // First half
-
-		if ( readOffsetMod8 > 0 && numberOfBitsToRead > 8 - ( readOffsetMod8 ) )   // If we have a second half, we didn't read enough bytes in the first half
-			*( inOutByteArray + offset ) |= *( data + ( readOffset >> 3 ) + 1 ) >> ( 8 - ( readOffsetMod8 ) ); // Second half (overlaps byte boundary)
-
-		if (numberOfBitsToRead>=8)
-		{
-			numberOfBitsToRead -= 8;
-			readOffset += 8;
-			offset++;
-		}
-		else
-		{
-
-      if (const int neg = static_cast<int>(numberOfBitsToRead) - 8;
-          neg < 0 )   // Reading a partial byte for the last byte, shift right so the data is aligned on the right
-			{
+		uint64_t bits = ReadBigEndian64( inputPtr );
+		if ( readOffsetMod8 != 0 )
+			bits = ( bits << readOffsetMod8 ) | ( inputPtr[ 8 ] >> ( 8 - readOffsetMod8 ) );
+		WriteBigEndian64( outputPtr, bits );
+		inputPtr += 8;
+		outputPtr += 8;
+		readOffset += 64;
+		numberOfBitsToRead -= 64;
+	}
 
-				if ( alignBitsToRight )
-					* ( inOutByteArray + offset ) >>= -neg;
+	if ( numberOfBitsToRead == 0 )
+		return true;
 
-				readOffset += 8 + neg;
-			}
-			else
-				readOffset += 8;
+	// The last 1 to 63 bits. Only the input bytes holding them are read, at most 9
+	const BitSize_t numberOfBytesToRead = ( readOffsetMod8 + numberOfBitsToRead + 7 ) >> 3;
+	uint64_t bits = 0;
+	for ( BitSize_t i = 0; i < numberOfBytesToRead && i < 8; i++ )
+		bits |= static_cast<uint64_t>( inputPtr[ i ] ) << ( 56 - 8 * i );
+	bits <<= readOffsetMod8;
+	if ( numberOfBytesToRead > 8 )
+		bits |= inputPtr[ 8 ] >> ( 8 - readOffsetMod8 );
+
+	const BitSize_t numberOfBytesToWrite = BITS_TO_BYTES( numberOfBitsToRead );
+	for ( BitSize_t i = 0; i < numberOfBytesToWrite; i++ )
+	{
+		outputPtr[ i ] = static_cast<unsigned char>( bits >> 56 );
+		bits <<= 8;
+	}
 
-			offset++;
+	// Reading a partial byte for the last byte, shift right so the data is aligned on the right
+	if ( alignBitsToRight && ( numberOfBitsToRead & 7 ) != 0 )
+		outputPtr[ numberOfBytesToWrite - 1 ] >>= 8 - ( numberOfBitsToRead & 7 );
 
-			numberOfBitsToRead=0;
-		}		
-	}
+	readOffset += numberOfBitsToRead;
 
 	return true;
 }
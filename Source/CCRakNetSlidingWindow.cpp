@@ -106,6 +106,13 @@ bool CCRakNetSlidingWindow::ShouldSendACKs(const CCTimeType curTime, const CCTim
 	return curTime >= oldestUnsentAck + SYN;
 }
 // ----------------------------------------------------------------------------------------------------------------------------
+CCTimeType CCRakNetSlidingWindow::GetNextACKTime(void) const
+{
+	if (GetSenderRTOForACK()== static_cast<CCTimeType>(UNSET_TIME_US))
+		return 0;
+	return oldestUnsentAck + SYN;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
 DatagramSequenceNumberType CCRakNetSlidingWindow::GetNextDatagramSequenceNumber()
 {
 	return nextDatagramSequenceNumber;
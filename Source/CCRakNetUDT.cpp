@@ -235,6 +235,13 @@ bool CCRakNetUDT::ShouldSendACKs(CCTimeType curTime, CCTimeType estimatedTimeToN
 		estimatedTimeToNextTick+curTime < oldestUnsentAck+rto-RTT;
 }
 // ----------------------------------------------------------------------------------------------------------------------------
+CCTimeType CCRakNetUDT::GetNextACKTime(void) const
+{
+	if (GetSenderRTOForACK()==(CCTimeType) UNSET_TIME_US)
+		return 0;
+	return oldestUnsentAck + SYN;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
 DatagramSequenceNumberType CCRakNetUDT::GetNextDatagramSequenceNumber(void)
 {
 	return nextDatagramSequenceNumber;
@@ -0,0 +1,392 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "../include/RakNet/CachedIncrementalReadInterface.h"
+#include "../include/RakNet/RakMemoryOverride.h"
+#include "../include/RakNet/RakAssert.h"
+#include <string.h>
+
+#if defined(_WIN32)
+#include "../include/RakNet/WindowsIncludes.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+using namespace RakNet;
+
+CachedIncrementalReadInterface::CachedIncrementalReadInterface()
+{
+	maxOpenFiles=64;
+	numOpenFiles=0;
+	readAheadBytes=1048576;
+	maxCachedBytes=67108864;
+	cachedBytes=0;
+	useCounter=0;
+}
+CachedIncrementalReadInterface::~CachedIncrementalReadInterface()
+{
+	InvalidateAll();
+}
+void CachedIncrementalReadInterface::SetMaxOpenFiles(unsigned int _maxOpenFiles)
+{
+	cacheMutex.Lock();
+	maxOpenFiles=_maxOpenFiles;
+	EvictFiles();
+	cacheMutex.Unlock();
+}
+void CachedIncrementalReadInterface::SetCacheSize(unsigned int _readAheadBytes, unsigned int _maxCachedBytes)
+{
+	RakAssert(_readAheadBytes>0);
+	cacheMutex.Lock();
+	while (files.Size())
+		DetachFile(files.Size()-1);
+	readAheadBytes=_readAheadBytes;
+	maxCachedBytes=_maxCachedBytes;
+	cacheMutex.Unlock();
+}
+void CachedIncrementalReadInterface::InvalidateFile(const char *filename)
+{
+	cacheMutex.Lock();
+	for (unsigned int i=0; i < files.Size(); i++)
+	{
+		if (strcmp(files[i]->filename.C_String(), filename)==0)
+		{
+			DetachFile(i);
+			break;
+		}
+	}
+	cacheMutex.Unlock();
+}
+void CachedIncrementalReadInterface::InvalidateAll(void)
+{
+	cacheMutex.Lock();
+	while (files.Size())
+		DetachFile(files.Size()-1);
+	cacheMutex.Unlock();
+}
+unsigned int CachedIncrementalReadInterface::GetFilePart( const char *filename, unsigned int startReadBytes, unsigned int numBytesToRead, void *preallocatedDestination, FileListNodeContext context)
+{
+	(void) context;
+
+	if (numBytesToRead==0)
+		return 0;
+
+	CachedFile *file = AddReader(filename);
+	char *destination = (char*) preallocatedDestination;
+	unsigned int numRead=0;
+
+	if (file->blockSize==0)
+	{
+		// Not caching, but still keep the handle
+		cacheMutex.Lock();
+		bool isOpen = OpenFile(file);
+		EvictFiles();
+		cacheMutex.Unlock();
+		if (isOpen)
+			numRead=ReadAt(file, startReadBytes, numBytesToRead, destination);
+	}
+	else
+	{
+		uint64_t offset = startReadBytes;
+		while (numRead < numBytesToRead)
+		{
+			unsigned int blockIndex = (unsigned int) (offset / file->blockSize);
+			unsigned int offsetInBlock = (unsigned int) (offset - (uint64_t) blockIndex * file->blockSize);
+			CachedBlock *block = AddBlockReader(file, blockIndex);
+			if (block==0)
+				break;
+
+			unsigned int numCopied=0;
+			if (block->length > offsetInBlock)
+			{
+				numCopied = block->length - offsetInBlock;
+				if (numCopied > numBytesToRead - numRead)
+					numCopied = numBytesToRead - numRead;
+				memcpy(destination + numRead, block->data + offsetInBlock, numCopied);
+			}
+			// A short block is the end of the file
+			bool endOfFile = block->length < file->blockSize;
+			RemoveBlockReader(block);
+
+			numRead+=numCopied;
+			offset+=numCopied;
+			if (endOfFile || numCopied==0)
+				break;
+		}
+	}
+
+	RemoveReader(file);
+	return numRead;
+}
+CachedIncrementalReadInterface::CachedFile *CachedIncrementalReadInterface::AddReader(const char *filename)
+{
+	CachedFile *file=0;
+	cacheMutex.Lock();
+	for (unsigned int i=0; i < files.Size(); i++)
+	{
+		if (strcmp(files[i]->filename.C_String(), filename)==0)
+		{
+			file=files[i];
+			break;
+		}
+	}
+	if (file==0)
+	{
+		file = RakNet::OP_NEW<CachedFile>(_FILE_AND_LINE_);
+		file->filename=filename;
+		file->isOpen=false;
+		file->blockSize=maxCachedBytes > 0 ? readAheadBytes : 0;
+		file->isDetached=false;
+		file->numReaders=0;
+		files.Push(file, _FILE_AND_LINE_);
+	}
+	file->numReaders++;
+	file->lastUse=++useCounter;
+	cacheMutex.Unlock();
+	return file;
+}
+void CachedIncrementalReadInterface::RemoveReader(CachedFile *file)
+{
+	cacheMutex.Lock();
+	file->numReaders--;
+	if (file->isDetached)
+	{
+		if (file->numReaders==0)
+			FreeCachedFile(file);
+	}
+	else
+	{
+		if (file->isOpen==false && file->blocks.Size()==0 && file->numReaders==0)
+		{
+			// Could not be opened and has nothing cached
+			for (unsigned int i=0; i < files.Size(); i++)
+			{
+				if (files[i]==file)
+				{
+					DetachFile(i);
+					break;
+				}
+			}
+		}
+		else
+			EvictFiles();
+	}
+	cacheMutex.Unlock();
+}
+bool CachedIncrementalReadInterface::OpenFile(CachedFile *file)
+{
+	if (file->isOpen)
+		return true;
+
+#if defined(_WIN32)
+	HANDLE handle = CreateFileA(file->filename.C_String(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (handle==INVALID_HANDLE_VALUE)
+		return false;
+	file->handle=handle;
+#else
+	int handle = open(file->filename.C_String(), O_RDONLY);
+	if (handle==-1)
+		return false;
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(handle, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	file->handle=handle;
+#endif
+
+	file->isOpen=true;
+	numOpenFiles++;
+	return true;
+}
+void CachedIncrementalReadInterface::CloseFile(CachedFile *file)
+{
+	if (file->isOpen==false)
+		return;
+
+#if defined(_WIN32)
+	CloseHandle((HANDLE) file->handle);
+#else
+	close(file->handle);
+#endif
+
+	file->isOpen=false;
+	numOpenFiles--;
+}
+unsigned int CachedIncrementalReadInterface::ReadAt(CachedFile *file, uint64_t offset, unsigned int numBytesToRead, char *destination)
+{
+	// Positional reads do not move a shared file pointer, so threads can read the same handle at once
+	unsigned int numRead=0;
+	while (numRead < numBytesToRead)
+	{
+#if defined(_WIN32)
+		OVERLAPPED overlapped;
+		memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset=(DWORD) (offset+numRead);
+		overlapped.OffsetHigh=(DWORD) ((offset+numRead) >> 32);
+		DWORD result;
+		if (ReadFile((HANDLE) file->handle, destination+numRead, numBytesToRead-numRead, &result, &overlapped)==FALSE || result==0)
+			break;
+#else
+		ssize_t result = pread(file->handle, destination+numRead, numBytesToRead-numRead, (off_t) (offset+numRead));
+		if (result==-1 && errno==EINTR)
+			continue;
+		if (result<=0)
+			break;
+#endif
+		numRead+=(unsigned int) result;
+	}
+	return numRead;
+}
+CachedIncrementalReadInterface::CachedBlock *CachedIncrementalReadInterface::AddBlockReader(CachedFile *file, unsigned int blockIndex)
+{
+	unsigned int i;
+	CachedBlock *block;
+	cacheMutex.Lock();
+	for (i=0; i < file->blocks.Size(); i++)
+	{
+		block=file->blocks[i];
+		if (block->blockIndex==blockIndex)
+		{
+			block->numReaders++;
+			block->lastUse=++useCounter;
+			cacheMutex.Unlock();
+			return block;
+		}
+	}
+	bool isOpen = OpenFile(file);
+	EvictFiles();
+	cacheMutex.Unlock();
+
+	if (isOpen==false)
+		return 0;
+
+	// Read outside the lock. If another reader loads the same block meanwhile, keep theirs
+	char *data = (char*) rakMalloc_Ex(file->blockSize, _FILE_AND_LINE_);
+	if (data==0)
+	{
+		notifyOutOfMemory(_FILE_AND_LINE_);
+		return 0;
+	}
+	unsigned int length = ReadAt(file, (uint64_t) blockIndex * file->blockSize, file->blockSize, data);
+
+	cacheMutex.Lock();
+	for (i=0; i < file->blocks.Size(); i++)
+	{
+		if (file->blocks[i]->blockIndex==blockIndex)
+			break;
+	}
+	if (i < file->blocks.Size())
+	{
+		rakFree_Ex(data, _FILE_AND_LINE_);
+		block=file->blocks[i];
+	}
+	else
+	{
+		block = RakNet::OP_NEW<CachedBlock>(_FILE_AND_LINE_);
+		block->blockIndex=blockIndex;
+		block->data=data;
+		block->length=length;
+		block->numReaders=0;
+		file->blocks.Push(block, _FILE_AND_LINE_);
+		cachedBytes+=file->blockSize;
+	}
+	block->numReaders++;
+	block->lastUse=++useCounter;
+	EvictBlocks();
+	cacheMutex.Unlock();
+	return block;
+}
+void CachedIncrementalReadInterface::RemoveBlockReader(CachedBlock *block)
+{
+	cacheMutex.Lock();
+	block->numReaders--;
+	EvictBlocks();
+	cacheMutex.Unlock();
+}
+void CachedIncrementalReadInterface::FreeCachedFile(CachedFile *file)
+{
+	CloseFile(file);
+	for (unsigned int i=0; i < file->blocks.Size(); i++)
+	{
+		cachedBytes-=file->blockSize;
+		rakFree_Ex(file->blocks[i]->data, _FILE_AND_LINE_);
+		RakNet::OP_DELETE(file->blocks[i], _FILE_AND_LINE_);
+	}
+	RakNet::OP_DELETE(file, _FILE_AND_LINE_);
+}
+void CachedIncrementalReadInterface::DetachFile(unsigned int index)
+{
+	CachedFile *file = files[index];
+	files.RemoveAtIndexFast(index);
+	if (file->numReaders==0)
+		FreeCachedFile(file);
+	else
+		file->isDetached=true;
+}
+void CachedIncrementalReadInterface::EvictBlocks(void)
+{
+	while (cachedBytes > maxCachedBytes)
+	{
+		// Least recently used block nobody is copying from
+		unsigned int oldestAge=0, oldestFileIndex=(unsigned int) -1, oldestBlockIndex=0;
+		for (unsigned int i=0; i < files.Size(); i++)
+		{
+			CachedFile *file = files[i];
+			for (unsigned int j=0; j < file->blocks.Size(); j++)
+			{
+				CachedBlock *block = file->blocks[j];
+				unsigned int age = useCounter - block->lastUse;
+				if (block->numReaders==0 && (oldestFileIndex==(unsigned int) -1 || age > oldestAge))
+				{
+					oldestAge=age;
+					oldestFileIndex=i;
+					oldestBlockIndex=j;
+				}
+			}
+		}
+		if (oldestFileIndex==(unsigned int) -1)
+			return;
+
+		CachedFile *file = files[oldestFileIndex];
+		CachedBlock *block = file->blocks[oldestBlockIndex];
+		cachedBytes-=file->blockSize;
+		rakFree_Ex(block->data, _FILE_AND_LINE_);
+		RakNet::OP_DELETE(block, _FILE_AND_LINE_);
+		file->blocks.RemoveAtIndexFast(oldestBlockIndex);
+		if (file->blocks.Size()==0 && file->isOpen==false && file->numReaders==0)
+			DetachFile(oldestFileIndex);
+	}
+}
+void CachedIncrementalReadInterface::EvictFiles(void)
+{
+	while (numOpenFiles > maxOpenFiles)
+	{
+		// Least recently used open file nobody is reading
+		unsigned int oldestAge=0, oldestFileIndex=(unsigned int) -1;
+		for (unsigned int i=0; i < files.Size(); i++)
+		{
+			CachedFile *file = files[i];
+			unsigned int age = useCounter - file->lastUse;
+			if (file->isOpen && file->numReaders==0 && (oldestFileIndex==(unsigned int) -1 || age > oldestAge))
+			{
+				oldestAge=age;
+				oldestFileIndex=i;
+			}
+		}
+		if (oldestFileIndex==(unsigned int) -1)
+			return;
+
+		CachedFile *file = files[oldestFileIndex];
+		CloseFile(file);
+		if (file->blocks.Size()==0)
+			DetachFile(oldestFileIndex);
+	}
+}
@@ -182,6 +182,12 @@ PluginReceiveResult CloudClient::OnReceive(Packet *packet)
 
 	return RR_CONTINUE_PROCESSING;
 }
+bool CloudClient::GetReceiveFilter(PluginReceiveFilter &filter) const
+{
+	// OnReceive() handles nothing. The application passes responses to OnGetReponse() and OnSubscriptionNotification()
+	(void) filter;
+	return true;
+}
 
 [[maybe_unused]] void CloudClient::OnGetReponse(Packet *packet, CloudClientCallback *_callback, CloudAllocator *_allocator)
 {
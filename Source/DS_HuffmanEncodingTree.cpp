@@ -10,6 +10,7 @@
 
 #include <RakNet/DS_HuffmanEncodingTree.h>
 #include <RakNet/DS_Queue.h>
+#include <RakNet/DS_List.h>
 #include <RakNet/BitStream.h>
 #include <RakNet/RakAssert.h>
 
@@ -22,6 +23,8 @@ using namespace RakNet;
 HuffmanEncodingTree::HuffmanEncodingTree()
 {
 	root = nullptr;
+	decodeTables = nullptr;
+	numDecodeTables = 0;
 }
 
 HuffmanEncodingTree::~HuffmanEncodingTree()
@@ -56,6 +59,10 @@ void HuffmanEncodingTree::FreeMemory()
 	for ( int i = 0; i < 256; ++i )
 		rakFree_Ex(encodingTable[ i ].encoding, _FILE_AND_LINE_ );
 
+	rakFree_Ex(decodeTables, _FILE_AND_LINE_ );
+	decodeTables = nullptr;
+	numDecodeTables = 0;
+
 	root = nullptr;
 }
 
@@ -146,8 +153,11 @@ void HuffmanEncodingTree::GenerateFromFrequencyTable( const unsigned int frequen
 		while ( currentNode != root );
 
 		// Write to the bitstream in the reverse order that we stored the path, which gives us the correct order from the root to the leaf
+		encodingTable[ counter ].code = 0;
 		while ( tempPathLength-- > 0 )
 		{
+			encodingTable[ counter ].code = ( encodingTable[ counter ].code << 1 ) | ( tempPath[ tempPathLength ] ? 1 : 0 );
+
 			if ( tempPath[ tempPathLength ] )   // Write 1's and 0's because writing a bool will write the BitStream TYPE_CHECKING validation bits if that is defined along with the actual data bit, which is not what we want
 				bitStream.Write1();
 			else
@@ -161,6 +171,72 @@ void HuffmanEncodingTree::GenerateFromFrequencyTable( const unsigned int frequen
 		// Reset the bitstream for the next iteration
 		bitStream.Reset();
 	}
+
+	GenerateDecodeTables();
+}
+
+// Each table covers DECODE_TABLE_BITS levels of the tree below one node. An index whose path reaches a leaf within those levels
+// holds the leaf's value and depth. The others link to a table for the node the path reaches, which is created the first time it is needed
+void HuffmanEncodingTree::GenerateDecodeTables( void )
+{
+	const unsigned int tableSize = 1 << DECODE_TABLE_BITS;
+	DataStructures::List<const HuffmanEncodingTreeNode *> tableRoots;
+
+	tableRoots.Insert( root, _FILE_AND_LINE_ );
+	for ( unsigned int tableIndex = 0; tableIndex < tableRoots.Size(); ++tableIndex )
+	{
+		decodeTables = static_cast<DecodeEntry *>( rakRealloc_Ex( decodeTables, sizeof( DecodeEntry ) * tableSize * ( tableIndex + 1 ), _FILE_AND_LINE_ ) );
+		DecodeEntry *table = decodeTables + tableSize * tableIndex;
+
+		for ( unsigned int pattern = 0; pattern < tableSize; ++pattern )
+		{
+			const HuffmanEncodingTreeNode* currentNode = tableRoots[ tableIndex ];
+			int depth;
+			for ( depth = 1; depth <= DECODE_TABLE_BITS; ++depth )
+			{
+				if ( ( pattern >> ( DECODE_TABLE_BITS - depth ) ) & 1 )
+					currentNode = currentNode->right;
+				else
+					currentNode = currentNode->left;
+
+				if ( currentNode->left == nullptr && currentNode->right == nullptr )   // Leaf
+					break;
+			}
+
+			if ( depth <= DECODE_TABLE_BITS )
+			{
+				table[ pattern ].next = 0;
+				table[ pattern ].value = currentNode->value;
+				table[ pattern ].bitLength = static_cast<unsigned char>( depth );
+			}
+			else
+			{
+				// Each pattern reaches a different node, so this node has no table yet
+				table[ pattern ].next = static_cast<unsigned short>( tableRoots.Size() );
+				table[ pattern ].value = 0;
+				table[ pattern ].bitLength = 0;
+				tableRoots.Insert( currentNode, _FILE_AND_LINE_ );
+			}
+		}
+	}
+
+	numDecodeTables = tableRoots.Size();
+}
+
+// Writes the bytes EncodeArray has packed, then the bits left over in pendingBits, and empties both
+static void FlushEncodedBits( unsigned char *pendingBytes, unsigned int &numPendingBytes, uint64_t &pendingBits, unsigned int &numPendingBits, RakNet::BitStream * output )
+{
+	const BitSize_t numBits = numPendingBytes * 8 + numPendingBits;
+	while ( numPendingBits > 0 )
+	{
+		pendingBytes[ numPendingBytes++ ] = static_cast<unsigned char>( pendingBits >> 56 );
+		pendingBits <<= 8;
+		numPendingBits = numPendingBits > 8 ? numPendingBits - 8 : 0;
+	}
+	if ( numBits > 0 )
+		output->WriteBits( pendingBytes, numBits, false ); // Data is left aligned
+	numPendingBytes = 0;
+	pendingBits = 0;
 }
 
 // Pass an array of bytes to array and a preallocated BitStream to receive the output
@@ -170,10 +246,37 @@ void HuffmanEncodingTree::EncodeArray(const unsigned char *input,
 	unsigned counter;
 
 	// For each input byte, Write out the corresponding series of 1's and 0's that give the encoded representation
+	// Codes are packed into pendingBits, most significant bit first, and written to output 256 bytes at a time
+	unsigned char pendingBytes[ 256 + sizeof( uint64_t ) ];
+	unsigned int numPendingBytes = 0;
+	uint64_t pendingBits = 0;
+	unsigned int numPendingBits = 0;
 	for ( counter = 0; counter < sizeInBytes; ++counter )
 	{
-		output->WriteBits( encodingTable[ input[ counter ] ].encoding, encodingTable[ input[ counter ] ].bitLength, false ); // Data is left aligned
+		const CharacterEncoding &characterEncoding = encodingTable[ input[ counter ] ];
+		if ( characterEncoding.bitLength > 32 )
+		{
+			// Only possible with very skewed frequency tables. Flush and write the code on its own
+			FlushEncodedBits( pendingBytes, numPendingBytes, pendingBits, numPendingBits, output );
+			output->WriteBits( characterEncoding.encoding, characterEncoding.bitLength, false ); // Data is left aligned
+			continue;
+		}
+
+		pendingBits |= static_cast<uint64_t>( characterEncoding.code ) << ( 64 - numPendingBits - characterEncoding.bitLength );
+		numPendingBits += characterEncoding.bitLength;
+		if ( numPendingBits >= 32 )
+		{
+			for ( int i = 0; i < 4; ++i )
+			{
+				pendingBytes[ numPendingBytes++ ] = static_cast<unsigned char>( pendingBits >> 56 );
+				pendingBits <<= 8;
+			}
+			numPendingBits -= 32;
+			if ( numPendingBytes >= 256 )
+				FlushEncodedBits( pendingBytes, numPendingBytes, pendingBits, numPendingBits, output );
+		}
 	}
+	FlushEncodedBits( pendingBytes, numPendingBytes, pendingBits, numPendingBits, output );
 
 	// Byte align the output so the unassigned remaining bits don't equate to some actual value
 	if ( output->GetNumberOfBitsUsed() % 8 != 0 )
@@ -197,34 +300,120 @@ void HuffmanEncodingTree::EncodeArray(const unsigned char *input,
 	}
 }
 
-unsigned HuffmanEncodingTree::DecodeArray( RakNet::BitStream * input,
-                                          const BitSize_t sizeInBits,
-                                          const size_t maxCharsToWrite, unsigned char *output )
+// The input is kept in bitBuffer, next bit first, and each step looks up DECODE_TABLE_BITS bits of it rather than walking the tree one bit at a time.
+// A code that does not fit in the bits left is padding and is dropped, as it was by the tree walk
+template <class OutputFunctor>
+unsigned HuffmanEncodingTree::DecodeBits( const unsigned char *input, const BitSize_t startBit, const BitSize_t sizeInBits, OutputFunctor &output ) const
 {
+	if ( sizeInBits == 0 )
+		return 0;
+
+	const size_t endByte = BITS_TO_BYTES( startBit + sizeInBits );
+	size_t readByte = startBit >> 3;
+	uint64_t bitBuffer = static_cast<uint64_t>( input[ readByte++ ] ) << ( 56 + ( startBit & 7 ) );
+	unsigned int bitsInBuffer = 8 - ( startBit & 7 );
+	BitSize_t bitsRemaining = sizeInBits;
+	unsigned outputWriteIndex = 0;
+	const DecodeEntry *table = decodeTables;
+
+	for (;;)
+	{
+		if ( bitsInBuffer < DECODE_TABLE_BITS )
+		{
+			if ( readByte + sizeof( uint64_t ) <= endByte )
+			{
+				const unsigned char *inputPtr = input + readByte;
+				const uint64_t bits = ( (uint64_t) inputPtr[0] << 56 ) | ( (uint64_t) inputPtr[1] << 48 ) | ( (uint64_t) inputPtr[2] << 40 ) | ( (uint64_t) inputPtr[3] << 32 ) |
+					( (uint64_t) inputPtr[4] << 24 ) | ( (uint64_t) inputPtr[5] << 16 ) | ( (uint64_t) inputPtr[6] << 8 ) | (uint64_t) inputPtr[7];
+				// Bits past the whole bytes counted here are loaded again by the next refill, with the same values
+				bitBuffer |= bits >> bitsInBuffer;
+				readByte += ( 63 - bitsInBuffer ) >> 3;
+				bitsInBuffer |= 56;
+			}
+			else
+			{
+				// Near the end. Past endByte the buffer fills with zeros, which bitsRemaining stops us from using
+				while ( bitsInBuffer <= 56 && readByte < endByte )
+				{
+					bitBuffer |= static_cast<uint64_t>( input[ readByte++ ] ) << ( 56 - bitsInBuffer );
+					bitsInBuffer += 8;
+				}
+			}
+		}
+
+		const DecodeEntry &entry = table[ bitBuffer >> ( 64 - DECODE_TABLE_BITS ) ];
+		const unsigned int bitLength = entry.bitLength != 0 ? entry.bitLength : DECODE_TABLE_BITS;
+		if ( bitLength > bitsRemaining )
+			break;
+		bitBuffer <<= bitLength;
+		bitsInBuffer = bitsInBuffer > bitLength ? bitsInBuffer - bitLength : 0;
+		bitsRemaining -= bitLength;
 
-  unsigned outputWriteIndex = 0;
-  const HuffmanEncodingTreeNode* currentNode = root;
+		if ( entry.bitLength != 0 )
+		{
+			output( outputWriteIndex++, entry.value );
+			table = decodeTables;
+		}
+		else
+			table = decodeTables + ( entry.next << DECODE_TABLE_BITS );
+	}
 
-	// For each bit, go left if it is a 0 and right if it is a 1.  When we reach a leaf, that gives us the desired value and we restart from the root
+	return outputWriteIndex;
+}
 
-	for ( unsigned counter = 0; counter < sizeInBits; ++counter )
+namespace
+{
+	// Writes to an array, counting but dropping characters past its end
+	struct DecodeToArray
 	{
-		if ( input->ReadBit() == false )   // left!
-			currentNode = currentNode->left;
-		else
-			currentNode = currentNode->right;
+		unsigned char *output;
+		size_t maxCharsToWrite;
 
-		if ( currentNode->left == nullptr && currentNode->right == nullptr )   // Leaf
+		void operator()( unsigned outputWriteIndex, unsigned char value ) const
 		{
-
 			if ( outputWriteIndex < maxCharsToWrite )
-				output[ outputWriteIndex ] = currentNode->value;
+				output[ outputWriteIndex ] = value;
+		}
+	};
 
-			outputWriteIndex++;
+	// Writes to a BitStream, 256 characters at a time
+	struct DecodeToBitStream
+	{
+		RakNet::BitStream *output;
+		unsigned char buffer[ 256 ];
+		unsigned int bufferSize;
 
-			currentNode = root;
+		void operator()( unsigned outputWriteIndex, unsigned char value )
+		{
+			(void) outputWriteIndex;
+			buffer[ bufferSize++ ] = value;
+			if ( bufferSize == sizeof( buffer ) )
+				Flush();
 		}
-	}
+
+		void Flush( void )
+		{
+			if ( bufferSize > 0 )
+				output->WriteBits( buffer, bufferSize * 8, true ); // Use WriteBits instead of Write(char) because we want to avoid TYPE_CHECKING
+			bufferSize = 0;
+		}
+	};
+}
+
+unsigned HuffmanEncodingTree::DecodeArray( RakNet::BitStream * input,
+                                          const BitSize_t sizeInBits,
+                                          const size_t maxCharsToWrite, unsigned char *output )
+{
+	// Never decode bits past the end of input. The read offset still moves past all sizeInBits bits
+	BitSize_t bitsToDecode = sizeInBits;
+	if ( bitsToDecode > input->GetNumberOfUnreadBits() )
+		bitsToDecode = input->GetNumberOfUnreadBits();
+
+	DecodeToArray decodeToArray;
+	decodeToArray.output = output;
+	decodeToArray.maxCharsToWrite = maxCharsToWrite;
+	const unsigned outputWriteIndex = DecodeBits( input->GetData(), input->GetReadOffset(), bitsToDecode, decodeToArray );
+	input->IgnoreBits( sizeInBits );
 
 	return outputWriteIndex;
 }
@@ -237,24 +426,11 @@ void HuffmanEncodingTree::DecodeArray( unsigned char *input,
   if ( sizeInBits <= 0 )
 		return ;
 
-	RakNet::BitStream bitStream(input, BITS_TO_BYTES(sizeInBits), false);
-
-  const HuffmanEncodingTreeNode* currentNode = root;
-
-	// For each bit, go left if it is a 0 and right if it is a 1.  When we reach a leaf, that gives us the desired value and we restart from the root
-	for ( unsigned counter = 0; counter < sizeInBits; ++counter )
-	{
-		if ( bitStream.ReadBit() == false )   // left!
-			currentNode = currentNode->left;
-		else
-			currentNode = currentNode->right;
-
-		if ( currentNode->left == nullptr && currentNode->right == nullptr )   // Leaf
-		{
-			output->WriteBits( &( currentNode->value ), sizeof( char ) * 8, true ); // Use WriteBits instead of Write(char) because we want to avoid TYPE_CHECKING
-			currentNode = root;
-		}
-	}
+	DecodeToBitStream decodeToBitStream;
+	decodeToBitStream.output = output;
+	decodeToBitStream.bufferSize = 0;
+	DecodeBits( input, 0, sizeInBits, decodeToBitStream );
+	decodeToBitStream.Flush();
 }
 
 // Insertion sort.  Slow but easy to write in this case
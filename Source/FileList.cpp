@@ -28,6 +28,8 @@
 #ifdef _WIN32 
 // For mkdir
 #include <direct.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 
 #else
@@ -42,9 +44,13 @@
 #include "../include/RakNet/SuperFastHash.h"
 #include "../include/RakNet/RakAssert.h"
 #include "../include/RakNet/LinuxStrings.h"
+#include "../include/RakNet/ThreadPool.h"
+#include "../include/RakNet/DS_Hash.h"
+#include "../include/RakNet/RakSleep.h"
 
 #define MAX_FILENAME_LENGTH 512
 static const unsigned HASH_LENGTH=4;
+static const unsigned int HASH_CACHE_VERSION=1;
 
 using namespace RakNet;
 
@@ -106,6 +112,7 @@ void FLP_Printf::OnSendAborted( SystemAddress systemAddress )
 }
 FileList::FileList()
 {
+	numHashThreads=4;
 }
 FileList::~FileList()
 {
@@ -192,6 +199,10 @@ void FileList::AddFile(const char *filename, const char *fullPathToFile, const c
 		}
 	}
 
+	InsertFile(filename, fullPathToFile, data, dataLength, fileLength, context, isAReference, takeDataPointer);
+}
+void FileList::InsertFile(const char *filename, const char *fullPathToFile, const char *data, const unsigned dataLength, const unsigned fileLength, FileListNodeContext context, bool isAReference, bool takeDataPointer)
+{
 	FileListNode n;
 //	size_t fileNameLen = strlen(filename);
 	if (dataLength && data)
@@ -222,6 +233,188 @@ void FileList::AddFile(const char *filename, const char *fullPathToFile, const c
 		
 	fileList.Insert(n, _FILE_AND_LINE_);
 }
+struct FileHashCacheEntry
+{
+	uint64_t fileLength;
+	uint64_t modificationTime;
+	unsigned int hash;
+	// Found by this scan
+	bool isCurrent;
+};
+typedef DataStructures::Hash<RakNet::RakString, FileHashCacheEntry, 8192, RakNet::RakString::ToInteger> FileHashCache;
+
+// One file found by AddFilesFromDirectory(), read and hashed on a thread pool thread
+struct FileHashJob
+{
+	RakNet::RakString fullPath;
+	unsigned int fileLength;
+	bool writeHash;
+	bool writeData;
+	// Read only while jobs are running
+	FileHashCache *hashCache;
+
+	// Outputs
+	bool fileRead;
+	char *data;
+	unsigned int dataLength;
+	unsigned int hash;
+	bool hasModificationTime;
+	uint64_t statFileLength;
+	uint64_t modificationTime;
+};
+
+static bool GetFileModificationTime(const char *path, uint64_t *fileLength, uint64_t *modificationTime)
+{
+#if defined(_WIN32)
+	struct _stat64 fileStat;
+	if (_stat64(path, &fileStat)!=0)
+		return false;
+	*modificationTime=(uint64_t) fileStat.st_mtime;
+#else
+	struct stat fileStat;
+	if (stat(path, &fileStat)!=0)
+		return false;
+#if defined(__linux__)
+	*modificationTime=(uint64_t) fileStat.st_mtim.tv_sec * 1000000000 + (uint64_t) fileStat.st_mtim.tv_nsec;
+#else
+	*modificationTime=(uint64_t) fileStat.st_mtime;
+#endif
+#endif
+	*fileLength=(uint64_t) fileStat.st_size;
+	return true;
+}
+static void LoadHashCache(const char *hashCachePath, FileHashCache *hashCache)
+{
+	FILE *fp = fopen(hashCachePath, "rb");
+	if (fp==0)
+		return;
+	fseek(fp, 0, SEEK_END);
+	long length = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (length <= 0)
+	{
+		fclose(fp);
+		return;
+	}
+	unsigned char *data = (unsigned char*) rakMalloc_Ex( length, _FILE_AND_LINE_ );
+	if (data==0)
+	{
+		fclose(fp);
+		notifyOutOfMemory(_FILE_AND_LINE_);
+		return;
+	}
+	size_t numRead = fread(data, 1, length, fp);
+	fclose(fp);
+
+	RakNet::BitStream bs(data, (unsigned int) numRead, false);
+	unsigned int version=0, numEntries=0;
+	bs.Read(version);
+	bs.Read(numEntries);
+	if (version==HASH_CACHE_VERSION)
+	{
+		RakNet::RakString path;
+		FileHashCacheEntry entry;
+		entry.isCurrent=false;
+		for (unsigned int i=0; i < numEntries; i++)
+		{
+			if (path.Deserialize(&bs)==false ||
+				bs.Read(entry.fileLength)==false ||
+				bs.Read(entry.modificationTime)==false ||
+				bs.Read(entry.hash)==false)
+				break;
+			hashCache->Push(path, entry, _FILE_AND_LINE_);
+		}
+	}
+	rakFree_Ex(data, _FILE_AND_LINE_ );
+}
+static void SaveHashCache(const char *hashCachePath, FileHashCache *hashCache, const char *scannedDirectory)
+{
+	DataStructures::List<FileHashCacheEntry> entries;
+	DataStructures::List<RakNet::RakString> paths;
+	hashCache->GetAsList(entries, paths, _FILE_AND_LINE_);
+
+	size_t scannedDirectoryLength = strlen(scannedDirectory);
+	unsigned int numEntries=0, i;
+	for (i=0; i < entries.Size(); i++)
+	{
+		// Keep files from other directories sharing this cache
+		if (entries[i].isCurrent || strncmp(paths[i].C_String(), scannedDirectory, scannedDirectoryLength)!=0)
+			numEntries++;
+	}
+
+	RakNet::BitStream bs;
+	bs.Write(HASH_CACHE_VERSION);
+	bs.Write(numEntries);
+	for (i=0; i < entries.Size(); i++)
+	{
+		if (entries[i].isCurrent || strncmp(paths[i].C_String(), scannedDirectory, scannedDirectoryLength)!=0)
+		{
+			paths[i].Serialize(&bs);
+			bs.Write(entries[i].fileLength);
+			bs.Write(entries[i].modificationTime);
+			bs.Write(entries[i].hash);
+		}
+	}
+
+	FILE *fp = fopen(hashCachePath, "wb");
+	if (fp==0)
+		return;
+	fwrite(bs.GetData(), 1, bs.GetNumberOfBytesUsed(), fp);
+	fclose(fp);
+}
+static FileHashJob* ReadAndHashFile(FileHashJob *job, bool *returnOutput, void* perThreadData)
+{
+	(void) perThreadData;
+	*returnOutput=true;
+
+	// Stat before reading, so a file changed during the read gets a newer time than the one cached for it
+	const char *fullPath = job->fullPath.C_String();
+	if (job->hashCache)
+		job->hasModificationTime=GetFileModificationTime(fullPath, &job->statFileLength, &job->modificationTime);
+
+	if (job->writeData)
+	{
+		FILE *fp = fopen(fullPath, "rb");
+		if (fp==0)
+			return job;
+		unsigned int prefixLength = job->writeHash ? HASH_LENGTH : 0;
+		job->dataLength=job->fileLength+prefixLength;
+		job->data=(char*) rakMalloc_Ex( job->dataLength, _FILE_AND_LINE_ );
+		RakAssert(job->data);
+		fread(job->data+prefixLength, job->fileLength, 1, fp);
+		fclose(fp);
+		if (job->writeHash)
+			job->hash=SuperFastHash(job->data+HASH_LENGTH, job->fileLength);
+	}
+	else
+	{
+		FileHashCacheEntry *entry=0;
+		if (job->hashCache && job->hasModificationTime)
+			entry=job->hashCache->Peek(job->fullPath);
+		if (entry && entry->fileLength==job->statFileLength && entry->modificationTime==job->modificationTime)
+			job->hash=entry->hash;
+		else
+			job->hash=SuperFastHashFile(fullPath);
+	}
+
+	if (job->writeHash)
+	{
+		unsigned int hash=job->hash;
+		if (RakNet::BitStream::DoEndianSwap())
+			RakNet::BitStream::ReverseBytesInPlace((unsigned char*) &hash, sizeof(hash));
+		if (job->data)
+			memcpy(job->data, &hash, HASH_LENGTH);
+		else
+		{
+			job->data=(char*) rakMalloc_Ex( HASH_LENGTH, _FILE_AND_LINE_ );
+			RakAssert(job->data);
+			memcpy(job->data, &hash, HASH_LENGTH);
+			job->dataLength=HASH_LENGTH;
+		}
+	}
+	job->fileRead=true;
+	return job;
+}
 void FileList::AddFilesFromDirectory(const char *applicationDirectory, const char *subDirectory, bool writeHash, bool writeData, bool recursive, FileListNodeContext context)
 {
 
@@ -232,8 +425,7 @@ void FileList::AddFilesFromDirectory(const char *applicationDirectory, const cha
 	char fullPath[520];
 	_finddata_t fileInfo;
 	intptr_t dir;
-	FILE *fp;
-	char *dirSoFar, *fileData;
+	char *dirSoFar;
 	dirSoFar=(char*) rakMalloc_Ex( 520, _FILE_AND_LINE_ );
 	RakAssert(dirSoFar);
 
@@ -260,6 +452,19 @@ void FileList::AddFilesFromDirectory(const char *applicationDirectory, const cha
 	for (unsigned int flpcIndex=0; flpcIndex < fileListProgressCallbacks.Size(); flpcIndex++)
 		fileListProgressCallbacks[flpcIndex]->OnAddFilesFromDirectoryStarted(this, dirSoFar);
 	// RAKNET_DEBUG_PRINTF("Adding files from directory %s\n",dirSoFar);
+
+	// Files are read and hashed by jobs, while this thread walks the directories
+	// Jobs are kept in the order found, so files are added in the same order however many threads there are
+	RakNet::RakString scannedDirectory(dirSoFar);
+	bool useHashCache = writeHash && writeData==false && hashCachePath.IsEmpty()==false;
+	FileHashCache hashCache;
+	if (useHashCache)
+		LoadHashCache(hashCachePath.C_String(), &hashCache);
+	DataStructures::List<FileHashJob*> jobs;
+	unsigned int numJobsDone=0;
+	ThreadPool<FileHashJob*, FileHashJob*> threadPool;
+	bool useThreads = (writeHash || writeData) && numHashThreads > 1 && threadPool.StartThreads(numHashThreads, 0);
+
 	dirList.Push(dirSoFar, _FILE_AND_LINE_ );
 	while (dirList.Size())
 	{
@@ -277,7 +482,7 @@ void FileList::AddFilesFromDirectory(const char *applicationDirectory, const cha
 			unsigned i;
 			for (i=0; i < dirList.Size(); i++)
 				rakFree_Ex(dirList[i], _FILE_AND_LINE_ );
-			return;
+			break;
 		}
 
 //		RAKNET_DEBUG_PRINTF("Adding %s. %i remaining.\n", fullPath, dirList.Size());
@@ -297,67 +502,39 @@ void FileList::AddFilesFromDirectory(const char *applicationDirectory, const cha
 			{
 				strcpy(fullPath, dirSoFar);
 				strcat(fullPath, fileInfo.name);
-				fileData=0;
 
 				for (unsigned int flpcIndex=0; flpcIndex < fileListProgressCallbacks.Size(); flpcIndex++)
 					fileListProgressCallbacks[flpcIndex]->OnFile(this, dirSoFar, fileInfo.name, fileInfo.size);
 
-				if (writeData && writeHash)
+				FileHashJob *job = RakNet::OP_NEW<FileHashJob>(_FILE_AND_LINE_);
+				job->fullPath=fullPath;
+				job->fileLength=(unsigned int) fileInfo.size;
+				job->writeHash=writeHash;
+				job->writeData=writeData;
+				job->hashCache=useHashCache ? &hashCache : 0;
+				job->fileRead=false;
+				job->data=0;
+				job->dataLength=0;
+				job->hash=0;
+				job->hasModificationTime=false;
+				job->statFileLength=0;
+				job->modificationTime=0;
+				jobs.Push(job, _FILE_AND_LINE_);
+
+				if (writeHash==false && writeData==false)
 				{
-					fp = fopen(fullPath, "rb");
-					if (fp)
-					{
-						fileData= (char*) rakMalloc_Ex( fileInfo.size+HASH_LENGTH, _FILE_AND_LINE_ );
-						RakAssert(fileData);
-						fread(fileData+HASH_LENGTH, fileInfo.size, 1, fp);
-						fclose(fp);
-
-						unsigned int hash = SuperFastHash(fileData+HASH_LENGTH, fileInfo.size);
-						if (RakNet::BitStream::DoEndianSwap())
-							RakNet::BitStream::ReverseBytesInPlace((unsigned char*) &hash, sizeof(hash));
-						memcpy(fileData, &hash, HASH_LENGTH);
-
-						//					sha1.Reset();
-						//					sha1.Update( ( unsigned char* ) fileData+HASH_LENGTH, fileInfo.size );
-						//					sha1.Final();
-						//					memcpy(fileData, sha1.GetHash(), HASH_LENGTH);
-						// File data and hash
-						AddFile((const char*)fullPath+rootLen, fullPath, fileData, fileInfo.size+HASH_LENGTH, fileInfo.size, context);
-					}					
-				}
-				else if (writeHash)
-				{
-//					sha1.Reset();
-//					DR_SHA1.hashFile((char*)fullPath);
-//					sha1.Final();
-
-					unsigned int hash = SuperFastHashFile(fullPath);
-					if (RakNet::BitStream::DoEndianSwap())
-						RakNet::BitStream::ReverseBytesInPlace((unsigned char*) &hash, sizeof(hash));
-
-					// Hash only
-				//	AddFile((const char*)fullPath+rootLen, (const char*)sha1.GetHash(), HASH_LENGTH, fileInfo.size, context);
-					AddFile((const char*)fullPath+rootLen, fullPath, (const char*)&hash, HASH_LENGTH, fileInfo.size, context);
-				}
-				else if (writeData)
-				{
-					fileData= (char*) rakMalloc_Ex( fileInfo.size, _FILE_AND_LINE_ );
-					RakAssert(fileData);
-					fp = fopen(fullPath, "rb");
-					fread(fileData, fileInfo.size, 1, fp);
-					fclose(fp);
-
-					// File data only
-					AddFile(fullPath+rootLen, fullPath, fileData, fileInfo.size, fileInfo.size, context);
+					// Just the filename
+					job->fileRead=true;
+					numJobsDone++;
 				}
+				else if (useThreads)
+					threadPool.AddInput(ReadAndHashFile, job);
 				else
 				{
-					// Just the filename
-					AddFile(fullPath+rootLen, fullPath, 0, 0, fileInfo.size, context);
+					bool returnOutput;
+					ReadAndHashFile(job, &returnOutput, 0);
+					numJobsDone++;
 				}
-
-				if (fileData)
-					rakFree_Ex(fileData, _FILE_AND_LINE_ );
 			}
 			else if ((fileInfo.attrib & _A_SUBDIR) && (fileInfo.attrib & (_A_HIDDEN | _A_SYSTEM))==0 && recursive)
 			{
@@ -373,8 +550,78 @@ void FileList::AddFilesFromDirectory(const char *applicationDirectory, const cha
 
 		_findclose(dir);
 		rakFree_Ex(dirSoFar, _FILE_AND_LINE_ );
+
+		// Jobs are finished through the pointers in jobs, so just discard the output
+		while (useThreads && threadPool.HasOutputFast() && threadPool.HasOutput())
+		{
+			threadPool.GetOutput();
+			numJobsDone++;
+		}
+	}
+
+	while (numJobsDone < jobs.Size())
+	{
+		while (threadPool.HasOutputFast() && threadPool.HasOutput())
+		{
+			threadPool.GetOutput();
+			numJobsDone++;
+		}
+		if (numJobsDone < jobs.Size())
+			RakSleep(1);
 	}
+	if (useThreads)
+		threadPool.StopThreads();
 
+	// Without existing files there is nothing to replace, so skip the search AddFile() does for each file
+	bool insertWithoutSearch = fileList.Size()==0;
+	for (unsigned int jobIndex=0; jobIndex < jobs.Size(); jobIndex++)
+	{
+		FileHashJob *job = jobs[jobIndex];
+		if (job->fileRead)
+		{
+			const char *filename = job->fullPath.C_String()+rootLen;
+			if (insertWithoutSearch)
+			{
+				InsertFile(filename, job->fullPath.C_String(), job->data, job->dataLength, job->fileLength, context, false, true);
+				// InsertFile() only takes the pointer when there is data
+				if (job->dataLength)
+					job->data=0;
+			}
+			else
+				AddFile(filename, job->fullPath.C_String(), job->data, job->dataLength, job->fileLength, context);
+
+			if (job->hasModificationTime)
+			{
+				FileHashCacheEntry entry;
+				entry.fileLength=job->statFileLength;
+				entry.modificationTime=job->modificationTime;
+				entry.hash=job->hash;
+				entry.isCurrent=true;
+				FileHashCacheEntry *existingEntry = hashCache.Peek(job->fullPath);
+				if (existingEntry)
+					*existingEntry=entry;
+				else
+					hashCache.Push(job->fullPath, entry, _FILE_AND_LINE_);
+			}
+		}
+		if (job->data)
+			rakFree_Ex(job->data, _FILE_AND_LINE_ );
+		RakNet::OP_DELETE(job, _FILE_AND_LINE_);
+	}
+
+	if (useHashCache)
+		SaveHashCache(hashCachePath.C_String(), &hashCache, scannedDirectory.C_String());
+}
+void FileList::SetNumHashThreads(unsigned int _numHashThreads)
+{
+	numHashThreads=_numHashThreads;
+}
+void FileList::SetHashCachePath(const char *_hashCachePath)
+{
+	if (_hashCachePath)
+		hashCachePath=_hashCachePath;
+	else
+		hashCachePath.Clear();
 }
 void FileList::Clear(void)
 {
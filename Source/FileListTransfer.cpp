@@ -489,6 +489,15 @@ bool FileListTransfer::DecodeFile(Packet *packet, bool isTheFullFile)
 
 	return true;
 }
+bool FileListTransfer::GetReceiveFilter(PluginReceiveFilter &filter) const
+{
+	filter.Add(ID_FILE_LIST_TRANSFER_HEADER);
+	filter.Add(ID_FILE_LIST_TRANSFER_FILE);
+	filter.Add(ID_FILE_LIST_REFERENCE_PUSH);
+	filter.Add(ID_FILE_LIST_REFERENCE_PUSH_ACK);
+	filter.Add(ID_DOWNLOAD_PROGRESS);
+	return true;
+}
 PluginReceiveResult FileListTransfer::OnReceive(Packet *packet)
 {
 	switch (packet->data[0]) 
@@ -18,6 +18,9 @@
 // For mkdir
 #include <direct.h>
 #include <io.h>
+// For _stati64
+#include <sys/types.h>
+#include <sys/stat.h>
 #else
 #include <sys/stat.h>
 #include <unistd.h>
@@ -170,6 +173,24 @@ unsigned int GetFileLength(const char *path)
 	return fileLength;
 
 }
+uint64_t GetFileLength64(const char *path)
+{
+#ifdef _WIN32
+	struct _stati64 fileStat;
+	if (_stati64(path, &fileStat)!=0)
+		return 0;
+#else
+	struct stat fileStat;
+	if (stat(path, &fileStat)!=0)
+	{
+		// Without large file support, stat() fails for files that do not fit in off_t
+		if (errno==EOVERFLOW)
+			return (uint64_t) -1;
+		return 0;
+	}
+#endif
+	return (uint64_t) fileStat.st_size;
+}
 
 #ifdef _MSC_VER
 #pragma warning( pop )
@@ -232,6 +232,25 @@ void FullyConnectedMesh2::SetMyContext(BitStream *userContext)
 	}
 }
 */
+bool FullyConnectedMesh2::GetReceiveFilter(PluginReceiveFilter &filter) const
+{
+	filter.Add(ID_REMOTE_NEW_INCOMING_CONNECTION);
+	filter.Add(ID_FCM2_REQUEST_FCMGUID);
+	filter.Add(ID_FCM2_RESPOND_CONNECTION_COUNT);
+	filter.Add(ID_FCM2_INFORM_FCMGUID);
+	filter.Add(ID_FCM2_UPDATE_MIN_TOTAL_CONNECTION_COUNT);
+	filter.Add(ID_FCM2_NEW_HOST);
+	filter.Add(ID_FCM2_VERIFIED_JOIN_START);
+	filter.Add(ID_FCM2_VERIFIED_JOIN_CAPABLE);
+	filter.Add(ID_FCM2_VERIFIED_JOIN_FAILED);
+	filter.Add(ID_FCM2_VERIFIED_JOIN_ACCEPTED);
+	filter.Add(ID_FCM2_VERIFIED_JOIN_REJECTED);
+	filter.Add(ID_NAT_TARGET_UNRESPONSIVE);
+	filter.Add(ID_NAT_TARGET_NOT_CONNECTED);
+	filter.Add(ID_NAT_CONNECTION_TO_TARGET_LOST);
+	filter.Add(ID_NAT_PUNCHTHROUGH_FAILED);
+	return true;
+}
 PluginReceiveResult FullyConnectedMesh2::OnReceive(Packet *packet)
 {
 	switch (packet->data[0])
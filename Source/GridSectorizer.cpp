@@ -50,7 +50,7 @@ void GridSectorizer::Init(const float _maxCellWidth, const float _maxCellHeight,
 void GridSectorizer::AddEntry(void *entry, const float minX, const float minY, const float maxX, const float maxY)
 {
 	RakAssert(cellWidth>0.0f);
-	RakAssert(minX < maxX && minY < maxY);
+	RakAssert(minX <= maxX && minY <= maxY);
 
 	int xStart, yStart, xEnd, yEnd, xCur, yCur;
 	xStart=WorldToCellXOffsetAndClamped(minX);
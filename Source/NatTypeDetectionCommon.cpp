@@ -129,6 +129,9 @@ RakNetSocket2* RakNet::CreateNonblockingBoundSocket(const char *bindAddr
 		bbp.pollingThreadPriority=0;
 		bbp.eventHandler=eventHandler;
 		bbp.remotePortRakNetWasStartedOn_PS3_PS4_PSP2=0;
+		bbp.recvBatchSize=0;
+		bbp.reusePort=false;
+		bbp.recvThreadCpu=-1;
 		RNS2BindResult br = ((RNS2_Berkley*) r2)->Bind(&bbp, _FILE_AND_LINE_);
 
 		if (br==BR_FAILED_TO_BIND_SOCKET)
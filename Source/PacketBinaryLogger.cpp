@@ -0,0 +1,433 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "../include/RakNet/NativeFeatureIncludes.h"
+#if _RAKNET_SUPPORT_PacketLogger==1
+
+#include "../include/RakNet/PacketBinaryLogger.h"
+#include "../include/RakNet/InternalPacket.h"
+#include "../include/RakNet/RakPeerInterface.h"
+#include "../include/RakNet/MessageIdentifiers.h"
+#include "../include/RakNet/GetTime.h"
+#include "../include/RakNet/RakSleep.h"
+#include "../include/RakNet/SocketIncludes.h"
+#include "../include/RakNet/gettimeofday.h"
+#include <string.h>
+#include <time.h>
+
+using namespace RakNet;
+
+STATIC_FACTORY_DEFINITIONS(PacketBinaryLogger,PacketBinaryLogger);
+
+// How many records the logging thread takes from the ring per write
+static const unsigned int PACKET_BINARY_LOGGER_BATCH_SIZE=64;
+
+// The decoder and PACKET_BINARY_LOGGER_RING_SIZE assume this
+static_assert(sizeof(PacketLogRecord)==128, "PacketLogRecord must not change size without changing PACKET_LOG_FILE_VERSION");
+
+void PacketLogAddress::Set(const SystemAddress &systemAddress)
+{
+	memset(this, 0, sizeof(*this));
+#if RAKNET_SUPPORT_IPV6==1
+	if (systemAddress.GetIPVersion()==6)
+	{
+		memcpy(ip, &systemAddress.address.addr6.sin6_addr, 16);
+		port=systemAddress.address.addr6.sin6_port;
+		ipVersion=6;
+		return;
+	}
+#endif
+	memcpy(ip, &systemAddress.address.addr4.sin_addr, 4);
+	port=systemAddress.address.addr4.sin_port;
+	ipVersion=4;
+}
+SystemAddress PacketLogAddress::Get(void) const
+{
+	SystemAddress systemAddress;
+#if RAKNET_SUPPORT_IPV6==1
+	if (ipVersion==6)
+	{
+		memset(&systemAddress.address.addr6, 0, sizeof(systemAddress.address.addr6));
+		systemAddress.address.addr6.sin6_family=AF_INET6;
+		memcpy(&systemAddress.address.addr6.sin6_addr, ip, 16);
+		systemAddress.SetPortNetworkOrder(port);
+		return systemAddress;
+	}
+#endif
+	systemAddress.address.addr4.sin_family=AF_INET;
+	memcpy(&systemAddress.address.addr4.sin_addr, ip, 4);
+	systemAddress.SetPortNetworkOrder(port);
+	return systemAddress;
+}
+
+RAK_THREAD_DECLARATION(RakNet::PacketBinaryLoggerLoop)
+{
+	PacketBinaryLogger *logger = (PacketBinaryLogger *) arguments;
+	logger->threadRunning.Increment();
+
+	while (logger->isLogging.load(std::memory_order_acquire))
+	{
+		logger->ringEvent.WaitOnEvent(50);
+		logger->wakeRequested.store(false, std::memory_order_relaxed);
+		logger->WriteRecords();
+	}
+	// Whatever was pushed before StopLog()
+	logger->WriteRecords();
+
+	logger->threadRunning.Decrement();
+	return 0;
+}
+
+PacketBinaryLogger::PacketBinaryLogger()
+{
+	wakeRequested=false;
+	isLogging=false;
+	droppedRecords=0;
+	droppedRecordsWritten=0;
+	memset(messageIdFilter, 1, sizeof(messageIdFilter));
+	sampleRate=1;
+	sampleCounter=0;
+	logFile=0;
+	startTime=0;
+	fileIndex=0;
+	fileBytes=0;
+	maxFileBytes=0;
+	maxFiles=0;
+}
+PacketBinaryLogger::~PacketBinaryLogger()
+{
+	StopLog();
+}
+bool PacketBinaryLogger::StartLog(const char *_filenamePrefix, unsigned int _maxFileBytes, unsigned int _maxFiles, unsigned int ringRecords)
+{
+	StopLog();
+
+	if (_filenamePrefix && _filenamePrefix[0])
+		filenamePrefix=_filenamePrefix;
+	else
+		filenamePrefix="PacketLog";
+	// Room for the file header and at least one record
+	if (_maxFileBytes!=0 && _maxFileBytes < sizeof(PacketLogFileHeader)+sizeof(PacketLogRecord))
+		_maxFileBytes=sizeof(PacketLogFileHeader)+sizeof(PacketLogRecord);
+	maxFileBytes=_maxFileBytes;
+	maxFiles=_maxFiles;
+	// Seconds since 1970 rather than GetTimeMS(), which restarts from 0 with the process and would reuse the names of an earlier run
+	startTime=(unsigned int) time(0);
+	fileIndex=0;
+	if (OpenFile()==false)
+		return false;
+
+	if (ring.GetCapacity() < ringRecords)
+		ring.SetCapacity(ringRecords, _FILE_AND_LINE_);
+	PacketLogRecord record;
+	while (ring.Pop(record))
+		;
+	droppedRecords=0;
+	droppedRecordsWritten=0;
+	wakeRequested=false;
+	ringEvent.InitEvent();
+
+	isLogging.store(true, std::memory_order_release);
+	int errorCode = RakNet::RakThread::Create(PacketBinaryLoggerLoop, this);
+	if (errorCode!=0)
+	{
+		isLogging=false;
+		ringEvent.CloseEvent();
+		fclose(logFile);
+		logFile=0;
+		return false;
+	}
+	while (threadRunning.GetValue()==0)
+		RakSleep(0);
+	return true;
+}
+void PacketBinaryLogger::StopLog(void)
+{
+	if (isLogging.exchange(false)==false)
+		return;
+
+	ringEvent.SetEvent();
+	while (threadRunning.GetValue()>0)
+		RakSleep(0);
+	ringEvent.CloseEvent();
+
+	if (logFile)
+	{
+		fclose(logFile);
+		logFile=0;
+	}
+}
+void PacketBinaryLogger::SetMessageIDFilter(MessageID messageId, bool log)
+{
+	messageIdFilter[messageId]=log;
+}
+void PacketBinaryLogger::SetMessageIDFilterAll(bool log)
+{
+	memset(messageIdFilter, log, sizeof(messageIdFilter));
+}
+void PacketBinaryLogger::SetSampleRate(unsigned int _sampleRate)
+{
+	if (_sampleRate==0)
+		_sampleRate=1;
+	sampleRate=_sampleRate;
+}
+uint64_t PacketBinaryLogger::GetDroppedRecords(void) const
+{
+	return droppedRecords.load(std::memory_order_relaxed);
+}
+void PacketBinaryLogger::OnDirectSocketSend(const char *data, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress)
+{
+	if (logDirectMessages==false || ShouldLog(data[0], true)==false)
+		return;
+
+	PacketLogRecord record;
+	InitRecord(record, PLRT_DIRECT_SEND, RakNet::GetTimeMS(), rakPeerInterface->GetExternalID(remoteSystemAddress), remoteSystemAddress);
+	record.messageId=data[0];
+	record.bitLength=bitsUsed;
+	PushRecord(record);
+}
+void PacketBinaryLogger::OnDirectSocketReceive(const char *data, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress)
+{
+	if (logDirectMessages==false || ShouldLog(data[0], true)==false)
+		return;
+
+	PacketLogRecord record;
+	InitRecord(record, PLRT_DIRECT_RECEIVE, RakNet::GetTime(), rakPeerInterface->GetInternalID(UNASSIGNED_SYSTEM_ADDRESS), remoteSystemAddress);
+	record.messageId=data[0];
+	record.bitLength=bitsUsed;
+	PushRecord(record);
+}
+void PacketBinaryLogger::OnReliabilityLayerNotification(const char *errorMessage, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress, bool isError)
+{
+	// Rare, so never filtered or sampled
+	if (isLogging.load(std::memory_order_relaxed)==false)
+		return;
+
+	PacketLogRecord record;
+	InitRecord(record, isError ? PLRT_RELIABILITY_ERROR : PLRT_RELIABILITY_WARNING, RakNet::GetTime(), rakPeerInterface->GetInternalID(UNASSIGNED_SYSTEM_ADDRESS), remoteSystemAddress);
+	record.bitLength=bitsUsed;
+	SetText(record, errorMessage, 0);
+	PushRecord(record);
+	RakAssert(isError==false);
+}
+void PacketBinaryLogger::OnInternalPacket(InternalPacket *internalPacket, unsigned frameNumber, SystemAddress remoteSystemAddress, RakNet::TimeMS time, int isSend)
+{
+	bool isTimestamp = internalPacket->data[0]==ID_TIMESTAMP;
+	unsigned char messageId = isTimestamp ? internalPacket->data[1+sizeof(RakNet::Time)] : internalPacket->data[0];
+	// Only the first part of a split message starts with its identifier
+	bool hasMessageId = internalPacket->splitPacketCount==0 || internalPacket->splitPacketIndex==0;
+	if (ShouldLog(messageId, hasMessageId)==false)
+		return;
+
+	PacketLogRecord record;
+	InitRecord(record, isTimestamp ? PLRT_INTERNAL_PACKET_TIMESTAMP : PLRT_INTERNAL_PACKET, time, rakPeerInterface->GetExternalID(remoteSystemAddress), remoteSystemAddress);
+	if (internalPacket->reliability==UNRELIABLE || internalPacket->reliability==UNRELIABLE_SEQUENCED || internalPacket->reliability==UNRELIABLE_WITH_ACK_RECEIPT)
+		record.reliableMessageNumber=(unsigned int)-1;
+	else
+		record.reliableMessageNumber=internalPacket->reliableMessageNumber;
+	record.frame=frameNumber;
+	record.bitLength=internalPacket->dataBitLength;
+	record.direction=(unsigned char) isSend;
+	record.messageId=messageId;
+	record.packet.splitPacketId=internalPacket->splitPacketId;
+	record.packet.splitPacketIndex=internalPacket->splitPacketIndex;
+	record.packet.splitPacketCount=internalPacket->splitPacketCount;
+	record.packet.orderingIndex=internalPacket->orderingIndex;
+	PushRecord(record);
+}
+void PacketBinaryLogger::OnAck(unsigned int messageNumber, SystemAddress remoteSystemAddress, RakNet::TimeMS time)
+{
+	if (ShouldLog(0, false)==false)
+		return;
+
+	PacketLogRecord record;
+	InitRecord(record, PLRT_ACK, time, rakPeerInterface->GetExternalID(remoteSystemAddress), remoteSystemAddress);
+	record.reliableMessageNumber=messageNumber;
+	PushRecord(record);
+}
+void PacketBinaryLogger::OnPushBackPacket(const char *data, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress)
+{
+	if (ShouldLog(data[0], true)==false)
+		return;
+
+	PacketLogRecord record;
+	InitRecord(record, PLRT_PUSH_BACK_PACKET, RakNet::GetTimeMS(), rakPeerInterface->GetExternalID(remoteSystemAddress), remoteSystemAddress);
+	record.messageId=data[0];
+	record.bitLength=bitsUsed;
+	PushRecord(record);
+}
+void PacketBinaryLogger::WriteMiscellaneous(const char *type, const char *msg)
+{
+	if (isLogging.load(std::memory_order_relaxed)==false)
+		return;
+
+	PacketLogRecord record;
+	InitRecord(record, PLRT_MISCELLANEOUS, RakNet::GetTimeMS(), rakPeerInterface->GetInternalID(), UNASSIGNED_SYSTEM_ADDRESS);
+	SetText(record, type, msg);
+	PushRecord(record);
+}
+void PacketBinaryLogger::LogHeader(void)
+{
+}
+bool PacketBinaryLogger::ShouldLog(unsigned char messageId, bool hasMessageId)
+{
+	if (isLogging.load(std::memory_order_relaxed)==false)
+		return false;
+	if (hasMessageId && messageIdFilter[messageId]==0)
+		return false;
+	if (sampleRate > 1)
+		return sampleCounter.fetch_add(1, std::memory_order_relaxed) % sampleRate == 0;
+	return true;
+}
+void PacketBinaryLogger::InitRecord(PacketLogRecord &record, PacketLogRecordType type, uint64_t time, const SystemAddress &local, const SystemAddress &remote)
+{
+	// Records are written to the file as they are, so padding and unused address bytes must not hold stack contents
+	memset(&record, 0, sizeof(record));
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	record.clockUS=(uint64_t) tv.tv_sec * 1000000 + (uint64_t) tv.tv_usec;
+	record.time=time;
+	record.type=(unsigned char) type;
+	record.remote.Set(remote);
+	record.local.Set(local);
+	record.packet.splitPacketId=(unsigned int)-1;
+	record.packet.splitPacketIndex=(unsigned int)-1;
+	record.packet.splitPacketCount=(unsigned int)-1;
+	record.packet.orderingIndex=(unsigned int)-1;
+}
+void PacketBinaryLogger::PushRecord(const PacketLogRecord &record)
+{
+	if (ring.Push(record)==false)
+	{
+		droppedRecords.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	// Wake the logging thread early rather than waiting for its timeout once the ring is half full
+	if (ring.Size() > ring.GetCapacity()/2 && wakeRequested.exchange(true, std::memory_order_relaxed)==false)
+		ringEvent.SetEvent();
+}
+void PacketBinaryLogger::SetText(PacketLogRecord &record, const char *first, const char *second)
+{
+	memset(record.text, 0, sizeof(record.text));
+	size_t firstLength=strlen(first);
+	if (firstLength > sizeof(record.text)-1)
+		firstLength=sizeof(record.text)-1;
+	memcpy(record.text, first, firstLength);
+	// Leave room for both terminators
+	size_t room=sizeof(record.text)-firstLength-1;
+	if (second && room > 1)
+	{
+		size_t secondLength=strlen(second);
+		if (secondLength > room-1)
+			secondLength=room-1;
+		memcpy(record.text+firstLength+1, second, secondLength);
+	}
+}
+void PacketBinaryLogger::WriteRecords(void)
+{
+	PacketLogRecord batch[PACKET_BINARY_LOGGER_BATCH_SIZE];
+	unsigned int count=0;
+	bool wroteAny=false;
+
+	for (;;)
+	{
+		// Note where records were lost before writing the ones after the loss
+		uint64_t dropped=droppedRecords.load(std::memory_order_relaxed);
+		if (dropped!=droppedRecordsWritten)
+		{
+			PacketLogRecord &record=batch[count++];
+			InitRecord(record, PLRT_DROPPED, RakNet::GetTimeMS(), UNASSIGNED_SYSTEM_ADDRESS, UNASSIGNED_SYSTEM_ADDRESS);
+			record.bitLength=(uint32_t) (dropped-droppedRecordsWritten);
+			droppedRecordsWritten=dropped;
+		}
+
+		while (count < PACKET_BINARY_LOGGER_BATCH_SIZE && ring.Pop(batch[count]))
+			count++;
+		if (count==0)
+			break;
+
+		WriteToFile(batch, count);
+		wroteAny=true;
+		if (count < PACKET_BINARY_LOGGER_BATCH_SIZE)
+			break;
+		count=0;
+	}
+
+	if (wroteAny && logFile)
+		fflush(logFile);
+}
+void PacketBinaryLogger::WriteToFile(const PacketLogRecord *records, unsigned int count)
+{
+	while (count > 0 && logFile)
+	{
+		unsigned int toWrite=count;
+		if (maxFileBytes!=0)
+		{
+			if (fileBytes + sizeof(PacketLogRecord) > maxFileBytes)
+			{
+				fclose(logFile);
+				logFile=0;
+				fileIndex++;
+				if (OpenFile()==false)
+					return;
+			}
+			unsigned int fit=(unsigned int) ((maxFileBytes-fileBytes)/sizeof(PacketLogRecord));
+			if (toWrite > fit)
+				toWrite=fit;
+		}
+
+		fwrite(records, sizeof(PacketLogRecord), toWrite, logFile);
+		fileBytes+=toWrite*(unsigned int) sizeof(PacketLogRecord);
+		records+=toWrite;
+		count-=toWrite;
+	}
+}
+bool PacketBinaryLogger::OpenFile(void)
+{
+	if (maxFiles!=0 && fileIndex >= maxFiles)
+	{
+		RakString oldest;
+		GetFilename(fileIndex-maxFiles, oldest);
+		remove(oldest.C_String());
+	}
+
+	RakString filename;
+	GetFilename(fileIndex, filename);
+	logFile=fopen(filename.C_String(), "wb");
+	if (logFile==0)
+		return false;
+
+	PacketLogFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PACKET_LOG_FILE_MAGIC, sizeof(PACKET_LOG_FILE_MAGIC));
+	header.version=PACKET_LOG_FILE_VERSION;
+	header.recordLength=sizeof(PacketLogRecord);
+	header.fileIndex=fileIndex;
+	header.printId=printId;
+	// The header is zeroed, so copying at most size-1 bytes leaves each string terminated
+	size_t length=strlen(prefix);
+	if (length > sizeof(header.prefix)-1)
+		length=sizeof(header.prefix)-1;
+	memcpy(header.prefix, prefix, length);
+	length=strlen(suffix);
+	if (length > sizeof(header.suffix)-1)
+		length=sizeof(header.suffix)-1;
+	memcpy(header.suffix, suffix, length);
+	fwrite(&header, sizeof(header), 1, logFile);
+	fileBytes=sizeof(header);
+	return true;
+}
+void PacketBinaryLogger::GetFilename(unsigned int index, RakString &filename) const
+{
+	filename.Set("%s_%u_%u.rpl", filenamePrefix.C_String(), startTime, index);
+}
+
+#endif // _RAKNET_SUPPORT_*
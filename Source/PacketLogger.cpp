@@ -157,59 +157,62 @@ void PacketLogger::OnReliabilityLayerNotification(const char *errorMessage, cons
 void PacketLogger::OnAck(unsigned int messageNumber, SystemAddress remoteSystemAddress, RakNet::TimeMS time)
 {
 	char str[256];
+	FormatAckLine(str, sizeof(str), messageNumber, time, rakPeerInterface->GetExternalID(remoteSystemAddress), remoteSystemAddress);
+	AddToLog(str);
+}
+
+void PacketLogger::FormatAckLine(char* into, size_t intoLength, unsigned int messageNumber, unsigned long long time, const SystemAddress& local, const SystemAddress& remote)
+{
 	char str1[64], str2[62];
-	SystemAddress localSystemAddress = rakPeerInterface->GetExternalID(remoteSystemAddress);
-	localSystemAddress.ToString(true, str1);
-	remoteSystemAddress.ToString(true, str2);
+	local.ToString(true, str1);
+	remote.ToString(true, str2);
 	char localtime[128];
 	GetLocalTime(localtime);
 
-    int written = std::snprintf(str, sizeof(str),
+    int written = std::snprintf(into, intoLength,
         "%s,Rcv,Ack,%i,,,,%" PRINTF_64_BIT_MODIFIER "u,%s,%s,,,,,,",
         localtime,
         messageNumber,
-        static_cast<unsigned long long>(time),
+        time,
         str1,
         str2
     );
 
-    if (written < 0 || written >= static_cast<int>(sizeof(str)))
+    if (written < 0 || written >= static_cast<int>(intoLength))
     {
-        str[sizeof(str) - 1] = '\0';
+        into[intoLength - 1] = '\0';
     }
-
-	AddToLog(str);
 }
 
 void PacketLogger::OnPushBackPacket(const char* data, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress)
 {
     char str[256];
-    char str1[64], str2[62];
-
-    SystemAddress localSystemAddress = rakPeerInterface->GetExternalID(remoteSystemAddress);
-    localSystemAddress.ToString(true, str1);
-    remoteSystemAddress.ToString(true, str2);
+    FormatPushBackPacketLine(str, sizeof(str), data[0], bitsUsed, RakNet::GetTimeMS(), rakPeerInterface->GetExternalID(remoteSystemAddress), remoteSystemAddress);
+    AddToLog(str);
+}
 
-    RakNet::TimeMS time = RakNet::GetTimeMS();
+void PacketLogger::FormatPushBackPacketLine(char* into, size_t intoLength, unsigned char messageIdentifier, const BitSize_t bitLen, unsigned long long time, const SystemAddress& local, const SystemAddress& remote)
+{
+    char str1[64], str2[62];
+    local.ToString(true, str1);
+    remote.ToString(true, str2);
 
     char localtime[128];
     GetLocalTime(localtime);
 
-    int written = std::snprintf(str, sizeof(str),
+    int written = std::snprintf(into, intoLength,
         "%s,Lcl,PBP,,,%s,%i,%" PRINTF_64_BIT_MODIFIER "u,%s,%s,,,,,,",
         localtime,
-        BaseIDTOString(data[0]),
-        bitsUsed,
-        static_cast<unsigned long long>(time),
+        BaseIDTOString(messageIdentifier),
+        bitLen,
+        time,
         str1,
         str2
     );
 
-    if (written < 0 || written >= static_cast<int>(sizeof(str))) {
-        str[sizeof(str) - 1] = '\0';
+    if (written < 0 || written >= static_cast<int>(intoLength)) {
+        into[intoLength - 1] = '\0';
     }
-
-    AddToLog(str);
 }
 
 void PacketLogger::OnInternalPacket(InternalPacket *internalPacket, unsigned frameNumber, SystemAddress remoteSystemAddress, RakNet::TimeMS time, int isSend)
@@ -258,30 +261,30 @@ void PacketLogger::WriteLog(const char *str)
 void PacketLogger::WriteMiscellaneous(const char* type, const char* msg)
 {
     char str[1024];
-    char str1[64];
-
-    SystemAddress localSystemAddress = rakPeerInterface->GetInternalID();
-    localSystemAddress.ToString(true, str1);
+    FormatMiscellaneousLine(str, sizeof(str), type, msg, RakNet::GetTimeMS(), rakPeerInterface->GetInternalID());
+    AddToLog(str);
+}
 
-    RakNet::TimeMS time = RakNet::GetTimeMS();
+void PacketLogger::FormatMiscellaneousLine(char* into, size_t intoLength, const char* type, const char* msg, unsigned long long time, const SystemAddress& local)
+{
+    char str1[64];
+    local.ToString(true, str1);
 
     char localtime[128];
     GetLocalTime(localtime);
 
-    int written = std::snprintf(str, sizeof(str),
+    int written = std::snprintf(into, intoLength,
         "%s,Lcl,%s,,,,,%" PRINTF_64_BIT_MODIFIER "u,%s,,,,,,,%s",
         localtime,
         type,
-        static_cast<unsigned long long>(time),
+        time,
         str1,
         msg
     );
 
-    if (written < 0 || written >= static_cast<int>(sizeof(str))) {
-        str[sizeof(str) - 1] = '\0';
+    if (written < 0 || written >= static_cast<int>(intoLength)) {
+        into[intoLength - 1] = '\0';
     }
-
-    AddToLog(str);
 }
 
 void PacketLogger::SetPrintID(bool print)
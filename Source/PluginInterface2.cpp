@@ -203,6 +203,11 @@ bool PluginInterface2::SendListUnified( const char **data, const int *lengths, c
 
 	return false;
 }
+void PluginInterface2::RefreshReceiveFilter(void)
+{
+	if (rakPeerInterface)
+		rakPeerInterface->RefreshPluginReceiveFilters();
+}
 void PluginInterface2::SetRakPeerInterface( RakPeerInterface *ptr )
 {
 	rakPeerInterface=ptr;
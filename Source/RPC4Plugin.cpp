@@ -24,6 +24,9 @@ using namespace RakNet;
 
 STATIC_FACTORY_DEFINITIONS(RPC4,RPC4);
 
+// Signal telling the remote system that numbers can be sent in place of identifiers
+static const char *RPC4_READS_NUMBERS_SIGNAL="__RPC4_ReadsNumbers";
+
 struct GlobalRegistration
 {
 	void ( *registerFunctionPointer ) ( RakNet::BitStream *userData, Packet *packet );
@@ -97,6 +100,11 @@ enum RPC4Identifiers
 	ID_RPC4_CALL,
 	ID_RPC4_RETURN,
 	ID_RPC4_SIGNAL,
+	// Same as ID_RPC4_CALL and ID_RPC4_SIGNAL, with a number in place of the identifier. The identifier follows the number until the remote system acknowledges it
+	ID_RPC4_CALL_INTERNED,
+	ID_RPC4_SIGNAL_INTERNED,
+	// Acknowledges a number sent with ID_RPC4_CALL_INTERNED or ID_RPC4_SIGNAL_INTERNED
+	ID_RPC4_INTERN_ACK,
 };
 int RPC4::LocalSlotObjectComp( const LocalSlotObject &key, const LocalSlotObject &data )
 {
@@ -121,12 +129,23 @@ int RPC4::LocalCallbackComp(const MessageID &key, RPC4::LocalCallback* const &da
 		return 1;
 	return 0;
 }
+int RPC4::InternedRemoteSystemComp(const RakNetGUID &key, RPC4::InternedRemoteSystem* const &data )
+{
+	if (key < data->guid)
+		return -1;
+	if (key > data->guid)
+		return 1;
+	return 0;
+}
 
 RPC4::RPC4()
 {
 	gotBlockingReturnValue=false;
 	nextSlotRegistrationCount=0;
 	interruptSignal=false;
+	internIdentifiers=true;
+	registrationVersion=0;
+	outgoingIdentifierCount=0;
 }
 RPC4::~RPC4()
 {
@@ -135,6 +154,8 @@ RPC4::~RPC4()
 	{
 		RakNet::OP_DELETE(localCallbacks[i],_FILE_AND_LINE_);
 	}
+	while (internedRemoteSystems.Size())
+		RemoveInternedRemoteSystem(internedRemoteSystems.Size()-1);
 
 	DataStructures::List<RakNet::RakString> keyList;
 	DataStructures::List<LocalSlot*> outputList;
@@ -153,6 +174,7 @@ bool RPC4::RegisterFunction(const char* uniqueID, void ( *functionPointer ) ( Ra
 		return false;
 
 	registeredNonblockingFunctions.Push(uniqueID,functionPointer,_FILE_AND_LINE_);
+	registrationVersion++;
 	return true;
 }
 void RPC4::RegisterSlot(const char *sharedIdentifier, void ( *functionPointer ) ( RakNet::BitStream *userData, Packet *packet ), int callPriority)
@@ -164,6 +186,7 @@ void RPC4::RegisterSlot(const char *sharedIdentifier, void ( *functionPointer )
 	{
 		localSlot = RakNet::OP_NEW<LocalSlot>(_FILE_AND_LINE_);
 		localSlots.Push(sharedIdentifier, localSlot,_FILE_AND_LINE_);
+		registrationVersion++;
 	}
 	else
 	{
@@ -178,6 +201,7 @@ bool RPC4::RegisterBlockingFunction(const char* uniqueID, void ( *functionPointe
 		return false;
 
 	registeredBlockingFunctions.Push(uniqueID,functionPointer,_FILE_AND_LINE_);
+	registrationVersion++;
 	return true;
 }
 void RPC4::RegisterLocalCallback(const char* uniqueID, MessageID messageId)
@@ -201,16 +225,19 @@ void RPC4::RegisterLocalCallback(const char* uniqueID, MessageID messageId)
 		lc->messageId=messageId;
 		lc->functions.Insert(str,str,false,_FILE_AND_LINE_);
 		localCallbacks.InsertAtIndex(lc,index,_FILE_AND_LINE_);
+		RefreshReceiveFilter();
 	}
 }
 bool RPC4::UnregisterFunction(const char* uniqueID)
 {
 	void ( *f ) ( RakNet::BitStream *, Packet * );
+	registrationVersion++;
 	return registeredNonblockingFunctions.Pop(f,uniqueID,_FILE_AND_LINE_);
 }
 bool RPC4::UnregisterBlockingFunction(const char* uniqueID)
 {
 	void ( *f ) ( RakNet::BitStream *, RakNet::BitStream *,Packet * );
+	registrationVersion++;
 	return registeredBlockingFunctions.Pop(f,uniqueID,_FILE_AND_LINE_);
 }
 bool RPC4::UnregisterLocalCallback(const char* uniqueID, MessageID messageId)
@@ -232,6 +259,7 @@ bool RPC4::UnregisterLocalCallback(const char* uniqueID, MessageID messageId)
 			{
 				RakNet::OP_DELETE(lc,_FILE_AND_LINE_);
 				localCallbacks.RemoveAtIndex(index);
+				RefreshReceiveFilter();
 				return true;
 			}
 		}
@@ -246,6 +274,7 @@ bool RPC4::UnregisterSlot(const char* sharedIdentifier)
 		LocalSlot *ls = localSlots.ItemAtIndex(hi);
 		RakNet::OP_DELETE(ls, _FILE_AND_LINE_);
 		localSlots.RemoveAtIndex(hi, _FILE_AND_LINE_);
+		registrationVersion++;
 		return true;
 	}
 	
@@ -316,25 +345,13 @@ void RPC4::CallLoopback( const char* uniqueID, RakNet::BitStream * bitStream )
 }
 void RPC4::Call( const char* uniqueID, RakNet::BitStream * bitStream, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast )
 {
-	RakNet::BitStream out;
-	out.Write((MessageID) ID_RPC_PLUGIN);
-	out.Write((MessageID) ID_RPC4_CALL);
-	out.WriteCompressed(uniqueID);
-	out.Write(false); // Nonblocking
-	if (bitStream)
-	{
-		bitStream->ResetReadPointer();
-		out.AlignWriteToByteBoundary();
-		out.Write(bitStream);
-	}
-	SendUnified(&out,priority,reliability,orderingChannel,systemIdentifier,broadcast);
+	SendCall(ID_RPC4_CALL, uniqueID, false, bitStream, priority, reliability, orderingChannel, systemIdentifier, broadcast);
 }
 bool RPC4::CallBlocking( const char* uniqueID, RakNet::BitStream * bitStream, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, RakNet::BitStream *returnData )
 {
 	RakNet::BitStream out;
 	out.Write((MessageID) ID_RPC_PLUGIN);
-	out.Write((MessageID) ID_RPC4_CALL);
-	out.WriteCompressed(uniqueID);
+	WriteIdentifier(&out, ID_RPC4_CALL, uniqueID, systemIdentifier);
 	out.Write(true); // Blocking
 	if (bitStream)
 	{
@@ -409,17 +426,7 @@ bool RPC4::CallBlocking( const char* uniqueID, RakNet::BitStream * bitStream, Pa
 }
 void RPC4::Signal(const char *sharedIdentifier, RakNet::BitStream *bitStream, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, bool invokeLocal)
 {
-	RakNet::BitStream out;
-	out.Write((MessageID) ID_RPC_PLUGIN);
-	out.Write((MessageID) ID_RPC4_SIGNAL);
-	out.WriteCompressed(sharedIdentifier);
-	if (bitStream)
-	{
-		bitStream->ResetReadPointer();
-		out.AlignWriteToByteBoundary();
-		out.Write(bitStream);
-	}
-	SendUnified(&out,priority,reliability,orderingChannel,systemIdentifier,broadcast);
+	SendCall(ID_RPC4_SIGNAL, sharedIdentifier, false, bitStream, priority, reliability, orderingChannel, systemIdentifier, broadcast);
 
 	if (invokeLocal)
 	{
@@ -463,12 +470,18 @@ void RPC4::InvokeSignal(DataStructures::HashIndex functionIndex, RakNet::BitStre
 	if (functionIndex.IsInvalid())
 		return;
 
+	InvokeSlots(localSlots.ItemAtIndex(functionIndex), serializedParameters, packet);
+}
+void RPC4::InvokeSlots(LocalSlot *localSlot, RakNet::BitStream *serializedParameters, Packet *packet)
+{
+	if (localSlot==0)
+		return;
+
 	//TimeUS t1 = GetTimeUS();
 	//TimeUS t2=0;
 	//TimeUS t3=0;
 
 	interruptSignal=false;
-	LocalSlot *localSlot = localSlots.ItemAtIndex(functionIndex);
 	unsigned int i;
 	i=0;
 	while (i < localSlot->slotObjects.Size())
@@ -516,6 +529,18 @@ void RPC4::OnAttach(void)
 			RegisterLocalCallback(globalRegistrationBuffer[i].functionName, globalRegistrationBuffer[i].messageId);
 	}
 }
+bool RPC4::GetReceiveFilter(PluginReceiveFilter &filter) const
+{
+	filter.Add(ID_RPC_PLUGIN);
+	for (unsigned int i=0; i < localCallbacks.Size(); i++)
+	{
+		// Local callbacks match on the first byte, which the filter skips for timestamped messages
+		if (localCallbacks[i]->messageId==ID_TIMESTAMP)
+			return false;
+		filter.Add(localCallbacks[i]->messageId);
+	}
+	return true;
+}
 PluginReceiveResult RPC4::OnReceive(Packet *packet)
 {
 	if (packet->data[0]==ID_RPC_PLUGIN)
@@ -523,45 +548,71 @@ PluginReceiveResult RPC4::OnReceive(Packet *packet)
 		RakNet::BitStream bsIn(packet->data,packet->length,false);
 		bsIn.IgnoreBytes(2);
 
-		if (packet->data[1]==ID_RPC4_CALL)
+		AnnounceReadsNumbers(packet);
+
+		InternedIdentifier *internedIdentifier=0;
+		if (packet->data[1]==ID_RPC4_CALL_INTERNED || packet->data[1]==ID_RPC4_SIGNAL_INTERNED)
+		{
+			internedIdentifier=ReadInternedIdentifier(&bsIn, packet);
+			if (internedIdentifier==0)
+				return RR_STOP_PROCESSING_AND_DEALLOCATE;
+		}
+
+		if (packet->data[1]==ID_RPC4_CALL || packet->data[1]==ID_RPC4_CALL_INTERNED)
 		{
-			RakNet::RakString functionName;
-			bsIn.ReadCompressed(functionName);
+			RakNet::RakString functionNameIn;
+			const RakNet::RakString *functionName=&functionNameIn;
+			if (internedIdentifier)
+				functionName=&internedIdentifier->identifier;
+			else
+				bsIn.ReadCompressed(functionNameIn);
 			bool isBlocking=false;
 			bsIn.Read(isBlocking);
 			if (isBlocking==false)
 			{
-				DataStructures::HashIndex skhi = registeredNonblockingFunctions.GetIndexOf(functionName.C_String());
-				if (skhi.IsInvalid())
+				void ( *fp ) ( RakNet::BitStream *, Packet * ) = 0;
+				if (internedIdentifier)
+					fp = internedIdentifier->nonblockingFunction;
+				else
+				{
+					DataStructures::HashIndex skhi = registeredNonblockingFunctions.GetIndexOf(functionName->C_String());
+					if (skhi.IsInvalid()==false)
+						fp = registeredNonblockingFunctions.ItemAtIndex(skhi);
+				}
+				if (fp==0)
 				{
 					RakNet::BitStream bsOut;
 					bsOut.Write((unsigned char) ID_RPC_REMOTE_ERROR);
 					bsOut.Write((unsigned char) RPC_ERROR_FUNCTION_NOT_REGISTERED);
-					bsOut.Write(functionName.C_String(),(unsigned int) functionName.GetLength()+1);
+					bsOut.Write(functionName->C_String(),(unsigned int) functionName->GetLength()+1);
 					SendUnified(&bsOut,HIGH_PRIORITY,RELIABLE_ORDERED,0,packet->systemAddress,false);
 					return RR_STOP_PROCESSING_AND_DEALLOCATE;
 				}
 
-				void ( *fp ) ( RakNet::BitStream *, Packet * );
-				fp = registeredNonblockingFunctions.ItemAtIndex(skhi);
 				bsIn.AlignReadToByteBoundary();
 				fp(&bsIn,packet);
 			}
 			else
 			{
-				DataStructures::HashIndex skhi = registeredBlockingFunctions.GetIndexOf(functionName.C_String());
-				if (skhi.IsInvalid())
+				void ( *fp ) ( RakNet::BitStream *, RakNet::BitStream *, Packet * ) = 0;
+				if (internedIdentifier)
+					fp = internedIdentifier->blockingFunction;
+				else
+				{
+					DataStructures::HashIndex skhi = registeredBlockingFunctions.GetIndexOf(functionName->C_String());
+					if (skhi.IsInvalid()==false)
+						fp = registeredBlockingFunctions.ItemAtIndex(skhi);
+				}
+				if (fp==0)
 				{
 					RakNet::BitStream bsOut;
 					bsOut.Write((unsigned char) ID_RPC_REMOTE_ERROR);
 					bsOut.Write((unsigned char) RPC_ERROR_FUNCTION_NOT_REGISTERED);
-					bsOut.Write(functionName.C_String(),(unsigned int) functionName.GetLength()+1);
+					bsOut.Write(functionName->C_String(),(unsigned int) functionName->GetLength()+1);
 					SendUnified(&bsOut,HIGH_PRIORITY,RELIABLE_ORDERED,0,packet->systemAddress,false);
 					return RR_STOP_PROCESSING_AND_DEALLOCATE;
 				}
 
-				void ( *fp ) ( RakNet::BitStream *, RakNet::BitStream *, Packet * );
-				fp = registeredBlockingFunctions.ItemAtIndex(skhi);
 				RakNet::BitStream returnData;
 				bsIn.AlignReadToByteBoundary();
 				fp(&bsIn, &returnData, packet);
@@ -575,16 +626,42 @@ PluginReceiveResult RPC4::OnReceive(Packet *packet)
 				SendUnified(&out,IMMEDIATE_PRIORITY,RELIABLE_ORDERED,0,packet->systemAddress,false);
 			}
 		}
-		else if (packet->data[1]==ID_RPC4_SIGNAL)
+		else if (packet->data[1]==ID_RPC4_SIGNAL || packet->data[1]==ID_RPC4_SIGNAL_INTERNED)
 		{
-			RakNet::RakString sharedIdentifier;
-			bsIn.ReadCompressed(sharedIdentifier);
-			DataStructures::HashIndex functionIndex;
-			functionIndex = localSlots.GetIndexOf(sharedIdentifier);
+			LocalSlot *localSlot=0;
+			if (internedIdentifier)
+				localSlot=internedIdentifier->localSlot;
+			else
+			{
+				RakNet::RakString sharedIdentifier;
+				bsIn.ReadCompressed(sharedIdentifier);
+				if (sharedIdentifier==RPC4_READS_NUMBERS_SIGNAL)
+				{
+					// Only systems connected through RakPeer have a guid to remember this by
+					if (rakPeerInterface && packet->guid!=UNASSIGNED_RAKNET_GUID)
+						GetInternedRemoteSystem(packet->guid, true)->readsNumbers=true;
+					return RR_STOP_PROCESSING_AND_DEALLOCATE;
+				}
+				DataStructures::HashIndex functionIndex;
+				functionIndex = localSlots.GetIndexOf(sharedIdentifier);
+				if (functionIndex.IsInvalid()==false)
+					localSlot=localSlots.ItemAtIndex(functionIndex);
+			}
 			RakNet::BitStream serializedParameters;
             bsIn.AlignReadToByteBoundary();
 			bsIn.Read(&serializedParameters);
-			InvokeSignal(functionIndex, &serializedParameters, packet);
+			InvokeSlots(localSlot, &serializedParameters, packet);
+		}
+		else if (packet->data[1]==ID_RPC4_INTERN_ACK)
+		{
+			unsigned int number;
+			if (bsIn.ReadCompressed(number) && number < outgoingIdentifierCount)
+			{
+				InternedRemoteSystem *internedRemoteSystem = GetInternedRemoteSystem(packet->guid, true);
+				while (internedRemoteSystem->outgoingAcknowledged.Size() <= number)
+					internedRemoteSystem->outgoingAcknowledged.Insert(false, _FILE_AND_LINE_);
+				internedRemoteSystem->outgoingAcknowledged[number]=true;
+			}
 		}
 		else
 		{
@@ -625,5 +702,230 @@ DataStructures::HashIndex RPC4::GetLocalSlotIndex(const char *sharedIdentifier)
 {
 	return localSlots.GetIndexOf(sharedIdentifier);
 }
+void RPC4::SetInternIdentifiers(bool enable)
+{
+	internIdentifiers=enable;
+}
+bool RPC4::GetInternIdentifiers(void) const
+{
+	return internIdentifiers;
+}
+void RPC4::OnClosedConnection(const SystemAddress &systemAddress, RakNetGUID rakNetGUID, PI2_LostConnectionReason lostConnectionReason )
+{
+	(void) systemAddress;
+	(void) lostConnectionReason;
+
+	bool objectExists;
+	unsigned int index = internedRemoteSystems.GetIndexFromKey(rakNetGUID, &objectExists);
+	if (objectExists)
+		RemoveInternedRemoteSystem(index);
+}
+void RPC4::OnRakPeerShutdown(void)
+{
+	while (internedRemoteSystems.Size())
+		RemoveInternedRemoteSystem(internedRemoteSystems.Size()-1);
+}
+// Writes the call type followed by either the identifier, or the number standing for it and, until the remote system acknowledges the number, the identifier
+void RPC4::SendCall(MessageID callType, const char *identifier, bool isBlocking, RakNet::BitStream *bitStream, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast)
+{
+	bool anyReadsNumbers=false;
+	unsigned int i;
+	if (internIdentifiers && broadcast && rakPeerInterface)
+	{
+		for (i=0; i < internedRemoteSystems.Size(); i++)
+		{
+			if (internedRemoteSystems[i]->readsNumbers)
+			{
+				anyReadsNumbers=true;
+				break;
+			}
+		}
+	}
+
+	if (anyReadsNumbers==false)
+	{
+		RakNet::BitStream out;
+		out.Write((MessageID) ID_RPC_PLUGIN);
+		if (broadcast)
+		{
+			out.Write(callType);
+			out.WriteCompressed(identifier);
+		}
+		else
+			WriteIdentifier(&out, callType, identifier, systemIdentifier);
+		if (callType==ID_RPC4_CALL)
+			out.Write(isBlocking);
+		if (bitStream)
+		{
+			bitStream->ResetReadPointer();
+			out.AlignWriteToByteBoundary();
+			out.Write(bitStream);
+		}
+		SendUnified(&out,priority,reliability,orderingChannel,systemIdentifier,broadcast);
+		return;
+	}
+
+	// Each system may know a different set of numbers, so send the broadcast to each system separately
+	RakNetGUID excludedGuid=systemIdentifier.rakNetGuid;
+	if (excludedGuid==UNASSIGNED_RAKNET_GUID && systemIdentifier.systemAddress!=UNASSIGNED_SYSTEM_ADDRESS)
+		excludedGuid=rakPeerInterface->GetGuidFromSystemAddress(systemIdentifier.systemAddress);
+	DataStructures::List<SystemAddress> addresses;
+	DataStructures::List<RakNetGUID> guids;
+	rakPeerInterface->GetSystemList(addresses, guids);
+	for (i=0; i < guids.Size(); i++)
+	{
+		if (guids[i]==excludedGuid)
+			continue;
+		RakNet::BitStream out;
+		out.Write((MessageID) ID_RPC_PLUGIN);
+		WriteIdentifier(&out, callType, identifier, guids[i]);
+		if (callType==ID_RPC4_CALL)
+			out.Write(isBlocking);
+		if (bitStream)
+		{
+			bitStream->ResetReadPointer();
+			out.AlignWriteToByteBoundary();
+			out.Write(bitStream);
+		}
+		SendUnified(&out,priority,reliability,orderingChannel,guids[i],false);
+	}
+}
+void RPC4::WriteIdentifier(RakNet::BitStream *out, MessageID callType, const char *identifier, const AddressOrGUID systemIdentifier)
+{
+	InternedRemoteSystem *internedRemoteSystem=0;
+	if (internIdentifiers && rakPeerInterface)
+	{
+		RakNetGUID guid=systemIdentifier.rakNetGuid;
+		if (guid==UNASSIGNED_RAKNET_GUID)
+			guid=rakPeerInterface->GetGuidFromSystemAddress(systemIdentifier.systemAddress);
+		if (guid!=UNASSIGNED_RAKNET_GUID)
+			internedRemoteSystem=GetInternedRemoteSystem(guid, false);
+	}
+
+	// Older versions of RPC4 do not announce that they read numbers, and always get the identifier
+	unsigned int number=(unsigned int) -1;
+	if (internedRemoteSystem && internedRemoteSystem->readsNumbers)
+	{
+		DataStructures::HashIndex hi = outgoingIdentifierNumbers.GetIndexOf(identifier);
+		if (hi.IsInvalid()==false)
+			number=outgoingIdentifierNumbers.ItemAtIndex(hi);
+		else if (outgoingIdentifierCount < RPC4_MAX_INTERNED_IDENTIFIERS)
+		{
+			number=outgoingIdentifierCount++;
+			outgoingIdentifierNumbers.Push(identifier,number,_FILE_AND_LINE_);
+		}
+	}
+
+	if (number==(unsigned int) -1)
+	{
+		out->Write(callType);
+		out->WriteCompressed(identifier);
+		return;
+	}
+
+	bool acknowledged = number < internedRemoteSystem->outgoingAcknowledged.Size() && internedRemoteSystem->outgoingAcknowledged[number];
+	out->Write((MessageID) (callType==ID_RPC4_CALL ? ID_RPC4_CALL_INTERNED : ID_RPC4_SIGNAL_INTERNED));
+	out->WriteCompressed(number);
+	out->Write(acknowledged==false);
+	if (acknowledged==false)
+		out->WriteCompressed(identifier);
+}
+// The remote system runs RPC4, so tell it once that we read numbers. Sent as a signal, which older versions of RPC4 ignore because no slot has this name
+void RPC4::AnnounceReadsNumbers(Packet *packet)
+{
+	// Calls through TCPInterface have no guid, and CallLoopback() uses our own
+	if (rakPeerInterface==0 || packet->guid==UNASSIGNED_RAKNET_GUID || packet->guid==rakPeerInterface->GetMyGUID())
+		return;
+	InternedRemoteSystem *internedRemoteSystem = GetInternedRemoteSystem(packet->guid, true);
+	if (internedRemoteSystem->announced)
+		return;
+	internedRemoteSystem->announced=true;
+
+	RakNet::BitStream bsOut;
+	bsOut.Write((MessageID) ID_RPC_PLUGIN);
+	bsOut.Write((MessageID) ID_RPC4_SIGNAL);
+	bsOut.WriteCompressed(RPC4_READS_NUMBERS_SIGNAL);
+	bsOut.AlignWriteToByteBoundary();
+	RakNet::BitStream emptyParameters;
+	bsOut.Write(&emptyParameters);
+	SendUnified(&bsOut,HIGH_PRIORITY,RELIABLE_ORDERED,0,packet->guid,false);
+}
+// Reads what WriteIdentifier() wrote after the call type. Returns 0 if the number is not known
+RPC4::InternedIdentifier* RPC4::ReadInternedIdentifier(RakNet::BitStream *bsIn, Packet *packet)
+{
+	unsigned int number;
+	bool hasIdentifier;
+	if (bsIn->ReadCompressed(number)==false || bsIn->Read(hasIdentifier)==false || number >= RPC4_MAX_INTERNED_IDENTIFIERS)
+		return 0;
+
+	InternedRemoteSystem *internedRemoteSystem = GetInternedRemoteSystem(packet->guid, true);
+	InternedIdentifier *internedIdentifier = number < internedRemoteSystem->incoming.Size() ? internedRemoteSystem->incoming[number] : 0;
+	if (hasIdentifier)
+	{
+		RakNet::RakString identifier;
+		if (bsIn->ReadCompressed(identifier)==false)
+			return 0;
+
+		if (internedIdentifier==0)
+		{
+			internedIdentifier = RakNet::OP_NEW<InternedIdentifier>(_FILE_AND_LINE_);
+			internedIdentifier->identifier=identifier;
+			LookUpInternedIdentifier(internedIdentifier);
+			while (internedRemoteSystem->incoming.Size() <= number)
+				internedRemoteSystem->incoming.Insert(0, _FILE_AND_LINE_);
+			internedRemoteSystem->incoming[number]=internedIdentifier;
+
+			// The sender keeps sending the identifier until this arrives
+			RakNet::BitStream bsOut;
+			bsOut.Write((MessageID) ID_RPC_PLUGIN);
+			bsOut.Write((MessageID) ID_RPC4_INTERN_ACK);
+			bsOut.WriteCompressed(number);
+			SendUnified(&bsOut,HIGH_PRIORITY,RELIABLE_ORDERED,0,packet->systemAddress,false);
+		}
+	}
+
+	if (internedIdentifier && internedIdentifier->registrationVersion!=registrationVersion)
+		LookUpInternedIdentifier(internedIdentifier);
+	return internedIdentifier;
+}
+void RPC4::LookUpInternedIdentifier(InternedIdentifier *internedIdentifier)
+{
+	DataStructures::HashIndex hi;
+	hi = registeredNonblockingFunctions.GetIndexOf(internedIdentifier->identifier);
+	internedIdentifier->nonblockingFunction = hi.IsInvalid() ? 0 : registeredNonblockingFunctions.ItemAtIndex(hi);
+	hi = registeredBlockingFunctions.GetIndexOf(internedIdentifier->identifier);
+	internedIdentifier->blockingFunction = hi.IsInvalid() ? 0 : registeredBlockingFunctions.ItemAtIndex(hi);
+	hi = localSlots.GetIndexOf(internedIdentifier->identifier);
+	internedIdentifier->localSlot = hi.IsInvalid() ? 0 : localSlots.ItemAtIndex(hi);
+	internedIdentifier->registrationVersion=registrationVersion;
+}
+RPC4::InternedRemoteSystem* RPC4::GetInternedRemoteSystem(RakNetGUID guid, bool create)
+{
+	bool objectExists;
+	unsigned int index = internedRemoteSystems.GetIndexFromKey(guid, &objectExists);
+	if (objectExists)
+		return internedRemoteSystems[index];
+	if (create==false)
+		return 0;
+
+	InternedRemoteSystem *internedRemoteSystem = RakNet::OP_NEW<InternedRemoteSystem>(_FILE_AND_LINE_);
+	internedRemoteSystem->guid=guid;
+	internedRemoteSystem->readsNumbers=false;
+	internedRemoteSystem->announced=false;
+	internedRemoteSystems.InsertAtIndex(internedRemoteSystem, index, _FILE_AND_LINE_);
+	return internedRemoteSystem;
+}
+void RPC4::RemoveInternedRemoteSystem(unsigned int index)
+{
+	InternedRemoteSystem *internedRemoteSystem = internedRemoteSystems[index];
+	unsigned int i;
+	for (i=0; i < internedRemoteSystem->incoming.Size(); i++)
+	{
+		if (internedRemoteSystem->incoming[i])
+			RakNet::OP_DELETE(internedRemoteSystem->incoming[i], _FILE_AND_LINE_);
+	}
+	RakNet::OP_DELETE(internedRemoteSystem, _FILE_AND_LINE_);
+	internedRemoteSystems.RemoveAtIndex(index);
+}
 
 #endif // _RAKNET_SUPPORT_*
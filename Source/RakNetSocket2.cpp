@@ -33,6 +33,14 @@ using namespace RakNet;
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/time.h>
+#if RAKNET_SUPPORT_SENDMMSG==1
+#include <netinet/udp.h>
+#endif
+#if RAKNET_SUPPORT_REUSEPORT==1
+#include <pthread.h>
+#include <sched.h>
+#endif
 #endif
 
 #ifdef TEST_NATIVE_CLIENT_ON_WINDOWS
@@ -286,6 +294,9 @@ bool IRNS2_Berkley::IsPortInUse(unsigned short port, const char *hostAddress, un
 	bbp.type=type; bbp.protocol=0; bbp.nonBlockingSocket=false;
 	bbp.setBroadcast=false;	bbp.doNotFragment=false; bbp.protocol=0;
 	bbp.setIPHdrIncl=false;
+	bbp.recvBatchSize=0;
+	bbp.reusePort=false;
+	bbp.recvThreadCpu=-1;
 	SystemAddress boundAddress;
 	RNS2_Berkley *rns2 = (RNS2_Berkley*) RakNetSocket2Allocator::AllocRNS2();
 	RNS2BindResult bindResult = rns2->Bind(&bbp, _FILE_AND_LINE_);
@@ -340,11 +351,17 @@ RAK_THREAD_DECLARATION(RNS2_Berkley::RecvFromLoop)
 
 	RNS2_Berkley *b = ( RNS2_Berkley * ) arguments;
 
+	b->SetRecvThreadAffinity();
 	b->RecvFromLoopInt();
 	return 0;
 }
 unsigned RNS2_Berkley::RecvFromLoopInt(void)
 {
+#if RAKNET_SUPPORT_RECVMMSG==1
+	if (binding.recvBatchSize>1)
+		return RecvFromLoopBatchInt();
+#endif
+
 	isRecvFromLoopThreadActive.Increment();
 	
 	while ( endThreads == false )
@@ -376,6 +393,73 @@ unsigned RNS2_Berkley::RecvFromLoopInt(void)
 	return 0;
 
 }
+#if RAKNET_SUPPORT_RECVMMSG==1
+unsigned RNS2_Berkley::RecvFromLoopBatchInt(void)
+{
+	isRecvFromLoopThreadActive.Increment();
+
+	int batchSize = binding.recvBatchSize > RNS2_MAXIMUM_RECV_BATCH_SIZE ? RNS2_MAXIMUM_RECV_BATCH_SIZE : (int) binding.recvBatchSize;
+	RNS2RecvBatchScratch *scratch = RakNet::OP_NEW<RNS2RecvBatchScratch>(_FILE_AND_LINE_);
+	RNS2RecvStruct *recvFromStructs[RNS2_MAXIMUM_RECV_BATCH_SIZE];
+	int i, numSlots=0;
+
+	// Used to backdate timeRead for datagrams that sat in the socket queue while the previous batch was being handed off
+	int timestampOpt=1;
+	setsockopt__( rns2Socket, SOL_SOCKET, SO_TIMESTAMP, ( char * ) & timestampOpt, sizeof ( timestampOpt ) );
+
+	while ( endThreads == false )
+	{
+		// Slots handed to the event handler on the previous pass are refilled here. Unused slots are kept for the next call
+		while (numSlots < batchSize)
+		{
+			recvFromStructs[numSlots]=binding.eventHandler->AllocRNS2RecvStruct(_FILE_AND_LINE_);
+			if (recvFromStructs[numSlots]==NULL)
+				break;
+			recvFromStructs[numSlots]->socket=this;
+			numSlots++;
+		}
+		if (numSlots==0)
+		{
+			// Only if batchSize is 0, or AllocRNS2RecvStruct() returned NULL because the allocation failed. Sleep rather than spin
+			RakSleep(1);
+			continue;
+		}
+
+		int numRead = RecvFromBlockingBatch(recvFromStructs, numSlots, scratch);
+		if (numRead<=0)
+		{
+			RakSleep(0);
+			continue;
+		}
+
+		for (i=0; i < numRead; i++)
+		{
+			if (recvFromStructs[i]->bytesRead>0)
+			{
+				RakAssert(recvFromStructs[i]->systemAddress.GetPort());
+				binding.eventHandler->OnRNS2Recv(recvFromStructs[i]);
+			}
+			else
+			{
+				binding.eventHandler->DeallocRNS2RecvStruct(recvFromStructs[i], _FILE_AND_LINE_);
+			}
+		}
+
+		// Compact the unused slots to the front
+		for (i=numRead; i < numSlots; i++)
+			recvFromStructs[i-numRead]=recvFromStructs[i];
+		numSlots-=numRead;
+	}
+
+	for (i=0; i < numSlots; i++)
+		binding.eventHandler->DeallocRNS2RecvStruct(recvFromStructs[i], _FILE_AND_LINE_);
+	RakNet::OP_DELETE(scratch, _FILE_AND_LINE_);
+
+	isRecvFromLoopThreadActive.Decrement();
+
+	return 0;
+}
+#endif // RAKNET_SUPPORT_RECVMMSG==1
 RNS2_Berkley::RNS2_Berkley()
 {
 	rns2Socket=(RNS2Socket)INVALID_SOCKET;
@@ -422,6 +506,11 @@ void RNS2_Berkley::BlockOnStopRecvPollingThread(void)
 	bsp.length=4;
 	bsp.systemAddress=boundAddress;
 	bsp.ttl=0;
+#if RAKNET_SUPPORT_REUSEPORT==1
+	// The kernel may hash a datagram to our own port onto any socket sharing it, so wake this one directly
+	if (binding.reusePort)
+		shutdown__(rns2Socket, SHUT_RD);
+#endif
 	Send(&bsp, _FILE_AND_LINE_);
 
 	RakNet::TimeMS timeout = RakNet::GetTimeMS()+1000;
@@ -506,7 +595,187 @@ void RNS2_Windows::SetSocketLayerOverride(SocketLayerOverride *_slo) {slo = _slo
 SocketLayerOverride* RNS2_Windows::GetSocketLayerOverride(void) {return slo;}
 #else
 RNS2BindResult RNS2_Linux::Bind( RNS2_BerkleyBindParameters *bindParameters, const char *file, unsigned int line ) {return BindShared(bindParameters, file, line);}
-RNS2SendResult RNS2_Linux::Send( RNS2_SendParameters *sendParameters, const char *file, unsigned int line ) {return Send_Windows_Linux_360NoVDP(rns2Socket,sendParameters, file, line);}
+RNS2SendResult RNS2_Linux::Send( RNS2_SendParameters *sendParameters, const char *file, unsigned int line ) {
+#if RAKNET_SUPPORT_SENDMMSG==1
+	// Anything queued earlier must go out first
+	if (sendBatchPending.load(std::memory_order_acquire))
+		FlushSendBatch();
+#endif
+	return Send_Windows_Linux_360NoVDP(rns2Socket,sendParameters, file, line);
+}
+#if RAKNET_SUPPORT_SENDMMSG==1
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+// Kernel limit on segments per GSO send
+#define RNS2_MAXIMUM_GSO_SEGMENTS 64
+// Largest UDP payload a single GSO send may carry
+#define RNS2_MAXIMUM_GSO_BYTES 65000
+
+struct RakNet::RNS2SendBatch
+{
+	// Queued datagrams, stored back to back so a run to the same address is already one contiguous GSO buffer
+	char data[RNS2_MAXIMUM_SEND_BATCH_SIZE*MAXIMUM_MTU_SIZE];
+	int offsets[RNS2_MAXIMUM_SEND_BATCH_SIZE];
+	int lengths[RNS2_MAXIMUM_SEND_BATCH_SIZE];
+	SystemAddress systemAddresses[RNS2_MAXIMUM_SEND_BATCH_SIZE];
+	int count;
+	int dataSize;
+	bool gsoSupported;
+
+	// One mmsghdr per run of datagrams, built on flush
+	mmsghdr msgs[RNS2_MAXIMUM_SEND_BATCH_SIZE];
+	iovec iovecs[RNS2_MAXIMUM_SEND_BATCH_SIZE];
+	char controls[RNS2_MAXIMUM_SEND_BATCH_SIZE][CMSG_SPACE(sizeof(uint16_t))];
+	int msgFirstDatagram[RNS2_MAXIMUM_SEND_BATCH_SIZE];
+	int msgDatagramCount[RNS2_MAXIMUM_SEND_BATCH_SIZE];
+};
+
+RNS2_Linux::RNS2_Linux() {sendBatch=0; sendBatchPending=false;}
+RNS2_Linux::~RNS2_Linux()
+{
+	if (sendBatch)
+	{
+		sendBatchMutex.Lock();
+		FlushSendBatchInt();
+		sendBatchMutex.Unlock();
+		RakNet::OP_DELETE(sendBatch, _FILE_AND_LINE_);
+	}
+}
+RNS2SendResult RNS2_Linux::SendBatched( RNS2_SendParameters *sendParameters, const char *file, unsigned int line )
+{
+	// TTL changes a socket option for the duration of one send, so it cannot share a batch
+	if (sendParameters->ttl>0 || sendParameters->length<=0 || sendParameters->length>MAXIMUM_MTU_SIZE)
+		return Send(sendParameters, file, line);
+
+	sendBatchMutex.Lock();
+	if (sendBatch==0)
+	{
+		sendBatch=RakNet::OP_NEW<RNS2SendBatch>(file, line);
+		sendBatch->count=0;
+		sendBatch->dataSize=0;
+		int gsoSize=0;
+		socklen_t gsoSizeLen=sizeof(gsoSize);
+		sendBatch->gsoSupported=getsockopt__(rns2Socket, IPPROTO_UDP, UDP_SEGMENT, ( char * ) & gsoSize, &gsoSizeLen)==0;
+	}
+	if (sendBatch->count==RNS2_MAXIMUM_SEND_BATCH_SIZE)
+		FlushSendBatchInt();
+
+	int idx=sendBatch->count++;
+	sendBatch->offsets[idx]=sendBatch->dataSize;
+	sendBatch->lengths[idx]=sendParameters->length;
+	sendBatch->systemAddresses[idx]=sendParameters->systemAddress;
+	memcpy(sendBatch->data+sendBatch->dataSize, sendParameters->data, (size_t) sendParameters->length);
+	sendBatch->dataSize+=sendParameters->length;
+	sendBatchPending=true;
+	sendBatchMutex.Unlock();
+
+	return sendParameters->length;
+}
+void RNS2_Linux::FlushSendBatch(void)
+{
+	sendBatchMutex.Lock();
+	if (sendBatch)
+		FlushSendBatchInt();
+	sendBatchMutex.Unlock();
+}
+void RNS2_Linux::FlushSendBatchInt(void)
+{
+	RNS2SendBatch *b=sendBatch;
+	sendBatchPending=false;
+	if (b->count==0)
+		return;
+
+	// Group consecutive datagrams into runs. A run shares one address and one segment size, except the last datagram may be shorter
+	int numMsgs=0;
+	int i=0;
+	while (i < b->count)
+	{
+		int first=i;
+		int segmentSize=b->lengths[i];
+		int runBytes=segmentSize;
+		i++;
+		if (b->gsoSupported)
+		{
+			while (i < b->count &&
+				i-first < RNS2_MAXIMUM_GSO_SEGMENTS &&
+				runBytes+b->lengths[i] <= RNS2_MAXIMUM_GSO_BYTES &&
+				b->lengths[i] <= segmentSize &&
+				b->systemAddresses[i]==b->systemAddresses[first])
+			{
+				runBytes+=b->lengths[i];
+				i++;
+				if (b->lengths[i-1] < segmentSize)
+					break;
+			}
+		}
+
+		mmsghdr &msg=b->msgs[numMsgs];
+		memset(&msg, 0, sizeof(msg));
+		b->iovecs[numMsgs].iov_base=b->data+b->offsets[first];
+		b->iovecs[numMsgs].iov_len=(size_t) runBytes;
+		msg.msg_hdr.msg_iov=&b->iovecs[numMsgs];
+		msg.msg_hdr.msg_iovlen=1;
+		SystemAddress &systemAddress=b->systemAddresses[first];
+		if (systemAddress.address.addr4.sin_family==AF_INET)
+		{
+			msg.msg_hdr.msg_name=&systemAddress.address.addr4;
+			msg.msg_hdr.msg_namelen=sizeof(sockaddr_in);
+		}
+#if RAKNET_SUPPORT_IPV6==1
+		else
+		{
+			msg.msg_hdr.msg_name=&systemAddress.address.addr6;
+			msg.msg_hdr.msg_namelen=sizeof(sockaddr_in6);
+		}
+#endif
+		if (i-first>1)
+		{
+			msg.msg_hdr.msg_control=b->controls[numMsgs];
+			msg.msg_hdr.msg_controllen=sizeof(b->controls[numMsgs]);
+			cmsghdr *cmsg=CMSG_FIRSTHDR(&msg.msg_hdr);
+			cmsg->cmsg_level=IPPROTO_UDP;
+			cmsg->cmsg_type=UDP_SEGMENT;
+			cmsg->cmsg_len=CMSG_LEN(sizeof(uint16_t));
+			uint16_t gsoSize=(uint16_t) segmentSize;
+			memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(gsoSize));
+		}
+		b->msgFirstDatagram[numMsgs]=first;
+		b->msgDatagramCount[numMsgs]=i-first;
+		numMsgs++;
+	}
+
+	int numSent=0;
+	while (numSent < numMsgs)
+	{
+		int result=sendmmsg(rns2Socket, b->msgs+numSent, (unsigned int) (numMsgs-numSent), 0);
+		if (result>0)
+		{
+			numSent+=result;
+			continue;
+		}
+
+		// This message failed. Resend its datagrams one at a time so each gets the same error reporting as Send()
+		// If it was a GSO run, the device cannot segment for us, so stop building runs
+		if (b->msgDatagramCount[numSent]>1)
+			b->gsoSupported=false;
+		for (int j=0; j < b->msgDatagramCount[numSent]; j++)
+		{
+			int idx=b->msgFirstDatagram[numSent]+j;
+			RNS2_SendParameters bsp;
+			bsp.data=b->data+b->offsets[idx];
+			bsp.length=b->lengths[idx];
+			bsp.systemAddress=b->systemAddresses[idx];
+			Send_Windows_Linux_360NoVDP(rns2Socket, &bsp, _FILE_AND_LINE_);
+		}
+		numSent++;
+	}
+
+	b->count=0;
+	b->dataSize=0;
+}
+#endif // RAKNET_SUPPORT_SENDMMSG==1
 void RNS2_Linux::GetMyIP( SystemAddress addresses[MAXIMUM_NUMBER_OF_INTERNAL_IDS] ) {return GetMyIP_Windows_Linux(addresses);}
 #endif // Linux
 
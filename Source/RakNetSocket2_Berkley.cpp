@@ -67,6 +67,31 @@ void RNS2_Berkley::SetIPHdrIncl(int ipHdrIncl)
 
 		setsockopt__( rns2Socket, IPPROTO_IP, IP_HDRINCL, ( char * ) & ipHdrIncl, sizeof( ipHdrIncl ) );
 
+}
+void RNS2_Berkley::SetReusePort(bool reusePort)
+{
+#if RAKNET_SUPPORT_REUSEPORT==1 && defined(SO_REUSEPORT)
+	if (reusePort)
+	{
+		int opt=1;
+		setsockopt__( rns2Socket, SOL_SOCKET, SO_REUSEPORT, ( char * ) & opt, sizeof ( opt ) );
+	}
+#else
+	(void) reusePort;
+#endif
+}
+void RNS2_Berkley::SetRecvThreadAffinity(void)
+{
+#if RAKNET_SUPPORT_REUSEPORT==1
+	if (binding.recvThreadCpu>=0)
+	{
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		CPU_SET(binding.recvThreadCpu, &cpuSet);
+		// Do not assert, the CPU may be offline or outside this process's cpuset
+		pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+	}
+#endif
 }
 void RNS2_Berkley::SetDoNotFragment( int opt )
 {
@@ -175,6 +200,8 @@ RNS2BindResult RNS2_Berkley::BindSharedIPV4( RNS2_BerkleyBindParameters *bindPar
 	SetNonBlockingSocket(bindParameters->nonBlockingSocket);
 	SetBroadcastSocket(bindParameters->setBroadcast);
 	SetIPHdrIncl(bindParameters->setIPHdrIncl);
+	// Must be set before bind__
+	SetReusePort(bindParameters->reusePort);
 
 	// Fill in the rest of the address structure
 	boundAddress.address.addr4.sin_family = AF_INET;
@@ -319,6 +346,7 @@ RNS2BindResult RNS2_Berkley::BindSharedIPV4And6( RNS2_BerkleyBindParameters *bin
 
 
 
+		SetReusePort(bindParameters->reusePort);
 		ret = bind__(rns2Socket, aip->ai_addr, (int) aip->ai_addrlen );
 		if (ret>=0)
 		{
@@ -538,6 +566,82 @@ void RNS2_Berkley::RecvFromBlockingIPV4(RNS2RecvStruct *recvFromStruct)
 	// printf("--- Got %i bytes from %s\n", recvFromStruct->bytesRead, recvFromStruct->systemAddress.ToString());
 }
 
+#if RAKNET_SUPPORT_RECVMMSG==1
+struct RakNet::RNS2RecvBatchScratch
+{
+	mmsghdr msgs[RNS2_MAXIMUM_RECV_BATCH_SIZE];
+	iovec iovecs[RNS2_MAXIMUM_RECV_BATCH_SIZE];
+	sockaddr_storage addresses[RNS2_MAXIMUM_RECV_BATCH_SIZE];
+	char controls[RNS2_MAXIMUM_RECV_BATCH_SIZE][CMSG_SPACE(sizeof(timeval))];
+};
+
+int RNS2_Berkley::RecvFromBlockingBatch(RNS2RecvStruct **recvFromStructs, int count, RNS2RecvBatchScratch *scratch)
+{
+	int i;
+	for (i=0; i < count; i++)
+	{
+		scratch->iovecs[i].iov_base=recvFromStructs[i]->data;
+		scratch->iovecs[i].iov_len=sizeof(recvFromStructs[i]->data);
+		memset(&scratch->msgs[i].msg_hdr,0,sizeof(scratch->msgs[i].msg_hdr));
+		scratch->msgs[i].msg_hdr.msg_iov=&scratch->iovecs[i];
+		scratch->msgs[i].msg_hdr.msg_iovlen=1;
+		scratch->msgs[i].msg_hdr.msg_name=&scratch->addresses[i];
+		scratch->msgs[i].msg_hdr.msg_namelen=sizeof(scratch->addresses[i]);
+		scratch->msgs[i].msg_hdr.msg_control=scratch->controls[i];
+		scratch->msgs[i].msg_hdr.msg_controllen=sizeof(scratch->controls[i]);
+		scratch->msgs[i].msg_len=0;
+	}
+
+	// Blocks until at least one datagram is available, then takes whatever else is already queued without blocking again
+	int numRead = recvmmsg(rns2Socket, scratch->msgs, (unsigned int) count, MSG_WAITFORONE, 0);
+	if (numRead<=0)
+		return numRead;
+
+	// One clock read per batch. Datagrams that waited in the kernel queue are backdated by their SO_TIMESTAMP age, so timeRead stays per datagram
+	RakNet::TimeUS timeNow=RakNet::GetTimeUS();
+	timeval wallNow;
+	gettimeofday(&wallNow, 0);
+	RakNet::TimeUS wallNowUS=(RakNet::TimeUS) wallNow.tv_sec*1000000+(RakNet::TimeUS) wallNow.tv_usec;
+
+	for (i=0; i < numRead; i++)
+	{
+		RNS2RecvStruct *recvFromStruct=recvFromStructs[i];
+		recvFromStruct->bytesRead=(int) scratch->msgs[i].msg_len;
+		recvFromStruct->timeRead=timeNow;
+
+		for (cmsghdr *cmsg=CMSG_FIRSTHDR(&scratch->msgs[i].msg_hdr); cmsg!=0; cmsg=CMSG_NXTHDR(&scratch->msgs[i].msg_hdr, cmsg))
+		{
+			if (cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SCM_TIMESTAMP)
+			{
+				timeval kernelTime;
+				memcpy(&kernelTime, CMSG_DATA(cmsg), sizeof(kernelTime));
+				RakNet::TimeUS kernelTimeUS=(RakNet::TimeUS) kernelTime.tv_sec*1000000+(RakNet::TimeUS) kernelTime.tv_usec;
+				// Ignore the stamp if the wall clock stepped backwards, or it would put timeRead in the future
+				if (kernelTimeUS<=wallNowUS && wallNowUS-kernelTimeUS < timeNow)
+					recvFromStruct->timeRead=timeNow-(wallNowUS-kernelTimeUS);
+				break;
+			}
+		}
+
+		const sockaddr_storage &their_addr=scratch->addresses[i];
+		if (their_addr.ss_family==AF_INET)
+		{
+			memcpy(&recvFromStruct->systemAddress.address.addr4,(const sockaddr_in *)&their_addr,sizeof(sockaddr_in));
+			recvFromStruct->systemAddress.debugPort=ntohs(recvFromStruct->systemAddress.address.addr4.sin_port);
+		}
+#if RAKNET_SUPPORT_IPV6==1
+		else
+		{
+			memcpy(&recvFromStruct->systemAddress.address.addr6,(const sockaddr_in6 *)&their_addr,sizeof(sockaddr_in6));
+			recvFromStruct->systemAddress.debugPort=ntohs(recvFromStruct->systemAddress.address.addr6.sin6_port);
+		}
+#endif
+	}
+
+	return numRead;
+}
+#endif // RAKNET_SUPPORT_RECVMMSG==1
+
 void RNS2_Berkley::RecvFromBlocking(RNS2RecvStruct *recvFromStruct)
 {
 #if RAKNET_SUPPORT_IPV6==1
@@ -67,6 +67,7 @@
 namespace RakNet
 {
 RAK_THREAD_DECLARATION(UpdateNetworkLoop);
+RAK_THREAD_DECLARATION(UpdateShardLoop);
 RAK_THREAD_DECLARATION(RecvFromLoop);
 RAK_THREAD_DECLARATION(UDTConnect);
 }
@@ -161,12 +162,13 @@ Packet *RakPeer::AllocPacket(unsigned dataSize, const char *file, unsigned int l
 	p->length=dataSize;
 	p->bitSize=BYTES_TO_BITS(dataSize);
 	p->deleteData=true;
+	p->receiveBuffer=0;
 	p->guid=UNASSIGNED_RAKNET_GUID;
 	p->wasGeneratedLocally=false;
 	return p;
 }
 
-Packet *RakPeer::AllocPacket(unsigned dataSize, unsigned char *data, const char *file, unsigned int line)
+Packet *RakPeer::AllocPacket(unsigned dataSize, unsigned char *data, ReceiveBuffer *receiveBuffer, const char *file, unsigned int line)
 {
 	// Packet *p = (Packet *)rakMalloc_Ex(sizeof(Packet), file, line);
 	RakNet::Packet *p;
@@ -179,11 +181,21 @@ Packet *RakPeer::AllocPacket(unsigned dataSize, unsigned char *data, const char
 	p->length=dataSize;
 	p->bitSize=BYTES_TO_BITS(dataSize);
 	p->deleteData=true;
+	p->receiveBuffer=receiveBuffer;
 	p->guid=UNASSIGNED_RAKNET_GUID;
 	p->wasGeneratedLocally=false;
 	return p;
 }
 
+// Frees a message returned by ReliabilityLayer::Receive() that is not passed on to the user
+static void FreeReceivedData(unsigned char *data, ReceiveBuffer *receiveBuffer)
+{
+	if (receiveBuffer)
+		receiveBuffer->Release();
+	else
+		rakFree_Ex(data, _FILE_AND_LINE_ );
+}
+
 STATIC_FACTORY_DEFINITIONS(RakPeerInterface,RakPeer) 
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -197,6 +209,7 @@ RakPeer::RakPeer()
 	_using_security = false;
 	_server_handshake = 0;
 	_cookie_jar = 0;
+	nextHandshakeId = 0;
 #endif
 
 	StringCompressor::AddReference();
@@ -219,6 +232,13 @@ RakPeer::RakPeer()
 	endThreads = true;
 	isMainLoopThreadActive = false;
 	incomingDatagramEventHandler=0;
+	numberOfUpdateThreads=1;
+	numberOfHandshakeThreads=0;
+	maxPendingHandshakes=256;
+	numberOfPendingHandshakes=0;
+	numberOfDroppedHandshakes=0;
+	zeroCopyReceive=false;
+	updatePluginsOnReceive=true;
 
 	// isRecvfromThreadActive=false;
 #if defined(GET_TIME_SPIKE_LIMIT) && GET_TIME_SPIKE_LIMIT>0
@@ -235,6 +255,8 @@ RakPeer::RakPeer()
 	splitMessageProgressInterval=0;
 	//unreliableTimeout=0;
 	unreliableTimeout=1000;
+	statisticsSnapshotInterval=RAKPEER_STATISTICS_SNAPSHOT_INTERVAL_MS;
+	nextPeerStatisticsSnapshotTime=0;
 	maxOutgoingBPS=0;
 	firstExternalID=UNASSIGNED_SYSTEM_ADDRESS;
 	myGuid=UNASSIGNED_RAKNET_GUID;
@@ -263,9 +285,14 @@ RakPeer::RakPeer()
 
 	remoteSystemIndexPool.SetPageSize(sizeof(DataStructures::MemoryPool<RemoteSystemIndex>::MemoryWithPage)*32);
 
+	bufferedPacketsQueue.SetCapacity(BUFFERED_PACKETS_QUEUE_SIZE, _FILE_AND_LINE_);
+	bufferedPacketsFreePool.SetCapacity(BUFFERED_PACKETS_QUEUE_SIZE, _FILE_AND_LINE_);
+
 	GenerateGUID();
 
 	quitAndDataEvents.InitEvent();
+	lastUpdateCycleTime=0;
+	nextUpdateCycleTime=0;
 	limitConnectionFrequencyFromTheSameIP=false;
 	ResetSendReceipt();
 }
@@ -447,6 +474,9 @@ StartupResult RakPeer::Startup( unsigned int maxConnections, SocketDescriptor *s
 			bbp.pollingThreadPriority=threadPriority;
 			bbp.eventHandler=this;
 			bbp.remotePortRakNetWasStartedOn_PS3_PS4_PSP2=socketDescriptors[i].remotePortRakNetWasStartedOn_PS3_PSP2;
+			bbp.recvBatchSize=socketDescriptors[i].recvBatchSize;
+			bbp.reusePort=socketDescriptors[i].reusePortSocketCount>1;
+			bbp.recvThreadCpu=bbp.reusePort ? 0 : -1;
 			RNS2BindResult br = ((RNS2_Berkley*) r2)->Bind(&bbp, _FILE_AND_LINE_);
 
 			if (
@@ -512,12 +542,47 @@ StartupResult RakPeer::Startup( unsigned int maxConnections, SocketDescriptor *s
 
 	}
 
-#if !defined(__native_client__) && !defined(WINDOWS_STORE_RT)
+#if RAKNET_SUPPORT_REUSEPORT==1
+	// Bind the rest of each SO_REUSEPORT group on the port its first socket got, one recv thread per core
+	long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numCpus<1)
+		numCpus=1;
 	for (i=0; i<socketDescriptorCount; i++)
+	{
+		if (socketDescriptors[i].reusePortSocketCount<=1 || socketList[i]->IsBerkleySocket()==false)
+			continue;
+
+		unsigned int reusePortSocketCount=socketDescriptors[i].reusePortSocketCount;
+		if (reusePortSocketCount>RNS2_MAXIMUM_REUSEPORT_SOCKETS)
+			reusePortSocketCount=RNS2_MAXIMUM_REUSEPORT_SOCKETS;
+
+		RNS2_BerkleyBindParameters bbp = *((RNS2_Berkley*) socketList[i])->GetBindings();
+		bbp.port=socketList[i]->GetBoundAddress().GetPort();
+		for (unsigned int j=1; j < reusePortSocketCount; j++)
+		{
+			bbp.recvThreadCpu=(int) (j % numCpus);
+			RakNetSocket2 *r2 = RakNetSocket2Allocator::AllocRNS2();
+			r2->SetUserConnectionSocketIndex((unsigned int)-1);
+			RNS2BindResult br = ((RNS2_Berkley*) r2)->Bind(&bbp, _FILE_AND_LINE_);
+			if (br!=BR_SUCCESS)
+			{
+				RakNetSocket2Allocator::DeallocRNS2(r2);
+				DerefAllSockets();
+				return br==BR_FAILED_SEND_TEST ? SOCKET_FAILED_TEST_SEND : SOCKET_PORT_ALREADY_IN_USE;
+			}
+			reusePortSocketList.Push(r2, _FILE_AND_LINE_ );
+		}
+	}
+#endif
+
+#if !defined(__native_client__) && !defined(WINDOWS_STORE_RT)
+	for (i=0; i<(int) socketList.Size(); i++)
 	{
 		if (socketList[i]->IsBerkleySocket())
 			((RNS2_Berkley*) socketList[i])->CreateRecvPollingThread(threadPriority);
 	}
+	for (i=0; i<(int) reusePortSocketList.Size(); i++)
+		((RNS2_Berkley*) reusePortSocketList[i])->CreateRecvPollingThread(threadPriority);
 #endif
 
 // #if !defined(_XBOX) && !defined(_XBOX_720_COMPILE_AS_WINDOWS) && !defined(X360)
@@ -555,6 +620,8 @@ StartupResult RakPeer::Startup( unsigned int maxConnections, SocketDescriptor *s
 		remoteSystemList = RakNet::OP_NEW_ARRAY<RemoteSystemStruct>(maximumNumberOfPeers, _FILE_AND_LINE_ );
 
 		remoteSystemLookup = RakNet::OP_NEW_ARRAY<RemoteSystemIndex*>((unsigned int) maximumNumberOfPeers * REMOTE_SYSTEM_LOOKUP_HASH_MULTIPLE, _FILE_AND_LINE_ );
+		remoteSystemAddressIndex.SetCapacity(maximumNumberOfPeers, _FILE_AND_LINE_ );
+		remoteSystemGuidIndex.SetCapacity(maximumNumberOfPeers, _FILE_AND_LINE_ );
 
 		activeSystemList = RakNet::OP_NEW_ARRAY<RemoteSystemStruct*>(maximumNumberOfPeers, _FILE_AND_LINE_ );
 
@@ -597,6 +664,18 @@ StartupResult RakPeer::Startup( unsigned int maxConnections, SocketDescriptor *s
 		ClearBufferedPackets();
 		ClearSocketQueryOutput();
 
+		if (StartUpdateShards(threadPriority)==false)
+		{
+			Shutdown( 0, 0 );
+			return FAILED_TO_CREATE_NETWORK_THREAD;
+		}
+
+		if (StartHandshakeThreads()==false)
+		{
+			Shutdown( 0, 0 );
+			return FAILED_TO_CREATE_NETWORK_THREAD;
+		}
+
 		if ( isMainLoopThreadActive == false )
 		{
 #if RAKPEER_USER_THREADED!=1
@@ -732,6 +811,7 @@ bool RakPeer::InitializeSecurity(const char *public_key, const char *private_key
 		_server_handshake->FillCookieJar(_cookie_jar);
 
 		memcpy(my_public_key, public_key, sizeof(my_public_key));
+		memcpy(my_private_key, private_key, sizeof(my_private_key));
 
 		_using_security = true;
 		return true;
@@ -772,6 +852,29 @@ void RakPeer::DisableSecurity( void )
 #endif
 }
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetNumberOfHandshakeThreads( unsigned int count, unsigned int _maxPendingHandshakes )
+{
+	numberOfHandshakeThreads = count;
+	if (_maxPendingHandshakes==0)
+		_maxPendingHandshakes=1;
+	maxPendingHandshakes = _maxPendingHandshakes;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::GetNumberOfHandshakeThreads( void ) const
+{
+	return numberOfHandshakeThreads;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::GetNumberOfPendingHandshakes( void ) const
+{
+	return numberOfPendingHandshakes.load(std::memory_order_relaxed);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+uint64_t RakPeer::GetNumberOfDroppedHandshakes( void ) const
+{
+	return numberOfDroppedHandshakes.load(std::memory_order_relaxed);
+}
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::AddToSecurityExceptionList(const char *ip)
 {
@@ -851,6 +954,28 @@ unsigned int RakPeer::GetMaximumIncomingConnections( void ) const
 {
 	return maximumIncomingConnections;
 }
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetNumberOfUpdateThreads( unsigned int count )
+{
+	if (count==0)
+		count=1;
+	numberOfUpdateThreads = count;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::GetNumberOfUpdateThreads( void ) const
+{
+	return numberOfUpdateThreads;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetZeroCopyReceive( bool enable )
+{
+	zeroCopyReceive.store(enable, std::memory_order_relaxed);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::GetZeroCopyReceive( void ) const
+{
+	return zeroCopyReceive.load(std::memory_order_relaxed);
+}
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // Returns how many open connections there are at this time
@@ -1048,6 +1173,8 @@ void RakPeer::Shutdown( unsigned int blockDuration, unsigned char orderingChanne
 			((RNS2_Berkley *)socketList[i])->SignalStopRecvPollingThread();
 		}
 	}
+	for (i=0; i < reusePortSocketList.Size(); i++)
+		((RNS2_Berkley *)reusePortSocketList[i])->SignalStopRecvPollingThread();
 #endif
 
 	/*
@@ -1087,11 +1214,16 @@ void RakPeer::Shutdown( unsigned int blockDuration, unsigned char orderingChanne
 			((RNS2_Berkley *)socketList[i])->BlockOnStopRecvPollingThread();
 		}
 	}
+	for (i=0; i < reusePortSocketList.Size(); i++)
+		((RNS2_Berkley *)reusePortSocketList[i])->BlockOnStopRecvPollingThread();
 #endif
 
 
 #endif // RAKPEER_USER_THREADED!=1
 
+	StopUpdateShards();
+	StopHandshakeThreads();
+
 //	char c=0;
 //	unsigned int socketIndex;
 	// remoteSystemList in Single thread
@@ -1111,6 +1243,8 @@ void RakPeer::Shutdown( unsigned int blockDuration, unsigned char orderingChanne
 	// Setting remoteSystemListSize prevents threads from accessing the reliability layer
 	maximumNumberOfPeers = 0;
 	//remoteSystemListSize = 0;
+	remoteSystemAddressIndex.Clear();
+	remoteSystemGuidIndex.Clear();
 
 	// Free any packets the user didn't deallocate
 	packetReturnMutex.Lock();
@@ -1121,6 +1255,7 @@ void RakPeer::Shutdown( unsigned int blockDuration, unsigned char orderingChanne
 	packetAllocationPoolMutex.Lock();
 	packetAllocationPool.Clear(_FILE_AND_LINE_);
 	packetAllocationPoolMutex.Unlock();
+	receiveBufferPool.Clear(_FILE_AND_LINE_);
 
 	/*
 	if (isRecvFromLoopThreadActive.GetValue()>0)
@@ -1347,6 +1482,65 @@ uint32_t RakPeer::Send( const RakNet::BitStream * bitStream, PacketPriority prio
 	SendBuffered((const char*)bitStream->GetData(), bitStream->GetNumberOfBitsUsed(), priority, reliability, orderingChannel, systemIdentifier, broadcast, RemoteSystemStruct::NO_ACTION, usedSendReceipt);
 
 
+	return usedSendReceipt;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t RakPeer::Send( RakNet::SendBuffer *sendBuffer, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, uint32_t forceReceiptNumber )
+{
+	RakAssert( !( reliability >= NUMBER_OF_RELIABILITIES || reliability < 0 ) );
+	RakAssert( !( priority > NUMBER_OF_PRIORITIES || priority < 0 ) );
+	RakAssert( !( orderingChannel >= NUMBER_OF_ORDERED_STREAMS ) );
+
+	if ( sendBuffer == 0 || sendBuffer->GetNumberOfBits() == 0 )
+		return 0;
+
+	if ( remoteSystemList == 0 || endThreads == true )
+		return 0;
+
+	if ( broadcast == false && systemIdentifier.IsUndefined() )
+		return 0;
+
+	uint32_t usedSendReceipt;
+	if (forceReceiptNumber!=0)
+		usedSendReceipt=forceReceiptNumber;
+	else
+		usedSendReceipt=IncrementNextSendReceipt();
+
+	if (broadcast==false && IsLoopbackAddress(systemIdentifier,true))
+	{
+		SendLoopback(sendBuffer->GetData(),sendBuffer->GetNumberOfBytes());
+		if (reliability>=UNRELIABLE_WITH_ACK_RECEIPT)
+		{
+			char buff[5];
+			buff[0]=ID_SND_RECEIPT_ACKED;
+			sendReceiptSerialMutex.Lock();
+			memcpy(buff+1, &sendReceiptSerial,4);
+			sendReceiptSerialMutex.Unlock();
+			SendLoopback( buff, 5 );
+		}
+		return usedSendReceipt;
+	}
+
+	// Same as SendBuffered(), but the command holds a reference instead of a copy
+	BufferedCommandStruct *bcs;
+	bcs=bufferedCommands.Allocate( _FILE_AND_LINE_ );
+	sendBuffer->AddRef();
+	bcs->data=0;
+	bcs->sendBuffer=sendBuffer;
+	bcs->numberOfBitsToSend=sendBuffer->GetNumberOfBits();
+	bcs->priority=priority;
+	bcs->reliability=reliability;
+	bcs->orderingChannel=orderingChannel;
+	bcs->systemIdentifier=systemIdentifier;
+	bcs->broadcast=broadcast;
+	bcs->connectionMode=RemoteSystemStruct::NO_ACTION;
+	bcs->receipt=usedSendReceipt;
+	bcs->command=BufferedCommandStruct::BCS_SEND;
+	bufferedCommands.Push(bcs);
+
+	// The update thread sleeps until its next scheduled event, so wake it to pick up the send
+	quitAndDataEvents.SetEvent();
+
 	return usedSendReceipt;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -1421,11 +1615,6 @@ Packet* RakPeer::Receive( void )
 		return 0;
 
 	RakNet::Packet *packet;
-//	Packet **threadPacket;
-	PluginReceiveResult pluginResult;
-
-	int offset;
-	unsigned int i;
 
 	// User should call RunUpdateCycle and RunRecvFromOnce to do this commented code
 	/*
@@ -1464,14 +1653,8 @@ Packet* RakPeer::Receive( void )
 #endif
 	*/
 
-	for (i=0; i < pluginListTS.Size(); i++)
-	{
-		pluginListTS[i]->Update();
-	}
-	for (i=0; i < pluginListNTS.Size(); i++)
-	{
-		pluginListNTS[i]->Update();
-	}
+	if (updatePluginsOnReceive)
+		UpdatePlugins();
 
 	do
 	{
@@ -1484,65 +1667,131 @@ Packet* RakPeer::Receive( void )
 		if (packet==0)
 			return 0;
 
-//		unsigned char msgId;
-		if ( ( packet->length >= sizeof(unsigned char) + sizeof( RakNet::Time ) ) &&
-			( (unsigned char) packet->data[ 0 ] == ID_TIMESTAMP ) )
-		{
-			offset = sizeof(unsigned char);
-			ShiftIncomingTimestamp( packet->data + offset, packet->systemAddress );
-//			msgId=packet->data[sizeof(unsigned char) + sizeof( RakNet::Time )];
-		}
-//		else
-	//		msgId=packet->data[0];
+		if (RunReceivePlugins(packet)==false)
+			packet=0; // Will do the loop again and get another packet
+	} while(packet==0);
+
+#ifdef _DEBUG
+	RakAssert( packet->data );
+#endif
 
-		// Some locally generated packets need to be processed by plugins, for example ID_FCM2_NEW_HOST
-		// The plugin itself should intercept these messages generated remotely
-// 		if (packet->wasGeneratedLocally)
-// 			return packet;
+	return packet;
+}
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Description:
+// Like Receive, but takes up to maxPackets messages from the queue with one lock, and updates plugins once for all of them
+//
+// Returns:
+// How many packets were written to packets
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::ReceiveBatch( Packet **packets, unsigned int maxPackets )
+{
+	if ( !( IsActive() ) || maxPackets==0 )
+		return 0;
 
-		CallPluginCallbacks(pluginListTS, packet);
-		CallPluginCallbacks(pluginListNTS, packet);
+	if (updatePluginsOnReceive)
+		UpdatePlugins();
 
-		for (i=0; i < pluginListTS.Size(); i++)
+	unsigned int numPackets=0, numPopped, firstPopped, i;
+	while (numPackets < maxPackets)
+	{
+		packetReturnMutex.Lock();
+		numPopped=0;
+		while (numPackets+numPopped < maxPackets && packetReturnQueue.IsEmpty()==false)
 		{
- 			pluginResult=pluginListTS[i]->OnReceive(packet);
-			if (pluginResult==RR_STOP_PROCESSING_AND_DEALLOCATE)
-			{
-				DeallocatePacket( packet );
-				packet=0; // Will do the loop again and get another packet
-				break; // break out of the enclosing for
-			}
-			else if (pluginResult==RR_STOP_PROCESSING)
-			{
-				packet=0;
-				break;
-			}
+			packets[numPackets+numPopped]=packetReturnQueue.Pop();
+			numPopped++;
 		}
+		packetReturnMutex.Unlock();
+		if (numPopped==0)
+			break;
 
-		for (i=0; i < pluginListNTS.Size(); i++)
+		// Compact in place, dropping messages a plugin absorbed. If any were, go back for more
+		firstPopped=numPackets;
+		for (i=0; i < numPopped; i++)
 		{
-			pluginResult=pluginListNTS[i]->OnReceive(packet);
-			if (pluginResult==RR_STOP_PROCESSING_AND_DEALLOCATE)
-			{
-				DeallocatePacket( packet );
-				packet=0; // Will do the loop again and get another packet
-				break; // break out of the enclosing for
-			}
-			else if (pluginResult==RR_STOP_PROCESSING)
-			{
-				packet=0;
-				break;
-			}
+			Packet *packet=packets[firstPopped+i];
+			if (RunReceivePlugins(packet))
+				packets[numPackets++]=packet;
 		}
-	
-	} while(packet==0);
+	}
 
-#ifdef _DEBUG
-	RakAssert( packet->data );
-#endif
+	return numPackets;
+}
 
-	return packet;
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Description:
+// Calls Update() on every attached plugin
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::UpdatePlugins( void )
+{
+	unsigned int i;
+	for (i=0; i < pluginListTS.Size(); i++)
+	{
+		pluginListTS[i]->Update();
+	}
+	for (i=0; i < pluginListNTS.Size(); i++)
+	{
+		pluginListNTS[i]->Update();
+	}
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetUpdatePluginsOnReceive( bool enable )
+{
+	updatePluginsOnReceive = enable;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::GetUpdatePluginsOnReceive( void ) const
+{
+	return updatePluginsOnReceive;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Description:
+// Passes a message taken from packetReturnQueue through the plugins
+//
+// Returns:
+// false if a plugin absorbed the message, true to return it to the user
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::RunReceivePlugins( Packet *packet )
+{
+	PluginReceiveResult pluginResult;
+	unsigned int i;
+
+	if ( ( packet->length >= sizeof(unsigned char) + sizeof( RakNet::Time ) ) &&
+		( (unsigned char) packet->data[ 0 ] == ID_TIMESTAMP ) )
+	{
+		ShiftIncomingTimestamp( packet->data + sizeof(unsigned char), packet->systemAddress );
+	}
+
+	// Some locally generated packets need to be processed by plugins, for example ID_FCM2_NEW_HOST
+	// The plugin itself should intercept these messages generated remotely
+
+	CallPluginCallbacks(pluginListTS, packet);
+	CallPluginCallbacks(pluginListNTS, packet);
+
+	// Only plugins whose GetReceiveFilter() includes this message, or that have no filter
+	MessageID messageId = packet->data[0];
+	if (messageId==ID_TIMESTAMP && packet->length > sizeof(unsigned char) + sizeof( RakNet::Time ))
+		messageId = packet->data[sizeof(unsigned char) + sizeof( RakNet::Time )];
+	DataStructures::List<PluginInterface2*> &receivePlugins = pluginReceiveTable[messageId];
+
+	for (i=0; i < receivePlugins.Size(); i++)
+	{
+		pluginResult=receivePlugins[i]->OnReceive(packet);
+		if (pluginResult==RR_STOP_PROCESSING_AND_DEALLOCATE)
+		{
+			DeallocatePacket( packet );
+			return false;
+		}
+		else if (pluginResult==RR_STOP_PROCESSING)
+		{
+			return false;
+		}
+	}
+
+	return true;
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -1556,7 +1805,7 @@ void RakPeer::DeallocatePacket( Packet *packet )
 
 	if (packet->deleteData)
 	{
-		rakFree_Ex(packet->data, _FILE_AND_LINE_ );
+		FreeReceivedData(packet->data, packet->receiveBuffer);
 		packet->~Packet();
 		packetAllocationPoolMutex.Lock();
 		packetAllocationPool.Release(packet,_FILE_AND_LINE_);
@@ -2289,27 +2538,22 @@ void RakPeer::SetInternalID(SystemAddress systemAddress, int index)
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 SystemAddress RakPeer::GetExternalID( const SystemAddress target ) const
 {
-	unsigned i;
-	SystemAddress inactiveExternalId;
-
-	inactiveExternalId=UNASSIGNED_SYSTEM_ADDRESS;
-
 	if (target==UNASSIGNED_SYSTEM_ADDRESS)
 		return firstExternalID;
 
 	// First check for active connection with this systemAddress
-	for ( i = 0; i < maximumNumberOfPeers; i++ )
-	{
-		if (remoteSystemList[ i ].systemAddress == target )
-		{
-			if ( remoteSystemList[ i ].isActive )
-				return remoteSystemList[ i ].myExternalSystemAddress;
-			else if (remoteSystemList[ i ].myExternalSystemAddress!=UNASSIGNED_SYSTEM_ADDRESS)
-				inactiveExternalId=remoteSystemList[ i ].myExternalSystemAddress;
-		}
-	}
+	unsigned int i = FindRemoteSystemIndex(target, true);
+	if (i!=(unsigned int) -1)
+		return remoteSystemList[ i ].myExternalSystemAddress;
 
-	return inactiveExternalId;
+	const RemoteSystemStruct *list = remoteSystemList;
+	unsigned int numPeers = maximumNumberOfPeers;
+	if (list==0)
+		return UNASSIGNED_SYSTEM_ADDRESS;
+	i = remoteSystemAddressIndex.Find(SystemAddress::ToInteger(target), [&](unsigned int index) {return index < numPeers && list[index].systemAddress==target && list[index].myExternalSystemAddress!=UNASSIGNED_SYSTEM_ADDRESS;});
+	if (i!=DataStructures::SeqLockHashIndex::NOT_FOUND)
+		return list[ i ].myExternalSystemAddress;
+	return UNASSIGNED_SYSTEM_ADDRESS;
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -2338,16 +2582,13 @@ const RakNetGUID& RakPeer::GetGuidFromSystemAddress( const SystemAddress input )
 	if (input.systemIndex!=(SystemIndex)-1 && input.systemIndex<maximumNumberOfPeers && remoteSystemList[ input.systemIndex ].systemAddress == input)
 		return remoteSystemList[ input.systemIndex ].guid;
 
-	unsigned int i;
-	for ( i = 0; i < maximumNumberOfPeers; i++ )
+	unsigned int i = FindRemoteSystemIndex(input, false);
+	if (i!=(unsigned int) -1)
 	{
-		if (remoteSystemList[ i ].systemAddress == input )
-		{
-			// Set the systemIndex so future lookups will be fast
-			remoteSystemList[i].guid.systemIndex = (SystemIndex) i;
+		// Set the systemIndex so future lookups will be fast
+		remoteSystemList[i].guid.systemIndex = (SystemIndex) i;
 
-			return remoteSystemList[ i ].guid;
-		}
+		return remoteSystemList[ i ].guid;
 	}
 
 	return UNASSIGNED_RAKNET_GUID;
@@ -2366,19 +2607,14 @@ unsigned int RakPeer::GetSystemIndexFromGuid( const RakNetGUID input ) const
 	if (input.systemIndex!=(SystemIndex)-1 && input.systemIndex<maximumNumberOfPeers && remoteSystemList[ input.systemIndex ].guid == input)
 		return input.systemIndex;
 
-	unsigned int i;
-	for ( i = 0; i < maximumNumberOfPeers; i++ )
+	unsigned int i = FindRemoteSystemIndex(input, false);
+	if (i!=(unsigned int) -1)
 	{
-		if (remoteSystemList[ i ].guid == input )
-		{
-			// Set the systemIndex so future lookups will be fast
-			remoteSystemList[i].guid.systemIndex = (SystemIndex) i;
-
-			return i;
-		}
+		// Set the systemIndex so future lookups will be fast
+		remoteSystemList[i].guid.systemIndex = (SystemIndex) i;
 	}
 
-	return (unsigned int) -1;
+	return i;
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -2394,16 +2630,13 @@ SystemAddress RakPeer::GetSystemAddressFromGuid( const RakNetGUID input ) const
 	if (input.systemIndex!=(SystemIndex)-1 && input.systemIndex<maximumNumberOfPeers && remoteSystemList[ input.systemIndex ].guid == input)
 		return remoteSystemList[ input.systemIndex ].systemAddress;
 
-	unsigned int i;
-	for ( i = 0; i < maximumNumberOfPeers; i++ )
+	unsigned int i = FindRemoteSystemIndex(input, false);
+	if (i!=(unsigned int) -1)
 	{
-		if (remoteSystemList[ i ].guid == input )
-		{
-			// Set the systemIndex so future lookups will be fast
-			remoteSystemList[i].guid.systemIndex = (SystemIndex) i;
+		// Set the systemIndex so future lookups will be fast
+		remoteSystemList[i].guid.systemIndex = (SystemIndex) i;
 
-			return remoteSystemList[ i ].systemAddress;
-		}
+		return remoteSystemList[ i ].systemAddress;
 	}
 
 	return UNASSIGNED_SYSTEM_ADDRESS;
@@ -2662,6 +2895,24 @@ void RakPeer::SetUnreliableTimeout(RakNet::TimeMS timeoutMS)
 		remoteSystemList[ i ].reliabilityLayer.SetUnreliableTimeout(unreliableTimeout);
 }
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Set how often the network thread publishes the statistics returned by GetStatistics() and GetStatisticsList()
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetStatisticsSnapshotInterval(RakNet::TimeMS intervalMS)
+{
+	statisticsSnapshotInterval=intervalMS;
+	for ( unsigned short i = 0; i < maximumNumberOfPeers; i++ )
+		remoteSystemList[ i ].reliabilityLayer.SetStatisticsSnapshotInterval(statisticsSnapshotInterval);
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Returns what was passed to SetStatisticsSnapshotInterval()
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+RakNet::TimeMS RakPeer::GetStatisticsSnapshotInterval(void) const
+{
+	return statisticsSnapshotInterval;
+}
+
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // Send a message to host, with the IP socket option TTL set to 3
 // This message will not reach the host, but will open the router.
@@ -2701,6 +2952,8 @@ void RakPeer::AttachPlugin( PluginInterface2 *plugin )
 	bool isNotThreadsafe = plugin->UsesReliabilityLayer();
 	if (isNotThreadsafe)
 	{
+		// With update shards, the reliability layer callbacks run on several threads at once
+		RakAssert(numberOfUpdateThreads<=1 || plugin->IsReliabilityLayerThreadSafe());
 		if (pluginListNTS.GetIndexOf(plugin)==MAX_UNSIGNED_LONG)
 		{
 			plugin->SetRakPeerInterface(this);
@@ -2717,6 +2970,7 @@ void RakPeer::AttachPlugin( PluginInterface2 *plugin )
 			pluginListTS.Insert(plugin, _FILE_AND_LINE_);
 		}
 	}
+	RefreshPluginReceiveFilters();
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -2752,10 +3006,33 @@ void RakPeer::DetachPlugin( PluginInterface2 *plugin )
 			pluginListTS.RemoveFromEnd();
 		}
 	}
+	RefreshPluginReceiveFilters();
 	plugin->OnDetach();
 	plugin->SetRakPeerInterface(0);
 }
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Rebuilds pluginReceiveTable from each plugin's GetReceiveFilter()
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::RefreshPluginReceiveFilters( void )
+{
+	unsigned int i, messageId;
+	for (messageId=0; messageId < 256; messageId++)
+		pluginReceiveTable[messageId].Clear(true, _FILE_AND_LINE_);
+
+	for (i=0; i < pluginListTS.Size()+pluginListNTS.Size(); i++)
+	{
+		PluginInterface2 *plugin = i < pluginListTS.Size() ? pluginListTS[i] : pluginListNTS[i-pluginListTS.Size()];
+		PluginReceiveFilter filter;
+		bool useFilter = plugin->GetReceiveFilter(filter);
+		for (messageId=0; messageId < 256; messageId++)
+		{
+			if (useFilter==false || filter.Contains((MessageID) messageId))
+				pluginReceiveTable[messageId].Insert(plugin, _FILE_AND_LINE_);
+		}
+	}
+}
+
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // Put a packet back at the end of the receive queue in case you don't want to deal with it immediately
 //
@@ -2792,6 +3069,7 @@ void RakPeer::ChangeSystemAddress(RakNetGUID guid, const SystemAddress &systemAd
 	bcs->systemIdentifier.rakNetGuid=guid;
 	bcs->command=BufferedCommandStruct::BCS_CHANGE_SYSTEM_ADDRESS;
 	bufferedCommands.Push(bcs);
+	quitAndDataEvents.SetEvent();
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 Packet* RakPeer::AllocatePacket(unsigned dataSize)
@@ -2808,6 +3086,7 @@ RakNetSocket2* RakPeer::GetSocket( const SystemAddress target )
 	bcs->systemIdentifier=target;
 	bcs->data=0;
 	bufferedCommands.Push(bcs);
+	quitAndDataEvents.SetEvent();
 
 	// Block up to one second to get the socket, although it should actually take virtually no time
 	SocketQueryOutput *sqo;
@@ -2846,6 +3125,7 @@ void RakPeer::GetSockets( DataStructures::List<RakNetSocket2* > &sockets )
 	bcs->systemIdentifier=UNASSIGNED_SYSTEM_ADDRESS;
 	bcs->data=0;
 	bufferedCommands.Push(bcs);
+	quitAndDataEvents.SetEvent();
 
 	// Block up to one second to get the socket, although it should actually take virtually no time
 	SocketQueryOutput *sqo;
@@ -2998,24 +3278,8 @@ RakNetStatistics * RakPeer::GetStatistics( const SystemAddress systemAddress, Ra
 
 	if (systemAddress==UNASSIGNED_SYSTEM_ADDRESS)
 	{
-		bool firstWrite=false;
-		// Return a crude sum
-		for ( unsigned short i = 0; i < maximumNumberOfPeers; i++ )
-		{
-			if (remoteSystemList[ i ].isActive)
-			{
-				RakNetStatistics rnsTemp;
-				remoteSystemList[ i ].reliabilityLayer.GetStatistics(&rnsTemp);
-
-				if (firstWrite==false)
-				{
-					memcpy(systemStats, &rnsTemp, sizeof(RakNetStatistics));
-					firstWrite=true;
-				}
-				else
-					(*systemStats)+=rnsTemp;
-			}
-		}
+		// Crude sum, published by PublishPeerStatisticsSnapshot()
+		peerStatisticsSnapshot.Read(*systemStats);
 		return systemStats;
 	}
 	else
@@ -3024,7 +3288,7 @@ RakNetStatistics * RakPeer::GetStatistics( const SystemAddress systemAddress, Ra
 		rss = GetRemoteSystemFromSystemAddress( systemAddress, false, false );
 		if ( rss && endThreads==false )
 		{
-			rss->reliabilityLayer.GetStatistics(systemStats);
+			rss->reliabilityLayer.GetStatisticsSnapshot(systemStats);
 			return systemStats;
 		}
 	}
@@ -3050,7 +3314,7 @@ void RakPeer::GetStatisticsList(DataStructures::List<SystemAddress> &addresses,
 			addresses.Push((activeSystemList[i])->systemAddress, _FILE_AND_LINE_ );
 			guids.Push((activeSystemList[i])->guid, _FILE_AND_LINE_ );
 			RakNetStatistics rns;
-			(activeSystemList[i])->reliabilityLayer.GetStatistics(&rns);
+			(activeSystemList[i])->reliabilityLayer.GetStatisticsSnapshot(&rns);
 			statistics.Push(rns, _FILE_AND_LINE_);
 		}
 	}
@@ -3060,7 +3324,7 @@ bool RakPeer::GetStatistics( const unsigned int index, RakNetStatistics *rns )
 {
 	if (index < maximumNumberOfPeers && remoteSystemList[ index ].isActive)
 	{
-		remoteSystemList[ index ].reliabilityLayer.GetStatistics(rns);
+		remoteSystemList[ index ].reliabilityLayer.GetStatisticsSnapshot(rns);
 		return true;
 	}
 	return false;
@@ -3075,10 +3339,13 @@ unsigned int RakPeer::GetReceiveBufferSize(void)
 	return size;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t RakPeer::GetBufferedPacketsDropped(void) const
+{
+	return bufferedPacketsDropped.GetValue();
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 int RakPeer::GetIndexFromSystemAddress( const SystemAddress systemAddress, bool calledFromNetworkThread ) const
 {
-	unsigned i;
-
 	if ( systemAddress == UNASSIGNED_SYSTEM_ADDRESS )
 		return -1;
 
@@ -3091,41 +3358,21 @@ int RakPeer::GetIndexFromSystemAddress( const SystemAddress systemAddress, bool
 	}
 	else
 	{
-		// remoteSystemList in user and network thread
-		for ( i = 0; i < maximumNumberOfPeers; i++ )
-			if ( remoteSystemList[ i ].isActive && remoteSystemList[ i ].systemAddress == systemAddress )
-				return i;
-
 		// If no active results found, try previously active results.
-		for ( i = 0; i < maximumNumberOfPeers; i++ )
-			if ( remoteSystemList[ i ].systemAddress == systemAddress )
-				return i;
+		return (int) FindRemoteSystemIndex(systemAddress, false);
 	}
-
-	return -1;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 int RakPeer::GetIndexFromGuid( const RakNetGUID guid )
 {
-	unsigned i;
-
 	if ( guid == UNASSIGNED_RAKNET_GUID )
 		return -1;
 
 	if (guid.systemIndex!=(SystemIndex)-1 && guid.systemIndex < maximumNumberOfPeers && remoteSystemList[guid.systemIndex].guid==guid && remoteSystemList[ guid.systemIndex ].isActive)
 		return guid.systemIndex;
 
-	// remoteSystemList in user and network thread
-	for ( i = 0; i < maximumNumberOfPeers; i++ )
-		if ( remoteSystemList[ i ].isActive && remoteSystemList[ i ].guid == guid )
-			return i;
-
 	// If no active results found, try previously active results.
-	for ( i = 0; i < maximumNumberOfPeers; i++ )
-		if ( remoteSystemList[ i ].guid == guid )
-			return i;
-
-	return -1;
+	return (int) FindRemoteSystemIndex(guid, false);
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 #if LIBCAT_SECURITY==1
@@ -3255,6 +3502,7 @@ ConnectionAttemptResult RakPeer::SendConnectionRequest( const char* host, unsign
 	}
 	requestedConnectionQueue.Push(rcs, _FILE_AND_LINE_ );
 	requestedConnectionQueueMutex.Unlock();
+	quitAndDataEvents.SetEvent();
 
 	return CONNECTION_ATTEMPT_STARTED;
 }
@@ -3309,6 +3557,7 @@ ConnectionAttemptResult RakPeer::SendConnectionRequest( const char* host, unsign
 	}
 	requestedConnectionQueue.Push(rcs, _FILE_AND_LINE_ );
 	requestedConnectionQueueMutex.Unlock();
+	quitAndDataEvents.SetEvent();
 
 	return CONNECTION_ATTEMPT_STARTED;
 }
@@ -3327,8 +3576,6 @@ RakPeer::RemoteSystemStruct *RakPeer::GetRemoteSystem( const AddressOrGUID syste
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 RakPeer::RemoteSystemStruct *RakPeer::GetRemoteSystemFromSystemAddress( const SystemAddress systemAddress, bool calledFromNetworkThread, bool onlyActive ) const
 {
-	unsigned i;
-
 	if ( systemAddress == UNASSIGNED_SYSTEM_ADDRESS )
 		return 0;
 
@@ -3346,22 +3593,10 @@ RakPeer::RemoteSystemStruct *RakPeer::GetRemoteSystemFromSystemAddress( const Sy
 	}
 	else
 	{
-		int deadConnectionIndex=-1;
-
 		// Active connections take priority.  But if there are no active connections, return the first systemAddress match found
-		for ( i = 0; i < maximumNumberOfPeers; i++ )
-		{
-			if (remoteSystemList[ i ].systemAddress == systemAddress)
-			{
-				if ( remoteSystemList[ i ].isActive )
-					return remoteSystemList + i;
-				else if (deadConnectionIndex==-1)
-					deadConnectionIndex=i;
-			}
-		}
-
-		if (deadConnectionIndex!=-1 && onlyActive==false)
-			return remoteSystemList + deadConnectionIndex;
+		unsigned int index = FindRemoteSystemIndex(systemAddress, onlyActive);
+		if (index!=(unsigned int) -1)
+			return remoteSystemList + index;
 	}
 
 	return 0;
@@ -3369,17 +3604,12 @@ RakPeer::RemoteSystemStruct *RakPeer::GetRemoteSystemFromSystemAddress( const Sy
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 RakPeer::RemoteSystemStruct *RakPeer::GetRemoteSystemFromGUID( const RakNetGUID guid, bool onlyActive ) const
 {
-	if (guid==UNASSIGNED_RAKNET_GUID)
-		return 0;
-
-	unsigned i;
-	for ( i = 0; i < maximumNumberOfPeers; i++ )
-	{
-		if (remoteSystemList[ i ].guid == guid && (onlyActive==false || remoteSystemList[ i ].isActive))
-		{
-			return remoteSystemList + i;
-		}
-	}
+	if (guid==UNASSIGNED_RAKNET_GUID)
+		return 0;
+
+	unsigned int index = FindRemoteSystemIndex(guid, onlyActive);
+	if (index!=(unsigned int) -1)
+		return remoteSystemList + index;
 	return 0;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -3575,15 +3805,19 @@ RakPeer::RemoteSystemStruct * RakPeer::AssignSystemAddressToRemoteSystemList( co
 			remoteSystem=remoteSystemList+assignedIndex;
 			ReferenceRemoteSystem(systemAddress, assignedIndex);
 			remoteSystem->MTUSize=defaultMTUSize;
-			remoteSystem->guid=guid;
+			SetRemoteSystemGuid(assignedIndex, guid);
 			remoteSystem->isActive = true; // This one line causes future incoming packets to go through the reliability layer
 			// Reserve this reliability layer for ourselves.
 			if (incomingMTU > remoteSystem->MTUSize)
 				remoteSystem->MTUSize=incomingMTU;
 			RakAssert(remoteSystem->MTUSize <= MAXIMUM_MTU_SIZE);
 			remoteSystem->reliabilityLayer.Reset(true, remoteSystem->MTUSize, useSecurity);
+#if LIBCAT_SECURITY==1
+			remoteSystem->handshakePending=false;
+#endif
 			remoteSystem->reliabilityLayer.SetSplitMessageProgressInterval(splitMessageProgressInterval);
 			remoteSystem->reliabilityLayer.SetUnreliableTimeout(unreliableTimeout);
+			remoteSystem->reliabilityLayer.SetStatisticsSnapshotInterval(statisticsSnapshotInterval);
 			remoteSystem->reliabilityLayer.SetTimeoutTime(defaultTimeoutTime);
 			AddToActiveSystemList(assignedIndex);
 			if (incomingRakNetSocket->GetBoundAddress()==bindingAddress)
@@ -3783,7 +4017,7 @@ void RakPeer::ReferenceRemoteSystem(const SystemAddress &sa, unsigned int remote
 // #endif
 
 
-	remoteSystemList[remoteSystemListIndex].systemAddress=sa;
+	SetRemoteSystemAddress(remoteSystemListIndex, sa);
 
 	unsigned int hashIndex = RemoteSystemLookupHashIndex(sa);
 	RemoteSystemIndex *rsi;
@@ -3869,6 +4103,53 @@ RakPeer::RemoteSystemStruct* RakPeer::GetRemoteSystem(const SystemAddress &sa) c
 	return remoteSystemList + remoteSystemIndex;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetRemoteSystemAddress(unsigned int remoteSystemListIndex, const SystemAddress &sa)
+{
+	SystemAddress &oldAddress = remoteSystemList[remoteSystemListIndex].systemAddress;
+	if (oldAddress!=UNASSIGNED_SYSTEM_ADDRESS)
+		remoteSystemAddressIndex.Remove(SystemAddress::ToInteger(oldAddress), remoteSystemListIndex);
+	oldAddress=sa;
+	if (sa!=UNASSIGNED_SYSTEM_ADDRESS)
+		remoteSystemAddressIndex.Insert(SystemAddress::ToInteger(sa), remoteSystemListIndex);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetRemoteSystemGuid(unsigned int remoteSystemListIndex, const RakNetGUID &guid)
+{
+	RakNetGUID &oldGuid = remoteSystemList[remoteSystemListIndex].guid;
+	if (oldGuid!=UNASSIGNED_RAKNET_GUID)
+		remoteSystemGuidIndex.Remove(oldGuid.g, remoteSystemListIndex);
+	oldGuid=guid;
+	if (guid!=UNASSIGNED_RAKNET_GUID)
+		remoteSystemGuidIndex.Insert(guid.g, remoteSystemListIndex);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::FindRemoteSystemIndex(const SystemAddress &sa, bool onlyActive) const
+{
+	const RemoteSystemStruct *list = remoteSystemList;
+	unsigned int numPeers = maximumNumberOfPeers;
+	if (list==0)
+		return (unsigned int) -1;
+
+	uint64_t key = SystemAddress::ToInteger(sa);
+	unsigned int index = remoteSystemAddressIndex.Find(key, [&](unsigned int i) {return i < numPeers && list[i].isActive && list[i].systemAddress==sa;});
+	if (index==DataStructures::SeqLockHashIndex::NOT_FOUND && onlyActive==false)
+		index = remoteSystemAddressIndex.Find(key, [&](unsigned int i) {return i < numPeers && list[i].systemAddress==sa;});
+	return index;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::FindRemoteSystemIndex(const RakNetGUID &guid, bool onlyActive) const
+{
+	const RemoteSystemStruct *list = remoteSystemList;
+	unsigned int numPeers = maximumNumberOfPeers;
+	if (list==0)
+		return (unsigned int) -1;
+
+	unsigned int index = remoteSystemGuidIndex.Find(guid.g, [&](unsigned int i) {return i < numPeers && list[i].isActive && list[i].guid==guid;});
+	if (index==DataStructures::SeqLockHashIndex::NOT_FOUND && onlyActive==false)
+		index = remoteSystemGuidIndex.Find(guid.g, [&](unsigned int i) {return i < numPeers && list[i].guid==guid;});
+	return index;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::ClearRemoteSystemLookup(void)
 {
 	remoteSystemIndexPool.Clear(_FILE_AND_LINE_);
@@ -3981,38 +4262,26 @@ bool RakPeer::AllowIncomingConnections(void) const
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::DeallocRNS2RecvStruct(RNS2RecvStruct *s, const char *file, unsigned int line)
 {
-	bufferedPacketsFreePoolMutex.Lock();
-	bufferedPacketsFreePool.Push(s, file, line);
-	bufferedPacketsFreePoolMutex.Unlock();
+	// Only free to the heap if more buffers are outstanding than the pool can hold
+	if (bufferedPacketsFreePool.Push(s)==false)
+		RakNet::OP_DELETE(s, file, line);
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 RNS2RecvStruct *RakPeer::AllocRNS2RecvStruct(const char *file, unsigned int line)
 {
-	bufferedPacketsFreePoolMutex.Lock();
-	if (bufferedPacketsFreePool.Size()>0)
-	{
-		RNS2RecvStruct *s = bufferedPacketsFreePool.Pop();
-		bufferedPacketsFreePoolMutex.Unlock();
+	RNS2RecvStruct *s;
+	if (bufferedPacketsFreePool.Pop(s))
 		return s;
-	}
-	else
-	{
-		bufferedPacketsFreePoolMutex.Unlock();
-		return RakNet::OP_NEW<RNS2RecvStruct>(file,line);
-	}
+	return RakNet::OP_NEW<RNS2RecvStruct>(file,line);
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::ClearBufferedPackets(void)
 {
-	bufferedPacketsFreePoolMutex.Lock();
-	while (bufferedPacketsFreePool.Size()>0)
-		RakNet::OP_DELETE(bufferedPacketsFreePool.Pop(), _FILE_AND_LINE_);
-	bufferedPacketsFreePoolMutex.Unlock();
-
-	bufferedPacketsQueueMutex.Lock();
-	while (bufferedPacketsQueue.Size()>0)
-		RakNet::OP_DELETE(bufferedPacketsQueue.Pop(), _FILE_AND_LINE_);
-	bufferedPacketsQueueMutex.Unlock();
+	RNS2RecvStruct *s;
+	while (bufferedPacketsFreePool.Pop(s))
+		RakNet::OP_DELETE(s, _FILE_AND_LINE_);
+	while (bufferedPacketsQueue.Pop(s))
+		RakNet::OP_DELETE(s, _FILE_AND_LINE_);
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::SetupBufferedPackets(void)
@@ -4021,21 +4290,19 @@ void RakPeer::SetupBufferedPackets(void)
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::PushBufferedPacket(RNS2RecvStruct * p)
 {
-	bufferedPacketsQueueMutex.Lock();
-	bufferedPacketsQueue.Push(p, _FILE_AND_LINE_);
-	bufferedPacketsQueueMutex.Unlock();
+	if (bufferedPacketsQueue.Push(p)==false)
+	{
+		// The update thread is behind. Drop the newest datagram rather than block the recv thread. Reliable data will be resent
+		bufferedPacketsDropped.Increment();
+		DeallocRNS2RecvStruct(p, _FILE_AND_LINE_);
+	}
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 RNS2RecvStruct *RakPeer::PopBufferedPacket(void)
 {
-	bufferedPacketsQueueMutex.Lock();
-	if (bufferedPacketsQueue.Size()>0)
-	{
-		RNS2RecvStruct *s = bufferedPacketsQueue.Pop();
-		bufferedPacketsQueueMutex.Unlock();
+	RNS2RecvStruct *s;
+	if (bufferedPacketsQueue.Pop(s))
 		return s;
-	}
-	bufferedPacketsQueueMutex.Unlock();
 	return 0;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -4097,7 +4364,7 @@ void RakPeer::CloseConnectionInternal( const AddressOrGUID& systemIdentifier, bo
 					// printf("--- Address %s has become inactive\n", remoteSystemList[index].systemAddress.ToString());
 					remoteSystemList[index].isActive = false;
 
-					remoteSystemList[index].guid=UNASSIGNED_RAKNET_GUID;
+					SetRemoteSystemGuid(index, UNASSIGNED_RAKNET_GUID);
 
 					// Reserve this reliability layer for ourselves
 					//remoteSystemList[ remoteSystemLookup[index].index ].systemAddress = UNASSIGNED_SYSTEM_ADDRESS;
@@ -4121,6 +4388,7 @@ void RakPeer::CloseConnectionInternal( const AddressOrGUID& systemIdentifier, bo
 			bcs->orderingChannel=orderingChannel;
 			bcs->priority=disconnectionNotificationPriority;
 			bufferedCommands.Push(bcs);
+			quitAndDataEvents.SetEvent();
 		}
 	}
 }
@@ -4143,6 +4411,7 @@ void RakPeer::SendBuffered( const char *data, BitSize_t numberOfBitsToSend, Pack
 	RakAssert( !( orderingChannel >= NUMBER_OF_ORDERED_STREAMS ) );
 
 	memcpy(bcs->data, data, (size_t) BITS_TO_BYTES(numberOfBitsToSend));
+	bcs->sendBuffer=0;
 	bcs->numberOfBitsToSend=numberOfBitsToSend;
 	bcs->priority=priority;
 	bcs->reliability=reliability;
@@ -4154,11 +4423,8 @@ void RakPeer::SendBuffered( const char *data, BitSize_t numberOfBitsToSend, Pack
 	bcs->command=BufferedCommandStruct::BCS_SEND;
 	bufferedCommands.Push(bcs);
 
-	if (priority==IMMEDIATE_PRIORITY)
-	{
-		// Forces pending sends to go out now, rather than waiting to the next update interval
-		quitAndDataEvents.SetEvent();
-	}
+	// The update thread sleeps until its next scheduled event, so wake it to pick up the send
+	quitAndDataEvents.SetEvent();
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::SendBufferedList( const char **data, const int *lengths, const int numParameters, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, RemoteSystemStruct::ConnectMode connectionMode, uint32_t receipt )
@@ -4204,6 +4470,7 @@ void RakPeer::SendBufferedList( const char **data, const int *lengths, const int
 
 	bcs=bufferedCommands.Allocate( _FILE_AND_LINE_ );
 	bcs->data = dataAggregate;
+	bcs->sendBuffer=0;
 	bcs->numberOfBitsToSend=BYTES_TO_BITS(totalLength);
 	bcs->priority=priority;
 	bcs->reliability=reliability;
@@ -4215,14 +4482,11 @@ void RakPeer::SendBufferedList( const char **data, const int *lengths, const int
 	bcs->command=BufferedCommandStruct::BCS_SEND;
 	bufferedCommands.Push(bcs);
 
-	if (priority==IMMEDIATE_PRIORITY)
-	{
-		// Forces pending sends to go out now, rather than waiting to the next update interval
-		quitAndDataEvents.SetEvent();
-	}
+	// The update thread sleeps until its next scheduled event, so wake it to pick up the send
+	quitAndDataEvents.SetEvent();
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-bool RakPeer::SendImmediate( char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, bool useCallerDataAllocation, RakNet::TimeUS currentTime, uint32_t receipt )
+bool RakPeer::SendImmediate( char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, bool useCallerDataAllocation, RakNet::TimeUS currentTime, uint32_t receipt, SendBuffer *sendBuffer )
 {
 	unsigned *sendList;
 	unsigned sendListSize;
@@ -4299,7 +4563,7 @@ bool RakPeer::SendImmediate( char *data, BitSize_t numberOfBitsToSend, PacketPri
 	{
 		// Send may split the packet and thus deallocate data.  Don't assume data is valid if we use the callerAllocationData
 		bool useData = useCallerDataAllocation && callerDataAllocationUsed==false && sendListIndex+1==sendListSize;
-		remoteSystemList[sendList[sendListIndex]].reliabilityLayer.Send( data, numberOfBitsToSend, priority, reliability, orderingChannel, useData==false, remoteSystemList[sendList[sendListIndex]].MTUSize, currentTime, receipt );
+		remoteSystemList[sendList[sendListIndex]].reliabilityLayer.Send( data, numberOfBitsToSend, priority, reliability, orderingChannel, useData==false, remoteSystemList[sendList[sendListIndex]].MTUSize, currentTime, receipt, sendBuffer );
 		if (useData)
 			callerDataAllocationUsed=true;
 
@@ -4359,7 +4623,9 @@ void RakPeer::ClearBufferedCommands(void)
 
 	while ((bcs=bufferedCommands.Pop())!=0)
 	{
-		if (bcs->data)
+		if (bcs->command==BufferedCommandStruct::BCS_SEND && bcs->sendBuffer)
+			bcs->sendBuffer->Release();
+		else if (bcs->data)
 			rakFree_Ex(bcs->data, _FILE_AND_LINE_ );
 
 		bufferedCommands.Deallocate(bcs, _FILE_AND_LINE_);
@@ -5248,6 +5514,12 @@ bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char *data,
 				// Duplicate connection request packet from packetloss
 				// Send back the same answer
 #if LIBCAT_SECURITY==1
+				if (rssFromSA->handshakePending)
+				{
+					// The answer is sent once a handshake thread has it
+					return true;
+				}
+
 				if (requiresSecurityOfThisClient)
 				{
 					CAT_AUDIT_PRINTF("AUDIT: Resending public key and answer from packetloss.  Sending ID_OPEN_CONNECTION_REPLY_2\n");
@@ -5302,6 +5574,15 @@ bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char *data,
 				return true;
 			}
 
+#if LIBCAT_SECURITY==1
+			if (requiresSecurityOfThisClient && rakPeer->numberOfPendingHandshakes.load(std::memory_order_relaxed) >= rakPeer->maxPendingHandshakes && rakPeer->handshakeThreadPool.WasStarted())
+			{
+				// The handshake threads are behind. Ignore the request rather than queue more work; the client sends it again
+				rakPeer->numberOfDroppedHandshakes.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+#endif // LIBCAT_SECURITY
+
 			bool thisIPConnectedRecently=false;
 			rssFromSA = rakPeer->AssignSystemAddressToRemoteSystemList(systemAddress, RakPeer::RemoteSystemStruct::UNVERIFIED_SENDER, rakNetSocket, &thisIPConnectedRecently, bindingAddress, mtu, guid, requiresSecurityOfThisClient);
 
@@ -5324,6 +5605,23 @@ bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char *data,
 			}
 
 #if LIBCAT_SECURITY==1
+			if (requiresSecurityOfThisClient && rakPeer->handshakeThreadPool.WasStarted())
+			{
+				// ProcessHandshakeCompletions() sends ID_OPEN_CONNECTION_REPLY_2 once a handshake thread has the answer
+				RakPeer::HandshakeJob *job = RakNet::OP_NEW<RakPeer::HandshakeJob>(_FILE_AND_LINE_);
+				job->rakPeer=rakPeer;
+				job->systemAddress=systemAddress;
+				job->guid=guid;
+				job->mtu=mtu;
+				job->handshakeId=++rakPeer->nextHandshakeId;
+				memcpy(job->challenge, remoteHandshakeChallenge, sizeof(job->challenge));
+				rssFromSA->handshakePending=true;
+				rssFromSA->handshakeId=job->handshakeId;
+				rakPeer->numberOfPendingHandshakes.fetch_add(1, std::memory_order_relaxed);
+				rakPeer->handshakeThreadPool.AddInput(RakPeer::ProcessHandshakeJob, job);
+				return true;
+			}
+
 			if (requiresSecurityOfThisClient)
 			{
 				CAT_AUDIT_PRINTF("AUDIT: Writing public key.  Sending ID_OPEN_CONNECTION_REPLY_2\n");
@@ -5392,13 +5690,18 @@ void ProcessNetworkPacket( SystemAddress systemAddress, const char *data, const
 	remoteSystem = rakPeer->GetRemoteSystemFromSystemAddress( systemAddress, true, true );
 	if ( remoteSystem )
 	{
+#if LIBCAT_SECURITY==1
+		if (remoteSystem->handshakePending)
+			return;
+#endif
+
 		// Handle regular incoming data
 		// HandleSocketReceiveFromConnectedPlayer is only safe to be called from the same thread as Update, which is this thread
 		if ( isOfflineMessage==false)
 		{
 			remoteSystem->reliabilityLayer.HandleSocketReceiveFromConnectedPlayer(
 				data, length, systemAddress, rakPeer->pluginListNTS, remoteSystem->MTUSize,
-				rakNetSocket, &rnr, timeRead, updateBitStream);
+				rakNetSocket, &rnr, timeRead, updateBitStream, rakPeer->zeroCopyReceive.load(std::memory_order_relaxed) ? &rakPeer->receiveBufferPool : 0);
 		}
 	}
 	else
@@ -5439,6 +5742,11 @@ void RakPeer::DerefAllSockets(void)
 		delete socketList[i];
 	}
 	socketList.Clear(false, _FILE_AND_LINE_);
+	for (i=0; i < reusePortSocketList.Size(); i++)
+	{
+		delete reusePortSocketList[i];
+	}
+	reusePortSocketList.Clear(false, _FILE_AND_LINE_);
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 unsigned int RakPeer::GetRakNetSocketFromUserConnectionSocketIndex(unsigned int userIndex) const
@@ -5515,6 +5823,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 	BitSize_t bitSize;
 	unsigned int byteSize;
 	unsigned char *data;
+	ReceiveBuffer *receiveBuffer;
 	SystemAddress systemAddress;
 	BufferedCommandStruct *bcs;
 	bool callerDataAllocationUsed;
@@ -5522,6 +5831,8 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 	RakNet::TimeUS timeNS=0;
 	RakNet::Time timeMS=0;
 
+	nextUpdateCycleTime=0;
+
 	// This is here so RecvFromBlocking actually gets data from the same thread
 
 	#if   defined(WINDOWS_STORE_RT)
@@ -5551,10 +5862,21 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 		}
 		if (socketListIndex!=socketList.Size())
 		*/
-			ProcessNetworkPacket(recvFromStruct->systemAddress, recvFromStruct->data, recvFromStruct->bytesRead, this, recvFromStruct->socket, recvFromStruct->timeRead, updateBitStream);
+			if (updateShards.Size()>1)
+			{
+				// Datagrams from connected systems are handled by the shard that owns the connection, in RunUpdateShards()
+				if (QueueForUpdateShard(recvFromStruct))
+					continue;
+			}
+			else
+				ProcessNetworkPacket(recvFromStruct->systemAddress, recvFromStruct->data, recvFromStruct->bytesRead, this, recvFromStruct->socket, recvFromStruct->timeRead, updateBitStream);
 			DeallocRNS2RecvStruct(recvFromStruct, _FILE_AND_LINE_);
 	}
 
+#if LIBCAT_SECURITY==1
+	ProcessHandshakeCompletions();
+#endif
+
 	while ((bcs=bufferedCommands.PopInaccurate())!=0)
 	{
 		if (bcs->command==BufferedCommandStruct::BCS_SEND)
@@ -5566,9 +5888,18 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 				timeMS = (RakNet::TimeMS)(timeNS/(RakNet::TimeUS)1000);
 			}
 
-			callerDataAllocationUsed=SendImmediate((char*)bcs->data, bcs->numberOfBitsToSend, bcs->priority, bcs->reliability, bcs->orderingChannel, bcs->systemIdentifier, bcs->broadcast, true, timeNS, bcs->receipt);
-			if ( callerDataAllocationUsed==false )
-				rakFree_Ex(bcs->data, _FILE_AND_LINE_ );
+			if (bcs->sendBuffer)
+			{
+				// Each reliability layer takes its own reference, so this command's reference is no longer needed
+				SendImmediate((char*)bcs->sendBuffer->GetData(), bcs->numberOfBitsToSend, bcs->priority, bcs->reliability, bcs->orderingChannel, bcs->systemIdentifier, bcs->broadcast, false, timeNS, bcs->receipt, bcs->sendBuffer);
+				bcs->sendBuffer->Release();
+			}
+			else
+			{
+				callerDataAllocationUsed=SendImmediate((char*)bcs->data, bcs->numberOfBitsToSend, bcs->priority, bcs->reliability, bcs->orderingChannel, bcs->systemIdentifier, bcs->broadcast, true, timeNS, bcs->receipt);
+				if ( callerDataAllocationUsed==false )
+					rakFree_Ex(bcs->data, _FILE_AND_LINE_ );
+			}
 
 			// Set the new connection state AFTER we call sendImmediate in case we are setting it to a disconnection state, which does not allow further sends
 			if (bcs->connectionMode!=RemoteSystemStruct::NO_ACTION )
@@ -5764,9 +6095,25 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 
 			requestedConnectionQueueMutex.Lock();
 		}
+
+		// Wake for the next connection attempt that is still pending
+		for (requestedConnectionQueueIndex=0; requestedConnectionQueueIndex < requestedConnectionQueue.Size(); requestedConnectionQueueIndex++)
+			ScheduleUpdateCycle(((RakNet::TimeUS) requestedConnectionQueue[requestedConnectionQueueIndex]->nextRequestTime+1)*(RakNet::TimeUS)1000);
 		requestedConnectionQueueMutex.Unlock();
 	}
 
+	if (updateShards.Size()>1)
+	{
+		if (timeNS==0)
+		{
+			timeNS = RakNet::GetTimeUS();
+			timeMS = (RakNet::TimeMS)(timeNS/(RakNet::TimeUS)1000);
+		}
+
+		// Incoming datagrams and ReliabilityLayer::Update() for all connections, in parallel
+		RunUpdateShards(timeNS);
+	}
+
 	// remoteSystemList in network thread
 	for ( activeSystemListIndex = 0; activeSystemListIndex < activeSystemListSize; ++activeSystemListIndex )
 	//for ( remoteSystemIndex = 0; remoteSystemIndex < remoteSystemListSize; ++remoteSystemIndex )
@@ -5804,10 +6151,15 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 
 					//remoteSystem->lastReliableSend=timeMS+remoteSystem->reliabilityLayer.GetTimeoutTime();
 					remoteSystem->lastReliableSend=timeMS;
+
+					// With update shards, Update() for this system already ran this cycle
+					if (updateShards.Size()>1)
+						quitAndDataEvents.SetEvent();
 				}
 			}
 
-			remoteSystem->reliabilityLayer.Update( remoteSystem->rakNetSocket, systemAddress, remoteSystem->MTUSize, timeNS, maxOutgoingBPS, pluginListNTS, &rnr, updateBitStream ); // systemAddress only used for the internet simulator test
+			if (updateShards.Size()<=1)
+				remoteSystem->reliabilityLayer.Update( remoteSystem->rakNetSocket, systemAddress, remoteSystem->MTUSize, timeNS, maxOutgoingBPS, pluginListNTS, &rnr, updateBitStream ); // systemAddress only used for the internet simulator test
 
 			// Check for failure conditions
 			if ( remoteSystem->reliabilityLayer.IsDeadConnection() ||
@@ -5869,13 +6221,22 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 				quitAndDataEvents.SetEvent();
 			}
 
+			// Wake for this system's next resend, ack, ping, or keepalive
+			ScheduleUpdateCycle(remoteSystem->reliabilityLayer.GetNextUpdateTime(timeNS+(RakNet::TimeUS)RAKPEER_MAXIMUM_UPDATE_WAIT_MS*(RakNet::TimeUS)1000));
+			if (remoteSystem->connectMode==RemoteSystemStruct::CONNECTED)
+			{
+				if (occasionalPing || remoteSystem->lowestPing == (unsigned short)-1)
+					ScheduleUpdateCycle(((RakNet::TimeUS) remoteSystem->nextPingTime+1)*(RakNet::TimeUS)1000);
+				ScheduleUpdateCycle(((RakNet::TimeUS) remoteSystem->lastReliableSend+remoteSystem->reliabilityLayer.GetTimeoutTime()/2+1)*(RakNet::TimeUS)1000);
+			}
+
 			// Find whoever has the lowest player ID
 			//if (systemAddress < authoritativeClientSystemAddress)
 			// authoritativeClientSystemAddress=systemAddress;
 
 			// Does the reliability layer have any packets waiting for us?
 			// To be thread safe, this has to be called in the same thread as HandleSocketReceiveFromConnectedPlayer
-			bitSize = remoteSystem->reliabilityLayer.Receive( &data );
+			bitSize = remoteSystem->reliabilityLayer.Receive( &data, &receiveBuffer );
 
 			while ( bitSize > 0 )
 			{
@@ -5896,7 +6257,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 					if ( (unsigned char)(data)[0] == ID_CONNECTION_REQUEST )
 					{
  						ParseConnectionRequestPacket(remoteSystem, systemAddress, (const char*)data, byteSize);
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, receiveBuffer);
 					}
 					else
 					{
@@ -5910,7 +6271,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 						AddToBanList(str1, remoteSystem->reliabilityLayer.GetTimeoutTime());
 
 
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, receiveBuffer);
 					}
 				}
 				else
@@ -5939,7 +6300,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 							// This can happen due to race conditions with the fully connected mesh
 							OnConnectionRequest( remoteSystem, incomingTimestamp );
 						}
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, receiveBuffer);
 					}
 					else if ( (unsigned char) data[ 0 ] == ID_NEW_INCOMING_CONNECTION && byteSize > sizeof(unsigned char)+sizeof(unsigned int)+sizeof(unsigned short)+sizeof(RakNet::Time)*2 )
 					{
@@ -5981,7 +6342,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 							}
 
 							// Send this info down to the game
-							packet=AllocPacket(byteSize, data, _FILE_AND_LINE_);
+							packet=AllocPacket(byteSize, data, receiveBuffer, _FILE_AND_LINE_);
 							packet->bitSize = bitSize;
 							packet->systemAddress = systemAddress;
 							packet->systemAddress.systemIndex = remoteSystem->remoteSystemIndex;
@@ -6011,7 +6372,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 
 						OnConnectedPong(sendPingTime,sendPongTime,remoteSystem);
 
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, receiveBuffer);
 					}
 					else if ( (unsigned char)data[0] == ID_CONNECTED_PING && byteSize == sizeof(unsigned char)+sizeof(RakNet::Time) )
 					{
@@ -6029,26 +6390,26 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 						// Update again immediately after this tick so the ping goes out right away
 						quitAndDataEvents.SetEvent();
 
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, receiveBuffer);
 					}
 					else if ( (unsigned char) data[ 0 ] == ID_DISCONNECTION_NOTIFICATION )
 					{
 						// We shouldn't close the connection immediately because we need to ack the ID_DISCONNECTION_NOTIFICATION
 						remoteSystem->connectMode=RemoteSystemStruct::DISCONNECT_ON_NO_ACK;
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, receiveBuffer);
 
 					//	AddPacketToProducer(packet);
 					}
 					else if ( (unsigned char)(data)[0] == ID_DETECT_LOST_CONNECTIONS && byteSize == sizeof(unsigned char) )
 					{
 						// Do nothing
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, receiveBuffer);
 					}
 					else if ( (unsigned char)(data)[0] == ID_INVALID_PASSWORD )
 					{
 						if (remoteSystem->connectMode==RemoteSystemStruct::REQUESTED_CONNECTION)
 						{
-							packet=AllocPacket(byteSize, data, _FILE_AND_LINE_);
+							packet=AllocPacket(byteSize, data, receiveBuffer, _FILE_AND_LINE_);
 							packet->bitSize = bitSize;
 							packet->systemAddress = systemAddress;
 							packet->systemAddress.systemIndex = remoteSystem->remoteSystemIndex;
@@ -6060,7 +6421,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 						}
 						else
 						{
-							rakFree_Ex(data, _FILE_AND_LINE_ );
+							FreeReceivedData(data, receiveBuffer);
 						}
 					}
 					else if ( (unsigned char)(data)[0] == ID_CONNECTION_REQUEST_ACCEPTED )
@@ -6121,7 +6482,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 								}
 
 								// Send the connection request complete to the game
-								packet=AllocPacket(byteSize, data, _FILE_AND_LINE_);
+								packet=AllocPacket(byteSize, data, receiveBuffer, _FILE_AND_LINE_);
 								packet->bitSize = byteSize * 8;
 								packet->systemAddress = systemAddress;
 								packet->systemAddress.systemIndex = ( SystemIndex ) GetIndexFromSystemAddress( systemAddress, true );
@@ -6147,14 +6508,14 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 							else
 							{
 								// Ignore, already connected
-								rakFree_Ex(data, _FILE_AND_LINE_ );
+								FreeReceivedData(data, receiveBuffer);
 							}
 						}
 						else
 						{
 							// Version mismatch error?
 							RakAssert(0);
-							rakFree_Ex(data, _FILE_AND_LINE_ );
+							FreeReceivedData(data, receiveBuffer);
 						}
 					}
 					else
@@ -6166,7 +6527,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 							remoteSystem->isActive
 							)
 						{
-							packet=AllocPacket(byteSize, data, _FILE_AND_LINE_);
+							packet=AllocPacket(byteSize, data, receiveBuffer, _FILE_AND_LINE_);
 							packet->bitSize = bitSize;
 							packet->systemAddress = systemAddress;
 							packet->systemAddress.systemIndex = remoteSystem->remoteSystemIndex;
@@ -6176,19 +6537,342 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 						}
 						else
 						{
-							rakFree_Ex(data, _FILE_AND_LINE_ );
+							FreeReceivedData(data, receiveBuffer);
 						}
 					}
 				}
 
 				// Does the reliability layer have any more packets waiting for us?
 				// To be thread safe, this has to be called in the same thread as HandleSocketReceiveFromConnectedPlayer
-				bitSize = remoteSystem->reliabilityLayer.Receive( &data );
+				bitSize = remoteSystem->reliabilityLayer.Receive( &data, &receiveBuffer );
 			}
 		
 	}
 
+	// Datagrams ReliabilityLayer queued with SendBatched() this cycle, for all remote systems, go out together
+	for (unsigned int socketListIndex=0; socketListIndex < socketList.Size(); socketListIndex++)
+		socketList[socketListIndex]->FlushSendBatch();
+	for (unsigned int socketListIndex=0; socketListIndex < reusePortSocketList.Size(); socketListIndex++)
+		reusePortSocketList[socketListIndex]->FlushSendBatch();
+
+	RakNet::TimeMS statisticsTime=RakNet::GetTimeMS();
+	if (statisticsTime >= nextPeerStatisticsSnapshotTime)
+	{
+		PublishPeerStatisticsSnapshot();
+		nextPeerStatisticsSnapshotTime=statisticsTime+statisticsSnapshotInterval;
+	}
+
+	lastUpdateCycleTime=timeNS;
+
+	return true;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::PublishPeerStatisticsSnapshot(void)
+{
+	// Sums the connection snapshots rather than calling ReliabilityLayer::GetStatistics(), which with update shards may only run on the shard's thread
+	RakNetStatistics sum, rns;
+	memset(&sum, 0, sizeof(sum));
+	bool firstWrite=false;
+	for (unsigned int i=0; i < activeSystemListSize; i++)
+	{
+		activeSystemList[i]->reliabilityLayer.GetStatisticsSnapshot(&rns);
+		if (firstWrite==false)
+		{
+			memcpy(&sum, &rns, sizeof(RakNetStatistics));
+			firstWrite=true;
+		}
+		else
+			sum+=rns;
+	}
+	peerStatisticsSnapshot.Write(sum);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::StartUpdateShards(int threadPriority)
+{
+	if (numberOfUpdateThreads<=1)
+		return true;
+
+	unsigned int i;
+	// Plugins may have been attached before SetNumberOfUpdateThreads()
+	for (i=0; i < pluginListNTS.Size(); i++)
+		RakAssert(pluginListNTS[i]->IsReliabilityLayerThreadSafe());
+
+	for (i=0; i < numberOfUpdateThreads; i++)
+	{
+		UpdateShard *shard = RakNet::OP_NEW<UpdateShard>(_FILE_AND_LINE_);
+		shard->rakPeer=this;
+		shard->startEvent.InitEvent();
+		shard->doneEvent.InitEvent();
+		shard->hasWork=false;
+		shard->isThreadActive=false;
+		updateShards.Push(shard, _FILE_AND_LINE_);
+	}
+
+	// Shard 0 runs on the update thread
+	for (i=1; i < updateShards.Size(); i++)
+	{
+		updateShards[i]->isThreadActive=true;
+		if (RakNet::RakThread::Create(UpdateShardLoop, updateShards[i], threadPriority)!=0)
+		{
+			updateShards[i]->isThreadActive=false;
+			return false;
+		}
+	}
+	return true;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::StopUpdateShards(void)
+{
+	unsigned int i;
+	for (i=1; i < updateShards.Size(); i++)
+	{
+		while (updateShards[i]->isThreadActive)
+		{
+			updateShards[i]->startEvent.SetEvent();
+			RakSleep(0);
+		}
+	}
+	for (i=0; i < updateShards.Size(); i++)
+	{
+		updateShards[i]->startEvent.CloseEvent();
+		updateShards[i]->doneEvent.CloseEvent();
+		RakNet::OP_DELETE(updateShards[i], _FILE_AND_LINE_);
+	}
+	updateShards.Clear(false, _FILE_AND_LINE_);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::QueueForUpdateShard(RNS2RecvStruct *recvFromStruct)
+{
+	// Offline messages and the connection handshake are handled here, as ProcessNetworkPacket() does
+	bool isOfflineMessage;
+	if (ProcessOfflineNetworkPacket(recvFromStruct->systemAddress, recvFromStruct->data, recvFromStruct->bytesRead, this, recvFromStruct->socket, &isOfflineMessage, recvFromStruct->timeRead))
+		return false;
+	if (isOfflineMessage)
+		return false;
+
+	RemoteSystemStruct *remoteSystem = GetRemoteSystemFromSystemAddress( recvFromStruct->systemAddress, true, true );
+	if (remoteSystem==0)
+		return false;
+#if LIBCAT_SECURITY==1
+	if (remoteSystem->handshakePending)
+		return false;
+#endif
+
+	UpdateShard *shard = updateShards[remoteSystem->remoteSystemIndex % updateShards.Size()];
+	shard->datagrams.Push(recvFromStruct, _FILE_AND_LINE_);
+	shard->datagramSystems.Push(remoteSystem, _FILE_AND_LINE_);
+	return true;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::RunUpdateShards(RakNet::TimeUS timeNS)
+{
+	unsigned int i;
+	for (i=0; i < activeSystemListSize; i++)
+		updateShards[activeSystemList[i]->remoteSystemIndex % updateShards.Size()]->remoteSystems.Push(activeSystemList[i], _FILE_AND_LINE_);
+	updateShardsTime=timeNS;
+
+	for (i=1; i < updateShards.Size(); i++)
+	{
+		if (updateShards[i]->remoteSystems.Size()>0 || updateShards[i]->datagrams.Size()>0)
+		{
+			updateShards[i]->hasWork.store(true, std::memory_order_release);
+			updateShards[i]->startEvent.SetEvent();
+		}
+	}
+
+	UpdateShardSystems(updateShards[0]);
+
+	for (i=1; i < updateShards.Size(); i++)
+	{
+		while (updateShards[i]->hasWork.load(std::memory_order_acquire))
+			updateShards[i]->doneEvent.WaitOnEvent(1000);
+	}
+
+	for (i=0; i < updateShards.Size(); i++)
+	{
+		updateShards[i]->remoteSystems.Clear(true, _FILE_AND_LINE_);
+		updateShards[i]->datagrams.Clear(true, _FILE_AND_LINE_);
+		updateShards[i]->datagramSystems.Clear(true, _FILE_AND_LINE_);
+	}
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::UpdateShardSystems(UpdateShard *shard)
+{
+	unsigned int i;
+	RemoteSystemStruct *remoteSystem;
+	SystemAddress systemAddress;
+
+	for (i=0; i < shard->datagrams.Size(); i++)
+	{
+		RNS2RecvStruct *recvFromStruct = shard->datagrams[i];
+		remoteSystem = shard->datagramSystems[i];
+
+		// The connection may have been closed by a buffered command since the datagram was queued
+		if (remoteSystem->isActive)
+		{
+			remoteSystem->reliabilityLayer.HandleSocketReceiveFromConnectedPlayer(
+				recvFromStruct->data, recvFromStruct->bytesRead, recvFromStruct->systemAddress, pluginListNTS, remoteSystem->MTUSize,
+				recvFromStruct->socket, &shard->rnr, recvFromStruct->timeRead, shard->updateBitStream, zeroCopyReceive.load(std::memory_order_relaxed) ? &receiveBufferPool : 0);
+		}
+		DeallocRNS2RecvStruct(recvFromStruct, _FILE_AND_LINE_);
+	}
+
+	for (i=0; i < shard->remoteSystems.Size(); i++)
+	{
+		remoteSystem = shard->remoteSystems[i];
+		systemAddress = remoteSystem->systemAddress;
+		remoteSystem->reliabilityLayer.Update( remoteSystem->rakNetSocket, systemAddress, remoteSystem->MTUSize, updateShardsTime, maxOutgoingBPS, pluginListNTS, &shard->rnr, shard->updateBitStream );
+	}
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::StartHandshakeThreads(void)
+{
+#if LIBCAT_SECURITY==1
+	numberOfPendingHandshakes=0;
+	numberOfDroppedHandshakes=0;
+	if (numberOfHandshakeThreads==0 || _using_security==false)
+		return true;
+
+	handshakeThreadPool.SetThreadDataInterface(&handshakeThreadDataFactory, this);
+	return handshakeThreadPool.StartThreads(numberOfHandshakeThreads, 0);
+#else
 	return true;
+#endif
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::StopHandshakeThreads(void)
+{
+#if LIBCAT_SECURITY==1
+	handshakeThreadPool.StopThreads();
+
+	unsigned int i;
+	for (i=0; i < handshakeThreadPool.InputSize(); i++)
+		RakNet::OP_DELETE(handshakeThreadPool.GetInputAtIndex(i), _FILE_AND_LINE_);
+	for (i=0; i < handshakeThreadPool.OutputSize(); i++)
+		RakNet::OP_DELETE(handshakeThreadPool.GetOutputAtIndex(i), _FILE_AND_LINE_);
+	handshakeThreadPool.Clear();
+	numberOfPendingHandshakes=0;
+#endif
+}
+#if LIBCAT_SECURITY==1
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void* RakPeer::HandshakeThreadDataFactory::PerThreadFactory(void *context)
+{
+	RakPeer *rakPeer = (RakPeer*) context;
+	cat::ServerEasyHandshake *serverHandshake = RakNet::OP_NEW<cat::ServerEasyHandshake>(_FILE_AND_LINE_);
+	if (serverHandshake->Initialize(rakPeer->my_public_key, rakPeer->my_private_key)==false)
+	{
+		RakNet::OP_DELETE(serverHandshake, _FILE_AND_LINE_);
+		return 0;
+	}
+	return serverHandshake;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::HandshakeThreadDataFactory::PerThreadDestructor(void* factoryResult, void *context)
+{
+	(void) context;
+	if (factoryResult)
+		RakNet::OP_DELETE((cat::ServerEasyHandshake*) factoryResult, _FILE_AND_LINE_);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+RakPeer::HandshakeJob* RakPeer::ProcessHandshakeJob(HandshakeJob *job, bool *returnOutput, void* perThreadData)
+{
+	cat::ServerEasyHandshake *serverHandshake = (cat::ServerEasyHandshake*) perThreadData;
+	job->succeeded = serverHandshake!=0 && serverHandshake->ProcessChallenge(job->challenge, job->answer, &job->authenticatedEncryption);
+
+	// Queue the result before waking the update thread, so it cannot look for it too early and go back to sleep
+	*returnOutput=false;
+	job->rakPeer->handshakeThreadPool.AddOutput(job);
+	job->rakPeer->quitAndDataEvents.SetEvent();
+	return job;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::ProcessHandshakeCompletions(void)
+{
+	while (handshakeThreadPool.HasOutputFast() && handshakeThreadPool.HasOutput())
+	{
+		HandshakeJob *job = handshakeThreadPool.GetOutput();
+		numberOfPendingHandshakes.fetch_sub(1, std::memory_order_relaxed);
+
+		// The connection may have been closed, or taken by another request, while the handshake thread was working
+		RemoteSystemStruct *remoteSystem = GetRemoteSystemFromSystemAddress( job->systemAddress, true, true );
+		if (remoteSystem==0 ||
+			remoteSystem->handshakePending==false ||
+			remoteSystem->handshakeId!=job->handshakeId ||
+			remoteSystem->connectMode!=RemoteSystemStruct::UNVERIFIED_SENDER)
+		{
+			RakNet::OP_DELETE(job, _FILE_AND_LINE_);
+			continue;
+		}
+
+		remoteSystem->handshakePending=false;
+		if (job->succeeded==false)
+		{
+			CAT_AUDIT_PRINTF("AUDIT: Challenge BAD!\n");
+
+			// Unassign this remote system
+			DereferenceRemoteSystem(job->systemAddress);
+			RakNet::OP_DELETE(job, _FILE_AND_LINE_);
+			continue;
+		}
+
+		CAT_AUDIT_PRINTF("AUDIT: Challenge good! Sending ID_OPEN_CONNECTION_REPLY_2\n");
+		memcpy(remoteSystem->answer, job->answer, sizeof(remoteSystem->answer));
+		*remoteSystem->reliabilityLayer.GetAuthenticatedEncryption() = job->authenticatedEncryption;
+
+		RakNet::BitStream bsAnswer;
+		bsAnswer.Write((MessageID)ID_OPEN_CONNECTION_REPLY_2);
+		bsAnswer.WriteAlignedBytes((const unsigned char*) OFFLINE_MESSAGE_DATA_ID, sizeof(OFFLINE_MESSAGE_DATA_ID));
+		bsAnswer.Write(myGuid);
+		bsAnswer.Write(job->systemAddress);
+		bsAnswer.Write(job->mtu);
+		bsAnswer.Write(true);
+		bsAnswer.WriteAlignedBytes((const unsigned char *) remoteSystem->answer,sizeof(remoteSystem->answer));
+
+		unsigned int i;
+		for (i=0; i < pluginListNTS.Size(); i++)
+			pluginListNTS[i]->OnDirectSocketSend((const char*) bsAnswer.GetData(), bsAnswer.GetNumberOfBitsUsed(), job->systemAddress);
+		RNS2_SendParameters bsp;
+		bsp.data = (char*) bsAnswer.GetData();
+		bsp.length = bsAnswer.GetNumberOfBytesUsed();
+		bsp.systemAddress = job->systemAddress;
+		remoteSystem->rakNetSocket->Send(&bsp, _FILE_AND_LINE_);
+
+		RakNet::OP_DELETE(job, _FILE_AND_LINE_);
+	}
+}
+#endif // LIBCAT_SECURITY
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::ScheduleUpdateCycle(RakNet::TimeUS time)
+{
+	if (nextUpdateCycleTime==0 || time < nextUpdateCycleTime)
+		nextUpdateCycleTime=time;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int RakPeer::GetUpdateCycleWaitMS(void) const
+{
+	int waitMS = RAKPEER_MAXIMUM_UPDATE_WAIT_MS;
+	if (nextUpdateCycleTime!=0)
+	{
+		if (nextUpdateCycleTime <= lastUpdateCycleTime)
+		{
+			// Was already due when the cycle ran, so it is held back by congestion control or the bandwidth limit. Poll for it at the ack interval
+			waitMS = 10;
+		}
+		else
+		{
+			RakNet::TimeUS timeNS = RakNet::GetTimeUS();
+			if (nextUpdateCycleTime <= timeNS)
+				waitMS = 0;
+			else if (nextUpdateCycleTime - timeNS < (RakNet::TimeUS) waitMS * (RakNet::TimeUS)1000)
+				waitMS = (int) ((nextUpdateCycleTime - timeNS + (RakNet::TimeUS)999) / (RakNet::TimeUS)1000);
+		}
+	}
+
+	// SetUserUpdateThread() callbacks still run at least as often as the previous fixed interval
+	if (userUpdateThreadPtr && waitMS > 10)
+		waitMS = 10;
+	return waitMS;
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -6293,8 +6977,8 @@ RAK_THREAD_DECLARATION(RakNet::UpdateNetworkLoop)
 
 		rakPeer->RunUpdateCycle(updateBitStream);
 
-		// Pending sends go out this often, unless quitAndDataEvents is set
-		rakPeer->quitAndDataEvents.WaitOnEvent(10);
+		// Sleep until the next resend, ack, or other scheduled event, unless quitAndDataEvents is set by incoming data or a send
+		rakPeer->quitAndDataEvents.WaitOnEvent(rakPeer->GetUpdateCycleWaitMS());
 
 		/*
 
@@ -6347,8 +7031,51 @@ RAK_THREAD_DECLARATION(RakNet::UpdateNetworkLoop)
 
 }
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+RAK_THREAD_DECLARATION(RakNet::UpdateShardLoop)
+{
+	RakPeer::UpdateShard *shard = ( RakPeer::UpdateShard * ) arguments;
+	RakPeer *rakPeer = shard->rakPeer;
+
+	while ( rakPeer->endThreads == false )
+	{
+		shard->startEvent.WaitOnEvent(1000);
+		if (shard->hasWork.load(std::memory_order_acquire))
+		{
+			rakPeer->UpdateShardSystems(shard);
+			shard->hasWork.store(false, std::memory_order_release);
+			shard->doneEvent.SetEvent();
+		}
+	}
+
+	shard->isThreadActive = false;
+	return 0;
+}
+
 void RakPeer::CallPluginCallbacks(DataStructures::List<PluginInterface2*> &pluginList, Packet *packet)
 {
+	// Most messages are none of these, so check once rather than for every plugin
+	switch (packet->data[0])
+	{
+	case ID_DISCONNECTION_NOTIFICATION:
+	case ID_CONNECTION_LOST:
+	case ID_NEW_INCOMING_CONNECTION:
+	case ID_CONNECTION_REQUEST_ACCEPTED:
+	case ID_CONNECTION_ATTEMPT_FAILED:
+	case ID_REMOTE_SYSTEM_REQUIRES_PUBLIC_KEY:
+	case ID_OUR_SYSTEM_REQUIRES_SECURITY:
+	case ID_PUBLIC_KEY_MISMATCH:
+	case ID_ALREADY_CONNECTED:
+	case ID_NO_FREE_INCOMING_CONNECTIONS:
+	case ID_CONNECTION_BANNED:
+	case ID_INVALID_PASSWORD:
+	case ID_INCOMPATIBLE_PROTOCOL_VERSION:
+	case ID_IP_RECENTLY_CONNECTED:
+		break;
+	default:
+		return;
+	}
+
 	for (unsigned int i=0; i < pluginList.Size(); i++)
 	{
 		switch (packet->data[0])
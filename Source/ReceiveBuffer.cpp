@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "../include/RakNet/ReceiveBuffer.h"
+#include "../include/RakNet/RakAssert.h"
+#include <string.h>
+
+using namespace RakNet;
+
+void ReceiveBuffer::AddRef(void)
+{
+	refCount.fetch_add(1, std::memory_order_relaxed);
+}
+void ReceiveBuffer::Release(void)
+{
+	RakAssert(refCount.load(std::memory_order_relaxed)>0);
+	// acq_rel so the thread that returns the buffer sees every other thread's last use of it
+	if (refCount.fetch_sub(1, std::memory_order_acq_rel)==1)
+		pool->Release(this);
+}
+ReceiveBufferPool::ReceiveBufferPool()
+{
+	pool.SetPageSize(sizeof(DataStructures::MemoryPool<ReceiveBuffer>::MemoryWithPage)*16);
+}
+ReceiveBufferPool::~ReceiveBufferPool()
+{
+	Clear(_FILE_AND_LINE_);
+}
+ReceiveBuffer *ReceiveBufferPool::Allocate(const unsigned char *datagram, unsigned int length, const char *file, unsigned int line)
+{
+	RakAssert(length <= MAXIMUM_MTU_SIZE);
+	if (length > MAXIMUM_MTU_SIZE)
+		return 0;
+
+	poolMutex.Lock();
+	ReceiveBuffer *receiveBuffer = pool.Allocate(file, line);
+	poolMutex.Unlock();
+	if (receiveBuffer==0)
+		return 0;
+
+	receiveBuffer->refCount.store(1, std::memory_order_relaxed);
+	receiveBuffer->pool=this;
+	memcpy(receiveBuffer->data, datagram, length);
+	return receiveBuffer;
+}
+void ReceiveBufferPool::Clear(const char *file, unsigned int line)
+{
+	poolMutex.Lock();
+	pool.Clear(file, line);
+	poolMutex.Unlock();
+}
+void ReceiveBufferPool::Release(ReceiveBuffer *receiveBuffer)
+{
+	poolMutex.Lock();
+	pool.Release(receiveBuffer, _FILE_AND_LINE_);
+	poolMutex.Unlock();
+}
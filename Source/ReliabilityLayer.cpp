@@ -20,6 +20,8 @@
 #include "../include/RakNet/RakAssert.h"
 #include "../include/RakNet/Rand.h"
 #include "../include/RakNet/MessageIdentifiers.h"
+#include "../include/RakNet/SendBuffer.h"
+#include "../include/RakNet/ReceiveBuffer.h"
 #ifdef USE_THREADED_SEND
 #include "SendToThread.h"
 #endif
@@ -47,6 +49,19 @@ static const CCTimeType MAX_TIME_BETWEEN_PACKETS= 350000; // 350 milliseconds
 //static const CCTimeType HISTOGRAM_RESTART_CYCLE=10000000; // Every 10 seconds reset the histogram
 #endif
 static const int DEFAULT_HAS_RECEIVED_PACKET_QUEUE_SIZE=512;
+
+#if LIBCAT_SECURITY==1 && RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE>1
+// Datagrams written by one ReliabilityLayer::Update() call, waiting to be encrypted together.
+// One per thread because Update() may run on several update shard threads at once. Always empty outside Update()
+struct EncryptBatch
+{
+	unsigned char data[RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE][MAXIMUM_MTU_SIZE];
+	cat::u32 lengths[RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE];
+	CCTimeType times[RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE];
+	int count;
+};
+static thread_local EncryptBatch encryptBatch;
+#endif
 static const CCTimeType STARTING_TIME_BETWEEN_PACKETS=MAX_TIME_BETWEEN_PACKETS;
 //static const long double TIME_BETWEEN_PACKETS_INCREASE_MULTIPLIER_DEFAULT=.02;
 //static const long double TIME_BETWEEN_PACKETS_DECREASE_MULTIPLIER_DEFAULT=1.0 / 9.0;
@@ -393,6 +408,9 @@ void ReliabilityLayer::InitializeVariables( void )
 	statistics.connectionStartTime = RakNet::GetTimeUS();
 	splitPacketId = 0;
 	elapsedTimeSinceLastUpdate=0;
+#if LIBCAT_SECURITY==1 && RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE>1
+	encryptBatchActive=false;
+#endif
 	throughputCapCountdown=0;
 	sendReliableMessageNumberIndex = 0;
 	internalOrderIndex=0;
@@ -402,6 +420,8 @@ void ReliabilityLayer::InitializeVariables( void )
 	bandwidthExceededStatistic=false;
 	remoteSystemTime=0;
 	unreliableTimeout=0;
+	SetStatisticsSnapshotInterval(RAKPEER_STATISTICS_SNAPSHOT_INTERVAL_MS);
+	nextStatisticsSnapshotTime=0;
 	lastBpsClear=0;
 
 	// Disable packet pairs
@@ -438,7 +458,13 @@ void ReliabilityLayer::InitializeVariables( void )
 	//	histogramStart=(CCTimeType)0;
 	//	histogramBitsSent=0;
 	unacknowledgedBytes=0;
-	resendLinkedListHead=0;
+	resendTimers.Clear();
+#if CC_TIME_TYPE_BYTES==4
+	resendTimers.SetTickLength(1);
+#else
+	// One millisecond ticks
+	resendTimers.SetTickLength(1000);
+#endif
 	totalUserDataBytesAcked=0;
 
 	datagramHistoryPopCount=0;
@@ -454,6 +480,9 @@ void ReliabilityLayer::InitializeVariables( void )
 	{
 		bpsMetrics[i].Reset(_FILE_AND_LINE_);
 	}
+
+	// So GetStatisticsSnapshot() does not return the previous connection's statistics before the first Update()
+	statisticsSnapshot.Write(statistics);
 }
 
 //-------------------------------------------------------------------------------------------------------
@@ -539,28 +568,12 @@ void ReliabilityLayer::FreeThreadSafeMemory( void )
 	statistics.messagesInResendBuffer=0;
 	statistics.bytesInResendBuffer=0;
 
-	if (resendLinkedListHead)
+	InternalPacket *resendPacket;
+	while ((resendPacket=resendTimers.Pop())!=0)
 	{
-		InternalPacket *prev;
-		InternalPacket *iter = resendLinkedListHead;
-
-#ifdef _MSC_VER
-#pragma warning( disable : 4127 ) // warning C4127: conditional expression is constant
-#endif
-		while (1)
-		{
-			if (iter->data)
-				FreeInternalPacketData(iter, _FILE_AND_LINE_ );
-			prev=iter;
-			iter=iter->resendNext;
-			if (iter==resendLinkedListHead)
-			{
-				ReleaseToInternalPacketPool(prev);
-				break;
-			}
-			ReleaseToInternalPacketPool(prev);
-		}
-		resendLinkedListHead=0;
+		if (resendPacket->data)
+			FreeInternalPacketData(resendPacket, _FILE_AND_LINE_ );
+		ReleaseToInternalPacketPool(resendPacket);
 	}
 	unacknowledgedBytes=0;
 
@@ -635,7 +648,7 @@ void ReliabilityLayer::FreeThreadSafeMemory( void )
 bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 	const char *buffer, unsigned int length, SystemAddress &systemAddress, DataStructures::List<PluginInterface2*> &messageHandlerList, int MTUSize,
 	RakNetSocket2 *s, RakNetRandom *rnr, CCTimeType timeRead,
-	BitStream &updateBitStream)
+	BitStream &updateBitStream, ReceiveBufferPool *receiveBufferPool)
 {
 #ifdef _DEBUG
 	RakAssert( !( buffer == 0 ) );
@@ -846,7 +859,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 					{
 						if (internalPacket->nextActionTime!=0)
 						{
-							internalPacket->nextActionTime=timeRead;
+							resendTimers.Reschedule(internalPacket, timeRead);
 						}
 					}				
 
@@ -885,12 +898,16 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 		SendAcknowledgementPacket( dhf.datagramNumber, 0);
 #endif
 
-		InternalPacket* internalPacket = CreateInternalPacketFromBitStream( &socketData, timeRead );
+		// Holds one reference while parsing. Each message pointing into it holds another
+		ReceiveBuffer *datagramCopy=0;
+		InternalPacket* internalPacket = CreateInternalPacketFromBitStream( &socketData, timeRead, receiveBufferPool, &datagramCopy );
 		if (internalPacket==0)
 		{
 			for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
 				messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification("CreateInternalPacketFromBitStream failed", BYTES_TO_BITS(length), systemAddress, true);			
 
+			if (datagramCopy)
+				datagramCopy->Release();
 			return true;
 		}
 
@@ -1490,9 +1507,12 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 
 CONTINUE_SOCKET_DATA_PARSE_LOOP:
 			// Parse the bitstream to create an internal packet
-			internalPacket = CreateInternalPacketFromBitStream( &socketData, timeRead );
+			internalPacket = CreateInternalPacketFromBitStream( &socketData, timeRead, receiveBufferPool, &datagramCopy );
 		}
 
+		if (datagramCopy)
+			datagramCopy->Release();
+
 	}
 
 
@@ -1504,7 +1524,7 @@ CONTINUE_SOCKET_DATA_PARSE_LOOP:
 //-------------------------------------------------------------------------------------------------------
 // This gets an end-user packet already parsed out. Returns number of BITS put into the buffer
 //-------------------------------------------------------------------------------------------------------
-BitSize_t ReliabilityLayer::Receive( unsigned char **data )
+BitSize_t ReliabilityLayer::Receive( unsigned char **data, ReceiveBuffer **receiveBuffer )
 {
 	InternalPacket * internalPacket;
 
@@ -1517,6 +1537,11 @@ BitSize_t ReliabilityLayer::Receive( unsigned char **data )
 
 		BitSize_t bitLength;
 		*data = internalPacket->data;
+		// The reference held by internalPacket passes to the caller
+		if (internalPacket->allocationScheme==InternalPacket::RECEIVE_BUFFER)
+			*receiveBuffer = internalPacket->receiveBuffer;
+		else
+			*receiveBuffer = 0;
 		bitLength = internalPacket->dataBitLength;
 		ReleaseToInternalPacketPool( internalPacket );
 		return bitLength;
@@ -1536,7 +1561,7 @@ BitSize_t ReliabilityLayer::Receive( unsigned char **data )
 // reliability is what reliability to use
 // ordering channel is from 0 to 255 and specifies what stream to use
 //-------------------------------------------------------------------------------------------------------
-bool ReliabilityLayer::Send( char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, unsigned char orderingChannel, bool makeDataCopy, int MTUSize, CCTimeType currentTime, uint32_t receipt )
+bool ReliabilityLayer::Send( char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, unsigned char orderingChannel, bool makeDataCopy, int MTUSize, CCTimeType currentTime, uint32_t receipt, SendBuffer *sendBuffer )
 {
 #ifdef _DEBUG
 	RakAssert( !( reliability >= NUMBER_OF_RELIABILITIES || reliability < 0 ) );
@@ -1579,7 +1604,13 @@ bool ReliabilityLayer::Send( char *data, BitSize_t numberOfBitsToSend, PacketPri
 
 	internalPacket->creationTime = currentTime;
 
-	if ( makeDataCopy )
+	if ( sendBuffer )
+	{
+		// Shared with every other destination of this send, see SendBuffer
+		RakAssert(data==sendBuffer->GetData());
+		AllocInternalPacketData(internalPacket, sendBuffer, (unsigned char*) data );
+	}
+	else if ( makeDataCopy )
 	{
 		AllocInternalPacketData(internalPacket, numberOfBytesToSend, true, _FILE_AND_LINE_ );
 		//internalPacket->data = (unsigned char*) rakMalloc_Ex( numberOfBytesToSend, _FILE_AND_LINE_ );
@@ -1807,6 +1838,11 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 		return;
 	}
 
+#if LIBCAT_SECURITY==1 && RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE>1
+	// Encrypt the datagrams of this update together, so the ChaCha keystream is generated for several at once
+	encryptBatchActive=useSecurity;
+#endif
+
 	if (congestionManager.ShouldSendACKs(time,timeSinceLastTick))
 	{
 		SendACKs(s, systemAddress, time, rnr, updateBitStream);
@@ -1899,6 +1935,9 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 
 			allDatagramSizesSoFar=0;
 
+			// Move everything whose resend time has passed to the due list
+			resendTimers.Advance(time);
+
 			// Keep filling datagrams until we exceed retransmission bandwidth
 			while ((int)BITS_TO_BYTES(allDatagramSizesSoFar)<retransmissionBandwidth)
 			{
@@ -1907,12 +1946,10 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 				// Fill one datagram, then break
 				while ( IsResendQueueEmpty()==false )
 				{
-					internalPacket = resendLinkedListHead;
-					RakAssert(internalPacket->messageNumberAssigned==true);
-
-					//if ( internalPacket->nextActionTime < time )
-					if ( time - internalPacket->nextActionTime < (((CCTimeType)-1)/2) )
+					internalPacket = resendTimers.GetDue();
+					if ( internalPacket )
 					{
+						RakAssert(internalPacket->messageNumberAssigned==true);
 						nextPacketBitLength = internalPacket->headerLength + internalPacket->dataBitLength;
 						if ( datagramSizeSoFar + nextPacketBitLength > GetMaxDatagramSizeExcludingMessageHeaderBits() )
 						{
@@ -1921,7 +1958,7 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 							break;
 						}
 
-						PopListHead(false);
+						RemoveFromResendTimers(internalPacket, false);
 
 						CC_DEBUG_PRINTF_2("Rs %i ", internalPacket->reliableMessageNumber.val);
 
@@ -2236,6 +2273,21 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 		// 			sendPacketSet[3].IsEmpty()==false;
 	}
 
+#if LIBCAT_SECURITY==1 && RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE>1
+	if (encryptBatchActive)
+	{
+		FlushEncryptBatch(s, systemAddress);
+		encryptBatchActive=false;
+	}
+#endif
+
+	if (time >= nextStatisticsSnapshotTime)
+	{
+		RakNetStatistics rns;
+		GetStatistics(&rns);
+		statisticsSnapshot.Write(rns);
+		nextStatisticsSnapshotTime=time+statisticsSnapshotInterval;
+	}
 
 	// Keep on top of deleting old unreliable split packets so they don't clog the list.
 	//DeleteOldUnreliableSplitPackets( time );
@@ -2302,6 +2354,19 @@ void ReliabilityLayer::SendBitStream( RakNetSocket2 *s, SystemAddress &systemAdd
 #endif
 
 #if LIBCAT_SECURITY==1
+#if RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE>1
+	if (encryptBatchActive)
+	{
+		RakAssert(length + cat::AuthenticatedEncryption::OVERHEAD_BYTES <= MAXIMUM_MTU_SIZE);
+		memcpy(encryptBatch.data[encryptBatch.count], bitStream->GetData(), length);
+		encryptBatch.lengths[encryptBatch.count]=length;
+		encryptBatch.times[encryptBatch.count]=currentTime;
+		if (++encryptBatch.count==RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE)
+			FlushEncryptBatch(s, systemAddress);
+		return;
+	}
+#endif
+
 	if (useSecurity)
 	{
 		unsigned char *buffer = reinterpret_cast<unsigned char*>( bitStream->GetData() );
@@ -2315,13 +2380,42 @@ void ReliabilityLayer::SendBitStream( RakNetSocket2 *s, SystemAddress &systemAdd
 	}
 #endif
 
+	SendDatagram(s, systemAddress, (char*) bitStream->GetData(), length, currentTime);
+}
+
+#if LIBCAT_SECURITY==1 && RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE>1
+void ReliabilityLayer::FlushEncryptBatch( RakNetSocket2 *s, SystemAddress &systemAddress )
+{
+	if (encryptBatch.count==0)
+		return;
+
+	cat::u8 *buffers[RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE];
+	cat::u32 bufferBytes[RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE];
+	for (int i=0; i < encryptBatch.count; i++)
+	{
+		buffers[i]=encryptBatch.data[i];
+		bufferBytes[i]=MAXIMUM_MTU_SIZE;
+	}
+
+	// Encrypt() would increase each length
+	bool success = auth_enc.EncryptBatch(buffers, bufferBytes, encryptBatch.lengths, encryptBatch.count);
+	RakAssert(success);
+
+	for (int i=0; i < encryptBatch.count; i++)
+		SendDatagram(s, systemAddress, (char*) encryptBatch.data[i], encryptBatch.lengths[i], encryptBatch.times[i]);
+	encryptBatch.count=0;
+}
+#endif
+
+void ReliabilityLayer::SendDatagram( RakNetSocket2 *s, SystemAddress &systemAddress, char *data, unsigned int length, CCTimeType currentTime)
+{
 	bpsMetrics[(int) ACTUAL_BYTES_SENT].Push1(currentTime,length);
 
 	RakAssert(length <= congestionManager.GetMTU());
 
 #ifdef USE_THREADED_SEND
 	SendToThread::SendToThreadBlock *block =  SendToThread::AllocateBlock();
-	memcpy(block->data, bitStream->GetData(), length);
+	memcpy(block->data, data, length);
 	block->dataWriteOffset=length;
 	block->extraSocketOptions=extraSocketOptions;
 	block->remotePortRakNetWasStartedOn_PS3=remotePortRakNetWasStartedOn_PS3;
@@ -2332,10 +2426,11 @@ void ReliabilityLayer::SendBitStream( RakNetSocket2 *s, SystemAddress &systemAdd
 	// SocketLayer::SendTo( s, ( char* ) bitStream->GetData(), length, systemAddress, __FILE__, __LINE__  );
 
 	RNS2_SendParameters bsp;
-	bsp.data = (char*) bitStream->GetData();
+	bsp.data = data;
 	bsp.length = length;
 	bsp.systemAddress = systemAddress;
-	s->Send(&bsp, _FILE_AND_LINE_);
+	// Goes out when RakPeer flushes the socket at the end of the update cycle
+	s->SendBatched(&bsp, _FILE_AND_LINE_);
 #endif
 }
 
@@ -2388,6 +2483,15 @@ void ReliabilityLayer::SetUnreliableTimeout(RakNet::TimeMS timeoutMS)
 	unreliableTimeout=(CCTimeType)timeoutMS*(CCTimeType)1000;
 #endif
 }
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetStatisticsSnapshotInterval(RakNet::TimeMS intervalMS)
+{
+#if CC_TIME_TYPE_BYTES==4
+	statisticsSnapshotInterval=intervalMS;
+#else
+	statisticsSnapshotInterval=(CCTimeType)intervalMS*(CCTimeType)1000;
+#endif
+}
 
 //-------------------------------------------------------------------------------------------------------
 // This will return true if we should not send at this time
@@ -2454,18 +2558,6 @@ unsigned ReliabilityLayer::RemovePacketFromResendListAndDeleteOlderReliableSeque
 #endif
 	}
 
-	// Testing1
-// 	if (resendLinkedListHead)
-// 	{
-// 		InternalPacket *internalPacket = resendLinkedListHead;
-// 		do 
-// 		{
-// 			internalPacket=internalPacket->resendNext;
-// 			printf("%i ", internalPacket->reliableMessageNumber.val);
-// 		} while (internalPacket!=resendLinkedListHead);
-// 		printf("\n");
-// 	}
-
 	//	bool deleted;
 	//	deleted=resendTree.Delete(messageNumber, internalPacket);
 	internalPacket = resendBuffer[messageNumber & RESEND_BUFFER_ARRAY_MASK];
@@ -2507,7 +2599,7 @@ unsigned ReliabilityLayer::RemovePacketFromResendListAndDeleteOlderReliableSeque
 		else
 			isReliable = false;
 
-		RemoveFromList(internalPacket, isReliable);
+		RemoveFromResendTimers(internalPacket, isReliable);
 		FreeInternalPacketData(internalPacket, _FILE_AND_LINE_ );
 		ReleaseToInternalPacketPool( internalPacket );
 
@@ -2679,7 +2771,7 @@ BitSize_t ReliabilityLayer::WriteToBitStreamFromInternalPacket( RakNet::BitStrea
 //-------------------------------------------------------------------------------------------------------
 // Parse a bitstream and create an internal packet to represent this data
 //-------------------------------------------------------------------------------------------------------
-InternalPacket* ReliabilityLayer::CreateInternalPacketFromBitStream( RakNet::BitStream *bitStream, CCTimeType time )
+InternalPacket* ReliabilityLayer::CreateInternalPacketFromBitStream( RakNet::BitStream *bitStream, CCTimeType time, ReceiveBufferPool *receiveBufferPool, ReceiveBuffer **datagramCopy )
 {
 	bool bitStreamSucceeded;
 	InternalPacket* internalPacket;
@@ -2769,6 +2861,28 @@ InternalPacket* ReliabilityLayer::CreateInternalPacketFromBitStream( RakNet::Bit
 		return 0;
 	}
 
+	if (receiveBufferPool && hasSplitPacket==false)
+	{
+		// Point into a copy of the whole datagram, made once for every unsplit message it holds
+		bitStream->AlignReadToByteBoundary();
+		if ( bitStream->GetNumberOfUnreadBits() < BYTES_TO_BITS( BITS_TO_BYTES( internalPacket->dataBitLength ) ) )
+		{
+			RakAssert("Couldn't read all the data"  && 0);
+			ReleaseToInternalPacketPool( internalPacket );
+			return 0;
+		}
+
+		if (*datagramCopy==0)
+			*datagramCopy = receiveBufferPool->Allocate(bitStream->GetData(), (unsigned int) bitStream->GetNumberOfBytesUsed(), _FILE_AND_LINE_);
+		if (*datagramCopy)
+		{
+			AllocInternalPacketData(internalPacket, *datagramCopy, (*datagramCopy)->data + BITS_TO_BYTES( bitStream->GetReadOffset() ));
+			bitStream->IgnoreBytes( BITS_TO_BYTES( internalPacket->dataBitLength ) );
+			return internalPacket;
+		}
+		// Out of pooled buffers, so fall back to copying this message
+	}
+
 	// Allocate memory to hold our data
 	AllocInternalPacketData(internalPacket, BITS_TO_BYTES( internalPacket->dataBitLength ), false, _FILE_AND_LINE_ );
 	RakAssert(BITS_TO_BYTES( internalPacket->dataBitLength )<MAXIMUM_MTU_SIZE);
@@ -2983,7 +3097,10 @@ void ReliabilityLayer::SplitPacket( InternalPacket *internalPacket )
 
 		// Copy over our chunk of data
 
-		AllocInternalPacketData(internalPacketArray[ splitPacketIndex ], &refCounter, internalPacket->data, internalPacket->data + byteOffset);
+		if (internalPacket->allocationScheme==InternalPacket::SEND_BUFFER)
+			AllocInternalPacketData(internalPacketArray[ splitPacketIndex ], internalPacket->sendBuffer, internalPacket->data + byteOffset);
+		else
+			AllocInternalPacketData(internalPacketArray[ splitPacketIndex ], &refCounter, internalPacket->data, internalPacket->data + byteOffset);
 		//		internalPacketArray[ splitPacketIndex ]->data = (unsigned char*) rakMalloc_Ex( bytesToSend, _FILE_AND_LINE_ );
 		//		memcpy( internalPacketArray[ splitPacketIndex ]->data, internalPacket->data + byteOffset, bytesToSend );
 
@@ -3026,6 +3143,9 @@ void ReliabilityLayer::SplitPacket( InternalPacket *internalPacket )
 
 	// Do not delete, original is referenced by all split packets to avoid numerous allocations. See AllocInternalPacketData above
 	//	FreeInternalPacketData(internalPacket, _FILE_AND_LINE_ );
+	// A SendBuffer is different: each split packet took its own reference, so drop the original's
+	if (internalPacket->allocationScheme==InternalPacket::SEND_BUFFER)
+		FreeInternalPacketData(internalPacket, _FILE_AND_LINE_ );
 	ReleaseToInternalPacketPool( internalPacket );
 
 	if (usedAlloca==false)
@@ -3191,24 +3311,30 @@ InternalPacket * ReliabilityLayer::BuildPacketFromSplitPacketList( SplitPacketCh
 #else
 	unsigned int j;
 	InternalPacket * internalPacket, *splitPacket;
-	// int splitPacketPartLength;
+	unsigned int splitPacketPartLength;
 
 	// Reconstruct
 	internalPacket = CreateInternalPacketCopy( splitPacketChannel->splitPacketList[0], 0, 0, time );
 	internalPacket->dataBitLength=0;
+	// Every part but the last is the same whole number of bytes, and the last is no longer
+	splitPacketPartLength=0;
 	for (j=0; j < splitPacketChannel->splitPacketList.Size(); j++)
+	{
 		internalPacket->dataBitLength+=splitPacketChannel->splitPacketList[j]->dataBitLength;
-	// splitPacketPartLength=BITS_TO_BYTES(splitPacketChannel->firstPacket->dataBitLength);
+		if (BITS_TO_BYTES(splitPacketChannel->splitPacketList[j]->dataBitLength) > splitPacketPartLength)
+			splitPacketPartLength=BITS_TO_BYTES(splitPacketChannel->splitPacketList[j]->dataBitLength);
+	}
 
 	internalPacket->data = (unsigned char*) rakMalloc_Ex( (size_t) BITS_TO_BYTES( internalPacket->dataBitLength ), _FILE_AND_LINE_ );
 	internalPacket->allocationScheme=InternalPacket::NORMAL;
 
-    BitSize_t offset = 0;
+	// splitPacketList is in arrival order, which differs from splitPacketIndex order when a part was resent
 	for (j=0; j < splitPacketChannel->splitPacketList.Size(); j++)
 	{
 		splitPacket=splitPacketChannel->splitPacketList[j];
-        memcpy(internalPacket->data + BITS_TO_BYTES(offset), splitPacket->data, (size_t)BITS_TO_BYTES(splitPacketChannel->splitPacketList[j]->dataBitLength));
-        offset += splitPacketChannel->splitPacketList[j]->dataBitLength;
+		// Parts from a misbehaving sender may not fit
+		if ((BitSize_t) splitPacket->splitPacketIndex*splitPacketPartLength + BITS_TO_BYTES(splitPacket->dataBitLength) <= BITS_TO_BYTES(internalPacket->dataBitLength))
+			memcpy(internalPacket->data + splitPacket->splitPacketIndex*splitPacketPartLength, splitPacket->data, (size_t)BITS_TO_BYTES(splitPacket->dataBitLength));
 	}
 
 	for (j=0; j < splitPacketChannel->splitPacketList.Size(); j++)
@@ -3350,8 +3476,8 @@ void ReliabilityLayer::InsertPacketIntoResendList( InternalPacket *internalPacke
 	(void) time;
 	(void) internalPacket;
 
-	AddToListTail(internalPacket, modifyUnacknowledgedBytes);
 	RakAssert(internalPacket->nextActionTime!=0);
+	AddToResendTimers(internalPacket, modifyUnacknowledgedBytes);
 
 }
 
@@ -3414,6 +3540,12 @@ RakNetStatistics * ReliabilityLayer::GetStatistics( RakNetStatistics *rns )
 	return rns;
 }
 
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::GetStatisticsSnapshot( RakNetStatistics *rns ) const
+{
+	statisticsSnapshot.Read(*rns);
+}
+
 //-------------------------------------------------------------------------------------------------------
 // Returns the number of packets in the resend queue, not counting holes
 //-------------------------------------------------------------------------------------------------------
@@ -3442,6 +3574,68 @@ CCTimeType ReliabilityLayer::GetTimeBetweenPackets(void) const
 	return timeBetweenPackets;
 }
 //-------------------------------------------------------------------------------------------------------
+RakNet::TimeUS ReliabilityLayer::GetNextUpdateTime(RakNet::TimeUS maxTime) const
+{
+#if CC_TIME_TYPE_BYTES==4
+	const CCTimeType ackPollInterval=10;
+	CCTimeType nextTime=(CCTimeType) (maxTime/(RakNet::TimeUS)1000);
+#else
+	const CCTimeType ackPollInterval=10000;
+	CCTimeType nextTime=maxTime;
+#endif
+	const CCTimeType halfSpan=((CCTimeType)-1)/2;
+	CCTimeType t;
+
+	// NAKs go out on every update
+	if (NAKs.Size()>0)
+		nextTime=lastUpdateTime;
+
+	if (acknowlegements.Size()>0)
+	{
+		t=congestionManager.GetNextACKTime();
+		if (t==0)
+			t=lastUpdateTime;
+		if (nextTime-t < halfSpan)
+			nextTime=t;
+	}
+
+	// Earliest resend. Resends already due are waiting on bandwidth, so this is lastUpdateTime
+	if (IsResendQueueEmpty()==false)
+	{
+		t=resendTimers.GetNextDeadline(nextTime);
+		if (nextTime-t < halfSpan)
+			nextTime=t;
+	}
+
+	// Messages still buffered after Update() are waiting on acks or the outgoing bandwidth limit
+	if (outgoingPacketBuffer.Size()>0)
+	{
+		t=lastUpdateTime+ackPollInterval;
+		if (nextTime-t < halfSpan)
+			nextTime=t;
+	}
+
+	if (unreliableTimeout>0 && unreliableLinkedListHead)
+	{
+		t=lastUpdateTime+timeToNextUnreliableCull;
+		if (nextTime-t < halfSpan)
+			nextTime=t;
+	}
+
+	for (unsigned int i=0; i < unreliableWithAckReceiptHistory.Size(); i++)
+	{
+		t=unreliableWithAckReceiptHistory[i].nextActionTime;
+		if (nextTime-t < halfSpan)
+			nextTime=t;
+	}
+
+#if CC_TIME_TYPE_BYTES==4
+	return (RakNet::TimeUS) nextTime*(RakNet::TimeUS)1000;
+#else
+	return nextTime;
+#endif
+}
+//-------------------------------------------------------------------------------------------------------
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
 CCTimeType ReliabilityLayer::GetAckPing(void) const
 {
@@ -3533,52 +3727,19 @@ void ReliabilityLayer::ClearPacketsAndDatagrams(void)
 	packetsToDeallocThisUpdate.Clear(true, _FILE_AND_LINE_);
 }
 //-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::MoveToListHead(InternalPacket *internalPacket)
+void ReliabilityLayer::RemoveFromResendTimers(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes)
 {
-	if ( internalPacket == resendLinkedListHead )
-		return;
-	if (resendLinkedListHead==0)
-	{
-		internalPacket->resendNext=internalPacket;
-		internalPacket->resendPrev=internalPacket;
-		resendLinkedListHead=internalPacket;
-		return;
-	}
-	internalPacket->resendPrev->resendNext = internalPacket->resendNext;
-	internalPacket->resendNext->resendPrev = internalPacket->resendPrev;
-	internalPacket->resendNext=resendLinkedListHead;
-	internalPacket->resendPrev=resendLinkedListHead->resendPrev;
-	internalPacket->resendPrev->resendNext=internalPacket;
-	resendLinkedListHead->resendPrev=internalPacket;
-	resendLinkedListHead=internalPacket;
-	RakAssert(internalPacket->headerLength+internalPacket->dataBitLength>0);
-
-	//ValidateResendList();
-}
-//-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::RemoveFromList(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes)
-{
-	InternalPacket *newPosition;
-	internalPacket->resendPrev->resendNext = internalPacket->resendNext;
-	internalPacket->resendNext->resendPrev = internalPacket->resendPrev;
-	newPosition = internalPacket->resendNext;
-	if ( internalPacket == resendLinkedListHead )
-		resendLinkedListHead = newPosition;
-	if (resendLinkedListHead==internalPacket)
-		resendLinkedListHead=0;
+	resendTimers.Remove(internalPacket);
 
 	if (modifyUnacknowledgedBytes)
 	{
 		RakAssert(unacknowledgedBytes>=BITS_TO_BYTES(internalPacket->headerLength+internalPacket->dataBitLength));
 		unacknowledgedBytes-=BITS_TO_BYTES(internalPacket->headerLength+internalPacket->dataBitLength);
 		// printf("-unacknowledgedBytes:%i ", unacknowledgedBytes);
-
-
-//		ValidateResendList();
 	}
 }
 //-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::AddToListTail(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes)
+void ReliabilityLayer::AddToResendTimers(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes)
 {
 	if (modifyUnacknowledgedBytes)
 	{
@@ -3586,31 +3747,12 @@ void ReliabilityLayer::AddToListTail(InternalPacket *internalPacket, bool modify
 		// printf("+unacknowledgedBytes:%i ", unacknowledgedBytes);
 	}
 
-	if (resendLinkedListHead==0)
-	{
-		internalPacket->resendNext=internalPacket;
-		internalPacket->resendPrev=internalPacket;
-		resendLinkedListHead=internalPacket;
-		return;
-	}
-	internalPacket->resendNext=resendLinkedListHead;
-	internalPacket->resendPrev=resendLinkedListHead->resendPrev;
-	internalPacket->resendPrev->resendNext=internalPacket;
-	resendLinkedListHead->resendPrev=internalPacket;
-
-//	ValidateResendList();
-
-}
-//-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::PopListHead(bool modifyUnacknowledgedBytes)
-{
-	RakAssert(resendLinkedListHead!=0);
-	RemoveFromList(resendLinkedListHead, modifyUnacknowledgedBytes);
+	resendTimers.Insert(internalPacket);
 }
 //-------------------------------------------------------------------------------------------------------
 bool ReliabilityLayer::IsResendQueueEmpty(void) const
 {
-	return resendLinkedListHead==0;
+	return resendTimers.IsEmpty();
 }
 //-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::SendACKs(RakNetSocket2 *s, SystemAddress &systemAddress, CCTimeType time, RakNetRandom *rnr, BitStream &updateBitStream)
@@ -3737,22 +3879,12 @@ void ReliabilityLayer::AddToUnreliableLinkedList(InternalPacket *internalPacket)
 //-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::ValidateResendList(void) const
 {
-// 	unsigned int count1=0, count2=0;
+// 	unsigned int count1=0;
 // 	for (unsigned int i=0; i < RESEND_BUFFER_ARRAY_LENGTH; i++)
 // 	if (resendBuffer[i])
 // 	count1++;
-// 
-// 	if (resendLinkedListHead)
-// 	{
-// 	InternalPacket *internalPacket = resendLinkedListHead;
-// 	do 
-// 	{
-// 	count2++;
-// 	internalPacket=internalPacket->resendNext;
-// 	} while (internalPacket!=resendLinkedListHead);
-// 	}
-// 	RakAssert(count1==count2);
-// 	RakAssert(count2<=RESEND_BUFFER_ARRAY_LENGTH);
+// 	RakAssert(count1==resendTimers.Size());
+// 	RakAssert(count1<=RESEND_BUFFER_ARRAY_LENGTH);
 }
 //-------------------------------------------------------------------------------------------------------
 bool ReliabilityLayer::ResendBufferOverflow(void) const
@@ -3857,6 +3989,22 @@ void ReliabilityLayer::AllocInternalPacketData(InternalPacket *internalPacket, u
 	internalPacket->data=externallyAllocatedPtr;
 }
 //-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::AllocInternalPacketData(InternalPacket *internalPacket, SendBuffer *sendBuffer, unsigned char *ourOffset)
+{
+	internalPacket->allocationScheme=InternalPacket::SEND_BUFFER;
+	internalPacket->data=ourOffset;
+	internalPacket->sendBuffer=sendBuffer;
+	sendBuffer->AddRef();
+}
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::AllocInternalPacketData(InternalPacket *internalPacket, ReceiveBuffer *receiveBuffer, unsigned char *ourOffset)
+{
+	internalPacket->allocationScheme=InternalPacket::RECEIVE_BUFFER;
+	internalPacket->data=ourOffset;
+	internalPacket->receiveBuffer=receiveBuffer;
+	receiveBuffer->AddRef();
+}
+//-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::AllocInternalPacketData(InternalPacket *internalPacket, unsigned int numBytes, bool allowStack, const char *file, unsigned int line)
 {
 	if (allowStack && numBytes <= sizeof(internalPacket->stackData))
@@ -3899,6 +4047,24 @@ void ReliabilityLayer::FreeInternalPacketData(InternalPacket *internalPacket, co
 		rakFree_Ex(internalPacket->data, file, line );
 		internalPacket->data=0;
 	}
+	else if (internalPacket->allocationScheme==InternalPacket::SEND_BUFFER)
+	{
+		if (internalPacket->sendBuffer==0)
+			return;
+
+		internalPacket->sendBuffer->Release();
+		internalPacket->sendBuffer=0;
+		internalPacket->data=0;
+	}
+	else if (internalPacket->allocationScheme==InternalPacket::RECEIVE_BUFFER)
+	{
+		if (internalPacket->receiveBuffer==0)
+			return;
+
+		internalPacket->receiveBuffer->Release();
+		internalPacket->receiveBuffer=0;
+		internalPacket->data=0;
+	}
 	else
 	{
 		// Data was on stack
@@ -16,6 +16,7 @@
 #include "../include/RakNet/MessageIdentifiers.h"
 #include "../include/RakNet/RakPeerInterface.h"
 #include "../include/RakNet/NetworkIDManager.h"
+#include "../include/RakNet/GridSectorizer.h"
 #include <optional>
 
 using namespace RakNet;
@@ -61,6 +62,7 @@ LastSerializationResult::LastSerializationResult()
 	replica=0;
 	lastSerializationResultBS=0;
 	whenLastSerialized = RakNet::GetTime();
+	constructedFromQuery=false;
 }
 LastSerializationResult::~LastSerializationResult()
 {
@@ -540,6 +542,35 @@ bool ReplicaManager3::GetAllConnectionDownloadsCompleted(WorldId worldId) const
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+void ReplicaManager3::SetAreaOfInterest(float cellSize, float minX, float minY, float maxX, float maxY, float hysteresis, WorldId worldId)
+{
+	RakAssert(worldsArray[worldId]!=0 && "World not in use");
+	RakAssert(cellSize > 0.0f && minX < maxX && minY < maxY && hysteresis >= 0.0f);
+	RM3World *world = worldsArray[worldId];
+
+	if (world->areaOfInterestGrid==0)
+		world->areaOfInterestGrid=RakNet::OP_NEW<GridSectorizer>(_FILE_AND_LINE_);
+	world->areaOfInterestGrid->Init(cellSize, cellSize, minX, minY, maxX, maxY);
+	world->areaOfInterestHysteresis=hysteresis;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void ReplicaManager3::DisableAreaOfInterest(WorldId worldId)
+{
+	RakAssert(worldsArray[worldId]!=0 && "World not in use");
+	RM3World *world = worldsArray[worldId];
+
+	// Connections move their held back replicas to queryToConstructReplicaList on the next Update()
+	if (world->areaOfInterestGrid)
+	{
+		RakNet::OP_DELETE(world->areaOfInterestGrid, _FILE_AND_LINE_);
+		world->areaOfInterestGrid=0;
+	}
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 void ReplicaManager3::Clear(bool deleteWorlds)
 {
 	for (uint32_t i=0; i < worldsList.Size(); i++)
@@ -560,6 +591,16 @@ void ReplicaManager3::Clear(bool deleteWorlds)
 ReplicaManager3::RM3World::RM3World()
 {
 	networkIDManager=0;
+	areaOfInterestGrid=0;
+	areaOfInterestHysteresis=0.0f;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+ReplicaManager3::RM3World::~RM3World()
+{
+	if (areaOfInterestGrid)
+		RakNet::OP_DELETE(areaOfInterestGrid, _FILE_AND_LINE_);
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -646,6 +687,20 @@ void ReplicaManager3::SetNetworkIDManager(NetworkIDManager *_networkIDManager, W
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+bool ReplicaManager3::GetReceiveFilter(PluginReceiveFilter &filter) const
+{
+	filter.Add(ID_REPLICA_MANAGER_CONSTRUCTION);
+	filter.Add(ID_REPLICA_MANAGER_SCOPE_CHANGE);
+	filter.Add(ID_REPLICA_MANAGER_SERIALIZE);
+	filter.Add(ID_REPLICA_MANAGER_DOWNLOAD_STARTED);
+	filter.Add(ID_REPLICA_MANAGER_DOWNLOAD_COMPLETE);
+	// Timestamped messages too short to hold an inner ID are absorbed in OnReceive()
+	filter.Add(ID_TIMESTAMP);
+	return true;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 PluginReceiveResult ReplicaManager3::OnReceive(Packet *packet)
 {
 	if (packet->length<2)
@@ -739,6 +794,8 @@ void Connection_RM3::AutoConstructByQuery(ReplicaManager3 *replicaManager3, Worl
 
 	if (constructionMode==QUERY_REPLICA_FOR_CONSTRUCTION || constructionMode==QUERY_REPLICA_FOR_CONSTRUCTION_AND_DESTRUCTION)
 	{
+		UpdateAreaOfInterest(replicaManager3, worldId);
+
 		while (index < queryToConstructReplicaList.Size())
 		{
 			lsr=queryToConstructReplicaList[index];
@@ -801,6 +858,7 @@ void Connection_RM3::AutoConstructByQuery(ReplicaManager3 *replicaManager3, Worl
 			{
 				OnConstructToThisConnection(index, replicaManager3);
 				RakAssert(lsr->replica);
+				lsr->constructedFromQuery=true;
 				constructedReplicasCulled.Push(lsr->replica,_FILE_AND_LINE_);
 			}
 			else if (constructionState==RM3CS_NEVER_CONSTRUCT)
@@ -874,6 +932,96 @@ void Connection_RM3::AutoConstructByQuery(ReplicaManager3 *replicaManager3, Worl
 
 	SendConstruction(constructedReplicasCulled,destroyedReplicasCulled,replicaManager3->defaultSendParameters,replicaManager3->rakPeerInterface,worldId,replicaManager3);
 }
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+static bool IsInViewRadius(Replica3 *replica, bool hasViewPosition, float viewX, float viewY, float radius)
+{
+	if (replica->hasAreaOfInterestPosition==false)
+		return true;
+	if (hasViewPosition==false)
+		return false;
+	float dx = replica->areaOfInterestX - viewX;
+	float dy = replica->areaOfInterestY - viewY;
+	return dx*dx + dy*dy <= radius*radius;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void Connection_RM3::UpdateAreaOfInterest(ReplicaManager3 *replicaManager3, WorldId worldId)
+{
+	ReplicaManager3::RM3World *world = replicaManager3->worldsArray[worldId];
+	uint32_t index;
+
+	if (world->areaOfInterestGrid==0 || viewRadius <= 0.0f)
+	{
+		// Area of interest was turned off, so everything held back is a candidate again
+		for (index=0; index < outOfAreaReplicaList.Size(); index++)
+			queryToConstructReplicaList.Push(outOfAreaReplicaList[index],_FILE_AND_LINE_);
+		outOfAreaReplicaList.Clear(false,_FILE_AND_LINE_);
+		return;
+	}
+
+	float viewX=0.0f, viewY=0.0f;
+	bool hasViewPosition = QueryViewPosition(&viewX, &viewY);
+	LastSerializationResult *lsr;
+
+	// Hold back replicas that have not been constructed and are out of view
+	index=0;
+	while (index < queryToConstructReplicaList.Size())
+	{
+		lsr=queryToConstructReplicaList[index];
+		if (IsInViewRadius(lsr->replica, hasViewPosition, viewX, viewY, viewRadius)==false)
+		{
+			queryToConstructReplicaList.RemoveAtIndex(index);
+			outOfAreaReplicaList.Insert(lsr->replica,lsr,true,_FILE_AND_LINE_);
+		}
+		else
+			index++;
+	}
+
+	// Destroy what we constructed once it is past the view radius plus hysteresis
+	float destroyRadius = viewRadius + world->areaOfInterestHysteresis;
+	index=0;
+	while (index < constructedReplicaList.Size())
+	{
+		lsr=constructedReplicaList[index];
+		if (lsr->constructedFromQuery && IsInViewRadius(lsr->replica, hasViewPosition, viewX, viewY, destroyRadius)==false)
+		{
+			destroyedReplicasCulled.Push(lsr->replica,_FILE_AND_LINE_);
+			OnLeaveAreaOfInterest(index, replicaManager3);
+		}
+		else
+			index++;
+	}
+
+	if (outOfAreaReplicaList.Size()==0)
+		return;
+
+	// Only replicas in nearby cells can have come into view, plus those that stopped reporting a position
+	if (hasViewPosition)
+		world->areaOfInterestGrid->GetEntries(world->areaOfInterestEntries, viewX-viewRadius, viewY-viewRadius, viewX+viewRadius, viewY+viewRadius);
+	else
+		world->areaOfInterestEntries.Clear(true,_FILE_AND_LINE_);
+	for (index=0; index < world->areaOfInterestLostPosition.Size(); index++)
+		world->areaOfInterestEntries.Push(world->areaOfInterestLostPosition[index],_FILE_AND_LINE_);
+	for (index=0; index < world->areaOfInterestEntries.Size(); index++)
+	{
+		Replica3 *replica = (Replica3 *) world->areaOfInterestEntries[index];
+		if (IsInViewRadius(replica, hasViewPosition, viewX, viewY, viewRadius)==false)
+			continue;
+		bool objectExists;
+		uint32_t idx = outOfAreaReplicaList.GetIndexFromKey(replica, &objectExists);
+		if (objectExists)
+		{
+			queryToConstructReplicaList.Push(outOfAreaReplicaList[idx],_FILE_AND_LINE_);
+			outOfAreaReplicaList.RemoveAtIndex(idx);
+		}
+	}
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 void ReplicaManager3::Update(void)
 {
 	uint32_t index,index2,index3;
@@ -887,6 +1035,23 @@ void ReplicaManager3::Update(void)
 		world = worldsList[index3];
 		worldId = world->worldId;
 
+		if (world->areaOfInterestGrid)
+		{
+			// Replicas move every tick, so rebuilding is simpler than moving entries between cells
+			world->areaOfInterestGrid->Clear();
+			world->areaOfInterestLostPosition.Clear(true,_FILE_AND_LINE_);
+			for (index=0; index < world->userReplicaList.Size(); index++)
+			{
+				Replica3 *replica = world->userReplicaList[index];
+				bool hadPosition = replica->hasAreaOfInterestPosition;
+				replica->hasAreaOfInterestPosition=replica->QueryAreaOfInterestPosition(&replica->areaOfInterestX, &replica->areaOfInterestY);
+				if (replica->hasAreaOfInterestPosition)
+					world->areaOfInterestGrid->AddEntry(replica, replica->areaOfInterestX, replica->areaOfInterestY, replica->areaOfInterestX, replica->areaOfInterestY);
+				else if (hadPosition)
+					world->areaOfInterestLostPosition.Push(replica,_FILE_AND_LINE_);
+			}
+		}
+
 		for (index=0; index < world->connectionList.Size(); index++)
 		{
 			if (world->connectionList[index]->isValidated==false)
@@ -1210,7 +1375,8 @@ PluginReceiveResult ReplicaManager3::OnConstruction(Packet *packet, unsigned cha
 		}
 	}
 
-	// Destructions
+	// Destructions, which SendConstruction() starts on a byte boundary
+	bsIn.AlignReadToByteBoundary();
 	bool b = bsIn.Read(destructionObjectListSize);
 	(void) b;
 	RakAssert(b);
@@ -1474,6 +1640,7 @@ Connection_RM3::Connection_RM3(const SystemAddress &_systemAddress, RakNetGUID _
 	isFirstConstruction=true;
 	groupConstructionAndSerialize=false;
 	gotDownloadComplete=false;
+	viewRadius=0.0f;
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -1485,6 +1652,8 @@ Connection_RM3::~Connection_RM3()
 		RakNet::OP_DELETE(constructedReplicaList[i], _FILE_AND_LINE_);
 	for (i=0; i < queryToConstructReplicaList.Size(); i++)
 		RakNet::OP_DELETE(queryToConstructReplicaList[i], _FILE_AND_LINE_);
+	for (i=0; i < outOfAreaReplicaList.Size(); i++)
+		RakNet::OP_DELETE(outOfAreaReplicaList[i], _FILE_AND_LINE_);
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -1801,6 +1970,11 @@ void Connection_RM3::OnLocalReference(Replica3* replica3, ReplicaManager3 *repli
 	{
 		RakAssert("replica added to queryToConstructReplicaList when already in constructedReplicaList" && 0);
 	}
+
+	if (outOfAreaReplicaList.HasData(replica3)==true)
+	{
+		RakAssert("replica added to queryToConstructReplicaList when already in outOfAreaReplicaList" && 0);
+	}
 #endif
 
 	LastSerializationResult* lsr=RakNet::OP_NEW<LastSerializationResult>(_FILE_AND_LINE_);
@@ -1838,6 +2012,13 @@ void Connection_RM3::OnDereference(Replica3* replica3, ReplicaManager3 *replicaM
 		}
 	}
 
+	idx=outOfAreaReplicaList.GetIndexFromKey(replica3, &objectExists);
+	if (objectExists)
+	{
+		lsr=outOfAreaReplicaList[idx];
+		outOfAreaReplicaList.RemoveAtIndex(idx);
+	}
+
 	for (idx=0; idx < queryToSerializeReplicaList.Size(); idx++)
 	{
 		if (queryToSerializeReplicaList[idx]->replica==replica3)
@@ -1889,6 +2070,15 @@ void Connection_RM3::OnDownloadFromThisSystem(Replica3* replica3, ReplicaManager
 			}
 		}
 
+		// The remote system now has this replica, so it is no longer waiting to come into its area of interest
+		bool objectExists;
+		uint32_t idx=outOfAreaReplicaList.GetIndexFromKey(replica3, &objectExists);
+		if (objectExists)
+		{
+			RakNet::OP_DELETE(outOfAreaReplicaList[idx],_FILE_AND_LINE_);
+			outOfAreaReplicaList.RemoveAtIndex(idx);
+		}
+
 		queryToDestructReplicaList.Push(lsr,_FILE_AND_LINE_);
 	}
 
@@ -1916,6 +2106,8 @@ void Connection_RM3::OnDownloadFromOtherSystem(Replica3* replica3, ReplicaManage
 				return;
 			}
 		}
+		if (outOfAreaReplicaList.HasData(replica3))
+			return;
 
 		OnLocalReference(replica3, replicaManager);
 	}
@@ -2027,6 +2219,15 @@ void Connection_RM3::OnDownloadExisting(Replica3* replica3, ReplicaManager3 *rep
 				return;
 			}
 		}
+
+		bool objectExists;
+		idx=outOfAreaReplicaList.GetIndexFromKey(replica3, &objectExists);
+		if (objectExists)
+		{
+			queryToConstructReplicaList.Push(outOfAreaReplicaList[idx],_FILE_AND_LINE_);
+			outOfAreaReplicaList.RemoveAtIndex(idx);
+			OnConstructToThisConnection(queryToConstructReplicaList.Size()-1, replicaManager);
+		}
 	}
 	else
 	{
@@ -2062,6 +2263,7 @@ void Connection_RM3::OnSendDestructionFromQuery(uint32_t queryToDestructIdx, Rep
 		}
 	}
 	//assert(queryToConstructReplicaList.GetIndexOf(lsr->replica)==(uint32_t)-1);
+	lsr->constructedFromQuery=false;
 	queryToConstructReplicaList.Push(lsr,_FILE_AND_LINE_);
 	ValidateLists(replicaManager);
 }
@@ -2077,6 +2279,35 @@ void Connection_RM3::OnDoNotQueryDestruction(uint32_t queryToDestructIdx, Replic
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+void Connection_RM3::OnLeaveAreaOfInterest(uint32_t constructedIdx, ReplicaManager3 *replicaManager)
+{
+	ValidateLists(replicaManager);
+	LastSerializationResult* lsr = constructedReplicaList[constructedIdx];
+	constructedReplicaList.RemoveAtIndex(constructedIdx);
+	uint32_t j;
+	for (j=0; j < queryToSerializeReplicaList.Size(); j++)
+	{
+		if (queryToSerializeReplicaList[j]==lsr)
+		{
+			queryToSerializeReplicaList.RemoveAtIndex(j);
+			break;
+		}
+	}
+	for (j=0; j < queryToDestructReplicaList.Size(); j++)
+	{
+		if (queryToDestructReplicaList[j]==lsr)
+		{
+			queryToDestructReplicaList.RemoveAtIndex(j);
+			break;
+		}
+	}
+	lsr->constructedFromQuery=false;
+	outOfAreaReplicaList.Insert(lsr->replica,lsr,true,_FILE_AND_LINE_);
+	ValidateLists(replicaManager);
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 void Connection_RM3::ValidateLists(ReplicaManager3 *replicaManager) const
 {
 	(void) replicaManager;
@@ -2401,6 +2632,9 @@ Replica3::Replica3()
 	forceSendUntilNextUpdate=false;
 	lsr=0;
 	referenceIndex = (uint32_t)-1;
+	areaOfInterestX=0.0f;
+	areaOfInterestY=0.0f;
+	hasAreaOfInterestPosition=false;
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "../include/RakNet/SendBuffer.h"
+#include "../include/RakNet/BitStream.h"
+#include "../include/RakNet/RakAssert.h"
+#include <new>
+#include <string.h>
+
+using namespace RakNet;
+
+SendBuffer *SendBuffer::Allocate(BitSize_t numberOfBits, const char *file, unsigned int line)
+{
+	if (numberOfBits==0)
+		return 0;
+
+	char *block = (char*) rakMalloc_Ex(sizeof(SendBuffer) + (size_t) BITS_TO_BYTES(numberOfBits), file, line);
+	if (block==0)
+	{
+		notifyOutOfMemory(file, line);
+		return 0;
+	}
+
+	SendBuffer *sendBuffer = new (block) SendBuffer;
+	sendBuffer->refCount.store(1, std::memory_order_relaxed);
+	sendBuffer->numberOfBits=numberOfBits;
+	sendBuffer->data=block+sizeof(SendBuffer);
+	return sendBuffer;
+}
+SendBuffer *SendBuffer::Create(const char *data, unsigned int numberOfBytes, const char *file, unsigned int line)
+{
+	SendBuffer *sendBuffer = Allocate(BYTES_TO_BITS(numberOfBytes), file, line);
+	if (sendBuffer)
+		memcpy(sendBuffer->data, data, numberOfBytes);
+	return sendBuffer;
+}
+SendBuffer *SendBuffer::Create(const RakNet::BitStream *bitStream, const char *file, unsigned int line)
+{
+	SendBuffer *sendBuffer = Allocate(bitStream->GetNumberOfBitsUsed(), file, line);
+	if (sendBuffer)
+		memcpy(sendBuffer->data, bitStream->GetData(), (size_t) bitStream->GetNumberOfBytesUsed());
+	return sendBuffer;
+}
+void SendBuffer::AddRef(void)
+{
+	refCount.fetch_add(1, std::memory_order_relaxed);
+}
+void SendBuffer::Release(void)
+{
+	RakAssert(refCount.load(std::memory_order_relaxed)>0);
+	// acq_rel so the thread that frees the block sees every other thread's last use of it
+	if (refCount.fetch_sub(1, std::memory_order_acq_rel)==1)
+	{
+		this->~SendBuffer();
+		rakFree_Ex(this, _FILE_AND_LINE_);
+	}
+}
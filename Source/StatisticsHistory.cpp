@@ -15,6 +15,9 @@
 #include "../include/RakNet/GetTime.h"
 #include "../include/RakNet/RakNetStatistics.h"
 #include "../include/RakNet/RakPeerInterface.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 using namespace RakNet;
 
@@ -55,6 +58,70 @@ int TimeAndValueQueueCompDesc( StatisticsHistory::TimeAndValueQueue* const &key,
 		return 1;
 	return 0;
 }
+int StatisticsHistory::KeyIdComp( const RakString &key, const StatisticsHistory::KeyId &data )
+{
+	if (key < data.key)
+		return -1;
+	if (key == data.key)
+		return 0;
+	return 1;
+}
+
+// Merges the sorted runs of times and vals, which start at runStarts, into one sorted run. runStarts ends with the total count
+// Each pass merges pairs of runs into the other buffer, so the result is in scratch if this returns true
+static bool MergeRuns(Time *times, SHValueType *vals, Time *scratchTimes, SHValueType *scratchVals, DataStructures::List<unsigned int> &runStarts)
+{
+	bool inScratch=false;
+	while (runStarts.Size() > 2)
+	{
+		Time *srcTimes = inScratch ? scratchTimes : times;
+		SHValueType *srcVals = inScratch ? scratchVals : vals;
+		Time *dstTimes = inScratch ? times : scratchTimes;
+		SHValueType *dstVals = inScratch ? vals : scratchVals;
+		DataStructures::List<unsigned int> mergedStarts;
+		unsigned int run;
+		for (run=0; run+2 < runStarts.Size(); run+=2)
+		{
+			unsigned int lhsIndex=runStarts[run];
+			unsigned int lhsEnd=runStarts[run+1];
+			unsigned int rhsIndex=lhsEnd;
+			unsigned int rhsEnd=runStarts[run+2];
+			unsigned int outputIndex=lhsIndex;
+			while (lhsIndex < lhsEnd && rhsIndex < rhsEnd)
+			{
+				if (srcTimes[rhsIndex] < srcTimes[lhsIndex])
+				{
+					dstTimes[outputIndex]=srcTimes[rhsIndex];
+					dstVals[outputIndex++]=srcVals[rhsIndex++];
+				}
+				else
+				{
+					dstTimes[outputIndex]=srcTimes[lhsIndex];
+					dstVals[outputIndex++]=srcVals[lhsIndex++];
+				}
+			}
+			memcpy(dstTimes+outputIndex, srcTimes+lhsIndex, (lhsEnd-lhsIndex)*sizeof(Time));
+			memcpy(dstVals+outputIndex, srcVals+lhsIndex, (lhsEnd-lhsIndex)*sizeof(SHValueType));
+			outputIndex+=lhsEnd-lhsIndex;
+			memcpy(dstTimes+outputIndex, srcTimes+rhsIndex, (rhsEnd-rhsIndex)*sizeof(Time));
+			memcpy(dstVals+outputIndex, srcVals+rhsIndex, (rhsEnd-rhsIndex)*sizeof(SHValueType));
+			mergedStarts.Push(runStarts[run], _FILE_AND_LINE_);
+		}
+		if (run+1 < runStarts.Size())
+		{
+			// Odd run out
+			unsigned int start=runStarts[run];
+			unsigned int end=runStarts[run+1];
+			memcpy(dstTimes+start, srcTimes+start, (end-start)*sizeof(Time));
+			memcpy(dstVals+start, srcVals+start, (end-start)*sizeof(SHValueType));
+			mergedStarts.Push(start, _FILE_AND_LINE_);
+		}
+		mergedStarts.Push(runStarts[runStarts.Size()-1], _FILE_AND_LINE_);
+		runStarts=mergedStarts;
+		inScratch=!inScratch;
+	}
+	return inScratch;
+}
 StatisticsHistory::TrackedObjectData::TrackedObjectData() {}
 StatisticsHistory::TrackedObjectData::TrackedObjectData(uint64_t _objectId, int _objectType, void *_userData)
 {
@@ -62,7 +129,11 @@ StatisticsHistory::TrackedObjectData::TrackedObjectData(uint64_t _objectId, int
 	objectType=_objectType;
 	userData=_userData;
 }
-StatisticsHistory::StatisticsHistory() {timeToTrack = 30000;}
+StatisticsHistory::StatisticsHistory()
+{
+	timeToTrack = 30000;
+	maxSamplesPerKey = STATISTICS_HISTORY_MAX_SAMPLES;
+}
 StatisticsHistory::~StatisticsHistory()
 {
 	Clear();
@@ -111,69 +182,16 @@ bool StatisticsHistory::AddValueByObjectID(uint64_t objectId, RakString key, SHV
 	unsigned int idx = GetObjectIndex(objectId);
 	if (idx == (unsigned int) -1)
 		return false;
-	AddValueByIndex(idx, key, val, curTime, combineEqualTimes);
+	AddValueByIndex(idx, GetKeyId(key), val, curTime, combineEqualTimes);
 	return true;
 }
 void StatisticsHistory::AddValueByIndex(unsigned int index, RakString key, SHValueType val, Time curTime, bool combineEqualTimes)
 {
-	TimeAndValueQueue *queue;
-	TrackedObject *to = objects[index];
-	DataStructures::HashIndex hi = to->dataQueues.GetIndexOf(key);
-	if (hi.IsInvalid())
-	{
-		queue = RakNet::OP_NEW<TimeAndValueQueue>(_FILE_AND_LINE_);
-		queue->key=key;
-		queue->timeToTrackValues = timeToTrack;
-		to->dataQueues.Push(key, queue, _FILE_AND_LINE_);
-	}
-	else
-	{
-		queue = to->dataQueues.ItemAtIndex(hi);
-	}
-
-	TimeAndValue tav;
-	if (combineEqualTimes==true && queue->values.Size()>0 && queue->values.PeekTail().time==curTime)
-	{
-		tav = queue->values.PopTail();
-
-		queue->recentSum -= tav.val;
-		queue->recentSumOfSquares -= tav.val * tav.val;
-		queue->longTermSum -= tav.val;
-		queue->longTermCount = queue->longTermCount - 1;
-	}
-	else
-	{
-		tav.val=0.0;
-		tav.time=curTime;
-	}
-
-	tav.val+=val;
-	queue->values.Push(tav, _FILE_AND_LINE_);
-
-	queue->recentSum += tav.val;
-	queue->recentSumOfSquares += tav.val * tav.val;
-	queue->longTermSum += tav.val;
-	queue->longTermCount = queue->longTermCount + 1;
-	if (queue->longTermLowest > tav.val)
-		queue->longTermLowest = tav.val;
-	if (queue->longTermHighest < tav.val)
-		queue->longTermHighest = tav.val;
+	AddValueByIndex(index, GetKeyId(key), val, curTime, combineEqualTimes);
 }
 StatisticsHistory::SHErrorCode StatisticsHistory::GetHistoryForKey(uint64_t objectId, RakString key, StatisticsHistory::TimeAndValueQueue **values, Time curTime) const
 {
-	if (values == 0)
-		return SH_INVALID_PARAMETER;
-
-	unsigned int idx = GetObjectIndex(objectId);
-	if (idx == (unsigned int) -1)
-		return SH_UKNOWN_OBJECT;
-	TrackedObject *to = objects[idx];
-	DataStructures::HashIndex hi = to->dataQueues.GetIndexOf(key);
-	if (hi.IsInvalid())
-		return SH_UKNOWN_KEY;
-	*values = to->dataQueues.ItemAtIndex(hi);
-	(*values)->CullExpiredValues(curTime);
-	return SH_OK;
+	return GetHistoryForKey(objectId, FindKeyId(key), values, curTime);
 }
 bool StatisticsHistory::GetHistorySorted(uint64_t objectId, SHSortOperation sortType, DataStructures::List<StatisticsHistory::TimeAndValueQueue *> &values) const
 {
@@ -181,15 +199,14 @@ bool StatisticsHistory::GetHistorySorted(uint64_t objectId, SHSortOperation sort
 	if (idx == (unsigned int) -1)
 		return false;
 	TrackedObject *to = objects[idx];
-	DataStructures::List<TimeAndValueQueue*> itemList;
-	DataStructures::List<RakString> keyList;
-	to->dataQueues.GetAsList(itemList,keyList,_FILE_AND_LINE_);
 	Time curTime = GetTime();
 
 	DataStructures::OrderedList<TimeAndValueQueue*, TimeAndValueQueue*,TimeAndValueQueueCompAsc> sortedQueues;
-	for (unsigned int i=0; i < itemList.Size(); i++)
+	for (unsigned int i=0; i < to->dataQueues.Size(); i++)
 	{
-		TimeAndValueQueue *tavq = itemList[i];
+		TimeAndValueQueue *tavq = to->dataQueues[i];
+		if (tavq==0)
+			continue;
 		tavq->CullExpiredValues(curTime);
 
 		if (sortType == SH_SORT_BY_RECENT_SUM_ASCENDING || sortType == SH_SORT_BY_RECENT_SUM_DESCENDING)
@@ -231,56 +248,276 @@ bool StatisticsHistory::GetHistorySorted(uint64_t objectId, SHSortOperation sort
 	return true;
 }
 void StatisticsHistory::MergeAllObjectsOnKey(RakString key, TimeAndValueQueue *tavqOutput, SHDataCategory dataCategory) const
+{
+	MergeAllObjectsOnKey(FindKeyId(key), tavqOutput, dataCategory);
+}
+void StatisticsHistory::GetUniqueKeyList(DataStructures::List<RakString> &keys)
+{
+	keys.Clear(true, _FILE_AND_LINE_);
+
+	for (unsigned int keyId=0; keyId < keyNames.Size(); keyId++)
+	{
+		for (unsigned int idx=0; idx < objects.Size(); idx++)
+		{
+			TrackedObject *to = objects[idx];
+			if (keyId < to->dataQueues.Size() && to->dataQueues[keyId]!=0)
+			{
+				keys.Push(keyNames[keyId], _FILE_AND_LINE_);
+				break;
+			}
+		}
+	}
+}
+unsigned int StatisticsHistory::GetKeyId(RakString key)
+{
+	bool keyExists;
+	unsigned int idx = keyIds.GetIndexFromKey(key, &keyExists);
+	if (keyExists)
+		return keyIds[idx].keyId;
+	KeyId keyId;
+	keyId.key=key;
+	keyId.keyId=keyNames.Size();
+	keyIds.InsertAtIndex(keyId,idx,_FILE_AND_LINE_);
+	keyNames.Push(key, _FILE_AND_LINE_);
+	return keyId.keyId;
+}
+unsigned int StatisticsHistory::FindKeyId(RakString key) const
+{
+	bool keyExists;
+	unsigned int idx = keyIds.GetIndexFromKey(key, &keyExists);
+	if (keyExists)
+		return keyIds[idx].keyId;
+	return (unsigned int) -1;
+}
+RakString StatisticsHistory::GetKeyName(unsigned int keyId) const
+{
+	if (keyId < keyNames.Size())
+		return keyNames[keyId];
+	return RakString();
+}
+bool StatisticsHistory::AddValueByObjectID(uint64_t objectId, unsigned int keyId, SHValueType val, Time curTime, bool combineEqualTimes)
+{
+	unsigned int idx = GetObjectIndex(objectId);
+	if (idx == (unsigned int) -1)
+		return false;
+	AddValueByIndex(idx, keyId, val, curTime, combineEqualTimes);
+	return true;
+}
+void StatisticsHistory::AddValueByIndex(unsigned int index, unsigned int keyId, SHValueType val, Time curTime, bool combineEqualTimes)
+{
+	if (keyId >= keyNames.Size())
+		return;
+	GetQueue(objects[index], keyId)->AddValue(val, curTime, combineEqualTimes);
+}
+StatisticsHistory::SHErrorCode StatisticsHistory::GetHistoryForKey(uint64_t objectId, unsigned int keyId, StatisticsHistory::TimeAndValueQueue **values, Time curTime) const
+{
+	if (values == 0)
+		return SH_INVALID_PARAMETER;
+
+	unsigned int idx = GetObjectIndex(objectId);
+	if (idx == (unsigned int) -1)
+		return SH_UKNOWN_OBJECT;
+	TrackedObject *to = objects[idx];
+	if (keyId >= to->dataQueues.Size() || to->dataQueues[keyId]==0)
+		return SH_UKNOWN_KEY;
+	*values = to->dataQueues[keyId];
+	(*values)->CullExpiredValues(curTime);
+	return SH_OK;
+}
+void StatisticsHistory::MergeAllObjectsOnKey(unsigned int keyId, TimeAndValueQueue *tavqOutput, SHDataCategory dataCategory) const
 {
 	tavqOutput->Clear();
 
 	Time curTime = GetTime();
 
 	// Find every object with this key
+	DataStructures::List<TimeAndValueQueue*> inputs;
+	unsigned int totalCount=0;
 	for (unsigned int idx=0; idx < objects.Size(); idx++)
 	{
 		TrackedObject *to = objects[idx];
-		DataStructures::HashIndex hi = to->dataQueues.GetIndexOf(key);
-		if (hi.IsInvalid()==false)
+		if (keyId < to->dataQueues.Size() && to->dataQueues[keyId]!=0)
 		{
-			TimeAndValueQueue *tavqInput = to->dataQueues.ItemAtIndex(hi);
+			TimeAndValueQueue *tavqInput = to->dataQueues[keyId];
 			tavqInput->CullExpiredValues(curTime);
-			TimeAndValueQueue::MergeSets(tavqOutput, dataCategory, tavqInput, dataCategory, tavqOutput);
+			inputs.Push(tavqInput, _FILE_AND_LINE_);
+			totalCount+=tavqInput->GetColumnCount(dataCategory!=StatisticsHistory::DC_DISCRETE);
 		}
 	}
-}
-void StatisticsHistory::GetUniqueKeyList(DataStructures::List<RakString> &keys)
-{
-	keys.Clear(true, _FILE_AND_LINE_);
+	if (inputs.Size()==0)
+		return;
 
-	for (unsigned int idx=0; idx < objects.Size(); idx++)
+	tavqOutput->key = keyNames[keyId];
+	tavqOutput->timeToTrackValues = inputs[inputs.Size()-1]->timeToTrackValues;
+	if (dataCategory==StatisticsHistory::DC_DISCRETE)
 	{
-		TrackedObject *to = objects[idx];
-		DataStructures::List<TimeAndValueQueue*> itemList;
-		DataStructures::List<RakNet::RakString> keyList;
-		to->dataQueues.GetAsList(itemList, keyList, _FILE_AND_LINE_);
-		for (unsigned int k=0; k < keyList.Size(); k++)
+		// Every value goes in, so the sums just add
+		for (unsigned int i=0; i < inputs.Size(); i++)
+		{
+			TimeAndValueQueue *tavqInput = inputs[i];
+			tavqOutput->recentSum += tavqInput->recentSum;
+			tavqOutput->recentSumOfSquares += tavqInput->recentSumOfSquares;
+			tavqOutput->recentCount += tavqInput->recentCount;
+			tavqOutput->longTermSum += tavqInput->longTermSum;
+			tavqOutput->longTermCount = tavqOutput->longTermCount + tavqInput->longTermCount;
+			if (tavqInput->longTermLowest < tavqOutput->longTermLowest)
+				tavqOutput->longTermLowest = tavqInput->longTermLowest;
+			if (tavqInput->longTermHighest > tavqOutput->longTermHighest)
+				tavqOutput->longTermHighest = tavqInput->longTermHighest;
+		}
+	}
+	if (totalCount==0)
+	{
+		// No values at full resolution, but there may still be buckets
+		if (dataCategory==StatisticsHistory::DC_DISCRETE)
+			tavqOutput->AssignColumnsAndBuckets(&inputs[0], inputs.Size(), 0, 0, 0);
+		return;
+	}
+
+	// Rather than merging one object at a time, copy every object into one pair of columns, as a sorted run each, then merge the runs together
+	// The first third holds the inputs, the other two are for merging
+	Time *times = RakNet::OP_NEW_ARRAY<Time>(totalCount*3, _FILE_AND_LINE_);
+	SHValueType *vals = RakNet::OP_NEW_ARRAY<SHValueType>(totalCount*3, _FILE_AND_LINE_);
+	DataStructures::List<unsigned int> runStarts;
+	unsigned int runStart=0;
+	for (unsigned int i=0; i < inputs.Size(); i++)
+	{
+		runStarts.Push(runStart, _FILE_AND_LINE_);
+		runStart+=inputs[i]->CopyColumns(times+runStart, vals+runStart, dataCategory, dataCategory!=StatisticsHistory::DC_DISCRETE);
+	}
+	runStarts.Push(totalCount, _FILE_AND_LINE_);
+	DataStructures::List<unsigned int> inputStarts = runStarts;
+
+	memcpy(times+totalCount, times, totalCount*sizeof(Time));
+	memcpy(vals+totalCount, vals, totalCount*sizeof(SHValueType));
+	bool inScratch = MergeRuns(times+totalCount, vals+totalCount, times+totalCount*2, vals+totalCount*2, runStarts);
+	Time *mergedTimes = inScratch ? times+totalCount*2 : times+totalCount;
+	SHValueType *mergedVals = inScratch ? vals+totalCount*2 : vals+totalCount;
+
+	if (dataCategory==StatisticsHistory::DC_DISCRETE)
+	{
+		// Buckets were left out of the columns, and keep their own lowest and highest
+		tavqOutput->AssignColumnsAndBuckets(&inputs[0], inputs.Size(), mergedTimes, mergedVals, totalCount);
+	}
+	else
+	{
+		// One output value per distinct time. Each object adds its value at that time, linearly interpolated between its two nearest values
+		// After its last value an object is extrapolated along its last slope, and before its first it adds nothing
+		unsigned int gridCount=1;
+		for (unsigned int i=1; i < totalCount; i++)
+		{
+			if (mergedTimes[i]!=mergedTimes[gridCount-1])
+				mergedTimes[gridCount++]=mergedTimes[i];
+		}
+		Time *gridTimes = mergedTimes;
+		SHValueType *gridPositions = mergedVals;
+		SHValueType *gridValues = inScratch ? vals+totalCount : vals+totalCount*2;
+		for (unsigned int j=0; j < gridCount; j++)
+		{
+			gridPositions[j] = (SHValueType) gridTimes[j];
+			gridValues[j] = 0;
+		}
+
+		for (unsigned int run=0; run+1 < inputStarts.Size(); run++)
 		{
-			bool hasKey=false;
-			for (unsigned int j=0; j < keys.Size(); j++)
+			unsigned int inputEnd = inputStarts[run+1];
+			unsigned int j=0;
+			SHValueType slope=0;
+			for (unsigned int i=inputStarts[run]; i < inputEnd; i++)
 			{
-				if (keys[j]==keyList[k])
+				if (i==inputStarts[run])
 				{
-					hasKey=true;
-					break;
+					while (j < gridCount && gridTimes[j] < times[i])
+						j++;
 				}
+				unsigned int segmentEnd;
+				if (i+1 < inputEnd)
+				{
+					if (times[i+1]!=times[i])
+						slope = (vals[i+1]-vals[i]) / (SHValueType) (times[i+1]-times[i]);
+					segmentEnd=j;
+					while (segmentEnd < gridCount && gridTimes[segmentEnd] < times[i+1])
+						segmentEnd++;
+				}
+				else
+				{
+					segmentEnd=gridCount;
+				}
+
+				SHValueType segmentStartValue = vals[i];
+				SHValueType segmentStartPosition = (SHValueType) times[i];
+				for (; j < segmentEnd; j++)
+					gridValues[j] += segmentStartValue + slope * (gridPositions[j] - segmentStartPosition);
 			}
+		}
 
-			if (hasKey==false)
-				keys.Push(keyList[k], _FILE_AND_LINE_);
+		// longTerm* values are unknown
+		SHValueType recentSum=0;
+		SHValueType recentSumOfSquares=0;
+		for (unsigned int j=0; j < gridCount; j++)
+		{
+			recentSum += gridValues[j];
+			recentSumOfSquares += gridValues[j] * gridValues[j];
 		}
+		tavqOutput->recentSum = recentSum;
+		tavqOutput->recentSumOfSquares = recentSumOfSquares;
+		tavqOutput->recentCount = gridCount;
+		tavqOutput->AssignColumns(gridTimes, gridValues, gridCount);
 	}
+
+	RakNet::OP_DELETE_ARRAY(times, _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(vals, _FILE_AND_LINE_);
+}
+void StatisticsHistory::SetMaxSamplesPerKey(unsigned int _maxSamplesPerKey)
+{
+	if (_maxSamplesPerKey==0)
+		_maxSamplesPerKey=1;
+	maxSamplesPerKey=_maxSamplesPerKey;
+}
+unsigned int StatisticsHistory::GetMaxSamplesPerKey(void) const {return maxSamplesPerKey;}
+StatisticsHistory::TimeAndValueQueue *StatisticsHistory::GetQueue(TrackedObject *to, unsigned int keyId)
+{
+	while (to->dataQueues.Size() <= keyId)
+		to->dataQueues.Push(0, _FILE_AND_LINE_);
+	TimeAndValueQueue *queue = to->dataQueues[keyId];
+	if (queue==0)
+	{
+		queue = RakNet::OP_NEW<TimeAndValueQueue>(_FILE_AND_LINE_);
+		queue->key=keyNames[keyId];
+		queue->timeToTrackValues = timeToTrack;
+		queue->SetMaxSamples(maxSamplesPerKey);
+		to->dataQueues[keyId]=queue;
+	}
+	return queue;
 }
 StatisticsHistory::TimeAndValueQueue::TimeAndValueQueue()
 {
+	sampleTimes=0;
+	sampleValues=0;
+	sampleCapacity=0;
+	sampleLimit=STATISTICS_HISTORY_MAX_SAMPLES;
+	lowestQueue.sequences=0;
+	highestQueue.sequences=0;
+	for (unsigned int tierIndex=0; tierIndex < DOWNSAMPLED_TIER_COUNT; tierIndex++)
+		tiers[tierIndex].buckets=0;
+	timeToTrackValues=30000;
 	Clear();
 }
-StatisticsHistory::TimeAndValueQueue::~TimeAndValueQueue(){}
+StatisticsHistory::TimeAndValueQueue::TimeAndValueQueue(const TimeAndValueQueue& input)
+{
+	sampleTimes=0;
+	sampleValues=0;
+	sampleCapacity=0;
+	lowestQueue.sequences=0;
+	highestQueue.sequences=0;
+	for (unsigned int tierIndex=0; tierIndex < DOWNSAMPLED_TIER_COUNT; tierIndex++)
+		tiers[tierIndex].buckets=0;
+	*this=input;
+}
+StatisticsHistory::TimeAndValueQueue::~TimeAndValueQueue()
+{
+	FreeMemory();
+}
 void StatisticsHistory::TimeAndValueQueue::SetTimeToTrackValues(Time t)
 {
 	timeToTrackValues = t;
@@ -291,40 +528,55 @@ SHValueType StatisticsHistory::TimeAndValueQueue::GetRecentSumOfSquares(void) co
 SHValueType StatisticsHistory::TimeAndValueQueue::GetLongTermSum(void) const {return longTermSum;}
 SHValueType StatisticsHistory::TimeAndValueQueue::GetRecentAverage(void) const
 {
-	if (values.Size() > 0)
-		return recentSum / (SHValueType) values.Size();
+	if (recentCount > 0)
+		return recentSum / (SHValueType) recentCount;
 	else
 		return 0;
 }
 SHValueType StatisticsHistory::TimeAndValueQueue::GetRecentLowest(void) const
 {
 	SHValueType out = SH_TYPE_MAX;
-	for (unsigned int idx=0; idx < values.Size(); idx++)
+	if (lowestQueue.count > 0)
+		out = sampleValues[SampleIndex(lowestQueue.sequences[lowestQueue.head])];
+	for (unsigned int tierIndex=0; tierIndex < DOWNSAMPLED_TIER_COUNT; tierIndex++)
 	{
-		if (values[idx].val < out)
-			out = values[idx].val;
+		const DownsampledTier &tier = tiers[tierIndex];
+		for (unsigned int i=0; i < tier.count; i++)
+		{
+			if (tier.buckets[(tier.head+i)%STATISTICS_HISTORY_TIER_BUCKETS].lowest < out)
+				out = tier.buckets[(tier.head+i)%STATISTICS_HISTORY_TIER_BUCKETS].lowest;
+		}
 	}
 	return out;
 }
 SHValueType StatisticsHistory::TimeAndValueQueue::GetRecentHighest(void) const
 {
 	SHValueType out = -SH_TYPE_MAX;
-	for (unsigned int idx=0; idx < values.Size(); idx++)
+	if (highestQueue.count > 0)
+		out = sampleValues[SampleIndex(highestQueue.sequences[highestQueue.head])];
+	for (unsigned int tierIndex=0; tierIndex < DOWNSAMPLED_TIER_COUNT; tierIndex++)
 	{
-		if (values[idx].val > out)
-			out = values[idx].val;
+		const DownsampledTier &tier = tiers[tierIndex];
+		for (unsigned int i=0; i < tier.count; i++)
+		{
+			if (tier.buckets[(tier.head+i)%STATISTICS_HISTORY_TIER_BUCKETS].highest > out)
+				out = tier.buckets[(tier.head+i)%STATISTICS_HISTORY_TIER_BUCKETS].highest;
+		}
 	}
 	return out;
 }
 SHValueType StatisticsHistory::TimeAndValueQueue::GetRecentStandardDeviation(void) const
 {
-	if (values.Size()==0)
+	if (recentCount==0)
 		return 0;
 
 	SHValueType recentMean= GetRecentAverage();
 	SHValueType squareOfMean = recentMean * recentMean;
-	SHValueType meanOfSquares = GetRecentSumOfSquares() / (SHValueType) values.Size();
-	return meanOfSquares - squareOfMean;
+	SHValueType meanOfSquares = GetRecentSumOfSquares() / (SHValueType) recentCount;
+	// Rounding can leave the variance slightly negative
+	if (meanOfSquares <= squareOfMean)
+		return 0;
+	return (SHValueType) sqrt(meanOfSquares - squareOfMean);
 }
 SHValueType StatisticsHistory::TimeAndValueQueue::GetLongTermAverage(void) const
 {
@@ -336,27 +588,77 @@ SHValueType StatisticsHistory::TimeAndValueQueue::GetLongTermLowest(void) const
 SHValueType StatisticsHistory::TimeAndValueQueue::GetLongTermHighest(void) const {return longTermHighest;}
 Time StatisticsHistory::TimeAndValueQueue::GetTimeRange(void) const
 {
-	if (values.Size()<2)
-		return 0;
-	return values[values.Size()-1].time - values[0].time;
+	Time oldest=0, newest=0;
+	bool hasValues=false;
+	for (int tierIndex=DOWNSAMPLED_TIER_COUNT-1; tierIndex >= 0 && hasValues==false; tierIndex--)
+	{
+		const DownsampledTier &tier = tiers[tierIndex];
+		if (tier.count > 0)
+		{
+			oldest = tier.buckets[tier.head].firstTime;
+			newest = tier.buckets[(tier.head+tier.count-1)%STATISTICS_HISTORY_TIER_BUCKETS].lastTime;
+			hasValues=true;
+		}
+	}
+	if (sampleCount > 0)
+	{
+		if (hasValues==false)
+			oldest = sampleTimes[sampleHead];
+		newest = sampleTimes[SampleIndex(firstSequence+sampleCount-1)];
+	}
+	return newest - oldest;
 }
 SHValueType StatisticsHistory::TimeAndValueQueue::GetSumSinceTime(Time t) const
 {
 	SHValueType sum = 0;
-	for (int i=values.Size(); i > 0; --i)
+	// Values are in time order, so stop at the first one before t
+	for (unsigned int i=sampleCount; i > 0; --i)
+	{
+		unsigned int idx = (sampleHead+i-1) & (sampleCapacity-1);
+		if (sampleTimes[idx] < t)
+			return sum;
+		sum+=sampleValues[idx];
+	}
+	// Downsampled buckets count only if they start at or after t
+	for (unsigned int tierIndex=0; tierIndex < DOWNSAMPLED_TIER_COUNT; tierIndex++)
 	{
-		if (values[i-1].time>=t)
-			sum+=values[i-1].val;
+		const DownsampledTier &tier = tiers[tierIndex];
+		for (unsigned int i=tier.count; i > 0; --i)
+		{
+			const DownsampledBucket &bucket = tier.buckets[(tier.head+i-1)%STATISTICS_HISTORY_TIER_BUCKETS];
+			if (bucket.firstTime < t)
+				return sum;
+			sum+=bucket.sum;
+		}
 	}
 	return sum;
 }
+unsigned int StatisticsHistory::TimeAndValueQueue::GetRecentCount(void) const {return recentCount;}
+unsigned int StatisticsHistory::TimeAndValueQueue::GetSampleCount(void) const {return sampleCount;}
+StatisticsHistory::TimeAndValue StatisticsHistory::TimeAndValueQueue::GetSample(unsigned int index) const
+{
+	TimeAndValue tav;
+	unsigned int idx = (sampleHead+index) & (sampleCapacity-1);
+	tav.time=sampleTimes[idx];
+	tav.val=sampleValues[idx];
+	return tav;
+}
+void StatisticsHistory::TimeAndValueQueue::SetMaxSamples(unsigned int _maxSamples)
+{
+	if (_maxSamples==0)
+		_maxSamples=1;
+	sampleLimit=_maxSamples;
+	while (sampleCount > sampleLimit)
+		DownsampleOldestSample();
+}
+unsigned int StatisticsHistory::TimeAndValueQueue::GetMaxSamples(void) const {return sampleLimit;}
 void StatisticsHistory::TimeAndValueQueue::MergeSets( const TimeAndValueQueue *lhs, SHDataCategory lhsDataCategory, const TimeAndValueQueue *rhs, SHDataCategory rhsDataCategory, TimeAndValueQueue *output )
 {
 	// Two ways to merge:
 	// 1. Treat rhs as just more data points.
 	// 1A. Sums are just added. If two values have the same time, just put in queue twice
 	// 1B. longTermLowest and longTermHighest are the lowest and highest of the two sets
-	// 
+	//
 	// 2. Add by time. If time for the other set is missing, calculate slope to extrapolate
 	// 2A. Have to recalculate recentSum, recentSumOfSquares.
 	// 2B. longTermSum, longTermCount, longTermLowest, longTermHighest are unknown
@@ -376,45 +678,67 @@ void StatisticsHistory::TimeAndValueQueue::MergeSets( const TimeAndValueQueue *l
 	lhsIndex=0;
 	rhsIndex=0;
 
-	// I use local valuesOutput in case lhs==output || rhs==output
-	DataStructures::Queue<TimeAndValue> valuesOutput;
+	// Copy both sets to columns in case lhs==output || rhs==output
+	// When adding as more data points, the downsampled buckets are copied over as they are. Otherwise they become single values
+	bool bothDiscrete = lhsDataCategory==StatisticsHistory::DC_DISCRETE && rhsDataCategory==StatisticsHistory::DC_DISCRETE;
+	unsigned int lhsCount=lhs->GetColumnCount(bothDiscrete==false);
+	unsigned int rhsCount=rhs->GetColumnCount(bothDiscrete==false);
+	unsigned int outputCount=0;
+	Time *lhsTimes = RakNet::OP_NEW_ARRAY<Time>((lhsCount+rhsCount)*2, _FILE_AND_LINE_);
+	SHValueType *lhsVals = RakNet::OP_NEW_ARRAY<SHValueType>((lhsCount+rhsCount)*2, _FILE_AND_LINE_);
+	Time *rhsTimes = lhsTimes+lhsCount;
+	SHValueType *rhsVals = lhsVals+lhsCount;
+	Time *outputTimes = rhsTimes+rhsCount;
+	SHValueType *outputVals = rhsVals+rhsCount;
+	if (lhsCount+rhsCount > 0)
+	{
+		lhs->CopyColumns(lhsTimes, lhsVals, lhsDataCategory, bothDiscrete==false);
+		rhs->CopyColumns(rhsTimes, rhsVals, rhsDataCategory, bothDiscrete==false);
+	}
 
-	if (lhsDataCategory==StatisticsHistory::DC_DISCRETE && rhsDataCategory==StatisticsHistory::DC_DISCRETE)
+	if (bothDiscrete)
 	{
-		while (rhsIndex < rhs->values.Size() && lhsIndex < lhs->values.Size())
+		while (rhsIndex < rhsCount && lhsIndex < lhsCount)
 		{
-			if (rhs->values[rhsIndex].time < lhs->values[lhsIndex].time)
+			if (rhsTimes[rhsIndex] < lhsTimes[lhsIndex])
 			{
-				valuesOutput.Push(rhs->values[rhsIndex], _FILE_AND_LINE_ );
+				outputTimes[outputCount]=rhsTimes[rhsIndex];
+				outputVals[outputCount++]=rhsVals[rhsIndex];
 				rhsIndex++;
 			}
-			else if (rhs->values[rhsIndex].time > lhs->values[lhsIndex].time)
+			else if (rhsTimes[rhsIndex] > lhsTimes[lhsIndex])
 			{
-				valuesOutput.Push(lhs->values[rhsIndex], _FILE_AND_LINE_ );
+				outputTimes[outputCount]=lhsTimes[lhsIndex];
+				outputVals[outputCount++]=lhsVals[lhsIndex];
 				lhsIndex++;
 			}
 			else
 			{
-				valuesOutput.Push(rhs->values[rhsIndex], _FILE_AND_LINE_ );
+				outputTimes[outputCount]=rhsTimes[rhsIndex];
+				outputVals[outputCount++]=rhsVals[rhsIndex];
 				rhsIndex++;
-				valuesOutput.Push(lhs->values[rhsIndex], _FILE_AND_LINE_ );
+				outputTimes[outputCount]=lhsTimes[lhsIndex];
+				outputVals[outputCount++]=lhsVals[lhsIndex];
 				lhsIndex++;
 			}
 		}
 
-		while (rhsIndex < rhs->values.Size())
+		while (rhsIndex < rhsCount)
 		{
-			valuesOutput.Push(rhs->values[rhsIndex], _FILE_AND_LINE_ );
+			outputTimes[outputCount]=rhsTimes[rhsIndex];
+			outputVals[outputCount++]=rhsVals[rhsIndex];
 			rhsIndex++;
 		}
-		while (lhsIndex < lhs->values.Size())
+		while (lhsIndex < lhsCount)
 		{
-			valuesOutput.Push(lhs->values[lhsIndex], _FILE_AND_LINE_ );
+			outputTimes[outputCount]=lhsTimes[lhsIndex];
+			outputVals[outputCount++]=lhsVals[lhsIndex];
 			lhsIndex++;
 		}
 
 		output->recentSum = lhs->recentSum + rhs->recentSum;
 		output->recentSumOfSquares = lhs->recentSumOfSquares + rhs->recentSumOfSquares;
+		output->recentCount = lhs->recentCount + rhs->recentCount;
 		output->longTermSum = lhs->longTermSum + rhs->longTermSum;
 		output->longTermCount = lhs->longTermCount + rhs->longTermCount;
 		if (lhs->longTermLowest < rhs->longTermLowest)
@@ -437,89 +761,112 @@ void StatisticsHistory::TimeAndValueQueue::MergeSets( const TimeAndValueQueue *l
 		SHValueType lastSlopeRhs=0;
 		Time timeSinceOppositeValue;
 
-		TimeAndValue newTimeAndValue;
-
-		while (rhsIndex < rhs->values.Size() && lhsIndex < lhs->values.Size())
+		while (rhsIndex < rhsCount && lhsIndex < lhsCount)
 		{
-			if (rhs->values[rhsIndex].time < lhs->values[lhsIndex].time)
+			if (rhsTimes[rhsIndex] < lhsTimes[lhsIndex])
 			{
-				timeSinceOppositeValue = rhs->values[rhsIndex].time - lastTimeAndValueLhs.time;
-				newTimeAndValue.val = rhs->values[rhsIndex].val + lastTimeAndValueLhs.val + lastSlopeLhs * timeSinceOppositeValue;
-				newTimeAndValue.time = rhs->values[rhsIndex].time;
-				lastTimeAndValueRhs = rhs->values[rhsIndex];
-				if (rhsIndex>0 && rhs->values[rhsIndex].time != rhs->values[rhsIndex-1].time && rhsDataCategory==StatisticsHistory::DC_CONTINUOUS)
-					lastSlopeRhs = (rhs->values[rhsIndex].val - rhs->values[rhsIndex-1].val) / (SHValueType) (rhs->values[rhsIndex].time - rhs->values[rhsIndex-1].time);
+				timeSinceOppositeValue = rhsTimes[rhsIndex] - lastTimeAndValueLhs.time;
+				outputVals[outputCount] = rhsVals[rhsIndex] + lastTimeAndValueLhs.val + lastSlopeLhs * timeSinceOppositeValue;
+				outputTimes[outputCount] = rhsTimes[rhsIndex];
+				lastTimeAndValueRhs.time = rhsTimes[rhsIndex];
+				lastTimeAndValueRhs.val = rhsVals[rhsIndex];
+				if (rhsIndex>0 && rhsTimes[rhsIndex] != rhsTimes[rhsIndex-1] && rhsDataCategory==StatisticsHistory::DC_CONTINUOUS)
+					lastSlopeRhs = (rhsVals[rhsIndex] - rhsVals[rhsIndex-1]) / (SHValueType) (rhsTimes[rhsIndex] - rhsTimes[rhsIndex-1]);
 				rhsIndex++;
 			}
-			else if (lhs->values[lhsIndex].time < rhs->values[rhsIndex].time)
+			else if (lhsTimes[lhsIndex] < rhsTimes[rhsIndex])
 			{
-				timeSinceOppositeValue = lhs->values[lhsIndex].time - lastTimeAndValueRhs.time;
-				newTimeAndValue.val = lhs->values[lhsIndex].val + lastTimeAndValueRhs.val + lastSlopeRhs * timeSinceOppositeValue;
-				newTimeAndValue.time = lhs->values[lhsIndex].time;
-				lastTimeAndValueLhs = lhs->values[lhsIndex];
-				if (lhsIndex>0 && lhs->values[lhsIndex].time != lhs->values[lhsIndex-1].time && lhsDataCategory==StatisticsHistory::DC_CONTINUOUS)
-					lastSlopeLhs = (lhs->values[lhsIndex].val - lhs->values[lhsIndex-1].val) / (SHValueType) (lhs->values[lhsIndex].time - lhs->values[lhsIndex-1].time);
+				timeSinceOppositeValue = lhsTimes[lhsIndex] - lastTimeAndValueRhs.time;
+				outputVals[outputCount] = lhsVals[lhsIndex] + lastTimeAndValueRhs.val + lastSlopeRhs * timeSinceOppositeValue;
+				outputTimes[outputCount] = lhsTimes[lhsIndex];
+				lastTimeAndValueLhs.time = lhsTimes[lhsIndex];
+				lastTimeAndValueLhs.val = lhsVals[lhsIndex];
+				if (lhsIndex>0 && lhsTimes[lhsIndex] != lhsTimes[lhsIndex-1] && lhsDataCategory==StatisticsHistory::DC_CONTINUOUS)
+					lastSlopeLhs = (lhsVals[lhsIndex] - lhsVals[lhsIndex-1]) / (SHValueType) (lhsTimes[lhsIndex] - lhsTimes[lhsIndex-1]);
 				lhsIndex++;
 			}
 			else
 			{
-				newTimeAndValue.val = lhs->values[lhsIndex].val + rhs->values[rhsIndex].val;
-				newTimeAndValue.time = lhs->values[lhsIndex].time;
-				lastTimeAndValueRhs = rhs->values[rhsIndex];
-				lastTimeAndValueLhs = lhs->values[lhsIndex];
-				if (rhsIndex>0 && rhs->values[rhsIndex].time != rhs->values[rhsIndex-1].time && rhsDataCategory==StatisticsHistory::DC_CONTINUOUS)
-					lastSlopeRhs = (rhs->values[rhsIndex].val - rhs->values[rhsIndex-1].val) / (SHValueType) (rhs->values[rhsIndex].time - rhs->values[rhsIndex-1].time);
-				if (lhsIndex>0 && lhs->values[lhsIndex].time != lhs->values[lhsIndex-1].time && lhsDataCategory==StatisticsHistory::DC_CONTINUOUS)
-					lastSlopeLhs = (lhs->values[lhsIndex].val - lhs->values[lhsIndex-1].val) / (SHValueType) (lhs->values[lhsIndex].time - lhs->values[lhsIndex-1].time);
+				outputVals[outputCount] = lhsVals[lhsIndex] + rhsVals[rhsIndex];
+				outputTimes[outputCount] = lhsTimes[lhsIndex];
+				lastTimeAndValueRhs.time = rhsTimes[rhsIndex];
+				lastTimeAndValueRhs.val = rhsVals[rhsIndex];
+				lastTimeAndValueLhs.time = lhsTimes[lhsIndex];
+				lastTimeAndValueLhs.val = lhsVals[lhsIndex];
+				if (rhsIndex>0 && rhsTimes[rhsIndex] != rhsTimes[rhsIndex-1] && rhsDataCategory==StatisticsHistory::DC_CONTINUOUS)
+					lastSlopeRhs = (rhsVals[rhsIndex] - rhsVals[rhsIndex-1]) / (SHValueType) (rhsTimes[rhsIndex] - rhsTimes[rhsIndex-1]);
+				if (lhsIndex>0 && lhsTimes[lhsIndex] != lhsTimes[lhsIndex-1] && lhsDataCategory==StatisticsHistory::DC_CONTINUOUS)
+					lastSlopeLhs = (lhsVals[lhsIndex] - lhsVals[lhsIndex-1]) / (SHValueType) (lhsTimes[lhsIndex] - lhsTimes[lhsIndex-1]);
 				lhsIndex++;
 				rhsIndex++;
 			}
 
-			valuesOutput.Push(newTimeAndValue, _FILE_AND_LINE_ );
+			outputCount++;
 		}
 
-		while (rhsIndex < rhs->values.Size())
+		while (rhsIndex < rhsCount)
 		{
-			timeSinceOppositeValue = rhs->values[rhsIndex].time - lastTimeAndValueLhs.time;
-			newTimeAndValue.val = rhs->values[rhsIndex].val + lastTimeAndValueLhs.val + lastSlopeLhs * timeSinceOppositeValue;
-			newTimeAndValue.time = rhs->values[rhsIndex].time;
-			valuesOutput.Push(newTimeAndValue, _FILE_AND_LINE_ );
+			timeSinceOppositeValue = rhsTimes[rhsIndex] - lastTimeAndValueLhs.time;
+			outputVals[outputCount] = rhsVals[rhsIndex] + lastTimeAndValueLhs.val + lastSlopeLhs * timeSinceOppositeValue;
+			outputTimes[outputCount++] = rhsTimes[rhsIndex];
 			rhsIndex++;
 		}
-		while (lhsIndex < lhs->values.Size())
+		while (lhsIndex < lhsCount)
 		{
-			timeSinceOppositeValue = lhs->values[lhsIndex].time - lastTimeAndValueRhs.time;
-			newTimeAndValue.val = lhs->values[lhsIndex].val + lastTimeAndValueRhs.val + lastSlopeRhs * timeSinceOppositeValue;
-			newTimeAndValue.time = lhs->values[lhsIndex].time;
-			valuesOutput.Push(newTimeAndValue, _FILE_AND_LINE_ );
+			timeSinceOppositeValue = lhsTimes[lhsIndex] - lastTimeAndValueRhs.time;
+			outputVals[outputCount] = lhsVals[lhsIndex] + lastTimeAndValueRhs.val + lastSlopeRhs * timeSinceOppositeValue;
+			outputTimes[outputCount++] = lhsTimes[lhsIndex];
 			lhsIndex++;
 		}
 
 		output->recentSum = 0;
 		output->recentSumOfSquares = 0;
-		for (unsigned int i=0; i < valuesOutput.Size(); i++)
+		for (unsigned int i=0; i < outputCount; i++)
 		{
-			output->recentSum += valuesOutput[i].val;
-			output->recentSumOfSquares += valuesOutput[i].val * valuesOutput[i].val;
+			output->recentSum += outputVals[i];
+			output->recentSumOfSquares += outputVals[i] * outputVals[i];
 		}
+		output->recentCount = outputCount;
 	}
 
-	output->values = valuesOutput;
+	if (bothDiscrete)
+	{
+		const TimeAndValueQueue *inputs[2] = {lhs, rhs};
+		output->AssignColumnsAndBuckets(inputs, 2, outputTimes, outputVals, outputCount);
+	}
+	else
+	{
+		output->AssignColumns(outputTimes, outputVals, outputCount);
+	}
+	RakNet::OP_DELETE_ARRAY(lhsTimes, _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(lhsVals, _FILE_AND_LINE_);
 }
 void StatisticsHistory::TimeAndValueQueue::ResizeSampleSet( int maxSamples, DataStructures::Queue<StatisticsHistory::TimeAndValue> &histogram, SHDataCategory dataCategory, Time timeClipStart, Time timeClipEnd )
 {
 	histogram.Clear(_FILE_AND_LINE_);
 	if (maxSamples==0)
 		return;
-	Time timeRange = GetTimeRange();
+	unsigned int count = GetColumnCount(true);
+	if (count<2)
+		return;
+	Time *times = RakNet::OP_NEW_ARRAY<Time>(count, _FILE_AND_LINE_);
+	SHValueType *vals = RakNet::OP_NEW_ARRAY<SHValueType>(count, _FILE_AND_LINE_);
+	CopyColumns(times, vals, dataCategory, true);
+	Time timeRange = times[count-1] - times[0];
 	if (timeRange==0)
+	{
+		RakNet::OP_DELETE_ARRAY(times, _FILE_AND_LINE_);
+		RakNet::OP_DELETE_ARRAY(vals, _FILE_AND_LINE_);
 		return;
+	}
 	if (maxSamples==1)
 	{
 		StatisticsHistory::TimeAndValue tav;
 		tav.time = timeRange;
 		tav.val = GetRecentSum();
 		histogram.Push(tav, _FILE_AND_LINE_);
+		RakNet::OP_DELETE_ARRAY(times, _FILE_AND_LINE_);
+		RakNet::OP_DELETE_ARRAY(vals, _FILE_AND_LINE_);
 		return;
 	}
 	Time interval = timeRange / maxSamples;
@@ -528,22 +875,20 @@ void StatisticsHistory::TimeAndValueQueue::ResizeSampleSet( int maxSamples, Data
 	unsigned int dataIndex;
 	Time timeBoundary;
 	StatisticsHistory::TimeAndValue currentSum;
-	Time currentTime;
 	SHValueType numSamples;
 	Time endTime;
-	
+
 	numSamples=0;
-	endTime = values[values.Size()-1].time;
+	endTime = times[count-1];
 	dataIndex=0;
-	currentTime=values[0].time;
 	currentSum.val=0;
-	currentSum.time=values[0].time + interval / 2;
-	timeBoundary = values[0].time + interval;
+	currentSum.time=times[0] + interval / 2;
+	timeBoundary = times[0] + interval;
 	while (timeBoundary <= endTime)
 	{
-		while (dataIndex < values.Size() && values[dataIndex].time <= timeBoundary)
+		while (dataIndex < count && times[dataIndex] <= timeBoundary)
 		{
-			currentSum.val += values[dataIndex].val;
+			currentSum.val += vals[dataIndex];
 			dataIndex++;
 			numSamples++;
 		}
@@ -551,11 +896,16 @@ void StatisticsHistory::TimeAndValueQueue::ResizeSampleSet( int maxSamples, Data
 		if (dataCategory==DC_CONTINUOUS)
 		{
 			if (dataIndex > 0 &&
-				dataIndex < values.Size() &&
-				values[dataIndex-1].time < timeBoundary &&
-				values[dataIndex].time > timeBoundary)
+				dataIndex < count &&
+				times[dataIndex-1] < timeBoundary &&
+				times[dataIndex] > timeBoundary)
 			{
-				SHValueType interpolatedValue = Interpolate(values[dataIndex-1], values[dataIndex], timeBoundary);
+				StatisticsHistory::TimeAndValue t1, t2;
+				t1.time=times[dataIndex-1];
+				t1.val=vals[dataIndex-1];
+				t2.time=times[dataIndex];
+				t2.val=vals[dataIndex];
+				SHValueType interpolatedValue = Interpolate(t1, t2, timeBoundary);
 				currentSum.val+=interpolatedValue;
 				numSamples++;
 			}
@@ -572,8 +922,10 @@ void StatisticsHistory::TimeAndValueQueue::ResizeSampleSet( int maxSamples, Data
 		currentSum.val=0;
 		numSamples=0;
 	}
+	RakNet::OP_DELETE_ARRAY(times, _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(vals, _FILE_AND_LINE_);
+
 
-	
 	if ( timeClipStart!=0 && histogram.Size()>=1)
 	{
 		timeClipStart = histogram.Peek().time+timeClipStart;
@@ -636,16 +988,88 @@ void StatisticsHistory::TimeAndValueQueue::ResizeSampleSet( int maxSamples, Data
 		}
 	}
 }
+void StatisticsHistory::TimeAndValueQueue::AddValue(SHValueType val, Time curTime, bool combineEqualTimes)
+{
+	if (combineEqualTimes==true && sampleCount>0 && sampleTimes[SampleIndex(firstSequence+sampleCount-1)]==curTime)
+	{
+		SHValueType newest = sampleValues[SampleIndex(firstSequence+sampleCount-1)];
+		PopNewestSample();
+
+		recentSum -= newest;
+		recentSumOfSquares -= newest * newest;
+		recentCount--;
+		longTermSum -= newest;
+		longTermCount = longTermCount - 1;
+		val+=newest;
+	}
+	else
+	{
+		while (sampleCount >= sampleLimit)
+			DownsampleOldestSample();
+	}
+
+	PushSample(curTime, val);
+
+	recentSum += val;
+	recentSumOfSquares += val * val;
+	recentCount++;
+	longTermSum += val;
+	longTermCount = longTermCount + 1;
+	if (longTermLowest > val)
+		longTermLowest = val;
+	if (longTermHighest < val)
+		longTermHighest = val;
+}
 void StatisticsHistory::TimeAndValueQueue::CullExpiredValues(Time curTime)
 {
-	while (values.Size())
+	// Oldest first, so the coarsest tier first
+	for (int tierIndex=DOWNSAMPLED_TIER_COUNT-1; tierIndex >= 0; tierIndex--)
+	{
+		DownsampledTier &tier = tiers[tierIndex];
+		while (tier.count > 0 && curTime - tier.buckets[tier.head].lastTime > timeToTrackValues)
+		{
+			DropBucket(tier.buckets[tier.head]);
+			tier.head=(tier.head+1)%STATISTICS_HISTORY_TIER_BUCKETS;
+			tier.count--;
+		}
+
+		// Buckets that have only partly expired lose that part of their values, as if they were evenly spread over the bucket's times
+		for (unsigned int i=0; i < tier.count; i++)
+		{
+			DownsampledBucket &bucket = tier.buckets[(tier.head+i)%STATISTICS_HISTORY_TIER_BUCKETS];
+			if (curTime - bucket.firstTime <= timeToTrackValues)
+				break;
+			Time span = bucket.lastTime - bucket.firstTime;
+			Time expiredSpan = curTime - timeToTrackValues - bucket.firstTime;
+			unsigned int expiredCount = (unsigned int) ((SHValueType) bucket.count * (SHValueType) expiredSpan / (SHValueType) span + (SHValueType) .5);
+			// The newest value has not expired
+			if (expiredCount >= bucket.count)
+				expiredCount = bucket.count-1;
+			if (expiredCount==0)
+				continue;
+			SHValueType expiredFraction = (SHValueType) expiredCount / (SHValueType) bucket.count;
+			DownsampledBucket expired;
+			expired.sum = bucket.sum * expiredFraction;
+			expired.sumOfSquares = bucket.sumOfSquares * expiredFraction;
+			expired.count = expiredCount;
+			DropBucket(expired);
+			bucket.sum -= expired.sum;
+			bucket.sumOfSquares -= expired.sumOfSquares;
+			bucket.count -= expiredCount;
+			// Only move up by the part whose values were removed, so small steps are not lost to rounding
+			bucket.firstTime += (Time) ((SHValueType) span * expiredFraction);
+		}
+	}
+
+	while (sampleCount)
 	{
-		StatisticsHistory::TimeAndValue tav = values.Peek();
-		if (curTime - tav.time > timeToTrackValues)
+		if (curTime - sampleTimes[sampleHead] > timeToTrackValues)
 		{
-			recentSum -= tav.val;
-			recentSumOfSquares -= tav.val * tav.val;
-			values.Pop();
+			SHValueType val = sampleValues[sampleHead];
+			recentSum -= val;
+			recentSumOfSquares -= val * val;
+			recentCount--;
+			PopOldestSample();
 		}
 		else
 		{
@@ -672,32 +1096,361 @@ void StatisticsHistory::TimeAndValueQueue::Clear(void)
 {
 	recentSum = 0;
 	recentSumOfSquares = 0;
+	recentCount = 0;
 	longTermSum = 0;
 	longTermCount = 0;
 	longTermLowest = SH_TYPE_MAX;
 	longTermHighest = -SH_TYPE_MAX;
-	values.Clear(_FILE_AND_LINE_);
+	// Keeps the memory, as the same queue is usually filled again
+	sampleHead = 0;
+	sampleCount = 0;
+	firstSequence = 0;
+	lowestQueue.head = 0;
+	lowestQueue.count = 0;
+	highestQueue.head = 0;
+	highestQueue.count = 0;
+	for (unsigned int tierIndex=0; tierIndex < DOWNSAMPLED_TIER_COUNT; tierIndex++)
+	{
+		tiers[tierIndex].head = 0;
+		tiers[tierIndex].count = 0;
+	}
 }
 StatisticsHistory::TimeAndValueQueue& StatisticsHistory::TimeAndValueQueue::operator = ( const TimeAndValueQueue& input )
 {
-	values=input.values;
+	if (&input == this)
+		return *this;
+
+	Clear();
+	sampleLimit=input.sampleLimit;
+	if (input.sampleCount > sampleCapacity)
+		GrowSamples(input.sampleCapacity);
+	for (unsigned int i=0; i < input.sampleCount; i++)
+	{
+		TimeAndValue tav = input.GetSample(i);
+		PushSample(tav.time, tav.val);
+	}
+	for (unsigned int tierIndex=0; tierIndex < DOWNSAMPLED_TIER_COUNT; tierIndex++)
+	{
+		const DownsampledTier &inputTier = input.tiers[tierIndex];
+		if (inputTier.count > 0 && tiers[tierIndex].buckets==0)
+			tiers[tierIndex].buckets = RakNet::OP_NEW_ARRAY<DownsampledBucket>(STATISTICS_HISTORY_TIER_BUCKETS, _FILE_AND_LINE_);
+		for (unsigned int i=0; i < inputTier.count; i++)
+			tiers[tierIndex].buckets[i] = inputTier.buckets[(inputTier.head+i)%STATISTICS_HISTORY_TIER_BUCKETS];
+		tiers[tierIndex].count = inputTier.count;
+	}
+
 	timeToTrackValues=input.timeToTrackValues;
 	key=input.key;
 	recentSum=input.recentSum;
 	recentSumOfSquares=input.recentSumOfSquares;
+	recentCount=input.recentCount;
 	longTermSum=input.longTermSum;
 	longTermCount=input.longTermCount;
 	longTermLowest=input.longTermLowest;
 	longTermHighest=input.longTermHighest;
 	return *this;
 }
+unsigned int StatisticsHistory::TimeAndValueQueue::GetColumnCount(bool includeBuckets) const
+{
+	unsigned int count = sampleCount;
+	if (includeBuckets)
+	{
+		for (unsigned int tierIndex=0; tierIndex < DOWNSAMPLED_TIER_COUNT; tierIndex++)
+			count += tiers[tierIndex].count;
+	}
+	return count;
+}
+unsigned int StatisticsHistory::TimeAndValueQueue::CopyColumns(Time *times, SHValueType *vals, SHDataCategory dataCategory, bool includeBuckets) const
+{
+	unsigned int count=0;
+	for (int tierIndex=DOWNSAMPLED_TIER_COUNT-1; includeBuckets && tierIndex >= 0; tierIndex--)
+	{
+		const DownsampledTier &tier = tiers[tierIndex];
+		for (unsigned int i=0; i < tier.count; i++)
+		{
+			const DownsampledBucket &bucket = tier.buckets[(tier.head+i)%STATISTICS_HISTORY_TIER_BUCKETS];
+			times[count] = bucket.firstTime + (bucket.lastTime - bucket.firstTime) / 2;
+			// Buckets from merged queues can overlap, so keep the times in order
+			if (count > 0 && times[count] < times[count-1])
+				times[count] = times[count-1];
+			if (dataCategory==DC_DISCRETE)
+				vals[count] = bucket.sum;
+			else
+				vals[count] = bucket.sum / (SHValueType) bucket.count;
+			count++;
+		}
+	}
+
+	// The ring is at most two runs
+	if (sampleCount > 0)
+	{
+		unsigned int firstRun = sampleCapacity - sampleHead;
+		if (firstRun > sampleCount)
+			firstRun = sampleCount;
+		memcpy(times+count, sampleTimes+sampleHead, firstRun*sizeof(Time));
+		memcpy(vals+count, sampleValues+sampleHead, firstRun*sizeof(SHValueType));
+		memcpy(times+count+firstRun, sampleTimes, (sampleCount-firstRun)*sizeof(Time));
+		memcpy(vals+count+firstRun, sampleValues, (sampleCount-firstRun)*sizeof(SHValueType));
+		count += sampleCount;
+	}
+	return count;
+}
+void StatisticsHistory::TimeAndValueQueue::AssignColumns(const Time *times, const SHValueType *vals, unsigned int count)
+{
+	sampleHead = 0;
+	sampleCount = 0;
+	firstSequence = 0;
+	lowestQueue.head = 0;
+	lowestQueue.count = 0;
+	highestQueue.head = 0;
+	highestQueue.count = 0;
+	for (unsigned int tierIndex=0; tierIndex < DOWNSAMPLED_TIER_COUNT; tierIndex++)
+	{
+		tiers[tierIndex].head = 0;
+		tiers[tierIndex].count = 0;
+	}
+
+	if (count > sampleCapacity)
+	{
+		unsigned int newCapacity = sampleCapacity==0 ? 16 : sampleCapacity;
+		while (newCapacity < count)
+			newCapacity *= 2;
+		GrowSamples(newCapacity);
+	}
+	for (unsigned int i=0; i < count; i++)
+		PushSample(times[i], vals[i]);
+}
+void StatisticsHistory::TimeAndValueQueue::AssignColumnsAndBuckets(const TimeAndValueQueue *const *inputs, unsigned int inputCount, const Time *times, const SHValueType *vals, unsigned int count)
+{
+	// Copy the buckets before assigning, in case this queue is one of the inputs
+	DataStructures::List<DownsampledBucket> buckets;
+	Time bucketsEnd=0;
+	for (unsigned int inputIndex=0; inputIndex < inputCount; inputIndex++)
+	{
+		for (unsigned int tierIndex=0; tierIndex < DOWNSAMPLED_TIER_COUNT; tierIndex++)
+		{
+			const DownsampledTier &tier = inputs[inputIndex]->tiers[tierIndex];
+			for (unsigned int i=0; i < tier.count; i++)
+			{
+				const DownsampledBucket &bucket = tier.buckets[(tier.head+i)%STATISTICS_HISTORY_TIER_BUCKETS];
+				buckets.Push(bucket, _FILE_AND_LINE_);
+				if (bucketsEnd < bucket.lastTime)
+					bucketsEnd = bucket.lastTime;
+			}
+		}
+	}
+
+	// The ring must stay newer than every bucket, so values from other inputs that are not become buckets of one value
+	unsigned int firstInRing=0;
+	if (buckets.Size() > 0)
+	{
+		for (; firstInRing < count && times[firstInRing] <= bucketsEnd; firstInRing++)
+		{
+			DownsampledBucket bucket;
+			bucket.firstTime = times[firstInRing];
+			bucket.lastTime = times[firstInRing];
+			bucket.sum = vals[firstInRing];
+			bucket.sumOfSquares = vals[firstInRing] * vals[firstInRing];
+			bucket.lowest = vals[firstInRing];
+			bucket.highest = vals[firstInRing];
+			bucket.count = 1;
+			buckets.Push(bucket, _FILE_AND_LINE_);
+		}
+	}
+
+	AssignColumns(times+firstInRing, vals+firstInRing, count-firstInRing);
+	if (buckets.Size() > 1)
+		qsort(&buckets[0], buckets.Size(), sizeof(DownsampledBucket), BucketFirstTimeComp);
+	for (unsigned int i=0; i < buckets.Size(); i++)
+		FoldIntoTier(0, buckets[i]);
+}
+unsigned int StatisticsHistory::TimeAndValueQueue::SampleIndex(unsigned int sequence) const
+{
+	return (sampleHead + (sequence - firstSequence)) & (sampleCapacity-1);
+}
+void StatisticsHistory::TimeAndValueQueue::PushSample(Time time, SHValueType val)
+{
+	if (sampleCount==sampleCapacity)
+		GrowSamples(sampleCapacity==0 ? 16 : sampleCapacity*2);
+
+	unsigned int idx = (sampleHead+sampleCount) & (sampleCapacity-1);
+	sampleTimes[idx]=time;
+	sampleValues[idx]=val;
+	sampleCount++;
+	PushExtreme(lowestQueue, firstSequence+sampleCount-1, true);
+	PushExtreme(highestQueue, firstSequence+sampleCount-1, false);
+}
+void StatisticsHistory::TimeAndValueQueue::PopOldestSample(void)
+{
+	// If the oldest value is in an extreme queue, it is at the front
+	if (lowestQueue.count > 0 && lowestQueue.sequences[lowestQueue.head]==firstSequence)
+	{
+		lowestQueue.head=(lowestQueue.head+1) & (sampleCapacity-1);
+		lowestQueue.count--;
+	}
+	if (highestQueue.count > 0 && highestQueue.sequences[highestQueue.head]==firstSequence)
+	{
+		highestQueue.head=(highestQueue.head+1) & (sampleCapacity-1);
+		highestQueue.count--;
+	}
+	sampleHead=(sampleHead+1) & (sampleCapacity-1);
+	sampleCount--;
+	firstSequence++;
+}
+void StatisticsHistory::TimeAndValueQueue::PopNewestSample(void)
+{
+	// The newest value is at the back of both extreme queues. Values it pushed out of a queue belong back in once it is gone, so add them again
+	unsigned int sequence = firstSequence+sampleCount-1;
+	ExtremeQueue *extremeQueues[2] = {&lowestQueue, &highestQueue};
+	for (int i=0; i < 2; i++)
+	{
+		ExtremeQueue &extremes = *extremeQueues[i];
+		extremes.count--;
+		unsigned int next = extremes.count > 0 ? extremes.sequences[(extremes.head+extremes.count-1) & (sampleCapacity-1)]+1 : firstSequence;
+		for (; next!=sequence; next++)
+			PushExtreme(extremes, next, i==0);
+	}
+	sampleCount--;
+}
+void StatisticsHistory::TimeAndValueQueue::DownsampleOldestSample(void)
+{
+	DownsampledBucket bucket;
+	bucket.firstTime = sampleTimes[sampleHead];
+	bucket.lastTime = bucket.firstTime;
+	bucket.sum = sampleValues[sampleHead];
+	bucket.sumOfSquares = bucket.sum * bucket.sum;
+	bucket.lowest = bucket.sum;
+	bucket.highest = bucket.sum;
+	bucket.count = 1;
+	PopOldestSample();
+	// Still part of the recent statistics, until CullExpiredValues() drops the bucket
+	FoldIntoTier(0, bucket);
+}
+void StatisticsHistory::TimeAndValueQueue::GrowSamples(unsigned int newCapacity)
+{
+	Time *newTimes = RakNet::OP_NEW_ARRAY<Time>(newCapacity, _FILE_AND_LINE_);
+	SHValueType *newValues = RakNet::OP_NEW_ARRAY<SHValueType>(newCapacity, _FILE_AND_LINE_);
+	unsigned int *newLowest = RakNet::OP_NEW_ARRAY<unsigned int>(newCapacity, _FILE_AND_LINE_);
+	unsigned int *newHighest = RakNet::OP_NEW_ARRAY<unsigned int>(newCapacity, _FILE_AND_LINE_);
+	unsigned int mask = sampleCapacity-1;
+	for (unsigned int i=0; i < sampleCount; i++)
+	{
+		newTimes[i]=sampleTimes[(sampleHead+i) & mask];
+		newValues[i]=sampleValues[(sampleHead+i) & mask];
+	}
+	for (unsigned int i=0; i < lowestQueue.count; i++)
+		newLowest[i]=lowestQueue.sequences[(lowestQueue.head+i) & mask];
+	for (unsigned int i=0; i < highestQueue.count; i++)
+		newHighest[i]=highestQueue.sequences[(highestQueue.head+i) & mask];
+
+	RakNet::OP_DELETE_ARRAY(sampleTimes, _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(sampleValues, _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(lowestQueue.sequences, _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(highestQueue.sequences, _FILE_AND_LINE_);
+	sampleTimes=newTimes;
+	sampleValues=newValues;
+	lowestQueue.sequences=newLowest;
+	highestQueue.sequences=newHighest;
+	sampleHead=0;
+	lowestQueue.head=0;
+	highestQueue.head=0;
+	sampleCapacity=newCapacity;
+}
+void StatisticsHistory::TimeAndValueQueue::PushExtreme(ExtremeQueue &extremes, unsigned int sequence, bool lowest)
+{
+	// Values behind this one that are not lower (or higher) can never be the lowest (or highest) again
+	unsigned int mask = sampleCapacity-1;
+	SHValueType val = sampleValues[SampleIndex(sequence)];
+	while (extremes.count > 0)
+	{
+		SHValueType back = sampleValues[SampleIndex(extremes.sequences[(extremes.head+extremes.count-1) & mask])];
+		if (lowest ? back < val : back > val)
+			break;
+		extremes.count--;
+	}
+	extremes.sequences[(extremes.head+extremes.count) & mask]=sequence;
+	extremes.count++;
+}
+void StatisticsHistory::TimeAndValueQueue::FoldIntoTier(unsigned int tierIndex, const DownsampledBucket &bucket)
+{
+	DownsampledTier &tier = tiers[tierIndex];
+	if (tier.buckets==0)
+	{
+		tier.buckets = RakNet::OP_NEW_ARRAY<DownsampledBucket>(STATISTICS_HISTORY_TIER_BUCKETS, _FILE_AND_LINE_);
+		tier.head=0;
+		tier.count=0;
+	}
+
+	Time interval = GetTierInterval(tierIndex);
+	if (tier.count > 0)
+	{
+		DownsampledBucket &newest = tier.buckets[(tier.head+tier.count-1)%STATISTICS_HISTORY_TIER_BUCKETS];
+		if (bucket.firstTime / interval <= newest.firstTime / interval)
+		{
+			// Same interval as the newest bucket
+			if (newest.lastTime < bucket.lastTime)
+				newest.lastTime = bucket.lastTime;
+			newest.sum += bucket.sum;
+			newest.sumOfSquares += bucket.sumOfSquares;
+			if (newest.lowest > bucket.lowest)
+				newest.lowest = bucket.lowest;
+			if (newest.highest < bucket.highest)
+				newest.highest = bucket.highest;
+			newest.count += bucket.count;
+			return;
+		}
+	}
+
+	if (tier.count==STATISTICS_HISTORY_TIER_BUCKETS)
+	{
+		DownsampledBucket oldest = tier.buckets[tier.head];
+		tier.head=(tier.head+1)%STATISTICS_HISTORY_TIER_BUCKETS;
+		tier.count--;
+		if (tierIndex+1 < DOWNSAMPLED_TIER_COUNT)
+			FoldIntoTier(tierIndex+1, oldest);
+		else
+			DropBucket(oldest);
+	}
+	tier.buckets[(tier.head+tier.count)%STATISTICS_HISTORY_TIER_BUCKETS]=bucket;
+	tier.count++;
+}
+void StatisticsHistory::TimeAndValueQueue::DropBucket(const DownsampledBucket &bucket)
+{
+	recentSum -= bucket.sum;
+	recentSumOfSquares -= bucket.sumOfSquares;
+	recentCount -= bucket.count;
+}
+int StatisticsHistory::TimeAndValueQueue::BucketFirstTimeComp(const void *lhs, const void *rhs)
+{
+	Time lhsTime = ((const DownsampledBucket *) lhs)->firstTime;
+	Time rhsTime = ((const DownsampledBucket *) rhs)->firstTime;
+	if (lhsTime < rhsTime)
+		return -1;
+	if (lhsTime > rhsTime)
+		return 1;
+	return 0;
+}
+Time StatisticsHistory::TimeAndValueQueue::GetTierInterval(unsigned int tierIndex)
+{
+	Time interval = STATISTICS_HISTORY_TIER_INTERVAL;
+	for (unsigned int i=0; i < tierIndex; i++)
+		interval *= STATISTICS_HISTORY_TIER_BUCKETS;
+	return interval;
+}
+void StatisticsHistory::TimeAndValueQueue::FreeMemory(void)
+{
+	RakNet::OP_DELETE_ARRAY(sampleTimes, _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(sampleValues, _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(lowestQueue.sequences, _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(highestQueue.sequences, _FILE_AND_LINE_);
+	for (unsigned int tierIndex=0; tierIndex < DOWNSAMPLED_TIER_COUNT; tierIndex++)
+		RakNet::OP_DELETE_ARRAY(tiers[tierIndex].buckets, _FILE_AND_LINE_);
+}
 StatisticsHistory::TrackedObject::TrackedObject() {}
 StatisticsHistory::TrackedObject::~TrackedObject()
 {
-	DataStructures::List<StatisticsHistory::TimeAndValueQueue*> itemList;
-	DataStructures::List<RakString> keyList;
-	for (unsigned int idx=0; idx < itemList.Size(); idx++)
-		RakNet::OP_DELETE(itemList[idx], _FILE_AND_LINE_);
+	for (unsigned int idx=0; idx < dataQueues.Size(); idx++)
+		RakNet::OP_DELETE(dataQueues[idx], _FILE_AND_LINE_);
 }
 unsigned int StatisticsHistory::GetObjectIndex(uint64_t objectId) const
 {
@@ -712,6 +1465,15 @@ StatisticsHistoryPlugin::StatisticsHistoryPlugin()
 	addNewConnections = true;
 	removeLostConnections = true;
 	newConnectionsObjectType = 0;
+
+	keyIds[RN_KEY_ACTUAL_BYTES_SENT] = statistics.GetKeyId("RN_ACTUAL_BYTES_SENT");
+	keyIds[RN_KEY_USER_MESSAGE_BYTES_RESENT] = statistics.GetKeyId("RN_USER_MESSAGE_BYTES_RESENT");
+	keyIds[RN_KEY_ACTUAL_BYTES_RECEIVED] = statistics.GetKeyId("RN_ACTUAL_BYTES_RECEIVED");
+	keyIds[RN_KEY_USER_MESSAGE_BYTES_PUSHED] = statistics.GetKeyId("RN_USER_MESSAGE_BYTES_PUSHED");
+	keyIds[RN_KEY_USER_MESSAGE_BYTES_RECEIVED_PROCESSED] = statistics.GetKeyId("RN_USER_MESSAGE_BYTES_RECEIVED_PROCESSED");
+	keyIds[RN_KEY_LAST_PING] = statistics.GetKeyId("RN_lastPing");
+	keyIds[RN_KEY_BYTES_IN_RESEND_BUFFER] = statistics.GetKeyId("RN_bytesInResendBuffer");
+	keyIds[RN_KEY_PACKETLOSS_LAST_SECOND] = statistics.GetKeyId("RN_packetlossLastSecond");
 }
 StatisticsHistoryPlugin::~StatisticsHistoryPlugin()
 {
@@ -736,42 +1498,42 @@ void StatisticsHistoryPlugin::Update(void)
 		if (objectIndex!=(unsigned int)-1)
 		{
 			statistics.AddValueByIndex(objectIndex,
-				"RN_ACTUAL_BYTES_SENT",
+				keyIds[RN_KEY_ACTUAL_BYTES_SENT],
 				(SHValueType) stats[idx].valueOverLastSecond[ACTUAL_BYTES_SENT],
 				curTime, false);
 
 			statistics.AddValueByIndex(objectIndex,
-				"RN_USER_MESSAGE_BYTES_RESENT",
+				keyIds[RN_KEY_USER_MESSAGE_BYTES_RESENT],
 				(SHValueType) stats[idx].valueOverLastSecond[USER_MESSAGE_BYTES_RESENT],
 				curTime, false);
 
 			statistics.AddValueByIndex(objectIndex,
-				"RN_ACTUAL_BYTES_RECEIVED",
+				keyIds[RN_KEY_ACTUAL_BYTES_RECEIVED],
 				(SHValueType) stats[idx].valueOverLastSecond[ACTUAL_BYTES_RECEIVED],
 				curTime, false);
 
 			statistics.AddValueByIndex(objectIndex,
-				"RN_USER_MESSAGE_BYTES_PUSHED",
+				keyIds[RN_KEY_USER_MESSAGE_BYTES_PUSHED],
 				(SHValueType) stats[idx].valueOverLastSecond[USER_MESSAGE_BYTES_PUSHED],
 				curTime, false);
 
 			statistics.AddValueByIndex(objectIndex,
-				"RN_USER_MESSAGE_BYTES_RECEIVED_PROCESSED",
+				keyIds[RN_KEY_USER_MESSAGE_BYTES_RECEIVED_PROCESSED],
 				(SHValueType) stats[idx].valueOverLastSecond[USER_MESSAGE_BYTES_RECEIVED_PROCESSED],
 				curTime, false);
 
 			statistics.AddValueByIndex(objectIndex,
-				"RN_lastPing",
+				keyIds[RN_KEY_LAST_PING],
 				(SHValueType) rakPeerInterface->GetLastPing(guids[idx]),
 				curTime, false);
 
 			statistics.AddValueByIndex(objectIndex,
-				"RN_bytesInResendBuffer",
+				keyIds[RN_KEY_BYTES_IN_RESEND_BUFFER],
 				(SHValueType) stats[idx].bytesInResendBuffer,
 				curTime, false);
-			
+
 			statistics.AddValueByIndex(objectIndex,
-				"RN_packetlossLastSecond",
+				keyIds[RN_KEY_PACKETLOSS_LAST_SECOND],
 				(SHValueType) stats[idx].packetlossLastSecond,
 				curTime, false);
 		}
@@ -892,7 +892,14 @@ namespace RakNet
 		{
 			return IsNetworkOrder();
 		}
-		inline static bool IsNetworkOrder(void) {bool r = IsNetworkOrderInternal(); return r;}
+		inline static bool IsNetworkOrder(void) {
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__)
+			// Known at compile time, so each Write() and Read() doesn't call IsNetworkOrderInternal()
+			return __BYTE_ORDER__==__ORDER_BIG_ENDIAN__;
+#else
+			bool r = IsNetworkOrderInternal(); return r;
+#endif
+		}
 		// Not inline, won't compile on PC due to winsock include errors
 		static bool IsNetworkOrderInternal(void);
 		static void ReverseBytes(const unsigned char *inByteArray, unsigned char *inOutByteArray, const unsigned int length);
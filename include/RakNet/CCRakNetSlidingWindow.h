@@ -100,6 +100,10 @@ class CCRakNetSlidingWindow
 	/// Should call once per update tick, and send if needed
 	bool ShouldSendACKs(CCTimeType curTime, CCTimeType estimatedTimeToNextTick);
 
+	/// Latest time by which ShouldSendACKs() returns true for the acks buffered so far, so the caller can sleep until then
+	/// Returns 0 if acks should be sent right away
+	CCTimeType GetNextACKTime(void) const;
+
 	/// Every data packet sent must contain a sequence number
 	/// Call this function to get it. The sequence number is passed into OnGotPacketPair()
 	DatagramSequenceNumberType GetAndIncrementNextDatagramSequenceNumber(void);
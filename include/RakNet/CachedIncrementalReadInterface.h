@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief IncrementalReadInterface that keeps files open and shares read-ahead blocks between readers
+///
+
+#ifndef __CACHED_INCREMENTAL_READ_INTERFACE_H
+#define __CACHED_INCREMENTAL_READ_INTERFACE_H
+
+#include "IncrementalReadInterface.h"
+#include "RakString.h"
+#include "SimpleMutex.h"
+#include "DS_List.h"
+#include "Export.h"
+
+namespace RakNet
+{
+
+/// \brief Reads files for FileListTransfer::Send() without reopening them for every chunk
+/// \details The default IncrementalReadInterface opens, seeks, reads and closes the file for each chunk. This class instead:
+/// <OL>
+/// <LI>Keeps up to maxOpenFiles handles open, closing the least recently used one when over the limit.
+/// <LI>Reads with positional reads (pread() or ReadFile() with an offset), so any number of threads can read the same handle at once.
+/// <LI>Reads the file in aligned blocks of readAheadBytes and caches up to maxCachedBytes of them. Every recipient of the same file copies from the same blocks, so a file sent to many systems is read from disk about once.
+/// </OL>
+/// GetFilePart() is threadsafe, so this can be used with FileListTransfer::StartIncrementalReadThreads().
+/// Files are assumed not to change while cached. Call InvalidateFile() or InvalidateAll() after changing files on disk.
+class RAK_DLL_EXPORT CachedIncrementalReadInterface : public IncrementalReadInterface
+{
+public:
+	CachedIncrementalReadInterface();
+	virtual ~CachedIncrementalReadInterface();
+
+	/// \param[in] _maxOpenFiles How many file handles to keep open at once. Files are not closed during a read, so the limit may be exceeded while more files than this are being read. Defaults to 64
+	void SetMaxOpenFiles(unsigned int _maxOpenFiles);
+
+	/// \param[in] _readAheadBytes Files are read from disk in aligned blocks of this size. Defaults to 1 megabyte
+	/// \param[in] _maxCachedBytes Total size of cached blocks. Blocks are not discarded while being copied out, so the limit may be exceeded briefly. Pass 0 to read directly into the caller's buffer without caching. Defaults to 64 megabytes
+	/// \note Calls InvalidateAll()
+	void SetCacheSize(unsigned int _readAheadBytes, unsigned int _maxCachedBytes);
+
+	/// Close \a filename and discard its cached blocks. The next read opens it again
+	void InvalidateFile(const char *filename);
+
+	/// Close all files and discard all cached blocks
+	void InvalidateAll(void);
+
+	/// Read part of a file into \a preallocatedDestination, from cache where possible
+	virtual unsigned int GetFilePart( const char *filename, unsigned int startReadBytes, unsigned int numBytesToRead, void *preallocatedDestination, FileListNodeContext context);
+
+protected:
+	struct CachedBlock
+	{
+		unsigned int blockIndex;
+		char *data;
+		unsigned int length;
+		unsigned int lastUse;
+		unsigned int numReaders;
+	};
+
+	struct CachedFile
+	{
+		RakString filename;
+#if defined(_WIN32)
+		void *handle;
+#else
+		int handle;
+#endif
+		bool isOpen;
+		// readAheadBytes when the file was added, or 0 if not caching. Fixed so SetCacheSize() does not affect readers in progress
+		unsigned int blockSize;
+		// Removed from files by InvalidateFile() while being read. The last reader deletes it
+		bool isDetached;
+		unsigned int lastUse;
+		unsigned int numReaders;
+		DataStructures::List<CachedBlock*> blocks;
+	};
+
+	CachedFile *AddReader(const char *filename);
+	void RemoveReader(CachedFile *file);
+	bool OpenFile(CachedFile *file);
+	void CloseFile(CachedFile *file);
+	static unsigned int ReadAt(CachedFile *file, uint64_t offset, unsigned int numBytesToRead, char *destination);
+	CachedBlock *AddBlockReader(CachedFile *file, unsigned int blockIndex);
+	void RemoveBlockReader(CachedBlock *block);
+	void FreeCachedFile(CachedFile *file);
+	void DetachFile(unsigned int index);
+	void EvictBlocks(void);
+	void EvictFiles(void);
+
+	// Guards everything below. Not held during disk reads or copies
+	SimpleMutex cacheMutex;
+	// Bounded by maxOpenFiles plus the number of cached blocks, so searched linearly
+	DataStructures::List<CachedFile*> files;
+	unsigned int maxOpenFiles;
+	unsigned int numOpenFiles;
+	unsigned int readAheadBytes;
+	unsigned int maxCachedBytes;
+	unsigned int cachedBytes;
+	unsigned int useCounter;
+};
+
+} // namespace RakNet
+
+#endif
@@ -137,6 +137,7 @@ public:
 
 protected:
 	PluginReceiveResult OnReceive(Packet *packet);
+	bool GetReceiveFilter(PluginReceiveFilter &filter) const;
 
 	CloudClientCallback *callback;
 	CloudAllocator *allocator;
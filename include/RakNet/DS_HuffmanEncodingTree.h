@@ -21,6 +21,7 @@
 #include "BitStream.h"
 #include "Export.h"
 #include "DS_LinkedList.h" 
+#include "NativeTypes.h"
 
 namespace RakNet
 {
@@ -62,10 +63,35 @@ private:
 	{
 		unsigned char* encoding;
 		unsigned short bitLength;
+		/// The same bits, right aligned. Only valid if bitLength <= 32
+		uint32_t code;
 	};
 
 	CharacterEncoding encodingTable[ 256 ];
 
+	/// Decoding looks up this many bits of input at a time rather than walking the tree one bit at a time
+	static const int DECODE_TABLE_BITS=10;
+
+	/// One entry of a decode table, indexed by the next DECODE_TABLE_BITS bits of input
+	struct DecodeEntry
+	{
+		/// Table to continue in after consuming DECODE_TABLE_BITS bits, if bitLength is 0
+		unsigned short next;
+		unsigned char value;
+		/// Length of the code for \a value, or 0 if the code is longer than DECODE_TABLE_BITS
+		unsigned char bitLength;
+	};
+
+	/// numDecodeTables tables of 1<<DECODE_TABLE_BITS entries. Table 0 decodes from the root, the rest from nodes a multiple of DECODE_TABLE_BITS deep
+	DecodeEntry *decodeTables;
+	unsigned int numDecodeTables;
+
+	void GenerateDecodeTables( void );
+
+	/// Decodes \a sizeInBits bits starting \a startBit bits into \a input, passing each character to \a output
+	template <class OutputFunctor>
+	unsigned DecodeBits( const unsigned char *input, BitSize_t startBit, BitSize_t sizeInBits, OutputFunctor &output ) const;
+
 	void InsertNodeIntoSortedList( HuffmanEncodingTreeNode * node, DataStructures::LinkedList<HuffmanEncodingTreeNode *> *huffmanEncodingTreeNodeList ) const;
 };
 
@@ -0,0 +1,187 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file DS_LocklessBoundedQueue.h
+/// \internal
+/// \brief Fixed size circular buffer that passes data between threads without critical sections
+///
+
+#ifndef __LOCKLESS_BOUNDED_QUEUE_H
+#define __LOCKLESS_BOUNDED_QUEUE_H
+
+#include "RakMemoryOverride.h"
+#include "RakAssert.h"
+#include "Export.h"
+#include <atomic>
+#include <stddef.h>
+
+namespace DataStructures
+{
+	/// \brief A fixed size queue without critical sections
+	/// \details Unlike SingleProducerConsumer this never allocates after SetCapacity(). Push() fails when the queue is full, so the caller decides what to drop.
+	/// Each cell carries a sequence number, so any number of threads may push and pop at the same time (Vyukov's bounded queue).
+	/// With one producer and one consumer, each operation is one uncontended atomic load and store.
+	/// queue_type should be cheap to copy, such as a pointer.
+	template <class queue_type>
+	class RAK_DLL_EXPORT LocklessBoundedQueue
+	{
+	public:
+		LocklessBoundedQueue();
+		~LocklessBoundedQueue();
+
+		/// Not threadsafe. Call before the queue is shared between threads. Existing contents are discarded.
+		/// \param[in] capacity Rounded up to a power of two
+		void SetCapacity(unsigned int capacity, const char *file, unsigned int line);
+		unsigned int GetCapacity(void) const;
+
+		/// \return false if the queue is full. input is not added in that case
+		bool Push(const queue_type &input);
+
+		/// \return false if the queue is empty
+		bool Pop(queue_type &output);
+
+		/// An estimate if other threads are pushing or popping at the same time
+		unsigned int Size(void) const;
+		bool IsEmpty(void) const;
+
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			queue_type data;
+		};
+
+		Cell *cells;
+		size_t mask;
+
+		// Producers and the consumer each own one index. Keep them on separate cache lines
+		alignas(64) std::atomic<size_t> enqueuePosition;
+		alignas(64) std::atomic<size_t> dequeuePosition;
+	};
+
+	template <class queue_type>
+		LocklessBoundedQueue<queue_type>::LocklessBoundedQueue()
+	{
+		cells=0;
+		mask=0;
+		enqueuePosition.store(0, std::memory_order_relaxed);
+		dequeuePosition.store(0, std::memory_order_relaxed);
+	}
+
+	template <class queue_type>
+		LocklessBoundedQueue<queue_type>::~LocklessBoundedQueue()
+	{
+		if (cells)
+			RakNet::OP_DELETE_ARRAY(cells, _FILE_AND_LINE_);
+	}
+
+	template <class queue_type>
+		void LocklessBoundedQueue<queue_type>::SetCapacity(unsigned int capacity, const char *file, unsigned int line)
+	{
+		if (cells)
+			RakNet::OP_DELETE_ARRAY(cells, file, line);
+
+		size_t size=2;
+		while (size < capacity)
+			size<<=1;
+		cells=RakNet::OP_NEW_ARRAY<Cell>((int) size, file, line);
+		mask=size-1;
+		for (size_t i=0; i < size; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		enqueuePosition.store(0, std::memory_order_relaxed);
+		dequeuePosition.store(0, std::memory_order_relaxed);
+	}
+
+	template <class queue_type>
+		unsigned int LocklessBoundedQueue<queue_type>::GetCapacity(void) const
+	{
+		return cells ? (unsigned int) (mask+1) : 0;
+	}
+
+	template <class queue_type>
+		bool LocklessBoundedQueue<queue_type>::Push(const queue_type &input)
+	{
+		RakAssert(cells);
+		size_t position=enqueuePosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell *cell=&cells[position & mask];
+			size_t sequence=cell->sequence.load(std::memory_order_acquire);
+			ptrdiff_t diff=(ptrdiff_t) sequence - (ptrdiff_t) position;
+			if (diff==0)
+			{
+				// Cell is free for this lap. Claim it, unless another producer got there first
+				if (enqueuePosition.compare_exchange_weak(position, position+1, std::memory_order_relaxed))
+				{
+					cell->data=input;
+					cell->sequence.store(position+1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				// The consumer has not released this cell from the previous lap
+				return false;
+			}
+			else
+			{
+				position=enqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	template <class queue_type>
+		bool LocklessBoundedQueue<queue_type>::Pop(queue_type &output)
+	{
+		RakAssert(cells);
+		size_t position=dequeuePosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell *cell=&cells[position & mask];
+			size_t sequence=cell->sequence.load(std::memory_order_acquire);
+			ptrdiff_t diff=(ptrdiff_t) sequence - (ptrdiff_t) (position+1);
+			if (diff==0)
+			{
+				if (dequeuePosition.compare_exchange_weak(position, position+1, std::memory_order_relaxed))
+				{
+					output=cell->data;
+					// Hand the cell back to producers for the next lap
+					cell->sequence.store(position+mask+1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				// Nothing written here yet
+				return false;
+			}
+			else
+			{
+				position=dequeuePosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	template <class queue_type>
+		unsigned int LocklessBoundedQueue<queue_type>::Size(void) const
+	{
+		size_t enqueued=enqueuePosition.load(std::memory_order_relaxed);
+		size_t dequeued=dequeuePosition.load(std::memory_order_relaxed);
+		return enqueued > dequeued ? (unsigned int) (enqueued-dequeued) : 0;
+	}
+
+	template <class queue_type>
+		bool LocklessBoundedQueue<queue_type>::IsEmpty(void) const
+	{
+		return Size()==0;
+	}
+}
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file DS_SeqLock.h
+/// \internal
+/// \brief A value published by one thread and read by any number of threads without locking
+///
+
+
+#ifndef __DS_SEQ_LOCK_H
+#define __DS_SEQ_LOCK_H
+
+#include "Export.h"
+#include "NativeTypes.h"
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include <string.h>
+
+namespace DataStructures
+{
+	/// \brief Single writer, multiple reader sequence lock around a copy of \a value_type
+	/// \details Write() never waits for readers, and Read() never takes a lock. A reader that overlaps a write copies the value again, so it never sees half of one write and half of another.
+	/// Same scheme as SeqLockHashIndex. The value is stored as relaxed atomic words, so there is no data race even while a reader is retrying.
+	/// Only one thread at a time may call Write(). Suited to small structs that are read much more often than written.
+	template <class value_type>
+	class RAK_DLL_EXPORT SeqLock
+	{
+		static_assert(std::is_trivially_copyable<value_type>::value, "SeqLock copies the value with memcpy");
+
+	public:
+		SeqLock();
+
+		/// Publish \a input. Readers see either the previous value or this one
+		void Write(const value_type &input);
+
+		/// Copy the most recently published value into \a output. Retries while a Write() is in progress
+		void Read(value_type &output) const;
+
+		/// \return How many times Write() was called
+		uint32_t GetWriteCount(void) const {return sequence.load(std::memory_order_acquire)/2;}
+
+	protected:
+		static const unsigned int WORD_COUNT=(unsigned int) ((sizeof(value_type)+sizeof(uint64_t)-1)/sizeof(uint64_t));
+
+		// Odd while a write is in progress
+		std::atomic<uint32_t> sequence;
+		std::atomic<uint64_t> words[WORD_COUNT];
+	};
+
+	template <class value_type>
+		SeqLock<value_type>::SeqLock()
+	{
+		sequence.store(0, std::memory_order_relaxed);
+		for (unsigned int i=0; i < WORD_COUNT; i++)
+			words[i].store(0, std::memory_order_relaxed);
+	}
+
+	template <class value_type>
+		void SeqLock<value_type>::Write(const value_type &input)
+	{
+		uint64_t buffer[WORD_COUNT];
+		buffer[WORD_COUNT-1]=0;
+		memcpy(buffer, &input, sizeof(value_type));
+
+		uint32_t start=sequence.load(std::memory_order_relaxed);
+		sequence.store(start+1, std::memory_order_relaxed);
+		// Readers that see any of the new words also see the odd sequence
+		std::atomic_thread_fence(std::memory_order_release);
+		for (unsigned int i=0; i < WORD_COUNT; i++)
+			words[i].store(buffer[i], std::memory_order_relaxed);
+		sequence.store(start+2, std::memory_order_release);
+	}
+
+	template <class value_type>
+		void SeqLock<value_type>::Read(value_type &output) const
+	{
+		uint64_t buffer[WORD_COUNT];
+		for (;;)
+		{
+			uint32_t start=sequence.load(std::memory_order_acquire);
+			if (start & 1)
+			{
+				// The writer may have been preempted mid write
+				std::this_thread::yield();
+				continue;
+			}
+			for (unsigned int i=0; i < WORD_COUNT; i++)
+				buffer[i]=words[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (sequence.load(std::memory_order_relaxed)==start)
+				break;
+		}
+		memcpy(&output, buffer, sizeof(value_type));
+	}
+}
+
+#endif
@@ -0,0 +1,257 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file DS_SeqLockHashIndex.h
+/// \internal
+/// \brief Open addressing hash from 64 bit keys to array indices, written by one thread and read by any thread
+///
+
+#ifndef __SEQ_LOCK_HASH_INDEX_H
+#define __SEQ_LOCK_HASH_INDEX_H
+
+#include "RakMemoryOverride.h"
+#include "RakAssert.h"
+#include "Export.h"
+#include "NativeTypes.h"
+#include <atomic>
+#include <thread>
+
+namespace DataStructures
+{
+	/// \brief Maps hashed keys to indices into an array the caller owns, such as RakPeer::remoteSystemList
+	/// \details Several indices may be stored under the same key, so the key only has to be a hash of the real key. Find() passes each candidate index to a functor that compares the real key.
+	/// Only one thread may call Insert(), Remove() and Clear(). Any number of threads may call Find() at the same time.
+	/// Writers bump a sequence number before and after each change (a seqlock). Readers never block the writer and retry if a change overlapped their probe.
+	/// Linear probing with tombstones. The table is rehashed in place when tombstones take up a quarter of it.
+	class RAK_DLL_EXPORT SeqLockHashIndex
+	{
+	public:
+		static const unsigned int NOT_FOUND=(unsigned int) -1;
+
+		SeqLockHashIndex();
+		~SeqLockHashIndex();
+
+		/// Not threadsafe. Call before the index is shared between threads. Existing contents are discarded.
+		/// \param[in] maxEntries Most entries stored at once. The table is at least twice this size, rounded up to a power of two
+		void SetCapacity(unsigned int maxEntries, const char *file, unsigned int line);
+
+		/// Removes all entries. Writer thread only
+		void Clear(void);
+
+		/// Adds \a value under \a key. Writer thread only
+		void Insert(uint64_t key, unsigned int value);
+
+		/// Removes one entry with this key and value, if present. Writer thread only
+		void Remove(uint64_t key, unsigned int value);
+
+		/// Any thread
+		/// \param[in] match Called as match(value) for each value stored under \a key until it returns true. It may be called again for the same value if the writer changed the table meanwhile
+		/// \return The value match() accepted, or NOT_FOUND
+		template <class MatchFunctor>
+		unsigned int Find(uint64_t key, const MatchFunctor &match) const;
+
+	private:
+		static const unsigned int EMPTY_SLOT=(unsigned int) -1;
+		static const unsigned int DELETED_SLOT=(unsigned int) -2;
+
+		struct Slot
+		{
+			std::atomic<uint64_t> key;
+			std::atomic<unsigned int> value;
+		};
+
+		static uint64_t Mix(uint64_t key);
+		void BeginWrite(void);
+		void EndWrite(void);
+		void InsertInt(uint64_t key, unsigned int value);
+		void Rehash(void);
+
+		Slot *slots;
+		unsigned int mask;
+		unsigned int numDeleted;
+		alignas(64) std::atomic<uint32_t> sequence;
+	};
+
+	inline SeqLockHashIndex::SeqLockHashIndex()
+	{
+		slots=0;
+		mask=0;
+		numDeleted=0;
+		sequence.store(0, std::memory_order_relaxed);
+	}
+
+	inline SeqLockHashIndex::~SeqLockHashIndex()
+	{
+		if (slots)
+			RakNet::OP_DELETE_ARRAY(slots, _FILE_AND_LINE_);
+	}
+
+	inline void SeqLockHashIndex::SetCapacity(unsigned int maxEntries, const char *file, unsigned int line)
+	{
+		if (slots)
+			RakNet::OP_DELETE_ARRAY(slots, file, line);
+
+		unsigned int size=2;
+		while (size < maxEntries*2)
+			size<<=1;
+		slots=RakNet::OP_NEW_ARRAY<Slot>((int) size, file, line);
+		mask=size-1;
+		for (unsigned int i=0; i < size; i++)
+		{
+			slots[i].key.store(0, std::memory_order_relaxed);
+			slots[i].value.store(EMPTY_SLOT, std::memory_order_relaxed);
+		}
+		numDeleted=0;
+	}
+
+	inline void SeqLockHashIndex::Clear(void)
+	{
+		if (slots==0)
+			return;
+		BeginWrite();
+		for (unsigned int i=0; i <= mask; i++)
+			slots[i].value.store(EMPTY_SLOT, std::memory_order_relaxed);
+		numDeleted=0;
+		EndWrite();
+	}
+
+	inline void SeqLockHashIndex::Insert(uint64_t key, unsigned int value)
+	{
+		RakAssert(slots);
+		RakAssert(value!=EMPTY_SLOT && value!=DELETED_SLOT);
+		BeginWrite();
+		InsertInt(key, value);
+		EndWrite();
+	}
+
+	inline void SeqLockHashIndex::Remove(uint64_t key, unsigned int value)
+	{
+		RakAssert(slots);
+		unsigned int i=(unsigned int) Mix(key) & mask;
+		for (unsigned int probes=0; probes <= mask; probes++, i=(i+1) & mask)
+		{
+			unsigned int slotValue=slots[i].value.load(std::memory_order_relaxed);
+			if (slotValue==EMPTY_SLOT)
+				return;
+			if (slotValue==value && slots[i].key.load(std::memory_order_relaxed)==key)
+			{
+				BeginWrite();
+				slots[i].value.store(DELETED_SLOT, std::memory_order_relaxed);
+				if (++numDeleted > (mask+1)/4)
+					Rehash();
+				EndWrite();
+				return;
+			}
+		}
+	}
+
+	template <class MatchFunctor>
+		unsigned int SeqLockHashIndex::Find(uint64_t key, const MatchFunctor &match) const
+	{
+		if (slots==0)
+			return NOT_FOUND;
+
+		for (;;)
+		{
+			uint32_t before=sequence.load(std::memory_order_acquire);
+			if (before & 1)
+			{
+				// The writer may have been preempted mid write
+				std::this_thread::yield();
+				continue;
+			}
+
+			unsigned int result=NOT_FOUND;
+			unsigned int i=(unsigned int) Mix(key) & mask;
+			for (unsigned int probes=0; probes <= mask; probes++, i=(i+1) & mask)
+			{
+				unsigned int slotValue=slots[i].value.load(std::memory_order_relaxed);
+				if (slotValue==EMPTY_SLOT)
+					break;
+				if (slotValue!=DELETED_SLOT && slots[i].key.load(std::memory_order_relaxed)==key && match(slotValue))
+				{
+					result=slotValue;
+					break;
+				}
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (sequence.load(std::memory_order_relaxed)==before)
+				return result;
+		}
+	}
+
+	inline uint64_t SeqLockHashIndex::Mix(uint64_t key)
+	{
+		// Finalizer from MurmurHash3, so keys that differ only in high bits still spread across the table
+		key^=key >> 33;
+		key*=0xff51afd7ed558ccdULL;
+		key^=key >> 33;
+		key*=0xc4ceb9fe1a85ec53ULL;
+		key^=key >> 33;
+		return key;
+	}
+
+	inline void SeqLockHashIndex::BeginWrite(void)
+	{
+		sequence.store(sequence.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	inline void SeqLockHashIndex::EndWrite(void)
+	{
+		sequence.store(sequence.load(std::memory_order_relaxed)+1, std::memory_order_release);
+	}
+
+	inline void SeqLockHashIndex::InsertInt(uint64_t key, unsigned int value)
+	{
+		unsigned int i=(unsigned int) Mix(key) & mask;
+		for (unsigned int probes=0; probes <= mask; probes++, i=(i+1) & mask)
+		{
+			unsigned int slotValue=slots[i].value.load(std::memory_order_relaxed);
+			if (slotValue==EMPTY_SLOT || slotValue==DELETED_SLOT)
+			{
+				if (slotValue==DELETED_SLOT)
+					numDeleted--;
+				slots[i].key.store(key, std::memory_order_relaxed);
+				slots[i].value.store(value, std::memory_order_relaxed);
+				return;
+			}
+		}
+		// More entries than SetCapacity() allowed for
+		RakAssert(0);
+	}
+
+	inline void SeqLockHashIndex::Rehash(void)
+	{
+		// Called between BeginWrite() and EndWrite()
+		unsigned int size=mask+1, i, numLive=0;
+		uint64_t *keys=RakNet::OP_NEW_ARRAY<uint64_t>((int) size, _FILE_AND_LINE_);
+		unsigned int *values=RakNet::OP_NEW_ARRAY<unsigned int>((int) size, _FILE_AND_LINE_);
+		for (i=0; i < size; i++)
+		{
+			unsigned int slotValue=slots[i].value.load(std::memory_order_relaxed);
+			if (slotValue!=EMPTY_SLOT && slotValue!=DELETED_SLOT)
+			{
+				keys[numLive]=slots[i].key.load(std::memory_order_relaxed);
+				values[numLive]=slotValue;
+				numLive++;
+			}
+			slots[i].value.store(EMPTY_SLOT, std::memory_order_relaxed);
+		}
+		numDeleted=0;
+		for (i=0; i < numLive; i++)
+			InsertInt(keys[i], values[i]);
+		RakNet::OP_DELETE_ARRAY(keys, _FILE_AND_LINE_);
+		RakNet::OP_DELETE_ARRAY(values, _FILE_AND_LINE_);
+	}
+}
+
+#endif
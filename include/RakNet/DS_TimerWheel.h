@@ -0,0 +1,382 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file DS_TimerWheel.h
+/// \internal
+/// \brief Hierarchical timing wheel, so a tick only touches the items that come due
+///
+
+#ifndef __TIMER_WHEEL_H
+#define __TIMER_WHEEL_H
+
+#include "RakAssert.h"
+#include "Export.h"
+#include "NativeTypes.h"
+#include <stddef.h>
+
+namespace DataStructures
+{
+	/// \brief Embed one of these in each item a TimerWheel holds
+	template <class T>
+	struct TimerWheelLinks
+	{
+		T *next;
+		// Points at whatever points at this item: a slot, the due list head, or the previous item's next
+		T **prevNext;
+		// level*64+slot, or TimerWheel::DUE_LIST
+		unsigned short slot;
+	};
+
+	/// \brief Holds items until their deadline passes, then hands them out in deadline order
+	/// \details Intrusive: each item stores its own links and deadline, named by the LINKS and DEADLINE template parameters, so scheduling never allocates. An item may be in at most one wheel.
+	/// There are four levels of 64 slots. Level 0 slots are one tick wide, and each higher level's slots are 64 times wider than the level below. Items due further out than 64^4 ticks wait in the top level and are filed again when their slot comes around.
+	/// Advance() moves every item whose deadline has passed to a due list. GetDue() returns the head of that list. Items come due in deadline order, to within one tick.
+	/// The cost of Advance() depends on the ticks elapsed and the number of items that come due, not on the number of items scheduled. Insert() and Remove() are O(1).
+	/// Not threadsafe.
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+	class RAK_DLL_EXPORT TimerWheel
+	{
+	public:
+		TimerWheel();
+
+		/// \param[in] ticks Width of a level 0 slot, in the same units as the deadlines. Call before inserting anything
+		void SetTickLength(uint64_t ticks);
+
+		/// Forgets every item without touching them. The clock keeps the time of the last Advance()
+		void Clear(void);
+
+		/// Schedules \a item for item->*DEADLINE. If that has already passed, \a item goes straight to the end of the due list
+		void Insert(T *item);
+
+		/// Unschedules \a item, whether or not it is due yet
+		void Remove(T *item);
+
+		/// Moves \a item to \a deadline
+		void Reschedule(T *item, uint64_t deadline);
+
+		/// Moves every item with a deadline at or before \a now to the due list. \a now going backwards is ignored
+		void Advance(uint64_t now);
+
+		/// \return The earliest due item, or 0. It stays in the wheel until removed
+		T *GetDue(void) const {return due;}
+
+		/// Removes and returns some item, due or not, or 0 if empty. For draining the wheel
+		T *Pop(void);
+
+		/// \return The time Advance() needs to reach before anything more comes due. Never later than the earliest deadline, but may be earlier for items more than 64 ticks away. \a notAfter if nothing is scheduled
+		uint64_t GetNextDeadline(uint64_t notAfter) const;
+
+		unsigned int Size(void) const {return numInSlots+numDue;}
+		bool IsEmpty(void) const {return numInSlots+numDue==0;}
+
+	protected:
+		static const int LEVELS=4;
+		static const int SLOT_BITS=6;
+		static const int SLOTS=1<<SLOT_BITS;
+		static const uint64_t SLOT_MASK=SLOTS-1;
+		static const unsigned short DUE_LIST=0xFFFF;
+
+		static int LowestSetBit(uint64_t bits);
+		void InsertIntoSlot(T *item);
+		void AppendToDue(T *item);
+		void Unlink(T *item);
+		void MoveSlotToDue(int level, int slot, bool onlyPassed);
+		void Cascade(void);
+
+		T *slots[LEVELS][SLOTS];
+		// Bit n is set if slots[level][n] is not empty
+		uint64_t occupied[LEVELS];
+		T *due;
+		T **dueTail;
+		uint64_t tickLength;
+		uint64_t currentTick;
+		uint64_t lastTime;
+		unsigned int numInSlots, numDue;
+	};
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		TimerWheel<T,LINKS,DEADLINE>::TimerWheel()
+	{
+		tickLength=1;
+		currentTick=0;
+		lastTime=0;
+		Clear();
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		void TimerWheel<T,LINKS,DEADLINE>::SetTickLength(uint64_t ticks)
+	{
+		RakAssert(IsEmpty());
+		tickLength=ticks > 0 ? ticks : 1;
+		currentTick=lastTime/tickLength;
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		void TimerWheel<T,LINKS,DEADLINE>::Clear(void)
+	{
+		for (int level=0; level < LEVELS; level++)
+		{
+			for (int slot=0; slot < SLOTS; slot++)
+				slots[level][slot]=0;
+			occupied[level]=0;
+		}
+		due=0;
+		dueTail=&due;
+		numInSlots=0;
+		numDue=0;
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		int TimerWheel<T,LINKS,DEADLINE>::LowestSetBit(uint64_t bits)
+	{
+		RakAssert(bits!=0);
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_ctzll(bits);
+#else
+		int index=0;
+		while ((bits & 1)==0)
+		{
+			bits>>=1;
+			index++;
+		}
+		return index;
+#endif
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		void TimerWheel<T,LINKS,DEADLINE>::Insert(T *item)
+	{
+		if (item->*DEADLINE <= lastTime)
+			AppendToDue(item);
+		else
+			InsertIntoSlot(item);
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		void TimerWheel<T,LINKS,DEADLINE>::InsertIntoSlot(T *item)
+	{
+		uint64_t tick=item->*DEADLINE/tickLength;
+		if (tick < currentTick)
+			tick=currentTick;
+		uint64_t delta=tick-currentTick;
+
+		int level=0;
+		while (level < LEVELS-1 && delta >= ((uint64_t)1 << (SLOT_BITS*(level+1))))
+			level++;
+		if (delta >= ((uint64_t)1 << (SLOT_BITS*LEVELS)))
+			tick=currentTick+((uint64_t)1 << (SLOT_BITS*LEVELS))-1;
+
+		int slot=(int) ((tick >> (SLOT_BITS*level)) & SLOT_MASK);
+		TimerWheelLinks<T> &links=item->*LINKS;
+		T **head=&slots[level][slot];
+		links.next=*head;
+		if (*head)
+			((*head)->*LINKS).prevNext=&links.next;
+		links.prevNext=head;
+		links.slot=(unsigned short) (level*SLOTS+slot);
+		*head=item;
+		occupied[level]|=(uint64_t)1 << slot;
+		numInSlots++;
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		void TimerWheel<T,LINKS,DEADLINE>::AppendToDue(T *item)
+	{
+		TimerWheelLinks<T> &links=item->*LINKS;
+		links.next=0;
+		links.prevNext=dueTail;
+		links.slot=DUE_LIST;
+		*dueTail=item;
+		dueTail=&links.next;
+		numDue++;
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		void TimerWheel<T,LINKS,DEADLINE>::Unlink(T *item)
+	{
+		TimerWheelLinks<T> &links=item->*LINKS;
+		RakAssert(links.prevNext && *links.prevNext==item);
+		*links.prevNext=links.next;
+		if (links.next)
+			(links.next->*LINKS).prevNext=links.prevNext;
+
+		if (links.slot==DUE_LIST)
+		{
+			if (dueTail==&links.next)
+				dueTail=links.prevNext;
+			numDue--;
+		}
+		else
+		{
+			int level=links.slot/SLOTS;
+			int slot=links.slot%SLOTS;
+			if (slots[level][slot]==0)
+				occupied[level]&=~((uint64_t)1 << slot);
+			numInSlots--;
+		}
+		links.next=0;
+		links.prevNext=0;
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		void TimerWheel<T,LINKS,DEADLINE>::Remove(T *item)
+	{
+		Unlink(item);
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		void TimerWheel<T,LINKS,DEADLINE>::Reschedule(T *item, uint64_t deadline)
+	{
+		Unlink(item);
+		item->*DEADLINE=deadline;
+		Insert(item);
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		void TimerWheel<T,LINKS,DEADLINE>::MoveSlotToDue(int level, int slot, bool onlyPassed)
+	{
+		T *item=slots[level][slot];
+		while (item)
+		{
+			T *next=(item->*LINKS).next;
+			if (onlyPassed==false || item->*DEADLINE <= lastTime)
+			{
+				Unlink(item);
+				AppendToDue(item);
+			}
+			item=next;
+		}
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		void TimerWheel<T,LINKS,DEADLINE>::Cascade(void)
+	{
+		// At each boundary of a higher level, spread the slot starting here over the levels below
+		for (int level=1; level < LEVELS; level++)
+		{
+			if ((currentTick & (((uint64_t)1 << (SLOT_BITS*level))-1))!=0)
+				break;
+			int slot=(int) ((currentTick >> (SLOT_BITS*level)) & SLOT_MASK);
+			while (slots[level][slot])
+			{
+				T *item=slots[level][slot];
+				Unlink(item);
+				InsertIntoSlot(item);
+			}
+		}
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		void TimerWheel<T,LINKS,DEADLINE>::Advance(uint64_t now)
+	{
+		if (now <= lastTime)
+			return;
+		lastTime=now;
+
+		uint64_t targetTick=now/tickLength;
+		while (currentTick < targetTick)
+		{
+			if (numInSlots==0)
+			{
+				currentTick=targetTick;
+				return;
+			}
+
+			if (occupied[0]!=0)
+			{
+				// Every item in a slot before targetTick is due
+				int slot=(int) (currentTick & SLOT_MASK);
+				if (occupied[0] & ((uint64_t)1 << slot))
+					MoveSlotToDue(0, slot, false);
+				currentTick++;
+			}
+			else
+			{
+				// Skip to the next boundary of the lowest level holding anything, since nothing can come due before it
+				int level=1;
+				while (level < LEVELS-1 && occupied[level]==0)
+					level++;
+				uint64_t boundary=(currentTick | (((uint64_t)1 << (SLOT_BITS*level))-1))+1;
+				if (boundary > targetTick)
+				{
+					currentTick=targetTick;
+					break;
+				}
+				currentTick=boundary;
+			}
+			Cascade();
+		}
+
+		// Items in the current tick only come due once their exact deadline passes
+		int slot=(int) (currentTick & SLOT_MASK);
+		if (occupied[0] & ((uint64_t)1 << slot))
+			MoveSlotToDue(0, slot, true);
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		T *TimerWheel<T,LINKS,DEADLINE>::Pop(void)
+	{
+		T *item=due;
+		for (int level=0; level < LEVELS && item==0; level++)
+		{
+			if (occupied[level])
+				item=slots[level][LowestSetBit(occupied[level])];
+		}
+		if (item)
+			Unlink(item);
+		return item;
+	}
+
+	template <class T, TimerWheelLinks<T> T::*LINKS, uint64_t T::*DEADLINE>
+		uint64_t TimerWheel<T,LINKS,DEADLINE>::GetNextDeadline(uint64_t notAfter) const
+	{
+		if (due)
+			return lastTime;
+
+		uint64_t next=notAfter;
+		for (int level=0; level < LEVELS; level++)
+		{
+			if (occupied[level]==0)
+				continue;
+
+			// Rotate so bit 0 is the slot for the current position at this level
+			int shift=SLOT_BITS*level;
+			int current=(int) ((currentTick >> shift) & SLOT_MASK);
+			uint64_t rotated=current==0 ? occupied[level] : (occupied[level] >> current) | (occupied[level] << (SLOTS-current));
+
+			uint64_t t;
+			if (level==0)
+			{
+				int offset=LowestSetBit(rotated);
+				// Level 0 slots hold one tick, so find the exact earliest deadline
+				T *item=slots[0][(current+offset) & (int) SLOT_MASK];
+				t=item->*DEADLINE;
+				for (item=(item->*LINKS).next; item; item=(item->*LINKS).next)
+				{
+					if (item->*DEADLINE < t)
+						t=item->*DEADLINE;
+				}
+			}
+			else
+			{
+				// Higher levels only bound when the slot starts. The slot at the current position is a full turn ahead
+				int offset=(rotated & ~(uint64_t)1)!=0 ? LowestSetBit(rotated & ~(uint64_t)1) : SLOTS;
+				t=(((currentTick >> shift) + (uint64_t) offset) << shift) * tickLength;
+			}
+			if (t < next)
+				next=t;
+		}
+		if (next < lastTime)
+			next=lastTime;
+		return next;
+	}
+}
+
+#endif
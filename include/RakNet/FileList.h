@@ -167,8 +167,19 @@ public:
 	/// \param[in] writeData Write the contents of each file
 	/// \param[in] recursive Whether or not to visit subdirectories
 	/// \param[in] context User defined byte to store with each file. Use for whatever you want.
+	/// \note Files are read and hashed on SetNumHashThreads() threads. Progress callbacks are still called from the calling thread, and files are added in directory order
 	void AddFilesFromDirectory(const char *applicationDirectory, const char *subDirectory, bool writeHash, bool writeData, bool recursive, FileListNodeContext context);
 
+	/// \brief How many threads AddFilesFromDirectory() uses to read and hash files
+	/// \details The directory walk and progress callbacks stay on the calling thread. Pass 0 or 1 to read on the calling thread. Defaults to 4
+	void SetNumHashThreads(unsigned int _numHashThreads);
+
+	/// \brief Remember file hashes between calls to AddFilesFromDirectory(), and between runs of the program
+	/// \details Hashes are stored by full path, file length and modification time. When AddFilesFromDirectory() is called with \a writeHash true and \a writeData false, files whose length and modification time match are not read again.
+	/// The cache is loaded at the start of each AddFilesFromDirectory() call and saved at the end. Entries for files that are no longer under the scanned directory are dropped
+	/// \param[in] _hashCachePath File the cache is stored in. Pass 0 to stop using a cache
+	void SetHashCachePath(const char *_hashCachePath);
+
 	/// Deallocate all memory
 	void Clear(void);
 
@@ -252,7 +263,12 @@ public:
 
 	static bool FixEndingSlash(char *str);
 protected:
+	/// AddFile() without checking for a file of the same name
+	void InsertFile(const char *filename, const char *fullPathToFile, const char *data, const unsigned dataLength, const unsigned fileLength, FileListNodeContext context, bool isAReference, bool takeDataPointer);
+
 	DataStructures::List<FileListProgress*> fileListProgressCallbacks;
+	unsigned int numHashThreads;
+	RakNet::RakString hashCachePath;
 };
 
 } // namespace RakNet
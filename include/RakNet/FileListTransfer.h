@@ -83,7 +83,7 @@ public:
 	/// \param[in] setID The return value of SetupReceive() which was previously called on \a recipient
 	/// \param[in] priority Passed to RakPeerInterface::Send()
 	/// \param[in] orderingChannel Passed to RakPeerInterface::Send()
-	/// \param[in] _incrementalReadInterface If a file in \a fileList has no data, _incrementalReadInterface will be used to read the file in chunks of size \a chunkSize
+	/// \param[in] _incrementalReadInterface If a file in \a fileList has no data, _incrementalReadInterface will be used to read the file in chunks of size \a chunkSize. Use CachedIncrementalReadInterface when sending the same files to many systems
 	/// \param[in] _chunkSize How large of a block of a file to read/send at once. Large values use more memory but transfer slightly faster.
 	void Send(FileList *fileList, RakNet::RakPeerInterface *rakPeer, SystemAddress recipient, unsigned short setID, PacketPriority priority, char orderingChannel, IncrementalReadInterface *_incrementalReadInterface=0, unsigned int _chunkSize=262144*4*16);
 
@@ -117,6 +117,8 @@ public:
 	/// \internal For plugin handling
 	virtual PluginReceiveResult OnReceive(Packet *packet);
 	/// \internal For plugin handling
+	virtual bool GetReceiveFilter(PluginReceiveFilter &filter) const;
+	/// \internal For plugin handling
 	virtual void OnRakPeerShutdown(void);
 	/// \internal For plugin handling
 	virtual void OnClosedConnection(const SystemAddress &systemAddress, RakNetGUID rakNetGUID, PI2_LostConnectionReason lostConnectionReason );
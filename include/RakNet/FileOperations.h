@@ -19,6 +19,7 @@
 #define __FILE_OPERATIONS_H
 
 #include "Export.h"
+#include "NativeTypes.h"
 
 bool RAK_DLL_EXPORT WriteFileWithDirectories( const char *path, char *data, unsigned dataLength );
 bool RAK_DLL_EXPORT IsSlash(unsigned char c);
@@ -26,6 +27,8 @@ void RAK_DLL_EXPORT AddSlash( char *input );
 void RAK_DLL_EXPORT QuoteIfSpaces(char *str);
 bool RAK_DLL_EXPORT DirectoryExists(const char *directory);
 unsigned int RAK_DLL_EXPORT GetFileLength(const char *path);
+// Same as GetFileLength(), for files of 4 gigabytes or more
+uint64_t RAK_DLL_EXPORT GetFileLength64(const char *path);
 
 #endif
 
@@ -226,6 +226,8 @@ public:
 	/// \internal
 	virtual PluginReceiveResult OnReceive(Packet *packet);
 	/// \internal
+	virtual bool GetReceiveFilter(PluginReceiveFilter &filter) const;
+	/// \internal
 	virtual void OnRakPeerStartup(void);
 	/// \internal
 	virtual void OnAttach(void);
@@ -21,6 +21,7 @@
 #include "RakNetDefines.h"
 #include "NativeTypes.h"
 #include "RakNetDefines.h"
+#include "DS_TimerWheel.h"
 #if USE_SLIDING_WINDOW_CONGESTION_CONTROL!=1
 #include "CCRakNetUDT.h"
 #else
@@ -29,6 +30,9 @@
 
 namespace RakNet {
 
+class SendBuffer;
+struct ReceiveBuffer;
+
 typedef uint16_t SplitPacketIdType;
 typedef uint32_t SplitPacketIndexType;
 
@@ -107,9 +111,17 @@ struct InternalPacket : public InternalPacketFixedSizeTransmissionHeader
 	
 		/// If allocation scheme is STACK, data points to stackData and should not be deallocated
 		/// This is only used when sending. Received packets are deallocated in RakPeer
-		STACK
+		STACK,
+
+		/// data points into sendBuffer, which this packet holds one reference to. Only used when sending
+		SEND_BUFFER,
+
+		/// data points into receiveBuffer, a copy of the datagram this message arrived in, which this packet holds one reference to. Only used when receiving
+		RECEIVE_BUFFER
 	} allocationScheme;
 	InternalPacketRefCountedData *refCountedData;
+	SendBuffer *sendBuffer;
+	ReceiveBuffer *receiveBuffer;
 	/// How many attempts we made at sending this message
 	unsigned char timesSent;
 	/// The priority level of this packet
@@ -117,9 +129,10 @@ struct InternalPacket : public InternalPacketFixedSizeTransmissionHeader
 	/// If the reliability type requires a receipt, then return this number with it
 	uint32_t sendReceiptSerial;
 
-	// Used for the resend queue
+	// Used for the resend queue, which is keyed on nextActionTime
+	DataStructures::TimerWheelLinks<InternalPacket> resendLinks;
 	// Linked list implementation so I can remove from the list via a pointer, without finding it in the list
-	InternalPacket *resendPrev, *resendNext,*unreliablePrev,*unreliableNext;
+	InternalPacket *unreliablePrev,*unreliableNext;
 
 	unsigned char stackData[128];
 };
@@ -0,0 +1,218 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief This will write all incoming and outgoing network messages to rotating files as fixed size binary records, from a background thread
+///
+
+
+#include "NativeFeatureIncludes.h"
+#if _RAKNET_SUPPORT_PacketLogger==1
+
+#ifndef __PACKET_BINARY_LOGGER_H_
+#define __PACKET_BINARY_LOGGER_H_
+
+#include "PacketLogger.h"
+#include "DS_LocklessBoundedQueue.h"
+#include "SignaledEvent.h"
+#include "LocklessTypes.h"
+#include "RakString.h"
+#include "RakThread.h"
+#include <atomic>
+#include <stdio.h>
+
+namespace RakNet
+{
+
+RAK_THREAD_DECLARATION(PacketBinaryLoggerLoop);
+
+/// \ingroup PACKETLOGGER_GROUP
+/// Which PacketLogger event a PacketLogRecord holds
+enum PacketLogRecordType
+{
+	PLRT_DIRECT_SEND,
+	PLRT_DIRECT_RECEIVE,
+	PLRT_RELIABILITY_ERROR,
+	PLRT_RELIABILITY_WARNING,
+	PLRT_INTERNAL_PACKET,
+	PLRT_INTERNAL_PACKET_TIMESTAMP,
+	PLRT_ACK,
+	PLRT_PUSH_BACK_PACKET,
+	PLRT_MISCELLANEOUS,
+	/// Written by the logging thread when the ring was full. bitLength holds how many records were lost
+	PLRT_DROPPED,
+};
+
+/// \ingroup PACKETLOGGER_GROUP
+/// A SystemAddress in a fixed layout, the same whether or not RAKNET_SUPPORT_IPV6 is defined
+struct PacketLogAddress
+{
+	unsigned char ip[16];
+	/// Network order
+	unsigned short port;
+	/// 4 or 6
+	unsigned char ipVersion;
+	unsigned char unused;
+
+	void Set(const SystemAddress &systemAddress);
+	SystemAddress Get(void) const;
+};
+
+/// \ingroup PACKETLOGGER_GROUP
+/// One event written by PacketBinaryLogger. Every record is the same size, so a file can be read without parsing
+struct PacketLogRecord
+{
+	/// Wall clock when the event was logged, in microseconds since 1970, for the Clock column
+	uint64_t clockUS;
+	/// The Time column, as PacketLogger would print it
+	uint64_t time;
+	uint32_t reliableMessageNumber;
+	uint32_t frame;
+	uint32_t bitLength;
+	/// PacketLogRecordType
+	unsigned char type;
+	/// isSend from OnInternalPacket()
+	unsigned char direction;
+	unsigned char messageId;
+	unsigned char unused;
+	PacketLogAddress remote;
+	PacketLogAddress local;
+	union
+	{
+		struct
+		{
+			uint32_t splitPacketId;
+			uint32_t splitPacketIndex;
+			uint32_t splitPacketCount;
+			uint32_t orderingIndex;
+		} packet;
+		/// For PLRT_RELIABILITY_ERROR and PLRT_RELIABILITY_WARNING, the message. For PLRT_MISCELLANEOUS, the type and the message, each null terminated. Truncated to fit
+		char text[56];
+	};
+};
+
+/// \ingroup PACKETLOGGER_GROUP
+/// Written at the start of each file PacketBinaryLogger creates, followed by PacketLogRecord until the end of the file
+struct PacketLogFileHeader
+{
+	/// PACKET_LOG_FILE_MAGIC
+	char magic[8];
+	/// PACKET_LOG_FILE_VERSION
+	uint32_t version;
+	/// sizeof(PacketLogRecord). Also tells a reader on a machine of the other endianness that the file is not readable
+	uint32_t recordLength;
+	/// Counts up from 0 each time the log rotates to a new file
+	uint32_t fileIndex;
+	/// SetPrintID()
+	unsigned char printId;
+	unsigned char unused[3];
+	/// SetPrefix() and SetSuffix()
+	char prefix[256];
+	char suffix[256];
+};
+
+#define PACKET_LOG_FILE_MAGIC "RAKPLOG"
+#define PACKET_LOG_FILE_VERSION 1
+
+/// \ingroup PACKETLOGGER_GROUP
+/// \brief Packetlogger that writes compact binary records to rotating files from a background thread
+/// \details PacketLogger formats a text line with snprintf on the network thread for every message, and PacketFileLogger writes and flushes it with fprintf. That is slow enough to change the behavior being logged.
+/// This logger instead copies each event into a fixed size PacketLogRecord and pushes it on a lock free ring. A background thread writes the ring to disk in large writes, starting a new file when the current one is full.
+/// If the ring is full the record is dropped rather than blocking the network thread. Dropped records are counted, and the file records where they were lost.
+/// SetMessageIDFilter() and SetSampleRate() cut the number of records, so logging can be left on under load.
+/// Use the PacketLogDecoder sample to turn the files into the same text PacketFileLogger writes.
+class RAK_DLL_EXPORT PacketBinaryLogger : public PacketLogger
+{
+public:
+	// GetInstance() and DestroyInstance(instance*)
+	STATIC_FACTORY_DECLARATIONS(PacketBinaryLogger)
+
+	PacketBinaryLogger();
+	virtual ~PacketBinaryLogger();
+
+	/// Opens the first file and starts the logging thread
+	/// \param[in] filenamePrefix Files are named filenamePrefix_time_index.rpl, where time is when the log started, in seconds since 1970. Pass an empty string to use PacketLog
+	/// \param[in] maxFileBytes Start a new file when the current one reaches this size. 0 to write one file without limit
+	/// \param[in] maxFiles Delete the oldest file when starting a new one would leave more than this many. 0 to keep every file
+	/// \param[in] ringRecords How many records can wait for the logging thread. Each uses sizeof(PacketLogRecord) bytes
+	/// \return false if the file could not be opened or the thread could not be started
+	bool StartLog(const char *filenamePrefix, unsigned int maxFileBytes=64*1024*1024, unsigned int maxFiles=8, unsigned int ringRecords=PACKET_BINARY_LOGGER_RING_SIZE);
+
+	/// Writes every record still in the ring, stops the logging thread, and closes the file
+	/// \note Events from other threads during this call may not be logged
+	void StopLog(void);
+
+	/// Sets whether to log messages with this identifier. Applies to internal packets, direct sends and receives, and pushed back packets.
+	/// Split messages only have an identifier in their first part, so the other parts are always logged. By default every identifier is logged
+	void SetMessageIDFilter(MessageID messageId, bool log);
+
+	/// Sets SetMessageIDFilter() for every identifier at once
+	void SetMessageIDFilterAll(bool log);
+
+	/// Log one of every \a sampleRate events that pass the filter. Defaults to 1, which logs everything
+	void SetSampleRate(unsigned int sampleRate);
+
+	/// \return How many records were lost because the logging thread fell behind
+	uint64_t GetDroppedRecords(void) const;
+
+	virtual void OnDirectSocketSend(const char *data, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress);
+	virtual void OnDirectSocketReceive(const char *data, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress);
+	virtual void OnReliabilityLayerNotification(const char *errorMessage, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress, bool isError);
+	virtual void OnInternalPacket(InternalPacket *internalPacket, unsigned frameNumber, SystemAddress remoteSystemAddress, RakNet::TimeMS time, int isSend);
+	virtual void OnAck(unsigned int messageNumber, SystemAddress remoteSystemAddress, RakNet::TimeMS time);
+	virtual void OnPushBackPacket(const char *data, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress);
+	virtual void WriteMiscellaneous(const char *type, const char *msg);
+
+	/// The decoder writes the header, so this does nothing
+	virtual void LogHeader(void);
+
+protected:
+	friend RAK_THREAD_DECLARATION(PacketBinaryLoggerLoop);
+
+	bool ShouldLog(unsigned char messageId, bool hasMessageId);
+	void InitRecord(PacketLogRecord &record, PacketLogRecordType type, uint64_t time, const SystemAddress &local, const SystemAddress &remote);
+	void PushRecord(const PacketLogRecord &record);
+	static void SetText(PacketLogRecord &record, const char *first, const char *second);
+
+	// Called on the logging thread
+	void WriteRecords(void);
+	void WriteToFile(const PacketLogRecord *records, unsigned int count);
+	bool OpenFile(void);
+	void GetFilename(unsigned int index, RakString &filename) const;
+
+	DataStructures::LocklessBoundedQueue<PacketLogRecord> ring;
+	SignaledEvent ringEvent;
+	// Set once a producer has woken the logging thread, so later producers do not signal again
+	std::atomic<bool> wakeRequested;
+	std::atomic<bool> isLogging;
+	LocklessUint32_t threadRunning;
+	std::atomic<uint64_t> droppedRecords;
+	// How many of droppedRecords the file already notes
+	uint64_t droppedRecordsWritten;
+
+	unsigned char messageIdFilter[256];
+	unsigned int sampleRate;
+	std::atomic<unsigned int> sampleCounter;
+
+	// Only used by the logging thread once it starts
+	FILE *logFile;
+	RakString filenamePrefix;
+	unsigned int startTime;
+	unsigned int fileIndex;
+	unsigned int fileBytes;
+	unsigned int maxFileBytes;
+	unsigned int maxFiles;
+};
+
+} // namespace RakNet
+
+#endif
+
+#endif // _RAKNET_SUPPORT_*
@@ -55,6 +55,11 @@ public:
 		, const char* idToPrint, const BitSize_t bitLen, unsigned long long time, const SystemAddress& local, const SystemAddress& remote,
 		unsigned int splitPacketId, unsigned int splitPacketIndex, unsigned int splitPacketCount, unsigned int orderingIndex);
 
+	// Translate the parameters of OnAck(), OnPushBackPacket() and WriteMiscellaneous() into an output line of at most intoLength characters, including the terminator
+	virtual void FormatAckLine(char* into, size_t intoLength, unsigned int messageNumber, unsigned long long time, const SystemAddress& local, const SystemAddress& remote);
+	virtual void FormatPushBackPacketLine(char* into, size_t intoLength, unsigned char messageIdentifier, const BitSize_t bitLen, unsigned long long time, const SystemAddress& local, const SystemAddress& remote);
+	virtual void FormatMiscellaneousLine(char* into, size_t intoLength, const char* type, const char* msg, unsigned long long time, const SystemAddress& local);
+
 	/// Events on low level sends and receives.  These functions may be called from different threads at the same time.
 	virtual void OnDirectSocketSend(const char *data, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress);
 	virtual void OnDirectSocketReceive(const char *data, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress);
@@ -94,7 +99,8 @@ protected:
 	virtual void AddToLog(const char *str);
 	// Users should override this
 	virtual const char* UserIDTOString(unsigned char Id);
-	void GetLocalTime(char buffer[128]);
+	// Fills the Clock column. Empty except on Windows
+	virtual void GetLocalTime(char buffer[128]);
 	bool logDirectMessages;
 
 	bool printId, printAcks;
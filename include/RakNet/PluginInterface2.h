@@ -79,6 +79,27 @@ enum PI2_FailedConnectionAttemptReason
 	FCAR_PUBLIC_KEY_MISMATCH
 };
 
+/// \brief The message IDs a plugin handles in OnReceive()
+/// \details Filled in by PluginInterface2::GetReceiveFilter(). RakPeer only passes a plugin the messages in its filter
+/// \ingroup PLUGIN_INTERFACE_GROUP
+class RAK_DLL_EXPORT PluginReceiveFilter
+{
+public:
+	PluginReceiveFilter() {Clear();}
+
+	void Clear(void) {for (int i=0; i < 8; i++) bits[i]=0;}
+
+	void Add(MessageID messageId) {bits[messageId >> 5]|=(uint32_t) 1 << (messageId & 31);}
+
+	/// Adds \a first through \a last, inclusive
+	void AddRange(MessageID first, MessageID last) {for (unsigned int i=first; i <= last; i++) Add((MessageID) i);}
+
+	bool Contains(MessageID messageId) const {return (bits[messageId >> 5] & ((uint32_t) 1 << (messageId & 31)))!=0;}
+
+protected:
+	uint32_t bits[8];
+};
+
 /// RakNet's plugin system. Each plugin processes the following events:
 /// -Connection attempts
 /// -The result of connection attempts
@@ -106,6 +127,13 @@ public:
 	/// \return True to allow the game and other plugins to get this message, false to absorb it
 	virtual PluginReceiveResult OnReceive(Packet *packet) {(void) packet; return RR_CONTINUE_PROCESSING;}
 
+	/// Queried by RakPeer when attached, and again when the plugin calls RefreshReceiveFilter()
+	/// Return true after adding every message ID OnReceive() handles to \a filter, and RakPeer will not call OnReceive() for any other message. Return false to get every message.
+	/// A message starting with ID_TIMESTAMP is matched on the message ID following the timestamp.
+	/// OnNewConnection(), OnClosedConnection() and OnFailedConnectionAttempt() are called regardless of the filter
+	/// \param[out] filter Empty when called
+	virtual bool GetReceiveFilter(PluginReceiveFilter &filter) const {(void) filter; return false;}
+
 	/// Called when RakPeer is initialized
 	virtual void OnRakPeerStartup(void) {}
 
@@ -134,6 +162,11 @@ public:
 	/// If true, then you cannot call RakPeer::AttachPlugin() or RakPeer::DetachPlugin() for this plugin, while RakPeer is active
 	virtual bool UsesReliabilityLayer(void) const {return false;}
 
+	/// Queried when attached to a RakPeer with more than one update thread. See RakPeer::SetNumberOfUpdateThreads()
+	/// Return true if OnReliabilityLayerNotification(), OnInternalPacket(), and OnAck() can be called from several threads at the same time
+	/// \pre Only queried if UsesReliabilityLayer() returns true
+	virtual bool IsReliabilityLayerThreadSafe(void) const {return false;}
+
 	/// Called on a send to the socket, per datagram, that does not go through the reliability layer
 	/// \pre To be called, UsesReliabilityLayer() must return true
 	/// \param[in] data The data being sent
@@ -194,6 +227,9 @@ protected:
 	void SendUnified( const char * data, const int length, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast );
 	bool SendListUnified( const char **data, const int *lengths, const int numParameters, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast );
 
+	/// Call when what GetReceiveFilter() returns changes. Call from the same thread as RakPeer::Receive()
+	void RefreshReceiveFilter(void);
+
 	Packet *AllocatePacketUnified(unsigned dataSize);
 	void PushBackPacketUnified(Packet *packet, bool pushAtHead);
 	void DeallocPacketUnified(Packet *packet);
@@ -176,6 +176,19 @@ class NetworkIDManager;
 		/// If called while processing a slot, no further slots for the currently executing signal will be executed
 		void InterruptSignal(void);
 
+		/// \brief Sets whether Call(), CallBlocking() and Signal() replace identifiers with short numbers once the remote system knows them
+		/// \details The first calls with an identifier to a remote system send the string along with a number, and the remote system acknowledges the number.
+		/// Later calls send only the number, and the remote system finds the function or slot by array index rather than by hashing the string.
+		/// Numbers are only sent to systems whose RPC4 announced that it reads them, so older versions of RPC4 still get strings.
+		/// RPC4 announces this to a system the first time it gets an RPC4 message from that system, so systems without RPC4 never get the announcement, and the first calls each way send strings.
+		/// While any connected system reads numbers, Call() and Signal() with broadcast send to each system in RakPeerInterface::GetSystemList() separately, in the form that system knows.
+		/// Systems whose connection has not completed do not get those broadcasts. CallLoopback() and calls through TCPInterface always send the string. Defaults to true.
+		/// \param[in] enable True to send numbers once acknowledged, false to always send the string
+		void SetInternIdentifiers(bool enable);
+
+		/// Returns the value passed to SetInternIdentifiers()
+		bool GetInternIdentifiers(void) const;
+
 		/// \internal
 		struct LocalCallback
 		{
@@ -215,6 +228,9 @@ class NetworkIDManager;
 		// --------------------------------------------------------------------------------------------
 		virtual void OnAttach(void);
 		virtual PluginReceiveResult OnReceive(Packet *packet);
+		virtual bool GetReceiveFilter(PluginReceiveFilter &filter) const;
+		virtual void OnClosedConnection(const SystemAddress &systemAddress, RakNetGUID rakNetGUID, PI2_LostConnectionReason lostConnectionReason );
+		virtual void OnRakPeerShutdown(void);
 
 		DataStructures::Hash<RakNet::RakString, void ( * ) ( RakNet::BitStream *, Packet * ),64, RakNet::RakString::ToInteger> registeredNonblockingFunctions;
 		DataStructures::Hash<RakNet::RakString, void ( * ) ( RakNet::BitStream *, RakNet::BitStream *, Packet * ),64, RakNet::RakString::ToInteger> registeredBlockingFunctions;
@@ -231,6 +247,52 @@ class NetworkIDManager;
 		bool interruptSignal;
 
 		void InvokeSignal(DataStructures::HashIndex functionIndex, RakNet::BitStream *serializedParameters, Packet *packet);
+		void InvokeSlots(LocalSlot *localSlot, RakNet::BitStream *serializedParameters, Packet *packet);
+
+		/// \internal
+		/// An identifier a remote system sent a number for, and what it was registered as here when last looked up
+		struct InternedIdentifier
+		{
+			RakNet::RakString identifier;
+			unsigned int registrationVersion;
+			void ( *nonblockingFunction ) ( RakNet::BitStream *, Packet * );
+			void ( *blockingFunction ) ( RakNet::BitStream *, RakNet::BitStream *, Packet * );
+			LocalSlot *localSlot;
+		};
+
+		/// \internal
+		struct InternedRemoteSystem
+		{
+			RakNetGUID guid;
+			/// True once the remote system announced that it reads numbers in place of identifiers
+			bool readsNumbers;
+			/// True once we announced to the remote system that we read numbers
+			bool announced;
+			/// Indexed by the number the remote system chose. 0 for numbers not received yet
+			DataStructures::List<InternedIdentifier*> incoming;
+			/// Indexed by the number we chose. True once the remote system acknowledged it
+			DataStructures::List<bool> outgoingAcknowledged;
+		};
+		static int InternedRemoteSystemComp(const RakNetGUID &key, InternedRemoteSystem* const &data );
+		DataStructures::OrderedList<RakNetGUID,InternedRemoteSystem*,RPC4::InternedRemoteSystemComp> internedRemoteSystems;
+
+		/// The number we send in place of each identifier
+		DataStructures::Hash<RakNet::RakString, unsigned int,64, RakNet::RakString::ToInteger> outgoingIdentifierNumbers;
+		/// How many numbers outgoingIdentifierNumbers has handed out
+		unsigned int outgoingIdentifierCount;
+
+		bool internIdentifiers;
+
+		/// Changed by every registration and unregistration, so InternedIdentifier knows to look up its identifier again
+		unsigned int registrationVersion;
+
+		void SendCall(MessageID callType, const char *identifier, bool isBlocking, RakNet::BitStream *bitStream, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast);
+		void WriteIdentifier(RakNet::BitStream *out, MessageID callType, const char *identifier, const AddressOrGUID systemIdentifier);
+		void AnnounceReadsNumbers(Packet *packet);
+		InternedIdentifier* ReadInternedIdentifier(RakNet::BitStream *bsIn, Packet *packet);
+		void LookUpInternedIdentifier(InternedIdentifier *internedIdentifier);
+		InternedRemoteSystem* GetInternedRemoteSystem(RakNetGUID guid, bool create);
+		void RemoveInternedRemoteSystem(unsigned int index);
 	};
 
 } // End namespace
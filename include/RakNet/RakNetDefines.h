@@ -160,6 +160,11 @@
 #define RPC4_GLOBAL_REGISTRATION_MAX_FUNCTION_NAME_LENGTH 48
 #endif
 
+/// Most identifiers RPC4 replaces with numbers. Identifiers past this many are always sent as strings, and larger numbers from a remote system are ignored
+#ifndef RPC4_MAX_INTERNED_IDENTIFIERS
+#define RPC4_MAX_INTERNED_IDENTIFIERS 4096
+#endif
+
 #ifndef XBOX_BYPASS_SECURITY
 #define XBOX_BYPASS_SECURITY 1
 #endif
@@ -170,12 +175,101 @@
 #define BUFFERED_PACKETS_PAGE_SIZE 8
 #endif
 
+// Number of received datagrams that can wait for the update thread, and number of processed datagram buffers kept for reuse by the recv threads
+// If the update thread falls this far behind, further datagrams are dropped and counted by RakPeer::GetBufferedPacketsDropped()
+#ifndef BUFFERED_PACKETS_QUEUE_SIZE
+#define BUFFERED_PACKETS_QUEUE_SIZE 4096
+#endif
+
+// Longest the RakPeer update thread sleeps when no resend, ack, ping, or connection attempt is due sooner
+// Incoming datagrams, Send(), Connect() and CloseConnection() wake it immediately
+#ifndef RAKPEER_MAXIMUM_UPDATE_WAIT_MS
+#define RAKPEER_MAXIMUM_UPDATE_WAIT_MS 100
+#endif
+
 // Controls how many allocations occur at once for the memory pool of incoming or outgoing datagrams.
 // Has small effect on memory usage per connection. Uses about 256 bytes*INTERNAL_PACKET_PAGE_SIZE per connection
 #ifndef INTERNAL_PACKET_PAGE_SIZE
 #define INTERNAL_PACKET_PAGE_SIZE 8
 #endif
 
+// If defined to 1, RNS2_Berkley can pull several datagrams per syscall with recvmmsg(), see RNS2_BerkleyBindParameters::recvBatchSize
+// Requires Linux 2.6.33 or later
+#ifndef RAKNET_SUPPORT_RECVMMSG
+#if defined(__linux__) && !defined(ANDROID)
+#define RAKNET_SUPPORT_RECVMMSG 1
+#else
+#define RAKNET_SUPPORT_RECVMMSG 0
+#endif
+#endif
+
+// If defined to 1, datagrams written by ReliabilityLayer during one RakPeer update cycle are queued with RakNetSocket2::SendBatched() and sent together with sendmmsg()
+// Runs of equal-sized datagrams to the same address are further combined into one UDP_SEGMENT (GSO) send when the kernel supports it
+#ifndef RAKNET_SUPPORT_SENDMMSG
+#if defined(__linux__) && !defined(ANDROID)
+#define RAKNET_SUPPORT_SENDMMSG 1
+#else
+#define RAKNET_SUPPORT_SENDMMSG 0
+#endif
+#endif
+
+// Number of datagrams RakNetSocket2::SendBatched() holds before it flushes on its own. Uses about MAXIMUM_MTU_SIZE bytes per datagram, per socket
+#ifndef RNS2_MAXIMUM_SEND_BATCH_SIZE
+#define RNS2_MAXIMUM_SEND_BATCH_SIZE 64
+#endif
+
+// If defined to 1, SocketDescriptor::reusePortSocketCount can bind several sockets to one port with SO_REUSEPORT, each with its own recv thread pinned to a core
+// Requires Linux 3.9 or later
+#ifndef RAKNET_SUPPORT_REUSEPORT
+#if defined(__linux__) && !defined(ANDROID)
+#define RAKNET_SUPPORT_REUSEPORT 1
+#else
+#define RAKNET_SUPPORT_REUSEPORT 0
+#endif
+#endif
+
+// Upper limit on SocketDescriptor::reusePortSocketCount
+#ifndef RNS2_MAXIMUM_REUSEPORT_SOCKETS
+#define RNS2_MAXIMUM_REUSEPORT_SOCKETS 64
+#endif
+
+// Upper limit on RNS2_BerkleyBindParameters::recvBatchSize. Each slot holds one RNS2RecvStruct (about MAXIMUM_MTU_SIZE bytes) while the recv thread waits
+#ifndef RNS2_MAXIMUM_RECV_BATCH_SIZE
+#define RNS2_MAXIMUM_RECV_BATCH_SIZE 64
+#endif
+
+// Number of datagrams to a secure connection that ReliabilityLayer::Update() encrypts together with AuthenticatedEncryption::EncryptBatch(). Uses about MAXIMUM_MTU_SIZE bytes per datagram, per update thread
+// 1 encrypts each datagram as it is written
+#ifndef RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE
+#define RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE 8
+#endif
+
+// Default for RakPeerInterface::SetStatisticsSnapshotInterval(). How often, in milliseconds, each connection publishes the statistics returned by RakPeerInterface::GetStatistics()
+#ifndef RAKPEER_STATISTICS_SNAPSHOT_INTERVAL_MS
+#define RAKPEER_STATISTICS_SNAPSHOT_INTERVAL_MS 100
+#endif
+
+// Default number of records PacketBinaryLogger holds for its logging thread. Each is sizeof(PacketLogRecord), 128 bytes
+#ifndef PACKET_BINARY_LOGGER_RING_SIZE
+#define PACKET_BINARY_LOGGER_RING_SIZE 8192
+#endif
+
+// Default for StatisticsHistory::SetMaxSamplesPerKey(). Values per key kept at full resolution, 16 bytes each plus 8 for the recent lowest and highest
+// Older values still within the time to track are folded into downsampled tiers
+#ifndef STATISTICS_HISTORY_MAX_SAMPLES
+#define STATISTICS_HISTORY_MAX_SAMPLES 1024
+#endif
+
+// Buckets in each StatisticsHistory downsampled tier. The first tier has buckets of STATISTICS_HISTORY_TIER_INTERVAL milliseconds,
+// and each bucket of the second tier covers a whole first tier
+#ifndef STATISTICS_HISTORY_TIER_BUCKETS
+#define STATISTICS_HISTORY_TIER_BUCKETS 64
+#endif
+
+#ifndef STATISTICS_HISTORY_TIER_INTERVAL
+#define STATISTICS_HISTORY_TIER_INTERVAL 1000
+#endif
+
 // If defined to 1, the user is responsible for calling RakPeer::RunUpdateCycle and RakPeer::RunRecvfrom
 #ifndef RAKPEER_USER_THREADED
 #define RAKPEER_USER_THREADED 0
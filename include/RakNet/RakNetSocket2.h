@@ -16,7 +16,9 @@
 #include "LocklessTypes.h"
 #include "RakThread.h"
 #include "DS_ThreadsafeAllocatingQueue.h"
+#include "SimpleMutex.h"
 #include "Export.h"
+#include <atomic>
 
 // For CFSocket
 // https://developer.apple.com/library/mac/#documentation/CoreFOundation/Reference/CFSocketRef/Reference/reference.html
@@ -40,6 +42,8 @@ namespace RakNet
 class RakNetSocket2;
 struct RNS2_BerkleyBindParameters;
 struct RNS2_SendParameters;
+struct RNS2RecvBatchScratch;
+struct RNS2SendBatch;
 typedef int RNS2Socket;
 
 enum RNS2BindResult
@@ -119,6 +123,11 @@ public:
 	// In order for the handler to trigger, some platforms must call PollRecvFrom, some platforms this create an internal thread.
 	void SetRecvEventHandler(RNS2EventHandler *_eventHandler);
 	virtual RNS2SendResult Send( RNS2_SendParameters *sendParameters, const char *file, unsigned int line )=0;
+	// Queues a datagram to go out with the next FlushSendBatch(), in order with other queued datagrams and with later calls to Send()
+	// Returns sendParameters->length once queued. Errors are reported per datagram when the batch is flushed, the same as Send()
+	// Threadsafe. RNS2_Linux guards the queue with sendBatchMutex, so any thread may queue and flush. Platforms without a batched send path send immediately
+	virtual RNS2SendResult SendBatched( RNS2_SendParameters *sendParameters, const char *file, unsigned int line ) {return Send(sendParameters, file, line);}
+	virtual void FlushSendBatch(void) {}
 	RNS2Type GetSocketType(void) const;
 	void SetSocketType(RNS2Type t);
 	bool IsBerkleySocket(void) const;
@@ -267,6 +276,14 @@ struct RNS2_BerkleyBindParameters
 	int pollingThreadPriority;
 	RNS2EventHandler *eventHandler;
 	unsigned short remotePortRakNetWasStartedOn_PS3_PS4_PSP2;
+	// If greater than 1, the recv thread reads up to this many datagrams per recvmmsg() call into preallocated RNS2RecvStruct.
+	// 0 or 1 reads one datagram per recvfrom() call. Ignored unless RAKNET_SUPPORT_RECVMMSG is 1. Clamped to RNS2_MAXIMUM_RECV_BATCH_SIZE
+	unsigned int recvBatchSize;
+	// If true, SO_REUSEPORT is set before binding so other sockets with this flag can bind the same port. The kernel hashes each remote address to one of them.
+	// Ignored unless RAKNET_SUPPORT_REUSEPORT is 1
+	bool reusePort;
+	// If 0 or greater, the recv thread pins itself to this CPU. -1 leaves the thread unpinned. Ignored unless RAKNET_SUPPORT_REUSEPORT is 1
+	int recvThreadCpu;
 };
 
 // Every platform except Windows Store 8 can use the Berkley sockets interface
@@ -308,9 +325,15 @@ protected:
 	void SetSocketOptions(void);
 	void SetBroadcastSocket(int broadcast);
 	void SetIPHdrIncl(int ipHdrIncl);
+	void SetReusePort(bool reusePort);
+	void SetRecvThreadAffinity(void);
 	void RecvFromBlocking(RNS2RecvStruct *recvFromStruct);
 	void RecvFromBlockingIPV4(RNS2RecvStruct *recvFromStruct);
 	void RecvFromBlockingIPV4And6(RNS2RecvStruct *recvFromStruct);
+#if RAKNET_SUPPORT_RECVMMSG==1
+	int RecvFromBlockingBatch(RNS2RecvStruct **recvFromStructs, int count, RNS2RecvBatchScratch *scratch);
+	unsigned RecvFromLoopBatchInt(void);
+#endif
 
 	RNS2Socket rns2Socket;
 	RNS2_BerkleyBindParameters binding;
@@ -434,14 +457,32 @@ protected:
 class RNS2_Linux : public RNS2_Berkley, public RNS2_Windows_Linux_360
 {
 public:
+#if RAKNET_SUPPORT_SENDMMSG==1
+	RNS2_Linux();
+	virtual ~RNS2_Linux();
+#endif
 	RNS2BindResult Bind( RNS2_BerkleyBindParameters *bindParameters, const char *file, unsigned int line );
 	RNS2SendResult Send( RNS2_SendParameters *sendParameters, const char *file, unsigned int line );
+#if RAKNET_SUPPORT_SENDMMSG==1
+	RNS2SendResult SendBatched( RNS2_SendParameters *sendParameters, const char *file, unsigned int line );
+	void FlushSendBatch(void);
+#endif
 
 	// ----------- STATICS ------------
 	static void GetMyIP( SystemAddress addresses[MAXIMUM_NUMBER_OF_INTERNAL_IDS] );
 protected:
 	static void GetMyIPIPV4( SystemAddress addresses[MAXIMUM_NUMBER_OF_INTERNAL_IDS] );
 	static void GetMyIPIPV4And6( SystemAddress addresses[MAXIMUM_NUMBER_OF_INTERNAL_IDS] );
+#if RAKNET_SUPPORT_SENDMMSG==1
+	// Requires sendBatchMutex
+	void FlushSendBatchInt(void);
+
+	// Allocated on the first SendBatched() call
+	RNS2SendBatch *sendBatch;
+	SimpleMutex sendBatchMutex;
+	// Lets Send() skip the mutex when nothing is queued. Written with sendBatchMutex locked, read without it
+	std::atomic<bool> sendBatchPending;
+#endif
 };
 
 #endif // Linux
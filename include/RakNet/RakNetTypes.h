@@ -182,6 +182,16 @@ struct RAK_DLL_EXPORT SocketDescriptor
 
 	/// XBOX only: set IPPROTO_VDP if you want to use VDP. If enabled, this socket does not support broadcast to 255.255.255.255
 	unsigned int extraSocketOptions;
+
+	/// Linux only: if greater than 1, the recv thread reads up to this many datagrams per recvmmsg() call. Default 0 reads one datagram per recvfrom() call
+	/// Useful for servers receiving a high datagram rate, where syscall overhead dominates the recv thread
+	unsigned int recvBatchSize;
+
+	/// Linux only: if greater than 1, binds this many sockets to the same port with SO_REUSEPORT. The kernel hashes each remote system to one of them.
+	/// Each socket gets its own recv thread, pinned to its own core. Connections reply through the socket their datagrams arrive on.
+	/// The extra sockets are internal: they are not returned by GetSockets() and take no connection socket index. Default 0 binds one socket.
+	/// If port is 0, the extra sockets share whichever port the first one was assigned
+	unsigned int reusePortSocketCount;
 };
 
 extern bool NonNumericHostString( const char *host );
@@ -424,6 +434,8 @@ struct RAK_DLL_EXPORT AddressOrGUID
 
 typedef uint64_t NetworkID;
 
+struct ReceiveBuffer;
+
 /// This represents a user message from another system.
 struct Packet
 {
@@ -448,6 +460,10 @@ struct Packet
 	/// Indicates whether to delete the data, or to simply delete the packet.
 	bool deleteData;
 
+	/// @internal
+	/// If not 0, data points into this shared copy of the datagram the message arrived in, rather than being allocated for this packet. See RakPeerInterface::SetZeroCopyReceive()
+	ReceiveBuffer *receiveBuffer;
+
 	/// @internal
 	/// If true, this message is meant for the user, not for the plugins, so do not process it through plugins
 	bool wasGeneratedLocally;
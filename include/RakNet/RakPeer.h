@@ -31,11 +31,16 @@
 //#include "RakNetSocket.h"
 #include "RakNetSmartPtr.h"
 #include "DS_ThreadsafeAllocatingQueue.h"
+#include "DS_LocklessBoundedQueue.h"
+#include "DS_SeqLockHashIndex.h"
+#include "DS_SeqLock.h"
+#include "ReceiveBuffer.h"
 #include "SignaledEvent.h"
 #include "NativeFeatureIncludes.h"
 #include "SecureHandshake.h"
 #include "LocklessTypes.h"
 #include "DS_Queue.h"
+#include "ThreadPool.h"
 
 namespace RakNet {
 /// Forward declarations
@@ -92,6 +97,25 @@ public:
 	/// \note Must be called while offline
 	void DisableSecurity( void );
 
+	/// \brief Moves the key agreement for secure incoming connections off the update thread onto \a count worker threads
+	/// \details The update thread still checks the cookie and assigns the connection, then sends ID_OPEN_CONNECTION_REPLY_2 once a worker has the answer. Other connections are not held up meanwhile.
+	/// While \a maxPendingHandshakes are queued or in progress, further connection requests are ignored. Clients send them again, so they connect once the backlog clears.
+	/// Verifying the client key when InitializeSecurity() was called with bRequireClientKey stays on the update thread.
+	/// Only takes effect if called before Startup(), with security initialized. Defaults to 0, which does the key agreement on the update thread
+	/// \pre LIBCAT_SECURITY must be defined to 1 in NativeFeatureIncludes.h for this function to have any effect
+	/// \param[in] count Number of worker threads
+	/// \param[in] maxPendingHandshakes Most handshakes queued or in progress at once
+	void SetNumberOfHandshakeThreads( unsigned int count, unsigned int maxPendingHandshakes=256 );
+
+	/// \brief Returns the value passed to SetNumberOfHandshakeThreads()
+	unsigned int GetNumberOfHandshakeThreads( void ) const;
+
+	/// \brief Returns how many handshakes are queued or in progress on the handshake threads
+	unsigned int GetNumberOfPendingHandshakes( void ) const;
+
+	/// \brief Returns how many connection requests were ignored since Startup() because maxPendingHandshakes were already pending
+	uint64_t GetNumberOfDroppedHandshakes( void ) const;
+
 	/// \brief This is useful if you have a fixed-address internal server behind a LAN.
 	///
 	///  Secure connections are determined by the recipient of an incoming connection. This has no effect if called on the system attempting to connect.	
@@ -121,6 +145,28 @@ public:
 	/// \return Maximum number of incoming connections, which is always <= maxConnections
 	unsigned int GetMaximumIncomingConnections( void ) const;
 
+	/// \brief Spreads the per-connection work of the update thread across \a count threads: processing incoming datagrams, resends, acks, and sending
+	/// \details Connections are assigned to threads by their system index. Connection state, internal messages and Receive() output stay on the update thread, so the API and message order are unchanged.
+	/// With more than one thread, PluginInterface2::OnInternalPacket(), OnAck() and OnReliabilityLayerNotification() are called from those threads, possibly at the same time.
+	/// Every attached plugin that returns true from PluginInterface2::UsesReliabilityLayer() must then also return true from PluginInterface2::IsReliabilityLayerThreadSafe(), which is asserted.
+	/// Messages sent by the update thread itself, such as pings and replies to connection messages, go out on the following cycle rather than the current one, adding up to one update interval of latency.
+	/// Only takes effect if called before Startup(). Defaults to 1
+	/// \param[in] count Number of threads, including the update thread
+	void SetNumberOfUpdateThreads( unsigned int count );
+
+	/// \brief Returns the value passed to SetNumberOfUpdateThreads()
+	unsigned int GetNumberOfUpdateThreads( void ) const;
+
+	/// \brief Hands unsplit incoming messages to Receive() as views into a shared copy of the datagram they arrived in.
+	/// \details Saves one allocation and one copy per message. The copy is returned to a pool when the last Packet pointing into it is deallocated.
+	/// Deallocate packets promptly with this enabled: one packet that is held keeps its whole datagram allocated. Messages split across datagrams are always copied.
+	/// Takes effect for datagrams processed after the call. Defaults to false
+	/// \param[in] enable True to hand out views, false to copy each message
+	void SetZeroCopyReceive( bool enable );
+
+	/// \brief Returns the value passed to SetZeroCopyReceive()
+	bool GetZeroCopyReceive( void ) const;
+
 	/// \brief Returns how many open connections exist at this time.
 	/// \return Number of open connections.
 	unsigned short NumberOfConnections(void) const;
@@ -243,6 +289,18 @@ public:
 	/// \note COMMON MISTAKE: When writing the first byte, bitStream->Write((unsigned char) ID_MY_TYPE) be sure it is casted to a byte, and you are not writing a 4 byte enumeration.
 	uint32_t Send( const RakNet::BitStream * bitStream, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, uint32_t forceReceiptNumber=0 );
 
+	/// Sends a block of data to the specified system that you are connected to.  Same as the above versions, but shares \a sendBuffer rather than copying it.
+	/// Every destination of a broadcast, and every fragment of a message too large for one datagram, references the same data. RakPeer adds its own references, so release yours whenever you are done with it.
+	/// \param[in] sendBuffer Data created with SendBuffer::Create()
+	/// \param[in] priority What priority level to send on.  See PacketPriority.h
+	/// \param[in] reliability How reliability to send this data.  See PacketPriority.h
+	/// \param[in] orderingChannel When using ordered or sequenced messages, what channel to order these on. Messages are only ordered relative to other messages on the same stream
+	/// \param[in] systemIdentifier Who to send this packet to, or in the case of broadcasting who not to send it to. Pass either a SystemAddress structure or a RakNetGUID structure. Use UNASSIGNED_SYSTEM_ADDRESS or to specify none
+	/// \param[in] broadcast True to send this packet to all connected systems. If true, then systemAddress specifies who not to send the packet to.
+	/// \param[in] forceReceipt If 0, will automatically determine the receipt number to return. If non-zero, will return what you give it.
+	/// \return 0 on bad input. Otherwise a number that identifies this message. If \a reliability is a type that returns a receipt, on a later call to Receive() you will get ID_SND_RECEIPT_ACKED or ID_SND_RECEIPT_LOSS with bytes 1-4 inclusive containing this number
+	uint32_t Send( RakNet::SendBuffer *sendBuffer, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, uint32_t forceReceiptNumber=0 );
+
 	/// \brief Sends multiple blocks of data, concatenating them automatically.
 	///
 	/// This is equivalent to:
@@ -267,16 +325,37 @@ public:
 
 	/// \brief Gets a message from the incoming message queue.
 	/// \details Use DeallocatePacket() to deallocate the message after you are done with it.
-	/// User-thread functions, such as RPC calls and the plugin function PluginInterface::Update occur here.
+	/// User-thread functions, such as RPC calls and the plugin function PluginInterface::Update occur here, unless SetUpdatePluginsOnReceive(false) was called.
 	/// \return 0 if no packets are waiting to be handled, otherwise a pointer to a packet.
 	/// \note COMMON MISTAKE: Be sure to call this in a loop, once per game tick, until it returns 0. If you only process one packet per game tick they will buffer up.
 	/// \sa RakNetTypes.h contains struct Packet.
 	Packet* Receive( void );
 
+	/// \brief Gets up to \a maxPackets messages from the incoming message queue at once.
+	/// \details Same as calling Receive() until it returns 0 or \a maxPackets messages were returned, but locks the queue once per batch rather than once per message, and updates plugins once per call.
+	/// Deallocate each message with DeallocatePacket(). Messages a plugin pushes back with PushBackPacket() while the batch is processed are returned by the next call.
+	/// \param[out] packets Array of at least \a maxPackets pointers to fill in.
+	/// \param[in] maxPackets Most messages to return.
+	/// \return How many entries of \a packets were filled in. 0 if no messages are waiting.
+	unsigned int ReceiveBatch( Packet **packets, unsigned int maxPackets );
+
 	/// \brief Call this to deallocate a message returned by Receive() when you are done handling it.
 	/// \param[in] packet Message to deallocate.	
 	void DeallocatePacket( Packet *packet );
 
+	/// \brief Calls PluginInterface2::Update() on every attached plugin.
+	/// \details Call once per game tick after SetUpdatePluginsOnReceive(false).
+	void UpdatePlugins( void );
+
+	/// \brief Sets whether Receive() and ReceiveBatch() call UpdatePlugins() each time they are called.
+	/// \details A loop draining the queue with Receive() updates every plugin once per message, which gets expensive when many messages arrive at once.
+	/// Pass false and call UpdatePlugins() once per game tick instead. Defaults to true.
+	/// \param[in] enable True to update plugins from Receive() and ReceiveBatch()
+	void SetUpdatePluginsOnReceive( bool enable );
+
+	/// \brief Returns the value passed to SetUpdatePluginsOnReceive()
+	bool GetUpdatePluginsOnReceive( void ) const;
+
 	/// \brief Return the total number of connections we are allowed.
 	/// \return Total number of connections allowed.
 	unsigned int GetMaximumNumberOfPeers( void ) const;
@@ -537,6 +616,10 @@ public:
 	/// \param[in] messageHandler Pointer to a plugin to detach.
 	void DetachPlugin( PluginInterface2 *messageHandler );
 
+	/// \brief Asks every attached plugin for PluginInterface2::GetReceiveFilter() again
+	/// \details Plugins call this through PluginInterface2::RefreshReceiveFilter() when the message IDs they handle change. Call from the same thread as Receive()
+	void RefreshPluginReceiveFilters( void );
+
 	// --------------------------------------------------------------------------------------------Miscellaneous Functions--------------------------------------------------------------------------------------------
 	/// \brief Puts a message back in the receive queue in case you don't want to deal with it immediately.
 	/// \param[in] packet The pointer to the packet you want to push back.
@@ -608,7 +691,8 @@ public:
 
 	/// \brief Returns a structure containing a large set of network statistics for the specified system.
 	/// You can map this data to a string using the C style StatisticsToString() function
-	/// \param[in] systemAddress Which connected system to get statistics for.
+	/// The statistics are a snapshot published by the network thread, at most SetStatisticsSnapshotInterval() old. Reading them never blocks the network thread
+	/// \param[in] systemAddress Which connected system to get statistics for. Pass UNASSIGNED_SYSTEM_ADDRESS for the sum over all connected systems.
 	/// \param[in] rns If you supply this structure,the network statistics will be written to it. Otherwise the method uses a static struct to write the data, which is not threadsafe.
 	/// \return 0 if the specified system can't be found. Otherwise a pointer to the struct containing the specified system's network statistics.
 	/// \sa RakNetStatistics.h
@@ -623,9 +707,20 @@ public:
 	/// \param[out] statistics Calculated RakNetStatistics for each connected system
 	virtual void GetStatisticsList(DataStructures::List<SystemAddress> &addresses, DataStructures::List<RakNetGUID> &guids, DataStructures::List<RakNetStatistics> &statistics);
 
+	/// \brief Set how often the network thread publishes the statistics returned by GetStatistics() and GetStatisticsList()
+	/// \details Each connection publishes its own snapshot, and the network thread publishes the sum over all connections at the same interval. Defaults to RAKPEER_STATISTICS_SNAPSHOT_INTERVAL_MS
+	/// \param[in] intervalMS Milliseconds between snapshots. 0 to publish every update, so statistics are current but each update costs more
+	void SetStatisticsSnapshotInterval(RakNet::TimeMS intervalMS);
+
+	/// \brief Returns what was passed to SetStatisticsSnapshotInterval()
+	RakNet::TimeMS GetStatisticsSnapshotInterval(void) const;
+
 	/// \Returns how many messages are waiting when you call Receive()
 	virtual unsigned int GetReceiveBufferSize(void);
 
+	/// \brief Returns how many incoming datagrams were dropped because the update thread fell BUFFERED_PACKETS_QUEUE_SIZE datagrams behind the recv threads
+	virtual uint32_t GetBufferedPacketsDropped(void) const;
+
 	// --------------------------------------------------------------------------------------------EVERYTHING AFTER THIS COMMENT IS FOR INTERNAL USE ONLY--------------------------------------------------------------------------------------------
 
 
@@ -639,6 +734,11 @@ public:
 	// );
 	bool RunUpdateCycle( BitStream &updateBitStream );
 
+	/// \internal
+	/// How long the update thread should wait after RunUpdateCycle(), before quitAndDataEvents is set
+	int GetUpdateCycleWaitMS(void) const;
+	void ScheduleUpdateCycle(RakNet::TimeUS time);
+
 	/// \internal
 	// Call manually if RAKPEER_USER_THREADED==1 at least every 30 milliseconds.
 	// Call in a loop until returns false if the socket is non-blocking
@@ -688,17 +788,41 @@ public:
 		// If the server has bRequireClientKey = true, then this is set to the validated public key of the connected client
 		// Valid after connectMode reaches HANDLING_CONNECTION_REQUEST
 		char client_public_key[cat::EasyHandshake::PUBLIC_KEY_BYTES];
+
+		// True while a handshake thread computes the answer. Datagrams are ignored until then, as there are no keys yet
+		bool handshakePending;
+		// Matches HandshakeJob::handshakeId while handshakePending
+		unsigned int handshakeId;
 #endif
 
 		enum ConnectMode {NO_ACTION, DISCONNECT_ASAP, DISCONNECT_ASAP_SILENTLY, DISCONNECT_ON_NO_ACK, REQUESTED_CONNECTION, HANDLING_CONNECTION_REQUEST, UNVERIFIED_SENDER, CONNECTED} connectMode;
 	};
 
+	/// \internal
+	/// One partition of the connections when SetNumberOfUpdateThreads() is greater than 1
+	/// Shard 0 runs on the update thread, the others each on their own thread. All are filled and drained by the update thread
+	struct UpdateShard
+	{
+		RakPeer *rakPeer;
+		// Connections to Update() this cycle
+		DataStructures::List<RemoteSystemStruct*> remoteSystems;
+		// Datagrams from connected systems, in arrival order, with the connection each is for
+		DataStructures::List<RNS2RecvStruct*> datagrams;
+		DataStructures::List<RemoteSystemStruct*> datagramSystems;
+		RakNetRandom rnr;
+		BitStream updateBitStream;
+		SignaledEvent startEvent, doneEvent;
+		std::atomic<bool> hasWork;
+		volatile bool isThreadActive;
+	};
+
 	// DS_APR
 	//void ProcessChromePacket(RakNetSocket2 *s, const char *buffer, int dataSize, const SystemAddress& recvFromAddress, RakNet::TimeUS timeRead);
 	// /DS_APR
 protected:
 
 	friend RAK_THREAD_DECLARATION(UpdateNetworkLoop);
+	friend RAK_THREAD_DECLARATION(UpdateShardLoop);
 	//friend RAK_THREAD_DECLARATION(RecvFromLoop);
 	friend RAK_THREAD_DECLARATION(UDTConnect);
 
@@ -791,6 +915,16 @@ protected:
 	void ClearRemoteSystemLookup(void);
 	DataStructures::MemoryPool<RemoteSystemIndex> remoteSystemIndexPool;
 
+	// remoteSystemLookup is only safe from the network thread. These mirror the systemAddress and guid of every remoteSystemList entry, and are safe to read from any thread
+	// Only the network thread writes them, through SetRemoteSystemAddress() and SetRemoteSystemGuid()
+	DataStructures::SeqLockHashIndex remoteSystemAddressIndex;
+	DataStructures::SeqLockHashIndex remoteSystemGuidIndex;
+	void SetRemoteSystemAddress(unsigned int remoteSystemListIndex, const SystemAddress &sa);
+	void SetRemoteSystemGuid(unsigned int remoteSystemListIndex, const RakNetGUID &guid);
+	// Active systems take priority. If onlyActive is false and no active system matches, returns an inactive match. Returns (unsigned int) -1 if none
+	unsigned int FindRemoteSystemIndex(const SystemAddress &sa, bool onlyActive) const;
+	unsigned int FindRemoteSystemIndex(const RakNetGUID &guid, bool onlyActive) const;
+
 	void AddToActiveSystemList(unsigned int remoteSystemListIndex);
 	void RemoveFromActiveSystemList(const SystemAddress &sa);
 
@@ -862,6 +996,8 @@ protected:
 	DataStructures::List<BanStruct*> banList;
 	// Threadsafe, and not thread safe
 	DataStructures::List<PluginInterface2*> pluginListTS, pluginListNTS;
+	// For each message ID, the plugins whose OnReceive() Receive() calls, pluginListTS first. Built by RefreshPluginReceiveFilters()
+	DataStructures::List<PluginInterface2*> pluginReceiveTable[256];
 
 	DataStructures::Queue<RequestedConnectionStruct*> requestedConnectionQueue;
 	SimpleMutex requestedConnectionQueueMutex;
@@ -880,6 +1016,8 @@ protected:
 		NetworkID networkID;
 		bool blockingCommand; // Only used for RPC
 		char *data;
+		// BCS_SEND only. If not 0, data is 0 and this command holds one reference to sendBuffer
+		SendBuffer *sendBuffer;
 		bool haveRakNetCloseSocket;
 		unsigned connectionSocketIndex;
 		unsigned short remotePortRakNetWasStartedOn_PS3;
@@ -898,10 +1036,12 @@ protected:
 
 	// DataStructures::ThreadsafeAllocatingQueue<RNS2RecvStruct> bufferedPackets;
 
-	DataStructures::Queue<RNS2RecvStruct*> bufferedPacketsFreePool;
-	RakNet::SimpleMutex bufferedPacketsFreePoolMutex;
-	DataStructures::Queue<RNS2RecvStruct*> bufferedPacketsQueue;
-	RakNet::SimpleMutex bufferedPacketsQueueMutex;
+	// Processed datagram buffers, recycled to the recv threads
+	DataStructures::LocklessBoundedQueue<RNS2RecvStruct*> bufferedPacketsFreePool;
+	// Datagrams from the recv threads, waiting for the update thread
+	DataStructures::LocklessBoundedQueue<RNS2RecvStruct*> bufferedPacketsQueue;
+	// Datagrams dropped because bufferedPacketsQueue was full
+	RakNet::LocklessUint32_t bufferedPacketsDropped;
 
 	virtual void DeallocRNS2RecvStruct(RNS2RecvStruct *s, const char *file, unsigned int line);
 	virtual RNS2RecvStruct *AllocRNS2RecvStruct(const char *file, unsigned int line);
@@ -926,7 +1066,7 @@ protected:
 	void CloseConnectionInternal( const AddressOrGUID& systemIdentifier, bool sendDisconnectionNotification, bool performImmediate, unsigned char orderingChannel, PacketPriority disconnectionNotificationPriority );
 	void SendBuffered( const char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, RemoteSystemStruct::ConnectMode connectionMode, uint32_t receipt );
 	void SendBufferedList( const char **data, const int *lengths, const int numParameters, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, RemoteSystemStruct::ConnectMode connectionMode, uint32_t receipt );
-	bool SendImmediate( char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, bool useCallerDataAllocation, RakNet::TimeUS currentTime, uint32_t receipt );
+	bool SendImmediate( char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, bool useCallerDataAllocation, RakNet::TimeUS currentTime, uint32_t receipt, SendBuffer *sendBuffer=0 );
 	//bool HandleBufferedRPC(BufferedCommandStruct *bcs, RakNet::TimeMS time);
 	void ClearBufferedCommands(void);
 	void ClearBufferedPackets(void);
@@ -943,6 +1083,8 @@ protected:
 
 	// Smart pointer so I can return the object to the user
 	DataStructures::List<RakNetSocket2* > socketList;
+	// The extra SO_REUSEPORT sockets for SocketDescriptor::reusePortSocketCount. Kept out of socketList so socket indices stay those the user passed to Startup()
+	DataStructures::List<RakNetSocket2* > reusePortSocketList;
 	void DerefAllSockets(void);
 	unsigned int GetRakNetSocketFromUserConnectionSocketIndex(unsigned int userIndex) const;
 	// Used for RPC replies
@@ -973,6 +1115,11 @@ protected:
 	SystemAddress firstExternalID;
 	int splitMessageProgressInterval;
 	RakNet::TimeMS unreliableTimeout;
+	RakNet::TimeMS statisticsSnapshotInterval;
+	// Sum of the connection snapshots, for GetStatistics(UNASSIGNED_SYSTEM_ADDRESS). Written by the network thread
+	DataStructures::SeqLock<RakNetStatistics> peerStatisticsSnapshot;
+	RakNet::TimeMS nextPeerStatisticsSnapshotTime;
+	void PublishPeerStatisticsSnapshot(void);
 
 	bool (*incomingDatagramEventHandler)(RNS2RecvStruct *);
 
@@ -988,15 +1135,40 @@ protected:
 
 
 	SignaledEvent quitAndDataEvents;
+	unsigned int numberOfUpdateThreads;
+	DataStructures::List<UpdateShard*> updateShards;
+	RakNet::TimeUS updateShardsTime;
+	bool StartUpdateShards(int threadPriority);
+	void StopUpdateShards(void);
+	bool QueueForUpdateShard(RNS2RecvStruct *recvFromStruct);
+	void RunUpdateShards(RakNet::TimeUS timeNS);
+	void UpdateShardSystems(UpdateShard *shard);
+
+	unsigned int numberOfHandshakeThreads, maxPendingHandshakes;
+	// Written by the update thread, read by any thread
+	std::atomic<unsigned int> numberOfPendingHandshakes;
+	std::atomic<uint64_t> numberOfDroppedHandshakes;
+	bool StartHandshakeThreads(void);
+	void StopHandshakeThreads(void);
+
+	// Time of the last RunUpdateCycle(), and the earliest time anything it handles is due again. 0 if nothing is scheduled
+	RakNet::TimeUS lastUpdateCycleTime, nextUpdateCycleTime;
 	bool limitConnectionFrequencyFromTheSameIP;
 
 	SimpleMutex packetAllocationPoolMutex;
 	DataStructures::MemoryPool<Packet> packetAllocationPool;
 
+	// If true, Receive() and ReceiveBatch() call UpdatePlugins()
+	bool updatePluginsOnReceive;
+
+	// Copies of incoming datagrams that received messages point into, when zeroCopyReceive is true. Set by the user's thread, read by the update threads
+	std::atomic<bool> zeroCopyReceive;
+	ReceiveBufferPool receiveBufferPool;
+
 	SimpleMutex packetReturnMutex;
 	DataStructures::Queue<Packet*> packetReturnQueue;
 	Packet *AllocPacket(unsigned dataSize, const char *file, unsigned int line);
-	Packet *AllocPacket(unsigned dataSize, unsigned char *data, const char *file, unsigned int line);
+	Packet *AllocPacket(unsigned dataSize, unsigned char *data, ReceiveBuffer *receiveBuffer, const char *file, unsigned int line);
 
 	/// This is used to return a number to the user when they call Send identifying the message
 	/// This number will be returned back with ID_SND_RECEIPT_ACKED or ID_SND_RECEIPT_LOSS and is only returned
@@ -1006,6 +1178,8 @@ protected:
 	void ResetSendReceipt(void);
 	void OnConnectedPong(RakNet::Time sendPingTime, RakNet::Time sendPongTime, RemoteSystemStruct *remoteSystem);
 	void CallPluginCallbacks(DataStructures::List<PluginInterface2*> &pluginList, Packet *packet);
+	// Runs plugin callbacks and OnReceive() for a message taken from packetReturnQueue. Returns false if a plugin absorbed it
+	bool RunReceivePlugins( Packet *packet );
 
 #if LIBCAT_SECURITY==1
 	// Encryption and security
@@ -1014,6 +1188,38 @@ protected:
 	cat::ServerEasyHandshake *_server_handshake;
 	cat::CookieJar *_cookie_jar;
 	bool InitializeClientSecurity(RequestedConnectionStruct *rcs, const char *public_key);
+
+	// Kept so each handshake thread can initialize its own ServerEasyHandshake, which is not threadsafe
+	char my_private_key[cat::EasyHandshake::PRIVATE_KEY_BYTES];
+
+	/// \internal
+	/// One ServerEasyHandshake::ProcessChallenge() for a handshake thread. Filled in by the update thread, which sends the result in ProcessHandshakeCompletions()
+	struct HandshakeJob
+	{
+		RakPeer *rakPeer;
+		SystemAddress systemAddress;
+		RakNetGUID guid;
+		uint16_t mtu;
+		unsigned int handshakeId;
+		char challenge[cat::EasyHandshake::CHALLENGE_BYTES];
+		char answer[cat::EasyHandshake::ANSWER_BYTES];
+		cat::AuthenticatedEncryption authenticatedEncryption;
+		bool succeeded;
+	};
+
+	/// \internal
+	/// Creates the ServerEasyHandshake for each handshake thread
+	struct HandshakeThreadDataFactory : public ThreadDataInterface
+	{
+		virtual void* PerThreadFactory(void *context);
+		virtual void PerThreadDestructor(void* factoryResult, void *context);
+	};
+
+	ThreadPool<HandshakeJob*,HandshakeJob*> handshakeThreadPool;
+	HandshakeThreadDataFactory handshakeThreadDataFactory;
+	unsigned int nextHandshakeId;
+	static HandshakeJob* ProcessHandshakeJob(HandshakeJob *job, bool *returnOutput, void* perThreadData);
+	void ProcessHandshakeCompletions(void);
 #endif
 
 
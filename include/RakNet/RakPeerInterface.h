@@ -24,6 +24,7 @@
 #include "DS_List.h"
 #include "RakNetSmartPtr.h"
 #include "RakNetSocket2.h"
+#include "SendBuffer.h"
 
 namespace RakNet
 {
@@ -78,6 +79,24 @@ public:
 	/// \note Must be called while offline
 	virtual void DisableSecurity( void )=0;
 
+	/// Moves the key agreement for secure incoming connections off the update thread onto \a count worker threads
+	/// The update thread still checks the cookie and assigns the connection, then sends ID_OPEN_CONNECTION_REPLY_2 once a worker has the answer. Other connections are not held up meanwhile
+	/// While \a maxPendingHandshakes are queued or in progress, further connection requests are ignored. Clients send them again, so they connect once the backlog clears
+	/// Only takes effect if called before Startup(), with security initialized. Defaults to 0, which does the key agreement on the update thread
+	/// \pre LIBCAT_SECURITY must be defined to 1 in NativeFeatureIncludes.h for this function to have any effect
+	/// \param[in] count Number of worker threads
+	/// \param[in] maxPendingHandshakes Most handshakes queued or in progress at once
+	virtual void SetNumberOfHandshakeThreads( unsigned int count, unsigned int maxPendingHandshakes=256 )=0;
+
+	/// Returns the value passed to SetNumberOfHandshakeThreads()
+	virtual unsigned int GetNumberOfHandshakeThreads( void ) const=0;
+
+	/// Returns how many handshakes are queued or in progress on the handshake threads
+	virtual unsigned int GetNumberOfPendingHandshakes( void ) const=0;
+
+	/// Returns how many connection requests were ignored since Startup() because maxPendingHandshakes were already pending
+	virtual uint64_t GetNumberOfDroppedHandshakes( void ) const=0;
+
 	/// If secure connections are on, do not use secure connections for a specific IP address.
 	/// This is useful if you have a fixed-address internal server behind a LAN.
 	/// \note Secure connections are determined by the recipient of an incoming connection. This has no effect if called on the system attempting to connect.
@@ -103,6 +122,27 @@ public:
 	/// \return the maximum number of incoming connections, which is always <= maxConnections
 	virtual unsigned int GetMaximumIncomingConnections( void ) const=0;
 
+	/// Spreads the per-connection work of the update thread across \a count threads: processing incoming datagrams, resends, acks, and sending
+	/// Connections are assigned to threads by their system index. Connection state, internal messages and Receive() output stay on the update thread, so the API and message order are unchanged
+	/// With more than one thread, PluginInterface2::OnInternalPacket(), OnAck() and OnReliabilityLayerNotification() are called from those threads, possibly at the same time
+	/// Every attached plugin that returns true from PluginInterface2::UsesReliabilityLayer() must then also return true from PluginInterface2::IsReliabilityLayerThreadSafe(), which is asserted
+	/// Messages sent by the update thread itself, such as pings and replies to connection messages, go out on the following cycle rather than the current one, adding up to one update interval of latency
+	/// Only takes effect if called before Startup(). Defaults to 1
+	/// \param[in] count Number of threads, including the update thread
+	virtual void SetNumberOfUpdateThreads( unsigned int count )=0;
+
+	/// Returns the value passed to SetNumberOfUpdateThreads()
+	virtual unsigned int GetNumberOfUpdateThreads( void ) const=0;
+
+	/// Hands unsplit incoming messages to Receive() as views into a shared copy of the datagram they arrived in, saving one allocation and one copy per message
+	/// The copy is returned to a pool when the last Packet pointing into it is deallocated, so one packet that is held keeps its whole datagram allocated. Messages split across datagrams are always copied
+	/// Takes effect for datagrams processed after the call. Defaults to false
+	/// \param[in] enable True to hand out views, false to copy each message
+	virtual void SetZeroCopyReceive( bool enable )=0;
+
+	/// Returns the value passed to SetZeroCopyReceive()
+	virtual bool GetZeroCopyReceive( void ) const=0;
+
 	/// Returns how many open connections there are at this time
 	/// \return the number of open connections
 	virtual unsigned short NumberOfConnections(void) const=0;
@@ -216,6 +256,18 @@ public:
 	/// \note COMMON MISTAKE: When writing the first byte, bitStream->Write((unsigned char) ID_MY_TYPE) be sure it is casted to a byte, and you are not writing a 4 byte enumeration.
 	virtual uint32_t Send( const RakNet::BitStream * bitStream, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, uint32_t forceReceiptNumber=0 )=0;
 
+	/// Sends a block of data to the specified system that you are connected to.  Same as the above versions, but shares \a sendBuffer rather than copying it.
+	/// Every destination of a broadcast, and every fragment of a message too large for one datagram, references the same data. RakPeer adds its own references, so release yours whenever you are done with it.
+	/// \param[in] sendBuffer Data created with SendBuffer::Create()
+	/// \param[in] priority What priority level to send on.  See PacketPriority.h
+	/// \param[in] reliability How reliability to send this data.  See PacketPriority.h
+	/// \param[in] orderingChannel When using ordered or sequenced messages, what channel to order these on. Messages are only ordered relative to other messages on the same stream
+	/// \param[in] systemIdentifier Who to send this packet to, or in the case of broadcasting who not to send it to. Pass either a SystemAddress structure or a RakNetGUID structure. Use UNASSIGNED_SYSTEM_ADDRESS or to specify none
+	/// \param[in] broadcast True to send this packet to all connected systems. If true, then systemAddress specifies who not to send the packet to.
+	/// \param[in] forceReceipt If 0, will automatically determine the receipt number to return. If non-zero, will return what you give it.
+	/// \return 0 on bad input. Otherwise a number that identifies this message. If \a reliability is a type that returns a receipt, on a later call to Receive() you will get ID_SND_RECEIPT_ACKED or ID_SND_RECEIPT_LOSS with bytes 1-4 inclusive containing this number
+	virtual uint32_t Send( RakNet::SendBuffer *sendBuffer, PacketPriority priority, PacketReliability reliability, char orderingChannel, const AddressOrGUID systemIdentifier, bool broadcast, uint32_t forceReceiptNumber=0 )=0;
+
 	/// Sends multiple blocks of data, concatenating them automatically.
 	///
 	/// This is equivalent to:
@@ -240,16 +292,35 @@ public:
 
 	/// Gets a message from the incoming message queue.
 	/// Use DeallocatePacket() to deallocate the message after you are done with it.
-	/// User-thread functions, such as RPC calls and the plugin function PluginInterface::Update occur here.
+	/// User-thread functions, such as RPC calls and the plugin function PluginInterface::Update occur here, unless SetUpdatePluginsOnReceive(false) was called.
 	/// \return 0 if no packets are waiting to be handled, otherwise a pointer to a packet.
 	/// \note COMMON MISTAKE: Be sure to call this in a loop, once per game tick, until it returns 0. If you only process one packet per game tick they will buffer up.
 	/// sa RakNetTypes.h contains struct Packet
 	virtual Packet* Receive( void )=0;
 
+	/// Gets up to \a maxPackets messages from the incoming message queue at once
+	/// Same as calling Receive() until it returns 0 or \a maxPackets messages were returned, but locks the queue once per batch rather than once per message, and updates plugins once per call
+	/// Deallocate each message with DeallocatePacket()
+	/// \param[out] packets Array of at least \a maxPackets pointers to fill in
+	/// \param[in] maxPackets Most messages to return
+	/// \return How many entries of \a packets were filled in. 0 if no messages are waiting
+	virtual unsigned int ReceiveBatch( Packet **packets, unsigned int maxPackets )=0;
+
 	/// Call this to deallocate a message returned by Receive() when you are done handling it.
 	/// \param[in] packet The message to deallocate.	
 	virtual void DeallocatePacket( Packet *packet )=0;
 
+	/// Calls PluginInterface2::Update() on every attached plugin. Call once per game tick after SetUpdatePluginsOnReceive(false)
+	virtual void UpdatePlugins( void )=0;
+
+	/// Sets whether Receive() and ReceiveBatch() call UpdatePlugins() each time they are called
+	/// A loop draining the queue with Receive() updates every plugin once per message. Pass false and call UpdatePlugins() once per game tick instead. Defaults to true
+	/// \param[in] enable True to update plugins from Receive() and ReceiveBatch()
+	virtual void SetUpdatePluginsOnReceive( bool enable )=0;
+
+	/// Returns the value passed to SetUpdatePluginsOnReceive()
+	virtual bool GetUpdatePluginsOnReceive( void ) const=0;
+
 	/// Return the total number of connections we are allowed
 	virtual unsigned int GetMaximumNumberOfPeers( void ) const=0;
 
@@ -500,6 +571,10 @@ public:
 	/// \param[in] messageHandler Pointer to a plugin to detach.
 	virtual void DetachPlugin( PluginInterface2 *messageHandler )=0;
 
+	/// \brief Asks every attached plugin for PluginInterface2::GetReceiveFilter() again
+	/// \details Plugins call this through PluginInterface2::RefreshReceiveFilter() when the message IDs they handle change. Call from the same thread as Receive()
+	virtual void RefreshPluginReceiveFilters( void )=0;
+
 	// --------------------------------------------------------------------------------------------Miscellaneous Functions--------------------------------------------------------------------------------------------
 	/// Put a message back at the end of the receive queue in case you don't want to deal with it immediately
 	/// \param[in] packet The packet you want to push back.
@@ -572,7 +647,8 @@ public:
 
 	/// Returns a structure containing a large set of network statistics for the specified system.
 	/// You can map this data to a string using the C style StatisticsToString() function
-	/// \param[in] systemAddress: Which connected system to get statistics for
+	/// The statistics are a snapshot published by the network thread, at most SetStatisticsSnapshotInterval() old. Reading them never blocks the network thread
+	/// \param[in] systemAddress: Which connected system to get statistics for. Pass UNASSIGNED_SYSTEM_ADDRESS for the sum over all connected systems
 	/// \param[in] rns If you supply this structure, it will be written to it.  Otherwise it will use a static struct, which is not threadsafe
 	/// \return 0 on can't find the specified system.  A pointer to a set of data otherwise.
 	/// \sa RakNetStatistics.h
@@ -587,9 +663,21 @@ public:
 	/// \param[out] statistics Calculated RakNetStatistics for each connected system
 	virtual void GetStatisticsList(DataStructures::List<SystemAddress> &addresses, DataStructures::List<RakNetGUID> &guids, DataStructures::List<RakNetStatistics> &statistics)=0;
 
+	/// Set how often the network thread publishes the statistics returned by GetStatistics() and GetStatisticsList(), for each connection and for the sum over all connections
+	/// Defaults to RAKPEER_STATISTICS_SNAPSHOT_INTERVAL_MS
+	/// \param[in] intervalMS Milliseconds between snapshots. 0 to publish every update, so statistics are current but each update costs more
+	virtual void SetStatisticsSnapshotInterval(RakNet::TimeMS intervalMS)=0;
+
+	/// \return What was passed to SetStatisticsSnapshotInterval()
+	virtual RakNet::TimeMS GetStatisticsSnapshotInterval(void) const=0;
+
 	/// \Returns how many messages are waiting when you call Receive()
 	virtual unsigned int GetReceiveBufferSize(void)=0;
 
+	/// \brief Returns how many incoming datagrams were dropped because the update thread fell BUFFERED_PACKETS_QUEUE_SIZE datagrams behind the recv threads
+	/// \details A rising value means the update thread cannot keep up with the incoming datagram rate
+	virtual uint32_t GetBufferedPacketsDropped(void) const=0;
+
 	// --------------------------------------------------------------------------------------------EVERYTHING AFTER THIS COMMENT IS FOR INTERNAL USE ONLY--------------------------------------------------------------------------------------------
 	
 	/// \internal
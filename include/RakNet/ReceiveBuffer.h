@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file ReceiveBuffer.h
+/// \internal
+/// \brief Pooled, reference counted copies of incoming datagrams, which received messages point into rather than copying
+///
+
+#ifndef __RAKNET_RECEIVE_BUFFER_H
+#define __RAKNET_RECEIVE_BUFFER_H
+
+#include "RakMemoryOverride.h"
+#include "MTUSize.h"
+#include "NativeTypes.h"
+#include "Export.h"
+#include "SimpleMutex.h"
+#include "DS_MemoryPool.h"
+#include <atomic>
+
+namespace RakNet
+{
+
+class ReceiveBufferPool;
+
+/// \internal
+/// \brief One incoming datagram, shared by every unsplit message parsed from it
+/// \details Each InternalPacket and Packet that points into \a data holds one reference. The last Release() returns the buffer to its pool.
+/// AddRef() and Release() may be called from any thread.
+struct ReceiveBuffer
+{
+	void AddRef(void);
+	void Release(void);
+
+	std::atomic<uint32_t> refCount;
+	ReceiveBufferPool *pool;
+	unsigned char data[MAXIMUM_MTU_SIZE];
+};
+
+/// \internal
+/// \brief Threadsafe pool of ReceiveBuffer. Buffers are allocated by the threads that parse datagrams and released by whichever thread deallocates the last message
+class RAK_DLL_EXPORT ReceiveBufferPool
+{
+public:
+	ReceiveBufferPool();
+	~ReceiveBufferPool();
+
+	/// Copies \a length bytes of \a datagram into a buffer. The caller owns the one reference
+	/// \return 0 if out of memory
+	ReceiveBuffer *Allocate(const unsigned char *datagram, unsigned int length, const char *file, unsigned int line);
+
+	/// Frees the memory of every buffer. Do not call while any buffer is referenced
+	void Clear(const char *file, unsigned int line);
+
+protected:
+	friend struct ReceiveBuffer;
+	void Release(ReceiveBuffer *receiveBuffer);
+
+	SimpleMutex poolMutex;
+	DataStructures::MemoryPool<ReceiveBuffer> pool;
+};
+
+} // namespace RakNet
+
+#endif
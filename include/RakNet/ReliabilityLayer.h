@@ -33,6 +33,8 @@
 #include "DS_MemoryPool.h"
 #include "RakNetDefines.h"
 #include "DS_Heap.h"
+#include "DS_TimerWheel.h"
+#include "DS_SeqLock.h"
 #include "BitStream.h"
 #include "NativeFeatureIncludes.h"
 #include "SecureHandshake.h"
@@ -58,6 +60,7 @@ namespace RakNet {
 	/// Forward declarations
 class PluginInterface2;
 class RakNetRandom;
+class ReceiveBufferPool;
 typedef uint64_t reliabilityHeapWeightType;
 
 // int SplitPacketIndexComp( SplitPacketIndexType const &key, InternalPacket* const &data );
@@ -143,16 +146,18 @@ public:
 	/// \param[in] systemAddress The player that this data is from
 	/// \param[in] messageHandlerList A list of registered plugins
 	/// \param[in] MTUSize maximum datagram size
+	/// \param[in] receiveBufferPool If not 0, unsplit messages point into one copy of the datagram taken from this pool, rather than each being copied into its own allocation
 	/// \retval true Success
 	/// \retval false Modified packet
 	bool HandleSocketReceiveFromConnectedPlayer(
 		const char *buffer, unsigned int length, SystemAddress &systemAddress, DataStructures::List<PluginInterface2*> &messageHandlerList, int MTUSize,
-		RakNetSocket2 *s, RakNetRandom *rnr, CCTimeType timeRead, BitStream &updateBitStream);
+		RakNetSocket2 *s, RakNetRandom *rnr, CCTimeType timeRead, BitStream &updateBitStream, ReceiveBufferPool *receiveBufferPool=0);
 
 	/// This allocates bytes and writes a user-level message to those bytes.
 	/// \param[out] data The message
+	/// \param[out] receiveBuffer 0 if \a data was allocated with rakMalloc_Ex. Otherwise \a data points into this buffer, and the caller now owns one reference to it
 	/// \return Returns number of BITS put into the buffer
-	BitSize_t Receive( unsigned char**data );
+	BitSize_t Receive( unsigned char**data, ReceiveBuffer **receiveBuffer );
 
 	/// Puts data on the send queue
 	/// \param[in] data The data to send
@@ -164,8 +169,9 @@ public:
 	/// \param[in] MTUSize maximum datagram size
 	/// \param[in] currentTime Current time, as per RakNet::GetTimeMS()
 	/// \param[in] receipt This number will be returned back with ID_SND_RECEIPT_ACKED or ID_SND_RECEIPT_LOSS and is only returned with the reliability types that contain RECEIPT in the name
+	/// \param[in] sendBuffer If not 0, \a data is sendBuffer->GetData(). A reference to \a sendBuffer is kept instead of a copy, and \a makeDataCopy is ignored.
 	/// \return True or false for success or failure.
-	bool Send( char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, unsigned char orderingChannel, bool makeDataCopy, int MTUSize, CCTimeType currentTime, uint32_t receipt );
+	bool Send( char *data, BitSize_t numberOfBitsToSend, PacketPriority priority, PacketReliability reliability, unsigned char orderingChannel, bool makeDataCopy, int MTUSize, CCTimeType currentTime, uint32_t receipt, SendBuffer *sendBuffer=0 );
 
 	/// Call once per game cycle.  Handles internal lists and actually does the send.
 	/// \param[in] s the communication  end point
@@ -188,8 +194,15 @@ public:
 
 	/// Get Statistics
 	/// \return A pointer to a static struct, filled out with current statistical information.
+	/// \note Only call from the thread that calls Update(). Other threads should use GetStatisticsSnapshot()
 	RakNetStatistics * GetStatistics( RakNetStatistics *rns );
 
+	/// Copy the statistics last published by Update(). Threadsafe, and never blocks Update()
+	void GetStatisticsSnapshot( RakNetStatistics *rns ) const;
+
+	/// How often Update() publishes statistics for GetStatisticsSnapshot(). 0 to publish every update
+	void SetStatisticsSnapshotInterval(RakNet::TimeMS intervalMS);
+
 	///Are we waiting for any data to be sent out or be processed by the player?
 	bool IsOutgoingDataWaiting(void);
 	bool AreAcksWaiting(void);
@@ -207,6 +220,12 @@ public:
 	bool AckTimeout(RakNet::Time curTime);
 	CCTimeType GetNextSendTime(void) const;
 	CCTimeType GetTimeBetweenPackets(void) const;
+
+	/// Returns the earliest time at which Update() has scheduled work to do: a resend, buffered acks or NAKs, an unreliable message to cull, or a send receipt loss to report
+	/// Data held back by congestion control is released by incoming acks, which the caller is woken for separately, so it is only polled at the ack interval
+	/// \param[in] maxTime Returned if nothing is scheduled sooner
+	/// \return The time, in the same units passed to Update()
+	RakNet::TimeUS GetNextUpdateTime(RakNet::TimeUS maxTime) const;
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
 	CCTimeType GetAckPing(void) const;
 #endif
@@ -225,13 +244,17 @@ private:
 	/// \param[in] bitStream The data to send.
 	void SendBitStream( RakNetSocket2 *s, SystemAddress &systemAddress, RakNet::BitStream *bitStream, RakNetRandom *rnr, CCTimeType currentTime);
 
+	/// Send an encrypted datagram to the socket and count it in the statistics
+	void SendDatagram( RakNetSocket2 *s, SystemAddress &systemAddress, char *data, unsigned int length, CCTimeType currentTime);
+
 	///Parse an internalPacket and create a bitstream to represent this data
 	/// \return Returns number of bits used
 	BitSize_t WriteToBitStreamFromInternalPacket( RakNet::BitStream *bitStream, const InternalPacket *const internalPacket, CCTimeType curTime );
 
 
 	/// Parse a bitstream and create an internal packet to represent this data
-	InternalPacket* CreateInternalPacketFromBitStream( RakNet::BitStream *bitStream, CCTimeType time );
+	/// If \a receiveBufferPool is not 0, an unsplit message points into *datagramCopy, which is copied from \a bitStream on first use. The caller releases *datagramCopy when done parsing
+	InternalPacket* CreateInternalPacketFromBitStream( RakNet::BitStream *bitStream, CCTimeType time, ReceiveBufferPool *receiveBufferPool, ReceiveBuffer **datagramCopy );
 
 	/// Does what the function name says
 	unsigned RemovePacketFromResendListAndDeleteOlderReliableSequenced( const MessageNumberType messageNumber, CCTimeType time, DataStructures::List<PluginInterface2*> &messageHandlerList, const SystemAddress &systemAddress );
@@ -330,6 +353,9 @@ private:
 	DataStructures::Queue<InternalPacket*> outputQueue;
 	int splitMessageProgressInterval;
 	CCTimeType unreliableTimeout;
+	CCTimeType statisticsSnapshotInterval, nextStatisticsSnapshotTime;
+	// Written by Update(), read by GetStatisticsSnapshot() from any thread
+	DataStructures::SeqLock<RakNetStatistics> statisticsSnapshot;
 
 	struct MessageNumberNode
 	{
@@ -374,7 +400,8 @@ private:
 	DataStructures::MemoryPool<InternalPacket> internalPacketPool;
 	// DataStructures::BPlusTree<DatagramSequenceNumberType, InternalPacket*, RESEND_TREE_ORDER> resendTree;
 	InternalPacket *resendBuffer[RESEND_BUFFER_ARRAY_LENGTH];
-	InternalPacket *resendLinkedListHead;
+	// Every message awaiting an ack, keyed on when it is next resent
+	DataStructures::TimerWheel<InternalPacket, &InternalPacket::resendLinks, &InternalPacket::nextActionTime> resendTimers;
 	InternalPacket *unreliableLinkedListHead;
 	void RemoveFromUnreliableLinkedList(InternalPacket *internalPacket);
 	void AddToUnreliableLinkedList(InternalPacket *internalPacket);
@@ -534,10 +561,8 @@ private:
 	void PushDatagram(void);
 	bool TagMostRecentPushAsSecondOfPacketPair(void);
 	void ClearPacketsAndDatagrams(void);
-	void MoveToListHead(InternalPacket *internalPacket);
-	void RemoveFromList(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes);
-	void AddToListTail(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes);
-	void PopListHead(bool modifyUnacknowledgedBytes);
+	void RemoveFromResendTimers(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes);
+	void AddToResendTimers(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes);
 	bool IsResendQueueEmpty(void) const;
 	void SortSplitPacketList(DataStructures::List<InternalPacket*> &data, unsigned int leftEdge, unsigned int rightEdge) const;
 	void SendACKs(RakNetSocket2 *s, SystemAddress &systemAddress, CCTimeType time, RakNetRandom *rnr, BitStream &updateBitStream);
@@ -573,6 +598,10 @@ private:
 	void AllocInternalPacketData(InternalPacket *internalPacket, InternalPacketRefCountedData **refCounter, unsigned char *externallyAllocatedPtr, unsigned char *ourOffset);
 	// Set the data pointer to externallyAllocatedPtr, do not allocate
 	void AllocInternalPacketData(InternalPacket *internalPacket, unsigned char *externallyAllocatedPtr);
+	// Adds a reference to sendBuffer. ourOffset points into its data
+	void AllocInternalPacketData(InternalPacket *internalPacket, SendBuffer *sendBuffer, unsigned char *ourOffset);
+	// Adds a reference to receiveBuffer. ourOffset points into its data
+	void AllocInternalPacketData(InternalPacket *internalPacket, ReceiveBuffer *receiveBuffer, unsigned char *ourOffset);
 	// Allocate new
 	void AllocInternalPacketData(InternalPacket *internalPacket, unsigned int numBytes, bool allowStack, const char *file, unsigned int line);
 	void FreeInternalPacketData(InternalPacket *internalPacket, const char *file, unsigned int line);
@@ -588,6 +617,14 @@ public:
 protected:
 	cat::AuthenticatedEncryption auth_enc;
 	bool useSecurity;
+
+#if RELIABILITY_LAYER_ENCRYPT_BATCH_SIZE>1
+	/// Encrypt and send the datagrams SendBitStream() held back during Update()
+	void FlushEncryptBatch( RakNetSocket2 *s, SystemAddress &systemAddress );
+
+	/// True during Update(), while SendBitStream() adds datagrams to the encrypt batch of the calling thread instead of encrypting each one
+	bool encryptBatchActive;
+#endif
 #endif // LIBCAT_SECURITY
 };
 
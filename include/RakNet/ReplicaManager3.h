@@ -31,6 +31,8 @@
 #include <cstdint>
 #include <optional>
 
+class GridSectorizer;
+
 /// \defgroup REPLICA_MANAGER_GROUP3 ReplicaManager3
 /// \brief Third implementation of object replication
 /// \details
@@ -250,6 +252,25 @@ public:
 	/// \return True when all downloads have been completed
 	bool GetAllConnectionDownloadsCompleted(WorldId worldId=0) const;
 
+	/// \brief Only query replicas near each connection, rather than every replica for every connection
+	/// \details Once per Update(), replicas that return true from Replica3::QueryAreaOfInterestPosition() are placed on a grid. A connection with Connection_RM3::SetViewRadius() is then only queried for replicas within its view radius of Connection_RM3::QueryViewPosition(), found from the grid cells nearby.<BR>
+	/// Replicas this system constructed to a connection with RM3CS_SEND_CONSTRUCTION are destroyed on that connection once further than the view radius plus \a hysteresis, so replicas near the edge do not construct and destroy repeatedly.<BR>
+	/// Only constructed replicas are serialized, so serialization is limited to the same area.<BR>
+	/// Replicas without a position, and connections without a view radius, are unaffected.
+	/// \note Only used for connections where Connection_RM3::QueryConstructionMode() returns QUERY_REPLICA_FOR_CONSTRUCTION or QUERY_REPLICA_FOR_CONSTRUCTION_AND_DESTRUCTION
+	/// \param[in] cellSize Width and height of a grid cell, in world units. Around the typical view radius works well
+	/// \param[in] minX Left edge of the world. Positions outside the world are placed in the nearest edge cell
+	/// \param[in] minY Bottom edge of the world
+	/// \param[in] maxX Right edge of the world
+	/// \param[in] maxY Top edge of the world
+	/// \param[in] hysteresis How far past the view radius a constructed replica must move before it is destroyed
+	/// \param[in] worldId Used for multiple worlds. World 0 is created automatically by default. See AddWorld()
+	void SetAreaOfInterest(float cellSize, float minX, float minY, float maxX, float maxY, float hysteresis, WorldId worldId=0);
+
+	/// \brief Stop using the grid from SetAreaOfInterest(). Replicas held back from connections are queried for construction again
+	/// \param[in] worldId Used for multiple worlds. World 0 is created automatically by default. See AddWorld()
+	void DisableAreaOfInterest(WorldId worldId=0);
+
 	/// \brief ReplicaManager3 can support multiple worlds, where each world has a separate NetworkIDManager, list of connections, replicas, etc
 	/// A world with id 0 is created automatically. If you want multiple worlds, use this function, and ReplicaManager3::SetNetworkIDManager() to have a different NetworkIDManager instance per world
 	/// \param[in] worldId A unique identifier for this world. User-defined
@@ -310,15 +331,25 @@ public:
 	struct RM3World
 	{
 		RM3World();
+		~RM3World();
 		void Clear(ReplicaManager3 *replicaManager3);
 
 		DataStructures::List<Connection_RM3*> connectionList;
 		DataStructures::List<Replica3*> userReplicaList;
 		WorldId worldId;
 		NetworkIDManager *networkIDManager;
+
+		// Set by SetAreaOfInterest(). Rebuilt from userReplicaList every Update()
+		GridSectorizer *areaOfInterestGrid;
+		float areaOfInterestHysteresis;
+		// Replicas that stopped returning a position this Update(), so are in no grid cell but may be held back by connections
+		DataStructures::List<Replica3*> areaOfInterestLostPosition;
+		// Working list for GridSectorizer::GetEntries()
+		DataStructures::List<void*> areaOfInterestEntries;
 	};
 protected:
 	virtual PluginReceiveResult OnReceive(Packet *packet);
+	virtual bool GetReceiveFilter(PluginReceiveFilter &filter) const;
 	virtual void OnClosedConnection(const SystemAddress &systemAddress, RakNetGUID rakNetGUID, PI2_LostConnectionReason lostConnectionReason );
 	virtual void OnNewConnection(const SystemAddress &systemAddress, RakNetGUID rakNetGUID, bool isIncoming);
 	virtual void OnRakPeerShutdown(void);
@@ -374,6 +405,10 @@ struct LastSerializationResult
 //	bool isConstructed;
 	RakNet::Time whenLastSerialized;
 
+	/// True if this system sent construction because Replica3::QueryConstruction() returned RM3CS_SEND_CONSTRUCTION.
+	/// Only these are destroyed when leaving the area of interest, see ReplicaManager3::SetAreaOfInterest()
+	bool constructedFromQuery;
+
 	void AllocBS(void);
 	LastSerializationResultBS* lastSerializationResultBS;
 };
@@ -491,6 +526,20 @@ public:
 	/// \return True if ID_REPLICA_MANAGER_DOWNLOAD_COMPLETE arrived for this connection
 	bool GetDownloadWasCompleted(void) const {return gotDownloadComplete;}
 
+	/// \brief Only construct replicas near this connection, when ReplicaManager3::SetAreaOfInterest() is used
+	/// \param[in] _viewRadius Replicas with a position further than this from QueryViewPosition() are not queried for construction. Pass 0 to query all replicas, which is the default
+	void SetViewRadius(float _viewRadius) {viewRadius=_viewRadius;}
+
+	/// \return What was passed to SetViewRadius()
+	float GetViewRadius(void) const {return viewRadius;}
+
+	/// \brief Where this connection views the world from, when SetViewRadius() is used
+	/// \details Called once per ReplicaManager3::Update(). Usually returns the position of this player's avatar
+	/// \param[out] x Horizontal position, in the same units as Replica3::QueryAreaOfInterestPosition()
+	/// \param[out] y Vertical position
+	/// \return False if this connection has no position yet, in which case no replica with a position is in view. The default returns false
+	virtual bool QueryViewPosition(float *x, float *y) {(void) x; (void) y; return false;}
+
 	/// List of enumerations for how to get the list of valid objects for other systems
 	enum ConstructionMode
 	{
@@ -651,6 +700,20 @@ protected:
 
 		Do not query destruction again
 		Remove from queryToDestructReplicaList
+
+		Outside area of interest
+		Remove from queryToConstructReplicaList
+		Add to outOfAreaReplicaList
+
+		Inside area of interest
+		Remove from outOfAreaReplicaList
+		Add to queryToConstructReplicaList
+
+		Constructed from query, then beyond area of interest and hysteresis
+		Remove from queryToDestructReplicaList
+		Remove from queryToSerializeReplicaList
+		Remove from constructedReplicaList
+		Add to outOfAreaReplicaList
 	*/
 	void OnLocalReference(Replica3* replica3, ReplicaManager3 *replicaManager);
 	void OnDereference(Replica3* replica3, ReplicaManager3 *replicaManager);
@@ -664,6 +727,8 @@ protected:
 	void OnDownloadExisting(Replica3* replica3, ReplicaManager3 *replicaManager);
 	void OnSendDestructionFromQuery(uint32_t queryToDestructIdx, ReplicaManager3 *replicaManager);
 	void OnDoNotQueryDestruction(uint32_t queryToDestructIdx, ReplicaManager3 *replicaManager);
+	void OnLeaveAreaOfInterest(uint32_t constructedIdx, ReplicaManager3 *replicaManager);
+	void UpdateAreaOfInterest(ReplicaManager3 *replicaManager3, WorldId worldId);
 	void ValidateLists(ReplicaManager3 *replicaManager) const;
 	void SendSerializeHeader(RakNet::Replica3 *replica, RakNet::Time timestamp, RakNet::BitStream *bs, WorldId worldId);
 	
@@ -684,6 +749,11 @@ protected:
 	// Objects that are constructed on this system are also queried if they should be destroyed to this system
 	DataStructures::List<LastSerializationResult*> queryToDestructReplicaList;
 
+	// Objects from queryToConstructReplicaList held back because they are outside the view radius. See ReplicaManager3::SetAreaOfInterest()
+	// Sorted so replicas found in the grid can be looked up
+	DataStructures::OrderedList<Replica3*, LastSerializationResult*, Connection_RM3::Replica3LSRComp> outOfAreaReplicaList;
+	float viewRadius;
+
 	// Working lists
 	DataStructures::List<Replica3*> constructedReplicasCulled, destroyedReplicasCulled;
 
@@ -897,6 +967,13 @@ public:
 	/// If a system gets a destruction command for an object that was already destroyed, the destruction message is ignored
 	virtual bool QueryRelayDestruction(Connection_RM3 *sourceConnection) const {(void) sourceConnection; return true;}
 
+	/// \brief Where this object is, when ReplicaManager3::SetAreaOfInterest() is used
+	/// \details Called once per ReplicaManager3::Update(). Connections with Connection_RM3::SetViewRadius() only get objects within their view radius.
+	/// \param[out] x Horizontal position, in the same units as ReplicaManager3::SetAreaOfInterest()
+	/// \param[out] y Vertical position
+	/// \return False if this object has no position, such as game rules or teams. These are queried for every connection as usual. The default returns false
+	virtual bool QueryAreaOfInterestPosition(float *x, float *y) {(void) x; (void) y; return false;}
+
 	/// \brief Write data to be sent only when the object is constructed on a remote system.
 	/// \details SerializeConstruction is used to write out data that you need to create this object in the context of your game, such as health, score, name. Use it for data you only need to send when the object is created.<BR>
 	/// After SerializeConstruction() is called, Serialize() will be called immediately thereafter. However, they are sent in different messages, so Serialize() may arrive a later frame than SerializeConstruction()
@@ -1092,6 +1169,9 @@ public:
 	bool forceSendUntilNextUpdate;
 	LastSerializationResult *lsr;
 	uint32_t referenceIndex;
+	// Last result of QueryAreaOfInterestPosition(), from ReplicaManager3::Update()
+	float areaOfInterestX, areaOfInterestY;
+	bool hasAreaOfInterestPosition;
 };
 
 /// \brief Use Replica3 through composition instead of inheritance by containing an instance of this templated class
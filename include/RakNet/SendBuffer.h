@@ -0,0 +1,69 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant 
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file SendBuffer.h
+/// \brief Reference counted message data that RakPeer can send to many systems without copying
+///
+
+#ifndef __RAKNET_SEND_BUFFER_H
+#define __RAKNET_SEND_BUFFER_H
+
+#include "RakMemoryOverride.h"
+#include "RakNetTypes.h"
+#include "Export.h"
+#include <atomic>
+
+namespace RakNet
+{
+
+class BitStream;
+
+/// \brief Immutable message data shared by every destination of a send
+/// \details Create() copies the message once. Pass the buffer to RakPeerInterface::Send(SendBuffer*, ...) as many times as you like, then call Release().
+/// Each destination, and each fragment of a message too large for one datagram, holds its own reference instead of its own copy.
+/// References held by RakPeer are dropped once the data is no longer needed: after the datagram goes out for unreliable sends, or when the remote system acknowledges it for reliable sends.
+/// AddRef() and Release() may be called from any thread. The data must not be modified after Create() returns.
+class RAK_DLL_EXPORT SendBuffer
+{
+public:
+	/// Copies \a numberOfBytes bytes from \a data. The caller owns the one reference
+	/// \return 0 if \a numberOfBytes is 0 or out of memory
+	static SendBuffer *Create(const char *data, unsigned int numberOfBytes, const char *file, unsigned int line);
+
+	/// Copies the used bits of \a bitStream. The caller owns the one reference
+	/// \return 0 if \a bitStream is empty or out of memory
+	static SendBuffer *Create(const RakNet::BitStream *bitStream, const char *file, unsigned int line);
+
+	void AddRef(void);
+
+	/// Deallocates the buffer when the last reference is released
+	void Release(void);
+
+	const char *GetData(void) const {return data;}
+	unsigned int GetNumberOfBytes(void) const {return (unsigned int) BITS_TO_BYTES(numberOfBits);}
+	BitSize_t GetNumberOfBits(void) const {return numberOfBits;}
+
+	/// Only meaningful if no other thread holds a reference
+	uint32_t GetReferenceCount(void) const {return refCount.load(std::memory_order_relaxed);}
+
+private:
+	// Allocated by Create() with the data in the same block, directly after this header
+	SendBuffer() {}
+	~SendBuffer() {}
+	static SendBuffer *Allocate(BitSize_t numberOfBits, const char *file, unsigned int line);
+
+	std::atomic<uint32_t> refCount;
+	BitSize_t numberOfBits;
+	char *data;
+};
+
+} // namespace RakNet
+
+#endif
@@ -53,7 +53,7 @@ protected:
 
 
 #else
-	SimpleMutex isSignaledMutex;
+	// Guarded by hMutex
 	bool isSignaled;
 #if !defined(ANDROID)
 	pthread_condattr_t condAttr;
@@ -26,7 +26,6 @@
 #include "DS_OrderedList.h"
 #include "RakString.h"
 #include "DS_Queue.h"
-#include "DS_Hash.h"
 #include <float.h>
 
 namespace RakNet
@@ -121,24 +120,48 @@ public:
 	void MergeAllObjectsOnKey(RakString key, TimeAndValueQueue *tavqOutput, SHDataCategory dataCategory) const;
 	void GetUniqueKeyList(DataStructures::List<RakString> &keys);
 
+	/// Keys are stored as small integers. Look up the integer for a key once and pass it to the overloads below to skip the string lookup on every value
+	/// \return The integer for this key, assigning the next unused one if the key is new. Stays the same until this instance is destroyed, even across Clear()
+	unsigned int GetKeyId(RakString key);
+	/// \return The integer for this key, or (unsigned int) -1 if no value was ever added with this key
+	unsigned int FindKeyId(RakString key) const;
+	/// \return The key passed to GetKeyId()
+	RakString GetKeyName(unsigned int keyId) const;
+	bool AddValueByObjectID(uint64_t objectId, unsigned int keyId, SHValueType val, Time curTime, bool combineEqualTimes);
+	void AddValueByIndex(unsigned int index, unsigned int keyId, SHValueType val, Time curTime, bool combineEqualTimes);
+	SHErrorCode GetHistoryForKey(uint64_t objectId, unsigned int keyId, TimeAndValueQueue **values, Time curTime) const;
+	void MergeAllObjectsOnKey(unsigned int keyId, TimeAndValueQueue *tavqOutput, SHDataCategory dataCategory) const;
+
+	/// Most values per key to keep at full resolution. When there are more within the time to track, the oldest are folded into downsampled tiers
+	/// Applies to keys first added after this call. Defaults to STATISTICS_HISTORY_MAX_SAMPLES
+	void SetMaxSamplesPerKey(unsigned int _maxSamplesPerKey);
+	unsigned int GetMaxSamplesPerKey(void) const;
+
 	struct TimeAndValue
 	{
 		Time time;
 		SHValueType val;
 	};
 
+	/// Values of one key, oldest first
+	/// The newest values are kept in a ring with separate time and value columns, holding at most GetMaxSamples()
+	/// Older values within the time to track are summed into STATISTICS_HISTORY_TIER_BUCKETS buckets of STATISTICS_HISTORY_TIER_INTERVAL milliseconds,
+	/// then into as many buckets each covering the whole first tier. The graph is coarser there, and the recent statistics are approximate:
+	/// once a bucket starts to expire, its sum and count shrink in proportion to the expired part of its times, as if its values were evenly spread.
+	/// GetRecentLowest() and GetRecentHighest() include a bucket until all of it has expired
 	struct TimeAndValueQueue
 	{
 		TimeAndValueQueue();
+		TimeAndValueQueue(const TimeAndValueQueue& input);
 		~TimeAndValueQueue();
 
-		DataStructures::Queue<TimeAndValue> values;
-
 		Time timeToTrackValues;
 		RakString key;
 
 		SHValueType recentSum;
 		SHValueType recentSumOfSquares;
+		// Values covered by recentSum, including those in downsampled tiers
+		unsigned int recentCount;
 		SHValueType longTermSum;
 		SHValueType longTermCount;
 		SHValueType longTermLowest;
@@ -158,6 +181,15 @@ public:
 		SHValueType GetLongTermHighest(void) const;
 		SHValueType GetSumSinceTime(Time t) const;
 		Time GetTimeRange(void) const;
+		/// \return How many values the recent statistics cover, including those in downsampled tiers
+		unsigned int GetRecentCount(void) const;
+
+		/// Values at full resolution, oldest first. Index 0 to GetSampleCount()-1
+		unsigned int GetSampleCount(void) const;
+		TimeAndValue GetSample(unsigned int index) const;
+
+		void SetMaxSamples(unsigned int _maxSamples);
+		unsigned int GetMaxSamples(void) const;
 
 		// Merge two sets to output
 		static void MergeSets( const TimeAndValueQueue *lhs, SHDataCategory lhsDataCategory, const TimeAndValueQueue *rhs, SHDataCategory rhsDataCategory, TimeAndValueQueue *output );
@@ -171,12 +203,90 @@ public:
 
 		TimeAndValueQueue& operator = ( const TimeAndValueQueue& input );
 
+		/// \internal
+		void AddValue(SHValueType val, Time curTime, bool combineEqualTimes);
 		/// \internal
 		void CullExpiredValues(Time curTime);
 		/// \internal
 		static SHValueType Interpolate(TimeAndValue t1, TimeAndValue t2, Time time);
 		/// \internal
 		SHValueType sortValue;
+
+		/// \internal
+		/// \return How many entries CopyColumns() writes
+		unsigned int GetColumnCount(bool includeBuckets) const;
+		/// \internal
+		/// Writes every downsampled bucket if \a includeBuckets, then every value at full resolution, oldest first
+		/// A bucket is written at the middle of its times, as its sum for DC_DISCRETE or its average for DC_CONTINUOUS
+		unsigned int CopyColumns(Time *times, SHValueType *vals, SHDataCategory dataCategory, bool includeBuckets) const;
+		/// \internal
+		/// Replaces all values with these, which must be in time order. Does not change the statistics, including GetRecentCount()
+		void AssignColumns(const Time *times, const SHValueType *vals, unsigned int count);
+		/// \internal
+		/// Same as AssignColumns(), then adds the downsampled buckets of \a inputs, which may include this queue
+		/// Values older than the newest bucket are folded in with the buckets, so the lowest and highest of every bucket carry over
+		void AssignColumnsAndBuckets(const TimeAndValueQueue *const *inputs, unsigned int inputCount, const Time *times, const SHValueType *vals, unsigned int count);
+
+	protected:
+		// Sum of consecutive values that were moved out of the ring
+		struct DownsampledBucket
+		{
+			Time firstTime;
+			Time lastTime;
+			SHValueType sum;
+			SHValueType sumOfSquares;
+			SHValueType lowest;
+			SHValueType highest;
+			unsigned int count;
+		};
+
+		// Ring of STATISTICS_HISTORY_TIER_BUCKETS, allocated when first needed
+		struct DownsampledTier
+		{
+			DownsampledBucket *buckets;
+			unsigned int head;
+			unsigned int count;
+		};
+
+		// Sequence numbers of values in the ring, in the order added. Each value is lower (or higher) than all values before it in the queue, so the front is the lowest (or highest)
+		struct ExtremeQueue
+		{
+			unsigned int *sequences;
+			unsigned int head;
+			unsigned int count;
+		};
+
+		enum
+		{
+			DOWNSAMPLED_TIER_COUNT=2
+		};
+
+		unsigned int SampleIndex(unsigned int sequence) const;
+		void PushSample(Time time, SHValueType val);
+		void PopOldestSample(void);
+		void PopNewestSample(void);
+		void DownsampleOldestSample(void);
+		void GrowSamples(unsigned int newCapacity);
+		void PushExtreme(ExtremeQueue &extremes, unsigned int sequence, bool lowest);
+		void FoldIntoTier(unsigned int tierIndex, const DownsampledBucket &bucket);
+		void DropBucket(const DownsampledBucket &bucket);
+		static int BucketFirstTimeComp(const void *lhs, const void *rhs);
+		static Time GetTierInterval(unsigned int tierIndex);
+		void FreeMemory(void);
+
+		// Ring of values at full resolution. Capacity is a power of 2
+		Time *sampleTimes;
+		SHValueType *sampleValues;
+		unsigned int sampleHead;
+		unsigned int sampleCount;
+		unsigned int sampleCapacity;
+		unsigned int sampleLimit;
+		// Sequence number of the value at sampleHead. Sequence numbers do not change when the ring grows, unlike indices
+		unsigned int firstSequence;
+		ExtremeQueue lowestQueue;
+		ExtremeQueue highestQueue;
+
+		DownsampledTier tiers[DOWNSAMPLED_TIER_COUNT];
 	};
 
 protected:
@@ -190,12 +300,29 @@ protected:
 		TrackedObject();
 		~TrackedObject();
 		TrackedObjectData trackedObjectData;
-		DataStructures::Hash<RakNet::RakString, TimeAndValueQueue*, 32, RakNet::RakString::ToInteger> dataQueues;
+		// Indexed by key id. 0 for keys this object has no values for
+		DataStructures::List<TimeAndValueQueue*> dataQueues;
 	};
 
+	struct KeyId
+	{
+		RakString key;
+		unsigned int keyId;
+	};
+public:
+	static int KeyIdComp( const RakString &key, const KeyId &data );
+protected:
+
+	TimeAndValueQueue *GetQueue(TrackedObject *to, unsigned int keyId);
+
 	DataStructures::OrderedList<uint64_t, TrackedObject*,TrackedObjectComp> objects;
+	// Sorted by key, for FindKeyId()
+	DataStructures::OrderedList<RakString, KeyId, KeyIdComp> keyIds;
+	// Indexed by key id
+	DataStructures::List<RakString> keyNames;
 
 	Time timeToTrack;
+	unsigned int maxSamplesPerKey;
 };
 
 /// \brief Input numerical values over time. Get sum, average, highest, lowest, standard deviation on recent or all-time values
@@ -226,6 +353,21 @@ protected:
 	bool addNewConnections;
 	bool removeLostConnections;
 	int newConnectionsObjectType;
+
+	// Key ids of the values added by Update()
+	enum
+	{
+		RN_KEY_ACTUAL_BYTES_SENT,
+		RN_KEY_USER_MESSAGE_BYTES_RESENT,
+		RN_KEY_ACTUAL_BYTES_RECEIVED,
+		RN_KEY_USER_MESSAGE_BYTES_PUSHED,
+		RN_KEY_USER_MESSAGE_BYTES_RECEIVED_PROCESSED,
+		RN_KEY_LAST_PING,
+		RN_KEY_BYTES_IN_RESEND_BUFFER,
+		RN_KEY_PACKETLOSS_LAST_SECOND,
+		RN_KEY_COUNT
+	};
+	unsigned int keyIds[RN_KEY_COUNT];
 };
 
 } // namespace RakNet